@@ -4,10 +4,11 @@ OTHER_CFLAGS=
 TARGET_ARCH=32
 
 function print_usage() {
-	echo "Usage: $0 [mipi-way|mipi-x] {CFLAGS...}"
+	echo "Usage: $0 [mipi-way|mipi-x|bench] {CFLAGS...}"
 	echo 
 	echo "Supported CFLAGS:"
 	echo "-DCOLOR_CONVERSION	Allow the app to accept different input color format."
+	echo "-DTRACE_SPANS		Trace dequeue, upload and present spans for a timeline."
 	echo
 }
 
@@ -34,6 +35,10 @@ function make_mipi_x() {
     make CC_ARCH="-m$TARGET_ARCH" CFLAGS+="-DI$TARGET_ARCH -DX11 $OTHER_CFLAGS" LIBS+='-lX11' EXECUTABLE=isp-mipi-test SOURCES+=src/isp-mipi-test.c all
 }
 
+function make_bench() {
+	make CC_ARCH="-m$TARGET_ARCH" CFLAGS+="-DI$TARGET_ARCH $OTHER_CFLAGS" isp-bench isp-convert-bench isp-record-bench
+}
+
 #function make_fifo_way() {
 #	make EXECUTABLE=isp-fifo-way clean
 #	make CFLAGS+="-DWAYLAND $OTHER_CFLAGS" LIBS+='-lwayland-client -lwayland-egl' EXECUTABLE=isp-fifo-way SOURCES+=src/isp-fifo-way.c all
@@ -64,6 +69,8 @@ else
 		make_mipi_way
 	elif [ $1 = "mipi-x" ]; then
 		make_mipi_x
+	elif [ $1 = "bench" ]; then
+		make_bench
 	elif [ $1 = "clean" ]; then
 		make clean
 	else
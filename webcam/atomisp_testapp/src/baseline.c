@@ -0,0 +1,286 @@
+/**
+	This file is part of Intel Atom ISP Test App.
+
+	Intel Atom ISP Test App is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Intel Atom ISP Test App is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Intel Atom ISP Test App.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "baseline.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define BASELINE_INITIAL_SIZE 16
+
+/**
+ * Two-sided 95% critical values of Student's t, by degrees of freedom.
+ */
+static const double T_CRITICAL_95[] = {
+	0, 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+	2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+	2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+};
+
+#define T_CRITICAL_95_LIMIT 1.960
+
+static double tCritical(double _degrees) {
+	// rounded down, which widens the interval
+	unsigned int df = (unsigned int) floor(_degrees);
+
+	if (df < 1) {
+		df = 1;
+	}
+	if (df >= sizeof(T_CRITICAL_95) / sizeof(T_CRITICAL_95[0])) {
+		return T_CRITICAL_95_LIMIT;
+	}
+	return T_CRITICAL_95[df];
+}
+
+static double meanOf(const BaselineMetric *_metric) {
+	double sum = 0;
+	unsigned int i;
+
+	for (i = 0; i < _metric->count; i++) {
+		sum += _metric->values[i];
+	}
+	return (_metric->count > 0) ? sum / _metric->count : 0;
+}
+
+/**
+ * Sample variance; 0 below two values.
+ */
+static double varianceOf(const BaselineMetric *_metric, double _mean) {
+	double sum = 0;
+	unsigned int i;
+
+	if (_metric->count < 2) {
+		return 0;
+	}
+
+	for (i = 0; i < _metric->count; i++) {
+		sum += (_metric->values[i] - _mean) * (_metric->values[i] - _mean);
+	}
+	return sum / (_metric->count - 1);
+}
+
+/**
+ * Values past BASELINE_MAX_RUNS are ignored.
+ */
+void BaselineMetric_add(BaselineMetric *_metric, double _value) {
+	if (_metric->count < BASELINE_MAX_RUNS) {
+		_metric->values[_metric->count++] = _value;
+	}
+}
+
+/**
+ * Welch's t interval of _current - _baseline at BASELINE_CONFIDENCE. A
+ * regression is a significant change for the worse of at least
+ * _thresholdPercent; _isHigherBetter tells which way is worse.
+ */
+void Baseline_compare(const BaselineMetric *_baseline, const BaselineMetric *_current, bool _isHigherBetter,
+					  double _thresholdPercent, BaselineComparison *_comparison) {
+	memset(_comparison, 0, sizeof(BaselineComparison));
+	_comparison->baseline = meanOf(_baseline);
+	_comparison->current = meanOf(_current);
+
+	double difference = _comparison->current - _comparison->baseline;
+	if (_comparison->baseline != 0) {
+		_comparison->changePercent = (difference * 100.0) / _comparison->baseline;
+	}
+	_comparison->low = difference;
+	_comparison->high = difference;
+
+	if (_baseline->count < 2 || _current->count < 2) {
+		return;
+	}
+	_comparison->isTestable = true;
+
+	double baselineShare = varianceOf(_baseline, _comparison->baseline) / _baseline->count;
+	double currentShare = varianceOf(_current, _comparison->current) / _current->count;
+	double error = sqrt(baselineShare + currentShare);
+
+	if (error > 0) {
+		// Welch-Satterthwaite
+		double degrees = ((baselineShare + currentShare) * (baselineShare + currentShare)) /
+				(((baselineShare * baselineShare) / (_baseline->count - 1)) +
+				 ((currentShare * currentShare) / (_current->count - 1)));
+		double margin = tCritical(degrees) * error;
+		_comparison->low = difference - margin;
+		_comparison->high = difference + margin;
+	}
+
+	_comparison->isSignificant = (_comparison->low > 0) || (_comparison->high < 0);
+
+	bool isWorse = _isHigherBetter ? (_comparison->high < 0) : (_comparison->low > 0);
+	_comparison->isRegression = _comparison->isSignificant && isWorse &&
+			fabs(_comparison->changePercent) >= _thresholdPercent;
+}
+
+static BaselineEntry *find(Baseline *self, const char *_key) {
+	unsigned int i;
+
+	for (i = 0; i < self->entriesCount; i++) {
+		if (strcmp(self->entries[i].key, _key) == 0) {
+			return &self->entries[i];
+		}
+	}
+	return NULL;
+}
+
+/**
+ * The entry for _key, added empty if there is none. Pointers to entries
+ * are good until the next add().
+ */
+static BaselineEntry *add(Baseline *self, const char *_key) {
+	BaselineEntry *entry = find(self, _key);
+	if (entry != NULL) {
+		return entry;
+	}
+
+	if (self->entriesCount == self->size) {
+		self->size = (self->size > 0) ? self->size * 2 : BASELINE_INITIAL_SIZE;
+		self->entries = (BaselineEntry *) realloc(self->entries, self->size * sizeof(BaselineEntry));
+	}
+
+	entry = &self->entries[self->entriesCount++];
+	memset(entry, 0, sizeof(BaselineEntry));
+	snprintf(entry->key, sizeof(entry->key), "%s", _key);
+	return entry;
+}
+
+static BaselineMetric *metricOf(BaselineEntry *_entry, const char *_name) {
+	if (strcmp(_name, "fps") == 0) {
+		return &_entry->fps;
+	}
+	if (strcmp(_name, "latency_p99") == 0) {
+		return &_entry->latencyP99;
+	}
+	return NULL;
+}
+
+/**
+ * Adds the entries of _path to the ones already held. Unknown metrics are
+ * skipped so newer files still load.
+ */
+static int load(Baseline *self, const char *_path) {
+	FILE *file = fopen(_path, "r");
+	if (file == NULL) {
+		sprintf(self->error, "Cannot open baseline %s.", _path);
+		return 0;
+	}
+
+	char line[1024];
+	unsigned int lineNumber = 0;
+	while (fgets(line, sizeof(line), file) != NULL) {
+		char *save = NULL;
+		char *key = strtok_r(line, " \t\r\n", &save);
+		lineNumber++;
+
+		if (key == NULL || *key == '#') {
+			continue;
+		}
+
+		char *name = strtok_r(NULL, " \t\r\n", &save);
+		if (name == NULL || strlen(key) >= BASELINE_KEY_LENGTH) {
+			sprintf(self->error, "%s:%u: expected <configuration> <metric> <values...>.", _path, lineNumber);
+			fclose(file);
+			return 0;
+		}
+
+		BaselineMetric *metric = metricOf(add(self, key), name);
+		if (metric == NULL) {
+			continue;
+		}
+
+		char *value;
+		while ((value = strtok_r(NULL, " \t\r\n", &save)) != NULL) {
+			char *end;
+			double number = strtod(value, &end);
+			if (*end != '\0') {
+				sprintf(self->error, "%s:%u: %s is not a number.", _path, lineNumber, value);
+				fclose(file);
+				return 0;
+			}
+			BaselineMetric_add(metric, number);
+		}
+	}
+
+	fclose(file);
+	return 1;
+}
+
+static void saveMetric(FILE *_file, const BaselineEntry *_entry, const char *_name, const BaselineMetric *_metric) {
+	unsigned int i;
+
+	if (_metric->count == 0) {
+		return;
+	}
+
+	fprintf(_file, "%s %s", _entry->key, _name);
+	for (i = 0; i < _metric->count; i++) {
+		fprintf(_file, " %.3f", _metric->values[i]);
+	}
+	fprintf(_file, "\n");
+}
+
+static int save(Baseline *self, const char *_path) {
+	FILE *file = fopen(_path, "w");
+	if (file == NULL) {
+		sprintf(self->error, "Cannot write baseline %s.", _path);
+		return 0;
+	}
+
+	unsigned int i;
+	fprintf(file, "# isp-bench baseline: <WxH/format/io/buffers> <metric> <one value per run...>\n");
+	for (i = 0; i < self->entriesCount; i++) {
+		saveMetric(file, &self->entries[i], "fps", &self->entries[i].fps);
+		saveMetric(file, &self->entries[i], "latency_p99", &self->entries[i].latencyP99);
+	}
+
+	if (fclose(file) != 0) {
+		sprintf(self->error, "Cannot write baseline %s.", _path);
+		return 0;
+	}
+	return 1;
+}
+
+static void Baseline_init(Baseline *self) {
+	self->entries = NULL;
+	self->entriesCount = 0;
+	self->size = 0;
+	self->error = (char *) calloc(256, sizeof(char));
+
+	// methods
+	self->add = add;
+	self->find = find;
+	self->load = load;
+	self->save = save;
+}
+
+Baseline *Baseline_new() {
+	Baseline *baseline = (Baseline *) calloc(1, sizeof(Baseline));
+	Baseline_init(baseline);
+	return baseline;
+}
+
+void Baseline_dispose(Baseline *self) {
+	if (self == NULL) {
+		return;
+	}
+
+	free(self->entries);
+	free(self->error);
+	free(self);
+}
@@ -0,0 +1,85 @@
+/**
+	This file is part of Intel Atom ISP Test App.
+
+	Intel Atom ISP Test App is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Intel Atom ISP Test App is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Intel Atom ISP Test App.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BASELINE_H_
+#define BASELINE_H_
+
+#include <stdbool.h>
+
+#define BASELINE_MAX_RUNS 32
+#define BASELINE_KEY_LENGTH 64
+#define BASELINE_CONFIDENCE 95	/* percent, two-sided */
+
+/**
+ * One figure of a configuration, measured once per repeated run.
+ */
+typedef struct BASELINE_METRIC_S {
+	unsigned int count;
+	double values[BASELINE_MAX_RUNS];
+} BaselineMetric;
+
+/**
+ * The runs of one isp-bench configuration, e.g. 640x480/NV12/mmap/4.
+ */
+typedef struct BASELINE_ENTRY_S {
+	char key[BASELINE_KEY_LENGTH];
+	BaselineMetric fps;
+	BaselineMetric latencyP99;	/* usec */
+} BaselineEntry;
+
+/**
+ * How a metric moved from the baseline runs to the current ones. The
+ * interval is the confidence interval of current - baseline.
+ */
+typedef struct BASELINE_COMPARISON_S {
+	double baseline;		/* means */
+	double current;
+	double changePercent;	/* of the baseline */
+	double low;
+	double high;
+	bool isTestable;		/* both sides have at least two runs */
+	bool isSignificant;		/* the interval excludes 0 */
+	bool isRegression;		/* significant, worse, and by at least the threshold */
+} BaselineComparison;
+
+/**
+ * A stored set of entries. On disk it is text, one line per entry and
+ * metric, e.g.
+ *
+ *   640x480/NV12/mmap/4 fps 29.981 30.002 29.994
+ *   640x480/NV12/mmap/4 latency_p99 35211 34987 35102
+ *
+ * with # comments.
+ */
+typedef struct BASELINE_S {
+	BaselineEntry *entries;
+	unsigned int entriesCount;
+	unsigned int size;
+	char *error;
+
+	BaselineEntry *(*add) (struct BASELINE_S *, const char *);
+	BaselineEntry *(*find) (struct BASELINE_S *, const char *);
+	int (*load) (struct BASELINE_S *, const char *);
+	int (*save) (struct BASELINE_S *, const char *);
+} Baseline;
+
+void BaselineMetric_add(BaselineMetric *, double);
+void Baseline_compare(const BaselineMetric *, const BaselineMetric *, bool, double, BaselineComparison *);
+Baseline *Baseline_new();
+void Baseline_dispose(Baseline *);
+
+#endif /* BASELINE_H_ */
@@ -0,0 +1,344 @@
+/**
+	This file is part of Intel Atom ISP Test App.
+
+	Intel Atom ISP Test App is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Intel Atom ISP Test App is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Intel Atom ISP Test App.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+
+#include "capture_engine.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+
+static void writeToLog(CaptureEngine *self, const char *_fmt, ...) {
+	char buffer[1024];
+	va_list args;
+	va_start(args, _fmt);
+	vsprintf(buffer, _fmt, args);
+	va_end(args);
+
+	// log to screen
+	fprintf(stdout, "%s\n", buffer);
+	fflush(stdout);
+
+	// log to file
+	if (self->hAppLog != NULL) {
+		fprintf(self->hAppLog, "%s\n", buffer);
+		fflush(self->hAppLog);
+	}
+}
+
+static void setLoggerWith(CaptureEngine *self, FILE *_hAppLog) {
+	self->hAppLog = _hAppLog;
+}
+
+/**
+ * Gives every stream a ring of _tracer; NULL stops tracing. Only call while
+ * the capture threads are stopped.
+ */
+static int setTracerWith(CaptureEngine *self, Tracer *_tracer) {
+	unsigned int i;
+
+	for (i = 0; i < self->streamsCount; i++) {
+		self->streams[i]->trace = NULL;
+	}
+
+	if (_tracer == NULL) {
+		return 1;
+	}
+
+	for (i = 0; i < self->streamsCount; i++) {
+		char name[TRACE_NAME_LENGTH];
+		snprintf(name, sizeof(name), "capture %u %s", i, self->streams[i]->video->device);
+		self->streams[i]->trace = _tracer->addRing(_tracer, name);
+		if (self->streams[i]->trace == NULL) {
+			sprintf(self->error, "Stream %d: %s", i, _tracer->error);
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static void traceFrame(CaptureStream *_stream, Video *_video, VideoFrame *_frame, const FrameDesc *_desc) {
+	TraceRecord record;
+
+	memset(&record, 0, sizeof(record));
+	record.event = TRACE_EVENT_CAPTURE;
+	record.stream = _stream->id;
+	record.sequence = _frame->sequence;
+	record.flags = _frame->flags;
+	record.frame = _video->frame;
+	record.timestamp = ((long long) _frame->timestamp.tv_sec * 1000000LL) + _frame->timestamp.tv_usec;
+	record.dequeued = Trace_usecOf(&_desc->captured);
+	record.captured = _stream->captured;
+	record.dropped = (_stream->ring != NULL) ? _stream->ring->dropped : 0;
+	record.driverDropped = _video->droppedFramesCount;
+	if (_stream->ring != NULL) {
+		record.queueDepth = _stream->ring->depth(_stream->ring);
+	}
+
+	_stream->trace->record(_stream->trace, &record);
+}
+
+static int onFrame(Reactor *_reactor, Video *_video, VideoFrame *_frame, void *_data) {
+	CaptureStream *stream = (CaptureStream *) _data;
+	FrameDesc desc;
+
+	memset(&desc, 0, sizeof(desc));
+	clock_gettime(CLOCK_MONOTONIC, &desc.captured);
+
+	long long latency = VideoFrame_ageUsecAt(_frame, &desc.captured);
+	if (latency >= 0) {
+		__atomic_add_fetch(&stream->latencySumUsec, latency, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&stream->latencyCount, 1, __ATOMIC_RELAXED);
+		if ((unsigned long long) latency > stream->latencyMaxUsec) {
+			__atomic_store_n(&stream->latencyMaxUsec, latency, __ATOMIC_RELAXED);
+		}
+	}
+	__atomic_add_fetch(&stream->captured, 1, __ATOMIC_RELAXED);
+
+	if (stream->trace != NULL) {
+		traceFrame(stream, _video, _frame, &desc);
+	}
+
+	if (stream->ring == NULL) {
+		_video->release(_video, _frame);
+		return 1;
+	}
+
+	desc.frame = _video->frame;
+	desc.video = *_frame;
+	if (!stream->ring->push(stream->ring, &desc)) {
+		// consumer is behind; give the buffer straight back to the driver
+		_video->release(_video, _frame);
+	}
+
+	return 1;
+}
+
+static void *streamThread(void *_data) {
+	CaptureStream *stream = (CaptureStream *) _data;
+
+	if (stream->cpu != CAPTURE_NO_AFFINITY) {
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		CPU_SET(stream->cpu, &cpus);
+		if (0 != pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus)) {
+			writeToLog(stream->engine, "Stream %d: cannot pin to CPU %d.", stream->id, stream->cpu);
+		}
+	}
+
+	while (!__atomic_load_n(&stream->isStopping, __ATOMIC_ACQUIRE)) {
+		int ret = stream->reactor->run(stream->reactor);
+		if (ret < 0) {
+			// retrying a dead device would only spin
+			writeToLog(stream->engine, "Stream %d failed: %s", stream->id, stream->reactor->error);
+			__atomic_store_n(&stream->isFailed, true, __ATOMIC_RELEASE);
+			break;
+		}
+		if (ret == 0) {
+			writeToLog(stream->engine, "Stream %d: %s", stream->id, stream->reactor->error);
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * _ringDepth of 0 means nobody consumes this stream's frames.
+ */
+static CaptureStream *addStream(CaptureEngine *self, Video *_video, int _cpu, int _ringDepth) {
+	if (self->streamsCount >= CAPTURE_MAX_STREAMS) {
+		sprintf(self->error, "Cannot capture more than %d streams.", CAPTURE_MAX_STREAMS);
+		return NULL;
+	}
+
+	CaptureStream *stream = (CaptureStream *) calloc(1, sizeof(CaptureStream));
+	stream->id = self->streamsCount;
+	stream->video = _video;
+	stream->ring = NULL;
+	stream->ringDepth = _ringDepth;
+	stream->reactor = NULL;
+	stream->trace = NULL;
+	stream->cpu = _cpu;
+	stream->isRunning = false;
+	stream->isStopping = false;
+	stream->isFailed = false;
+	stream->engine = self;
+
+	self->streams[self->streamsCount++] = stream;
+	return stream;
+}
+
+static int initDevices(CaptureEngine *self) {
+	unsigned int i;
+
+	for (i = 0; i < self->streamsCount; i++) {
+		CaptureStream *stream = self->streams[i];
+
+		if (stream->video->initDevice(stream->video) != 1) {
+			sprintf(self->error, "%s: %s", stream->video->device, stream->video->error);
+			return 0;
+		}
+
+		if (stream->ringDepth <= 0 || stream->ring != NULL) {
+			continue;
+		}
+
+		// every frame in the ring is held, and the capture thread needs one
+		// more to drop frames with, so the ring stays below the held cap
+		Video *video = stream->video;
+		if (stream->ringDepth >= video->maxHeldFrames) {
+			stream->ringDepth = (video->maxHeldFrames > 1) ? video->maxHeldFrames - 1 : 1;
+		}
+		stream->ring = FrameRing_newWith(stream->ringDepth);
+		writeToLog(self, "Stream %d: frame ring depth %d.", stream->id, stream->ring->capacity);
+	}
+
+	return 1;
+}
+
+static int startStreams(CaptureEngine *self) {
+	unsigned int i;
+
+	for (i = 0; i < self->streamsCount; i++) {
+		Video *video = self->streams[i]->video;
+		if (video->startStream(video) <= 0) {
+			sprintf(self->error, "%s", video->error);
+			return 0;
+		}
+		writeToLog(self, "Stream %d: %s started streaming.", i, video->device);
+	}
+
+	return 1;
+}
+
+static void stopStreams(CaptureEngine *self) {
+	unsigned int i;
+
+	for (i = 0; i < self->streamsCount; i++) {
+		Video *video = self->streams[i]->video;
+		video->stopStream(video);
+		writeToLog(self, "Stream %d: %s stopped streaming.", i, video->device);
+	}
+}
+
+static void stop(CaptureEngine *self);
+
+/**
+ * Starts one capture thread per stream. Streams must already be streaming.
+ */
+static int start(CaptureEngine *self) {
+	unsigned int i;
+
+	for (i = 0; i < self->streamsCount; i++) {
+		CaptureStream *stream = self->streams[i];
+
+		if (stream->ring != NULL) {
+			stream->ring->reset(stream->ring);
+		}
+		stream->captured = 0;
+		stream->latencySumUsec = 0;
+		stream->latencyMaxUsec = 0;
+		stream->latencyCount = 0;
+		stream->isStopping = false;
+		stream->isFailed = false;
+
+		stream->reactor = Reactor_new();
+		stream->reactor->setTraceWith(stream->reactor, stream->trace);
+		if (!stream->reactor->addVideo(stream->reactor, stream->video, onFrame, stream)) {
+			sprintf(self->error, "%s", stream->reactor->error);
+			stop(self);
+			return 0;
+		}
+
+		if (0 != pthread_create(&stream->thread, NULL, streamThread, stream)) {
+			sprintf(self->error, "Cannot start the capture thread of stream %d.", i);
+			stop(self);
+			return 0;
+		}
+		stream->isRunning = true;
+	}
+
+	return 1;
+}
+
+static void stop(CaptureEngine *self) {
+	unsigned int i;
+
+	for (i = 0; i < self->streamsCount; i++) {
+		CaptureStream *stream = self->streams[i];
+
+		if (stream->isRunning) {
+			__atomic_store_n(&stream->isStopping, true, __ATOMIC_RELEASE);
+			stream->reactor->shutdown(stream->reactor);
+			pthread_join(stream->thread, NULL);
+			stream->isRunning = false;
+		}
+
+		Reactor_dispose(stream->reactor);
+		stream->reactor = NULL;
+	}
+}
+
+static void CaptureEngine_init(CaptureEngine *self) {
+	self->streamsCount = 0;
+	self->hAppLog = NULL;
+	self->error = (char *) calloc(256, sizeof(char));
+
+	// methods
+	self->setLoggerWith = setLoggerWith;
+	self->setTracerWith = setTracerWith;
+	self->addStream = addStream;
+	self->initDevices = initDevices;
+	self->startStreams = startStreams;
+	self->stopStreams = stopStreams;
+	self->start = start;
+	self->stop = stop;
+}
+
+CaptureEngine *CaptureEngine_new() {
+	CaptureEngine *engine = (CaptureEngine *) calloc(1, sizeof(CaptureEngine));
+	CaptureEngine_init(engine);
+	return engine;
+}
+
+/**
+ * Stops the capture threads and disposes every stream's Video.
+ */
+void CaptureEngine_dispose(CaptureEngine *self) {
+	if (self == NULL) {
+		return;
+	}
+
+	stop(self);
+
+	unsigned int i;
+	for (i = 0; i < self->streamsCount; i++) {
+		Video_dispose(self->streams[i]->video);
+		FrameRing_dispose(self->streams[i]->ring);
+		free(self->streams[i]);
+	}
+
+	free(self->error);
+	free(self);
+}
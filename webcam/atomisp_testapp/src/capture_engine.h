@@ -0,0 +1,81 @@
+/**
+	This file is part of Intel Atom ISP Test App.
+
+	Intel Atom ISP Test App is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Intel Atom ISP Test App is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Intel Atom ISP Test App.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CAPTURE_ENGINE_H_
+#define CAPTURE_ENGINE_H_
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "video.h"
+#include "frame_ring.h"
+#include "reactor.h"
+#include "trace.h"
+
+#define CAPTURE_MAX_STREAMS REACTOR_MAX_SOURCES
+#define CAPTURE_NO_AFFINITY -1
+
+struct CAPTURE_ENGINE_S;
+
+/**
+ * One device with its own capture thread.
+ *
+ * Frames go into ring when the stream has a consumer; otherwise they are
+ * counted and handed straight back to the driver.
+ */
+typedef struct CAPTURE_STREAM_S {
+	unsigned int id;
+	Video *video;
+	FrameRing *ring;
+	int ringDepth;
+	Reactor *reactor;
+	TraceRing *trace;	/* written by the stream's thread; NULL when not tracing */
+	pthread_t thread;
+	int cpu;
+	bool isRunning;
+	bool isStopping;
+	bool isFailed;		/* the device failed and the thread gave up on it */
+	struct CAPTURE_ENGINE_S *engine;
+
+	// written by the stream's thread only
+	unsigned long captured;
+	unsigned long long latencySumUsec;	/* dequeue time - driver timestamp */
+	unsigned long long latencyMaxUsec;
+	unsigned long latencyCount;
+} CaptureStream;
+
+typedef struct CAPTURE_ENGINE_S {
+	unsigned int streamsCount;
+	CaptureStream *streams[CAPTURE_MAX_STREAMS];
+	FILE *hAppLog;
+	char *error;
+
+	void (*setLoggerWith) (struct CAPTURE_ENGINE_S *, FILE *);
+	int (*setTracerWith) (struct CAPTURE_ENGINE_S *, Tracer *);
+	CaptureStream *(*addStream) (struct CAPTURE_ENGINE_S *, Video *, int, int);
+	int (*initDevices) (struct CAPTURE_ENGINE_S *);
+	int (*startStreams) (struct CAPTURE_ENGINE_S *);
+	void (*stopStreams) (struct CAPTURE_ENGINE_S *);
+	int (*start) (struct CAPTURE_ENGINE_S *);
+	void (*stop) (struct CAPTURE_ENGINE_S *);
+} CaptureEngine;
+
+CaptureEngine *CaptureEngine_new();
+void CaptureEngine_dispose(CaptureEngine *);
+
+#endif /* CAPTURE_ENGINE_H_ */
@@ -0,0 +1,314 @@
+/**
+	This file is part of Intel Atom ISP Test App.
+
+	Intel Atom ISP Test App is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Intel Atom ISP Test App is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Intel Atom ISP Test App.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "color_convert.h"
+#include "color_convert_kernels.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+static const char *ISA_NAMES[] = {
+	[CONVERT_ISA_SCALAR] = "scalar",
+	[CONVERT_ISA_SSE2] = "sse2",
+	[CONVERT_ISA_SSSE3] = "ssse3",
+	[CONVERT_ISA_AVX2] = "avx2"
+};
+
+static inline unsigned char clamp255(int _value) {
+	return (_value < 0) ? 0 : ((_value > 255) ? 255 : (unsigned char) _value);
+}
+
+static inline void yuvToRgba(int _y, int _u, int _v, unsigned char *_out) {
+	int y = CONVERT_Y * (_y - 16);
+	int u = _u - 128;
+	int v = _v - 128;
+
+	_out[0] = clamp255((y + (CONVERT_RV * v) + CONVERT_ROUND) >> CONVERT_SHIFT);
+	_out[1] = clamp255((y - (CONVERT_GU * u) - (CONVERT_GV * v) + CONVERT_ROUND) >> CONVERT_SHIFT);
+	_out[2] = clamp255((y + (CONVERT_BU * u) + CONVERT_ROUND) >> CONVERT_SHIFT);
+	_out[3] = 255;
+}
+
+void ColorConvert_rowYV16(const unsigned char *_y, const unsigned char *_u, const unsigned char *_v,
+						  unsigned char *_out, unsigned int _width) {
+	unsigned int x;
+
+	for (x = 0; x < _width; x++) {
+		yuvToRgba(_y[x], _u[x / 2], _v[x / 2], _out + (x * 4));
+	}
+}
+
+void ColorConvert_rowNV12(const unsigned char *_y, const unsigned char *_uv, const unsigned char *_unused,
+						  unsigned char *_out, unsigned int _width) {
+	unsigned int x;
+
+	for (x = 0; x < _width; x++) {
+		unsigned int pair = (x / 2) * 2;
+		yuvToRgba(_y[x], _uv[pair], _uv[pair + 1], _out + (x * 4));
+	}
+}
+
+/**
+ * 4:2:2 packed in pairs of pixels; the offsets are of Y0, Y1, U and V in
+ * each 4 byte pair.
+ */
+static inline void rowPacked(const unsigned char *_src, unsigned char *_out, unsigned int _width,
+							 unsigned int _y0, unsigned int _y1, unsigned int _u, unsigned int _v) {
+	unsigned int x;
+
+	for (x = 0; x < _width; x++) {
+		const unsigned char *pair = _src + ((x / 2) * 4);
+		yuvToRgba(pair[(x & 1) ? _y1 : _y0], pair[_u], pair[_v], _out + (x * 4));
+	}
+}
+
+void ColorConvert_rowYUYV(const unsigned char *_src, const unsigned char *_unused1, const unsigned char *_unused2,
+						  unsigned char *_out, unsigned int _width) {
+	rowPacked(_src, _out, _width, 0, 2, 1, 3);
+}
+
+void ColorConvert_rowUYVY(const unsigned char *_src, const unsigned char *_unused1, const unsigned char *_unused2,
+						  unsigned char *_out, unsigned int _width) {
+	rowPacked(_src, _out, _width, 1, 3, 0, 2);
+}
+
+void ColorConvert_rowYVYU(const unsigned char *_src, const unsigned char *_unused1, const unsigned char *_unused2,
+						  unsigned char *_out, unsigned int _width) {
+	rowPacked(_src, _out, _width, 0, 2, 3, 1);
+}
+
+void ColorConvert_rowVYUY(const unsigned char *_src, const unsigned char *_unused1, const unsigned char *_unused2,
+						  unsigned char *_out, unsigned int _width) {
+	rowPacked(_src, _out, _width, 1, 3, 2, 0);
+}
+
+static void rowRGB3(const unsigned char *_src, const unsigned char *_unused1, const unsigned char *_unused2,
+					unsigned char *_out, unsigned int _width) {
+	unsigned int x;
+
+	for (x = 0; x < _width; x++) {
+		_out[(x * 4) + 0] = _src[(x * 3) + 0];
+		_out[(x * 4) + 1] = _src[(x * 3) + 1];
+		_out[(x * 4) + 2] = _src[(x * 3) + 2];
+		_out[(x * 4) + 3] = 255;
+	}
+}
+
+/**
+ * RGB565, little endian; the top bits are repeated into the low ones so
+ * white stays 255.
+ */
+static void rowRGBP(const unsigned char *_src, const unsigned char *_unused1, const unsigned char *_unused2,
+					unsigned char *_out, unsigned int _width) {
+	unsigned int x;
+
+	for (x = 0; x < _width; x++) {
+		unsigned int pixel = _src[x * 2] | (_src[(x * 2) + 1] << 8);
+		unsigned int r = (pixel >> 11) & 0x1f;
+		unsigned int g = (pixel >> 5) & 0x3f;
+		unsigned int b = pixel & 0x1f;
+
+		_out[(x * 4) + 0] = (r << 3) | (r >> 2);
+		_out[(x * 4) + 1] = (g << 2) | (g >> 4);
+		_out[(x * 4) + 2] = (b << 3) | (b >> 2);
+		_out[(x * 4) + 3] = 255;
+	}
+}
+
+static ConvertRow_t scalarRow(PixelFormat_t _format) {
+	switch (_format) {
+	case YV16:
+		return ColorConvert_rowYV16;
+	case NV12:
+		return ColorConvert_rowNV12;
+	case YUYV:
+		return ColorConvert_rowYUYV;
+	case UYVY:
+		return ColorConvert_rowUYVY;
+	case YVYU:
+		return ColorConvert_rowYVYU;
+	case VYUY:
+		return ColorConvert_rowVYUY;
+	case RGB3:
+		return rowRGB3;
+	case RGBP:
+		return rowRGBP;
+	default:
+		return NULL;
+	}
+}
+
+/**
+ * The best instruction set this CPU (and OS) runs.
+ */
+ConvertIsa_t ColorConvert_cpuIsa() {
+#if defined(__i386__) || defined(__x86_64__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		return CONVERT_ISA_AVX2;
+	}
+	if (__builtin_cpu_supports("ssse3")) {
+		return CONVERT_ISA_SSSE3;
+	}
+	if (__builtin_cpu_supports("sse2")) {
+		return CONVERT_ISA_SSE2;
+	}
+#endif
+	return CONVERT_ISA_SCALAR;
+}
+
+const char *ColorConvert_isaName(ConvertIsa_t _isa) {
+	if ((unsigned int) _isa >= sizeof(ISA_NAMES) / sizeof(ISA_NAMES[0])) {
+		return "unknown";
+	}
+
+	return ISA_NAMES[_isa];
+}
+
+bool ColorConvert_parseIsa(const char *_name, ConvertIsa_t *_isa) {
+	unsigned int i;
+
+	for (i = 0; i < sizeof(ISA_NAMES) / sizeof(ISA_NAMES[0]); i++) {
+		if (strcasecmp(_name, ISA_NAMES[i]) == 0) {
+			*_isa = (ConvertIsa_t) i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void convertBand(void *_arg, unsigned int _first, unsigned int _end) {
+	ColorConverter *self = (ColorConverter *) _arg;
+	const VideoFrame *frame = self->frame;
+	unsigned int y, p;
+	const unsigned char *rows[PIXEL_FORMAT_MAX_PLANES] = { NULL, NULL, NULL };
+
+	for (y = _first; y < _end; y++) {
+		for (p = 0; p < self->formatInfo->planesCount; p++) {
+			const VideoPlane *plane = &frame->planes[p];
+			rows[p] = plane->data + ((y / self->formatInfo->planes[p].verticalSubsampling) * plane->bytesperline);
+		}
+		self->convertRow(rows[0], rows[1], rows[2], self->rgba + (y * self->stride), frame->planes[0].width);
+	}
+}
+
+/**
+ * The job converting _frame into _rgba, _stride bytes per row, at least
+ * 4 * width; NULL (and error set) when it cannot. The frame stays this
+ * object's until the job is done.
+ */
+static WorkerJob *prepare(ColorConverter *self, const VideoFrame *_frame, unsigned char *_rgba, unsigned int _stride) {
+	if (self->convertRow == NULL) {
+		return NULL;
+	}
+
+	if (_frame->planesCount < self->formatInfo->planesCount) {
+		sprintf(self->error, "Frame has %u planes, expected %u.", _frame->planesCount, self->formatInfo->planesCount);
+		return NULL;
+	}
+
+	self->frame = _frame;
+	self->rgba = _rgba;
+	self->stride = _stride;
+	self->job->rowsCount = _frame->planes[0].height;
+	return self->job;
+}
+
+/**
+ * Converts _frame into _rgba and returns when done; no stage is chained.
+ */
+static int convert(ColorConverter *self, const VideoFrame *_frame, unsigned char *_rgba, unsigned int _stride) {
+	WorkerJob *job = prepare(self, _frame, _rgba, _stride);
+	if (job == NULL) {
+		return 0;
+	}
+
+	if (self->pool != NULL) {
+		WorkerJob_chain(job, NULL, 0);
+		self->pool->submit(self->pool, job);
+		self->pool->wait(self->pool, job);
+	} else {
+		convertBand(self, 0, job->rowsCount);
+	}
+
+	return 1;
+}
+
+static void setPool(ColorConverter *self, WorkerPool *_pool) {
+	self->pool = _pool;
+}
+
+static void ColorConverter_init(ColorConverter *self, PixelFormat_t _pixelFormat, ConvertIsa_t _maxIsa) {
+	self->formatInfo = PixelFormat_info(_pixelFormat);
+	self->isa = CONVERT_ISA_SCALAR;
+	self->convertRow = NULL;
+	self->pool = NULL;
+	self->job = WorkerJob_newWith(convertBand, self, 0);
+	self->error = (char *) calloc(256, sizeof(char));
+	self->frame = NULL;
+	self->rgba = NULL;
+	self->stride = 0;
+
+	// methods
+	self->setPool = setPool;
+	self->prepare = prepare;
+	self->convert = convert;
+
+	ConvertIsa_t isa = ColorConvert_cpuIsa();
+	if (isa > _maxIsa) {
+		isa = _maxIsa;
+	}
+
+	// the fastest kernel there is for the format, down to the scalar one
+#if defined(__i386__) || defined(__x86_64__)
+	for (; isa > CONVERT_ISA_SCALAR; isa--) {
+		self->convertRow = ColorConvert_x86Row(_pixelFormat, isa);
+		if (self->convertRow != NULL) {
+			self->isa = isa;
+			return;
+		}
+	}
+#endif
+
+	self->convertRow = scalarRow(_pixelFormat);
+	if (self->convertRow == NULL) {
+		sprintf(self->error, "No RGB conversion for %s.", PixelFormat_name(_pixelFormat));
+	}
+}
+
+/**
+ * Picks the fastest kernel for _pixelFormat up to _maxIsa that the CPU
+ * runs. convertRow is NULL (and error set) for formats it cannot convert.
+ */
+ColorConverter *ColorConverter_newWith(PixelFormat_t _pixelFormat, ConvertIsa_t _maxIsa) {
+	ColorConverter *converter = (ColorConverter *) calloc(1, sizeof(ColorConverter));
+	ColorConverter_init(converter, _pixelFormat, _maxIsa);
+	return converter;
+}
+
+void ColorConverter_dispose(ColorConverter *self) {
+	if (self == NULL) {
+		return;
+	}
+
+	WorkerJob_dispose(self->job);
+	free(self->error);
+	free(self);
+}
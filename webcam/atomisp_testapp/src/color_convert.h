@@ -0,0 +1,77 @@
+/**
+	This file is part of Intel Atom ISP Test App.
+
+	Intel Atom ISP Test App is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Intel Atom ISP Test App is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Intel Atom ISP Test App.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COLOR_CONVERT_H_
+#define COLOR_CONVERT_H_
+
+#include <stdbool.h>
+
+#include "utilities.h"
+#include "pixel_format.h"
+#include "video.h"
+#include "worker_pool.h"
+
+/**
+ * Instruction sets with conversion kernels, slowest first.
+ */
+typedef enum CONVERT_ISA {
+	CONVERT_ISA_SCALAR,
+	CONVERT_ISA_SSE2,
+	CONVERT_ISA_SSSE3,
+	CONVERT_ISA_AVX2,
+	CONVERT_ISA_BEST = CONVERT_ISA_AVX2
+} ConvertIsa_t;
+
+/**
+ * Converts one row of _width pixels to RGBA. The planes are the rows of Y,
+ * U and V, of Y and UV, or of the packed pixels alone.
+ */
+typedef void (*ConvertRow_t) (const unsigned char *, const unsigned char *, const unsigned char *,
+							  unsigned char *, unsigned int);
+
+/**
+ * Turns captured frames into RGBA, 8 bits per channel with alpha 255, on
+ * the CPU, with the BT.601 coefficients of the fragment shaders.
+ *
+ * With a pool the rows are split in tiles over its threads. prepare()
+ * gives the job of one frame, for chaining other stages after it.
+ */
+typedef struct COLOR_CONVERTER_S {
+	const PixelFormatInfo *formatInfo;
+	ConvertIsa_t isa;		/* of the kernel in use */
+	ConvertRow_t convertRow;
+	WorkerPool *pool;		/* not owned; NULL runs on the calling thread */
+	WorkerJob *job;
+	char *error;
+
+	// the frame prepared
+	const VideoFrame *frame;
+	unsigned char *rgba;
+	unsigned int stride;
+
+	void (*setPool) (struct COLOR_CONVERTER_S *, WorkerPool *);
+	WorkerJob *(*prepare) (struct COLOR_CONVERTER_S *, const VideoFrame *, unsigned char *, unsigned int);
+	int (*convert) (struct COLOR_CONVERTER_S *, const VideoFrame *, unsigned char *, unsigned int);
+} ColorConverter;
+
+ConvertIsa_t ColorConvert_cpuIsa();
+const char *ColorConvert_isaName(ConvertIsa_t);
+bool ColorConvert_parseIsa(const char *, ConvertIsa_t *);
+ColorConverter *ColorConverter_newWith(PixelFormat_t, ConvertIsa_t);
+void ColorConverter_dispose(ColorConverter *);
+
+#endif /* COLOR_CONVERT_H_ */
@@ -0,0 +1,50 @@
+/**
+	This file is part of Intel Atom ISP Test App.
+
+	Intel Atom ISP Test App is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Intel Atom ISP Test App is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Intel Atom ISP Test App.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COLOR_CONVERT_KERNELS_H_
+#define COLOR_CONVERT_KERNELS_H_
+
+#include "color_convert.h"
+
+/**
+ * BT.601, limited range, as in the fragment shaders, in Q13 fixed point:
+ *
+ *   R = 1.1643 (Y - 16) + 1.5958 (V - 128)
+ *   G = 1.1643 (Y - 16) - 0.39173 (U - 128) - 0.81290 (V - 128)
+ *   B = 1.1643 (Y - 16) + 2.017 (U - 128)
+ *
+ * Every kernel computes exactly these sums, so they all give the same bytes.
+ */
+#define CONVERT_SHIFT 13
+#define CONVERT_ROUND (1 << (CONVERT_SHIFT - 1))
+#define CONVERT_Y 9538
+#define CONVERT_RV 13073
+#define CONVERT_GU 3209
+#define CONVERT_GV 6659
+#define CONVERT_BU 16523
+
+// scalar rows; the SIMD kernels finish their rows with them
+void ColorConvert_rowYV16(const unsigned char *, const unsigned char *, const unsigned char *, unsigned char *, unsigned int);
+void ColorConvert_rowNV12(const unsigned char *, const unsigned char *, const unsigned char *, unsigned char *, unsigned int);
+void ColorConvert_rowYUYV(const unsigned char *, const unsigned char *, const unsigned char *, unsigned char *, unsigned int);
+void ColorConvert_rowUYVY(const unsigned char *, const unsigned char *, const unsigned char *, unsigned char *, unsigned int);
+void ColorConvert_rowYVYU(const unsigned char *, const unsigned char *, const unsigned char *, unsigned char *, unsigned int);
+void ColorConvert_rowVYUY(const unsigned char *, const unsigned char *, const unsigned char *, unsigned char *, unsigned int);
+
+ConvertRow_t ColorConvert_x86Row(PixelFormat_t, ConvertIsa_t);
+
+#endif /* COLOR_CONVERT_KERNELS_H_ */
@@ -0,0 +1,447 @@
+/**
+	This file is part of Intel Atom ISP Test App.
+
+	Intel Atom ISP Test App is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Intel Atom ISP Test App is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Intel Atom ISP Test App.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * SSE2, SSSE3 and AVX2 conversion kernels. Each is compiled for its own
+ * instruction set through target attributes, so the file builds with the
+ * app's plain CFLAGS and ColorConverter only calls what the CPU runs.
+ *
+ * All of them widen to 16 bits, then form the Q13 sums of
+ * color_convert_kernels.h with pmaddwd in 32 bits:
+ *
+ *   R = (Y, V) . (CONVERT_Y, CONVERT_RV) + round
+ *   G = (Y, U) . (CONVERT_Y, -CONVERT_GU) + (V, 1) . (-CONVERT_GV, round)
+ *   B = (Y, U) . (CONVERT_Y, CONVERT_BU) + round
+ *
+ * and saturate back to bytes, which is what the scalar clamp does.
+ */
+
+#include "color_convert_kernels.h"
+
+#if defined(__i386__) || defined(__x86_64__)
+
+#include <string.h>
+#include <immintrin.h>
+
+#define SSE2 __attribute__((target("sse2")))
+#define SSSE3 __attribute__((target("ssse3")))
+#define AVX2 __attribute__((target("avx2")))
+
+#define Z -128	/* pshufb: zero this byte */
+
+static inline SSE2 __m128i load32(const unsigned char *_src) {
+	int value;
+	memcpy(&value, _src, sizeof(value));
+	return _mm_cvtsi32_si128(value);
+}
+
+/**
+ * Writes 8 RGBA pixels from Y - 16, U - 128 and V - 128 in 16 bit lanes.
+ */
+static inline SSE2 void storeRgba8(__m128i _y, __m128i _u, __m128i _v, unsigned char *_out) {
+	const __m128i coeffR = _mm_set_epi16(CONVERT_RV, CONVERT_Y, CONVERT_RV, CONVERT_Y,
+										 CONVERT_RV, CONVERT_Y, CONVERT_RV, CONVERT_Y);
+	const __m128i coeffG = _mm_set_epi16(-CONVERT_GU, CONVERT_Y, -CONVERT_GU, CONVERT_Y,
+										 -CONVERT_GU, CONVERT_Y, -CONVERT_GU, CONVERT_Y);
+	const __m128i coeffGV = _mm_set_epi16(CONVERT_ROUND, -CONVERT_GV, CONVERT_ROUND, -CONVERT_GV,
+										  CONVERT_ROUND, -CONVERT_GV, CONVERT_ROUND, -CONVERT_GV);
+	const __m128i coeffB = _mm_set_epi16(CONVERT_BU, CONVERT_Y, CONVERT_BU, CONVERT_Y,
+										 CONVERT_BU, CONVERT_Y, CONVERT_BU, CONVERT_Y);
+	const __m128i round = _mm_set1_epi32(CONVERT_ROUND);
+	const __m128i one = _mm_set1_epi16(1);
+	const __m128i alpha = _mm_set1_epi8(-1);
+
+	__m128i yvLo = _mm_unpacklo_epi16(_y, _v);
+	__m128i yvHi = _mm_unpackhi_epi16(_y, _v);
+	__m128i yuLo = _mm_unpacklo_epi16(_y, _u);
+	__m128i yuHi = _mm_unpackhi_epi16(_y, _u);
+	__m128i v1Lo = _mm_unpacklo_epi16(_v, one);
+	__m128i v1Hi = _mm_unpackhi_epi16(_v, one);
+
+	__m128i r = _mm_packs_epi32(
+			_mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(yvLo, coeffR), round), CONVERT_SHIFT),
+			_mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(yvHi, coeffR), round), CONVERT_SHIFT));
+	__m128i g = _mm_packs_epi32(
+			_mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(yuLo, coeffG), _mm_madd_epi16(v1Lo, coeffGV)), CONVERT_SHIFT),
+			_mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(yuHi, coeffG), _mm_madd_epi16(v1Hi, coeffGV)), CONVERT_SHIFT));
+	__m128i b = _mm_packs_epi32(
+			_mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(yuLo, coeffB), round), CONVERT_SHIFT),
+			_mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(yuHi, coeffB), round), CONVERT_SHIFT));
+
+	__m128i rg = _mm_unpacklo_epi8(_mm_packus_epi16(r, r), _mm_packus_epi16(g, g));
+	__m128i ba = _mm_unpacklo_epi8(_mm_packus_epi16(b, b), alpha);
+	_mm_storeu_si128((__m128i *) _out, _mm_unpacklo_epi16(rg, ba));
+	_mm_storeu_si128((__m128i *) (_out + 16), _mm_unpackhi_epi16(rg, ba));
+}
+
+/**
+ * The 16 pixel version of storeRgba8(); lane 0 holds pixels 0 to 7, lane 1
+ * pixels 8 to 15.
+ */
+static inline AVX2 void storeRgba16(__m256i _y, __m256i _u, __m256i _v, unsigned char *_out) {
+	const __m256i coeffR = _mm256_set1_epi32((CONVERT_RV << 16) | CONVERT_Y);
+	const __m256i coeffG = _mm256_set1_epi32((int) (((unsigned int) -CONVERT_GU << 16) | CONVERT_Y));
+	const __m256i coeffGV = _mm256_set1_epi32((int) ((CONVERT_ROUND << 16) | ((unsigned int) -CONVERT_GV & 0xffff)));
+	const __m256i coeffB = _mm256_set1_epi32((CONVERT_BU << 16) | CONVERT_Y);
+	const __m256i round = _mm256_set1_epi32(CONVERT_ROUND);
+	const __m256i one = _mm256_set1_epi16(1);
+	const __m256i alpha = _mm256_set1_epi8(-1);
+
+	__m256i yvLo = _mm256_unpacklo_epi16(_y, _v);
+	__m256i yvHi = _mm256_unpackhi_epi16(_y, _v);
+	__m256i yuLo = _mm256_unpacklo_epi16(_y, _u);
+	__m256i yuHi = _mm256_unpackhi_epi16(_y, _u);
+	__m256i v1Lo = _mm256_unpacklo_epi16(_v, one);
+	__m256i v1Hi = _mm256_unpackhi_epi16(_v, one);
+
+	__m256i r = _mm256_packs_epi32(
+			_mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(yvLo, coeffR), round), CONVERT_SHIFT),
+			_mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(yvHi, coeffR), round), CONVERT_SHIFT));
+	__m256i g = _mm256_packs_epi32(
+			_mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(yuLo, coeffG), _mm256_madd_epi16(v1Lo, coeffGV)), CONVERT_SHIFT),
+			_mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(yuHi, coeffG), _mm256_madd_epi16(v1Hi, coeffGV)), CONVERT_SHIFT));
+	__m256i b = _mm256_packs_epi32(
+			_mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(yuLo, coeffB), round), CONVERT_SHIFT),
+			_mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(yuHi, coeffB), round), CONVERT_SHIFT));
+
+	__m256i rg = _mm256_unpacklo_epi8(_mm256_packus_epi16(r, r), _mm256_packus_epi16(g, g));
+	__m256i ba = _mm256_unpacklo_epi8(_mm256_packus_epi16(b, b), alpha);
+	__m256i first = _mm256_unpacklo_epi16(rg, ba);		/* pixels 0-3 and 8-11 */
+	__m256i second = _mm256_unpackhi_epi16(rg, ba);	/* pixels 4-7 and 12-15 */
+	_mm256_storeu_si256((__m256i *) _out, _mm256_permute2x128_si256(first, second, 0x20));
+	_mm256_storeu_si256((__m256i *) (_out + 32), _mm256_permute2x128_si256(first, second, 0x31));
+}
+
+// SSE2
+
+static SSE2 void rowYV16_sse2(const unsigned char *_y, const unsigned char *_u, const unsigned char *_v,
+							  unsigned char *_out, unsigned int _width) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i yOffset = _mm_set1_epi16(16);
+	const __m128i uvOffset = _mm_set1_epi16(128);
+	unsigned int x;
+
+	for (x = 0; x + 8 <= _width; x += 8) {
+		__m128i y = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (_y + x)), zero), yOffset);
+		__m128i u = _mm_unpacklo_epi8(load32(_u + (x / 2)), zero);
+		__m128i v = _mm_unpacklo_epi8(load32(_v + (x / 2)), zero);
+
+		u = _mm_sub_epi16(_mm_unpacklo_epi16(u, u), uvOffset);
+		v = _mm_sub_epi16(_mm_unpacklo_epi16(v, v), uvOffset);
+		storeRgba8(y, u, v, _out + (x * 4));
+	}
+	ColorConvert_rowYV16(_y + x, _u + (x / 2), _v + (x / 2), _out + (x * 4), _width - x);
+}
+
+static SSE2 void rowNV12_sse2(const unsigned char *_y, const unsigned char *_uv, const unsigned char *_unused,
+							  unsigned char *_out, unsigned int _width) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i lowBytes = _mm_set1_epi16(0x00ff);
+	const __m128i yOffset = _mm_set1_epi16(16);
+	const __m128i uvOffset = _mm_set1_epi16(128);
+	unsigned int x;
+
+	for (x = 0; x + 8 <= _width; x += 8) {
+		__m128i y = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (_y + x)), zero), yOffset);
+		// four U V pairs, one per 16 bit lane
+		__m128i uv = _mm_loadl_epi64((const __m128i *) (_uv + x));
+		__m128i u = _mm_and_si128(uv, lowBytes);
+		__m128i v = _mm_srli_epi16(uv, 8);
+
+		u = _mm_sub_epi16(_mm_unpacklo_epi16(u, u), uvOffset);
+		v = _mm_sub_epi16(_mm_unpacklo_epi16(v, v), uvOffset);
+		storeRgba8(y, u, v, _out + (x * 4));
+	}
+	ColorConvert_rowNV12(_y + x, _uv + x, NULL, _out + (x * 4), _width - x);
+}
+
+/**
+ * Packed 4:2:2: Y in the low or high byte of every 16 bit word, the chroma
+ * in the other, alternating U and V or V and U.
+ */
+static inline SSE2 void rowPacked_sse2(const unsigned char *_src, unsigned char *_out, unsigned int _width,
+									   bool _isYHigh, bool _isVFirst) {
+	const __m128i lowBytes = _mm_set1_epi16(0x00ff);
+	const __m128i yOffset = _mm_set1_epi16(16);
+	const __m128i uvOffset = _mm_set1_epi16(128);
+	unsigned int x;
+
+	for (x = 0; x + 8 <= _width; x += 8) {
+		__m128i raw = _mm_loadu_si128((const __m128i *) (_src + (x * 2)));
+		__m128i low = _mm_and_si128(raw, lowBytes);
+		__m128i high = _mm_srli_epi16(raw, 8);
+		__m128i y = _isYHigh ? high : low;
+		__m128i chroma = _isYHigh ? low : high;
+
+		// first and second chroma of each pair, repeated for both pixels
+		__m128i first = _mm_shufflehi_epi16(_mm_shufflelo_epi16(chroma, _MM_SHUFFLE(2, 2, 0, 0)), _MM_SHUFFLE(2, 2, 0, 0));
+		__m128i second = _mm_shufflehi_epi16(_mm_shufflelo_epi16(chroma, _MM_SHUFFLE(3, 3, 1, 1)), _MM_SHUFFLE(3, 3, 1, 1));
+
+		y = _mm_sub_epi16(y, yOffset);
+		first = _mm_sub_epi16(first, uvOffset);
+		second = _mm_sub_epi16(second, uvOffset);
+		storeRgba8(y, _isVFirst ? second : first, _isVFirst ? first : second, _out + (x * 4));
+	}
+}
+
+static SSE2 void rowYUYV_sse2(const unsigned char *_src, const unsigned char *_unused1, const unsigned char *_unused2,
+							  unsigned char *_out, unsigned int _width) {
+	unsigned int x = _width & ~7u;
+	rowPacked_sse2(_src, _out, _width, false, false);
+	ColorConvert_rowYUYV(_src + (x * 2), NULL, NULL, _out + (x * 4), _width - x);
+}
+
+static SSE2 void rowUYVY_sse2(const unsigned char *_src, const unsigned char *_unused1, const unsigned char *_unused2,
+							  unsigned char *_out, unsigned int _width) {
+	unsigned int x = _width & ~7u;
+	rowPacked_sse2(_src, _out, _width, true, false);
+	ColorConvert_rowUYVY(_src + (x * 2), NULL, NULL, _out + (x * 4), _width - x);
+}
+
+static SSE2 void rowYVYU_sse2(const unsigned char *_src, const unsigned char *_unused1, const unsigned char *_unused2,
+							  unsigned char *_out, unsigned int _width) {
+	unsigned int x = _width & ~7u;
+	rowPacked_sse2(_src, _out, _width, false, true);
+	ColorConvert_rowYVYU(_src + (x * 2), NULL, NULL, _out + (x * 4), _width - x);
+}
+
+static SSE2 void rowVYUY_sse2(const unsigned char *_src, const unsigned char *_unused1, const unsigned char *_unused2,
+							  unsigned char *_out, unsigned int _width) {
+	unsigned int x = _width & ~7u;
+	rowPacked_sse2(_src, _out, _width, true, true);
+	ColorConvert_rowVYUY(_src + (x * 2), NULL, NULL, _out + (x * 4), _width - x);
+}
+
+// SSSE3: pshufb widens and repeats the chroma in one step
+
+static SSSE3 void rowYV16_ssse3(const unsigned char *_y, const unsigned char *_u, const unsigned char *_v,
+								unsigned char *_out, unsigned int _width) {
+	const __m128i yMask = _mm_setr_epi8(0, Z, 1, Z, 2, Z, 3, Z, 4, Z, 5, Z, 6, Z, 7, Z);
+	const __m128i chromaMask = _mm_setr_epi8(0, Z, 0, Z, 1, Z, 1, Z, 2, Z, 2, Z, 3, Z, 3, Z);
+	const __m128i yOffset = _mm_set1_epi16(16);
+	const __m128i uvOffset = _mm_set1_epi16(128);
+	unsigned int x;
+
+	for (x = 0; x + 8 <= _width; x += 8) {
+		__m128i y = _mm_shuffle_epi8(_mm_loadl_epi64((const __m128i *) (_y + x)), yMask);
+		__m128i u = _mm_shuffle_epi8(load32(_u + (x / 2)), chromaMask);
+		__m128i v = _mm_shuffle_epi8(load32(_v + (x / 2)), chromaMask);
+
+		storeRgba8(_mm_sub_epi16(y, yOffset), _mm_sub_epi16(u, uvOffset), _mm_sub_epi16(v, uvOffset), _out + (x * 4));
+	}
+	ColorConvert_rowYV16(_y + x, _u + (x / 2), _v + (x / 2), _out + (x * 4), _width - x);
+}
+
+static SSSE3 void rowNV12_ssse3(const unsigned char *_y, const unsigned char *_uv, const unsigned char *_unused,
+								unsigned char *_out, unsigned int _width) {
+	const __m128i yMask = _mm_setr_epi8(0, Z, 1, Z, 2, Z, 3, Z, 4, Z, 5, Z, 6, Z, 7, Z);
+	const __m128i uMask = _mm_setr_epi8(0, Z, 0, Z, 2, Z, 2, Z, 4, Z, 4, Z, 6, Z, 6, Z);
+	const __m128i vMask = _mm_setr_epi8(1, Z, 1, Z, 3, Z, 3, Z, 5, Z, 5, Z, 7, Z, 7, Z);
+	const __m128i yOffset = _mm_set1_epi16(16);
+	const __m128i uvOffset = _mm_set1_epi16(128);
+	unsigned int x;
+
+	for (x = 0; x + 8 <= _width; x += 8) {
+		__m128i y = _mm_shuffle_epi8(_mm_loadl_epi64((const __m128i *) (_y + x)), yMask);
+		__m128i uv = _mm_loadl_epi64((const __m128i *) (_uv + x));
+		__m128i u = _mm_shuffle_epi8(uv, uMask);
+		__m128i v = _mm_shuffle_epi8(uv, vMask);
+
+		storeRgba8(_mm_sub_epi16(y, yOffset), _mm_sub_epi16(u, uvOffset), _mm_sub_epi16(v, uvOffset), _out + (x * 4));
+	}
+	ColorConvert_rowNV12(_y + x, _uv + x, NULL, _out + (x * 4), _width - x);
+}
+
+/**
+ * Packed 4:2:2 with the byte offsets of Y0, U and V in the first pair.
+ */
+static inline SSSE3 void rowPacked_ssse3(const unsigned char *_src, unsigned char *_out, unsigned int _width,
+										 char _y, char _u, char _v) {
+	const __m128i yMask = _mm_setr_epi8(_y, Z, _y + 2, Z, _y + 4, Z, _y + 6, Z,
+										_y + 8, Z, _y + 10, Z, _y + 12, Z, _y + 14, Z);
+	const __m128i uMask = _mm_setr_epi8(_u, Z, _u, Z, _u + 4, Z, _u + 4, Z,
+										_u + 8, Z, _u + 8, Z, _u + 12, Z, _u + 12, Z);
+	const __m128i vMask = _mm_setr_epi8(_v, Z, _v, Z, _v + 4, Z, _v + 4, Z,
+										_v + 8, Z, _v + 8, Z, _v + 12, Z, _v + 12, Z);
+	const __m128i yOffset = _mm_set1_epi16(16);
+	const __m128i uvOffset = _mm_set1_epi16(128);
+	unsigned int x;
+
+	for (x = 0; x + 8 <= _width; x += 8) {
+		__m128i raw = _mm_loadu_si128((const __m128i *) (_src + (x * 2)));
+
+		storeRgba8(_mm_sub_epi16(_mm_shuffle_epi8(raw, yMask), yOffset),
+				   _mm_sub_epi16(_mm_shuffle_epi8(raw, uMask), uvOffset),
+				   _mm_sub_epi16(_mm_shuffle_epi8(raw, vMask), uvOffset), _out + (x * 4));
+	}
+}
+
+static SSSE3 void rowYUYV_ssse3(const unsigned char *_src, const unsigned char *_unused1, const unsigned char *_unused2,
+								unsigned char *_out, unsigned int _width) {
+	unsigned int x = _width & ~7u;
+	rowPacked_ssse3(_src, _out, _width, 0, 1, 3);
+	ColorConvert_rowYUYV(_src + (x * 2), NULL, NULL, _out + (x * 4), _width - x);
+}
+
+static SSSE3 void rowUYVY_ssse3(const unsigned char *_src, const unsigned char *_unused1, const unsigned char *_unused2,
+								unsigned char *_out, unsigned int _width) {
+	unsigned int x = _width & ~7u;
+	rowPacked_ssse3(_src, _out, _width, 1, 0, 2);
+	ColorConvert_rowUYVY(_src + (x * 2), NULL, NULL, _out + (x * 4), _width - x);
+}
+
+static SSSE3 void rowYVYU_ssse3(const unsigned char *_src, const unsigned char *_unused1, const unsigned char *_unused2,
+								unsigned char *_out, unsigned int _width) {
+	unsigned int x = _width & ~7u;
+	rowPacked_ssse3(_src, _out, _width, 0, 3, 1);
+	ColorConvert_rowYVYU(_src + (x * 2), NULL, NULL, _out + (x * 4), _width - x);
+}
+
+static SSSE3 void rowVYUY_ssse3(const unsigned char *_src, const unsigned char *_unused1, const unsigned char *_unused2,
+								unsigned char *_out, unsigned int _width) {
+	unsigned int x = _width & ~7u;
+	rowPacked_ssse3(_src, _out, _width, 1, 2, 0);
+	ColorConvert_rowVYUY(_src + (x * 2), NULL, NULL, _out + (x * 4), _width - x);
+}
+
+// AVX2: 16 pixels, 8 per 128 bit lane, so the in-lane shuffles stay as in SSSE3
+
+static inline AVX2 __m256i lanes(__m128i _low, __m128i _high) {
+	return _mm256_inserti128_si256(_mm256_castsi128_si256(_low), _high, 1);
+}
+
+static AVX2 void rowYV16_avx2(const unsigned char *_y, const unsigned char *_u, const unsigned char *_v,
+							  unsigned char *_out, unsigned int _width) {
+	const __m256i chromaMask = lanes(_mm_setr_epi8(0, Z, 0, Z, 1, Z, 1, Z, 2, Z, 2, Z, 3, Z, 3, Z),
+									 _mm_setr_epi8(4, Z, 4, Z, 5, Z, 5, Z, 6, Z, 6, Z, 7, Z, 7, Z));
+	const __m256i yOffset = _mm256_set1_epi16(16);
+	const __m256i uvOffset = _mm256_set1_epi16(128);
+	unsigned int x;
+
+	for (x = 0; x + 16 <= _width; x += 16) {
+		__m256i y = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) (_y + x)));
+		__m128i u8 = _mm_loadl_epi64((const __m128i *) (_u + (x / 2)));
+		__m128i v8 = _mm_loadl_epi64((const __m128i *) (_v + (x / 2)));
+		__m256i u = _mm256_shuffle_epi8(lanes(u8, u8), chromaMask);
+		__m256i v = _mm256_shuffle_epi8(lanes(v8, v8), chromaMask);
+
+		storeRgba16(_mm256_sub_epi16(y, yOffset), _mm256_sub_epi16(u, uvOffset), _mm256_sub_epi16(v, uvOffset),
+					_out + (x * 4));
+	}
+	rowYV16_ssse3(_y + x, _u + (x / 2), _v + (x / 2), _out + (x * 4), _width - x);
+}
+
+static AVX2 void rowNV12_avx2(const unsigned char *_y, const unsigned char *_uv, const unsigned char *_unused,
+							  unsigned char *_out, unsigned int _width) {
+	const __m256i uMask = lanes(_mm_setr_epi8(0, Z, 0, Z, 2, Z, 2, Z, 4, Z, 4, Z, 6, Z, 6, Z),
+								_mm_setr_epi8(8, Z, 8, Z, 10, Z, 10, Z, 12, Z, 12, Z, 14, Z, 14, Z));
+	const __m256i vMask = lanes(_mm_setr_epi8(1, Z, 1, Z, 3, Z, 3, Z, 5, Z, 5, Z, 7, Z, 7, Z),
+								_mm_setr_epi8(9, Z, 9, Z, 11, Z, 11, Z, 13, Z, 13, Z, 15, Z, 15, Z));
+	const __m256i yOffset = _mm256_set1_epi16(16);
+	const __m256i uvOffset = _mm256_set1_epi16(128);
+	unsigned int x;
+
+	for (x = 0; x + 16 <= _width; x += 16) {
+		__m256i y = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) (_y + x)));
+		__m256i uv = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) (_uv + x)));
+		__m256i u = _mm256_shuffle_epi8(uv, uMask);
+		__m256i v = _mm256_shuffle_epi8(uv, vMask);
+
+		storeRgba16(_mm256_sub_epi16(y, yOffset), _mm256_sub_epi16(u, uvOffset), _mm256_sub_epi16(v, uvOffset),
+					_out + (x * 4));
+	}
+	rowNV12_ssse3(_y + x, _uv + x, NULL, _out + (x * 4), _width - x);
+}
+
+static inline AVX2 void rowPacked_avx2(const unsigned char *_src, unsigned char *_out, unsigned int _width,
+									   char _y, char _u, char _v) {
+	const __m128i yMask = _mm_setr_epi8(_y, Z, _y + 2, Z, _y + 4, Z, _y + 6, Z,
+										_y + 8, Z, _y + 10, Z, _y + 12, Z, _y + 14, Z);
+	const __m128i uMask = _mm_setr_epi8(_u, Z, _u, Z, _u + 4, Z, _u + 4, Z,
+										_u + 8, Z, _u + 8, Z, _u + 12, Z, _u + 12, Z);
+	const __m128i vMask = _mm_setr_epi8(_v, Z, _v, Z, _v + 4, Z, _v + 4, Z,
+										_v + 8, Z, _v + 8, Z, _v + 12, Z, _v + 12, Z);
+	const __m256i yMask2 = lanes(yMask, yMask);
+	const __m256i uMask2 = lanes(uMask, uMask);
+	const __m256i vMask2 = lanes(vMask, vMask);
+	const __m256i yOffset = _mm256_set1_epi16(16);
+	const __m256i uvOffset = _mm256_set1_epi16(128);
+	unsigned int x;
+
+	for (x = 0; x + 16 <= _width; x += 16) {
+		// 32 bytes are 16 pixels; each lane holds 8 whole ones
+		__m256i raw = _mm256_loadu_si256((const __m256i *) (_src + (x * 2)));
+
+		storeRgba16(_mm256_sub_epi16(_mm256_shuffle_epi8(raw, yMask2), yOffset),
+					_mm256_sub_epi16(_mm256_shuffle_epi8(raw, uMask2), uvOffset),
+					_mm256_sub_epi16(_mm256_shuffle_epi8(raw, vMask2), uvOffset), _out + (x * 4));
+	}
+}
+
+static AVX2 void rowYUYV_avx2(const unsigned char *_src, const unsigned char *_unused1, const unsigned char *_unused2,
+							  unsigned char *_out, unsigned int _width) {
+	unsigned int x = _width & ~15u;
+	rowPacked_avx2(_src, _out, _width, 0, 1, 3);
+	rowYUYV_ssse3(_src + (x * 2), NULL, NULL, _out + (x * 4), _width - x);
+}
+
+static AVX2 void rowUYVY_avx2(const unsigned char *_src, const unsigned char *_unused1, const unsigned char *_unused2,
+							  unsigned char *_out, unsigned int _width) {
+	unsigned int x = _width & ~15u;
+	rowPacked_avx2(_src, _out, _width, 1, 0, 2);
+	rowUYVY_ssse3(_src + (x * 2), NULL, NULL, _out + (x * 4), _width - x);
+}
+
+static AVX2 void rowYVYU_avx2(const unsigned char *_src, const unsigned char *_unused1, const unsigned char *_unused2,
+							  unsigned char *_out, unsigned int _width) {
+	unsigned int x = _width & ~15u;
+	rowPacked_avx2(_src, _out, _width, 0, 3, 1);
+	rowYVYU_ssse3(_src + (x * 2), NULL, NULL, _out + (x * 4), _width - x);
+}
+
+static AVX2 void rowVYUY_avx2(const unsigned char *_src, const unsigned char *_unused1, const unsigned char *_unused2,
+							  unsigned char *_out, unsigned int _width) {
+	unsigned int x = _width & ~15u;
+	rowPacked_avx2(_src, _out, _width, 1, 2, 0);
+	rowVYUY_ssse3(_src + (x * 2), NULL, NULL, _out + (x * 4), _width - x);
+}
+
+/**
+ * Indexed by PixelFormat_t and ConvertIsa_t; NULL where there is no kernel.
+ */
+static const ConvertRow_t KERNELS[][CONVERT_ISA_BEST + 1] = {
+	[YVYU] = { NULL, rowYVYU_sse2, rowYVYU_ssse3, rowYVYU_avx2 },
+	[YUYV] = { NULL, rowYUYV_sse2, rowYUYV_ssse3, rowYUYV_avx2 },
+	[UYVY] = { NULL, rowUYVY_sse2, rowUYVY_ssse3, rowUYVY_avx2 },
+	[VYUY] = { NULL, rowVYUY_sse2, rowVYUY_ssse3, rowVYUY_avx2 },
+	[YV16] = { NULL, rowYV16_sse2, rowYV16_ssse3, rowYV16_avx2 },
+	[NV12] = { NULL, rowNV12_sse2, rowNV12_ssse3, rowNV12_avx2 }
+};
+
+/**
+ * The kernel for _format written for exactly _isa; the caller checks the
+ * CPU runs it.
+ */
+ConvertRow_t ColorConvert_x86Row(PixelFormat_t _format, ConvertIsa_t _isa) {
+	if ((unsigned int) _format >= sizeof(KERNELS) / sizeof(KERNELS[0]) || (unsigned int) _isa > CONVERT_ISA_BEST) {
+		return NULL;
+	}
+
+	return KERNELS[_format][_isa];
+}
+
+#endif /* __i386__ || __x86_64__ */
@@ -0,0 +1,246 @@
+/**
+	This file is part of Intel Atom ISP Test App.
+
+	Intel Atom ISP Test App is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Intel Atom ISP Test App is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Intel Atom ISP Test App.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "demosaic.h"
+#include "demosaic_kernels.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static inline unsigned int sampleAt(const uint16_t *_row, int _x, int _width) {
+	// mirrored, so a sample past the edge has the color of the one it stands for
+	if (_x < 0) {
+		_x = -_x;
+	} else if (_x >= _width) {
+		_x = (2 * _width) - 2 - _x;
+	}
+
+	return _row[_x] & DEMOSAIC_MASK;
+}
+
+static inline unsigned char level(int _sample, int _black, int _gain) {
+	int value = (((_sample - _black) * _gain) + DEMOSAIC_ROUND) >> DEMOSAIC_SHIFT;
+	return (value < 0) ? 0 : ((value > 255) ? 255 : (unsigned char) value);
+}
+
+void Demosaic_span(const uint16_t *_above, const uint16_t *_row, const uint16_t *_below, bool _isBlueRow,
+				   unsigned char *_out, unsigned int _width, const DemosaicLevels *_levels,
+				   unsigned int _from, unsigned int _to) {
+	int black = _levels->blackLevel;
+	int x, width = _width;
+
+	for (x = _from; x < (int) _to; x++) {
+		unsigned int c = sampleAt(_row, x, width);
+		unsigned int across = (sampleAt(_row, x - 1, width) + sampleAt(_row, x + 1, width) + 1) >> 1;
+		unsigned int upDown = (sampleAt(_above, x, width) + sampleAt(_below, x, width) + 1) >> 1;
+		unsigned int cross = (sampleAt(_row, x - 1, width) + sampleAt(_row, x + 1, width) +
+							  sampleAt(_above, x, width) + sampleAt(_below, x, width) + 2) >> 2;
+		unsigned int diagonal = (sampleAt(_above, x - 1, width) + sampleAt(_above, x + 1, width) +
+								 sampleAt(_below, x - 1, width) + sampleAt(_below, x + 1, width) + 2) >> 2;
+		unsigned int r, g, b;
+
+		if (!_isBlueRow) {
+			if ((x & 1) == 0) {		// G, R to the sides
+				r = across;
+				g = c;
+				b = upDown;
+			} else {				// R
+				r = c;
+				g = cross;
+				b = diagonal;
+			}
+		} else {
+			if ((x & 1) == 0) {		// B
+				r = diagonal;
+				g = cross;
+				b = c;
+			} else {				// G, B to the sides
+				r = upDown;
+				g = c;
+				b = across;
+			}
+		}
+
+		unsigned char *out = _out + (x * 4);
+		out[0] = level(r, black, _levels->gains[0]);
+		out[1] = level(g, black, _levels->gains[1]);
+		out[2] = level(b, black, _levels->gains[2]);
+		out[3] = 255;
+	}
+}
+
+static void scalarRow(const uint16_t *_above, const uint16_t *_row, const uint16_t *_below, bool _isBlueRow,
+					  unsigned char *_out, unsigned int _width, const DemosaicLevels *_levels) {
+	Demosaic_span(_above, _row, _below, _isBlueRow, _out, _width, _levels, 0, _width);
+}
+
+static void demosaicBand(void *_arg, unsigned int _first, unsigned int _end) {
+	Demosaic *self = (Demosaic *) _arg;
+	const VideoPlane *plane = self->plane;
+	unsigned int y;
+
+	for (y = _first; y < _end; y++) {
+		// the row past the edge is the mirrored one, of the same colors
+		unsigned int above = (y == 0) ? 1 : y - 1;
+		unsigned int below = (y + 1 == plane->height) ? y - 1 : y + 1;
+
+		self->demosaicRow((const uint16_t *) (plane->data + (above * plane->bytesperline)),
+						  (const uint16_t *) (plane->data + (y * plane->bytesperline)),
+						  (const uint16_t *) (plane->data + (below * plane->bytesperline)),
+						  (y & 1) != 0, self->rgba + (y * self->stride), plane->width, &self->levels);
+	}
+}
+
+/**
+ * The job demosaicing _plane into _rgba, _stride bytes per row, at least
+ * 4 * width; NULL (and error set) for sizes it cannot demosaic. The frame
+ * stays this object's until the job is done.
+ */
+static WorkerJob *prepare(Demosaic *self, const VideoPlane *_plane, unsigned char *_rgba, unsigned int _stride) {
+	if (_plane->width < 2 || _plane->height < 2 || (_plane->width & 1) != 0 || (_plane->height & 1) != 0) {
+		sprintf(self->error, "Cannot demosaic %ux%u; needs an even size of at least 2x2.", _plane->width, _plane->height);
+		return NULL;
+	}
+
+	self->plane = _plane;
+	self->rgba = _rgba;
+	self->stride = _stride;
+	self->job->rowsCount = _plane->height;
+	return self->job;
+}
+
+/**
+ * Demosaics _plane into _rgba and returns when done; no stage is chained.
+ */
+static int demosaic(Demosaic *self, const VideoPlane *_plane, unsigned char *_rgba, unsigned int _stride) {
+	WorkerJob *job = prepare(self, _plane, _rgba, _stride);
+	if (job == NULL) {
+		return 0;
+	}
+
+	if (self->pool != NULL) {
+		WorkerJob_chain(job, NULL, 0);
+		self->pool->submit(self->pool, job);
+		self->pool->wait(self->pool, job);
+	} else {
+		demosaicBand(self, 0, job->rowsCount);
+	}
+
+	return 1;
+}
+
+static void setLevels(Demosaic *self, const DemosaicLevels *_levels) {
+	self->levels = *_levels;
+}
+
+static void setPool(Demosaic *self, WorkerPool *_pool) {
+	self->pool = _pool;
+}
+
+void Demosaic_defaultLevels(DemosaicLevels *_levels) {
+	_levels->blackLevel = DEMOSAIC_DEFAULT_BLACK;
+	_levels->gains[0] = DEMOSAIC_GAIN_ONE;
+	_levels->gains[1] = DEMOSAIC_GAIN_ONE;
+	_levels->gains[2] = DEMOSAIC_GAIN_ONE;
+}
+
+/**
+ * Parses black[,r,g,b]: the black level in 10 bit units, then the white
+ * balance gains as decimals, e.g. 64,1.9,1.0,1.6. Omitted gains stay 1.
+ */
+bool Demosaic_parseLevels(const char *_spec, DemosaicLevels *_levels) {
+	unsigned int black;
+	float gains[3] = { 1.0f, 1.0f, 1.0f };
+	char extra;
+
+	int count = sscanf(_spec, "%u,%f,%f,%f%c", &black, &gains[0], &gains[1], &gains[2], &extra);
+	if (count != 1 && count != 4) {
+		return false;
+	}
+	if (black > DEMOSAIC_MASK) {
+		return false;
+	}
+
+	unsigned int i;
+	for (i = 0; i < 3; i++) {
+		if (gains[i] < 0.0f || gains[i] * DEMOSAIC_GAIN_ONE > DEMOSAIC_GAIN_MAX) {
+			return false;
+		}
+	}
+
+	_levels->blackLevel = black;
+	for (i = 0; i < 3; i++) {
+		_levels->gains[i] = (unsigned int) ((gains[i] * DEMOSAIC_GAIN_ONE) + 0.5f);
+	}
+	return true;
+}
+
+static void Demosaic_init(Demosaic *self, ConvertIsa_t _maxIsa) {
+	self->isa = CONVERT_ISA_SCALAR;
+	self->demosaicRow = scalarRow;
+	self->pool = NULL;
+	self->job = WorkerJob_newWith(demosaicBand, self, 0);
+	self->error = (char *) calloc(256, sizeof(char));
+	self->plane = NULL;
+	self->rgba = NULL;
+	self->stride = 0;
+	Demosaic_defaultLevels(&self->levels);
+
+	// methods
+	self->setLevels = setLevels;
+	self->setPool = setPool;
+	self->prepare = prepare;
+	self->demosaic = demosaic;
+
+	ConvertIsa_t isa = ColorConvert_cpuIsa();
+	if (isa > _maxIsa) {
+		isa = _maxIsa;
+	}
+
+	// the fastest kernel there is, down to the scalar one
+#if defined(__i386__) || defined(__x86_64__)
+	for (; isa > CONVERT_ISA_SCALAR; isa--) {
+		DemosaicRow_t row = Demosaic_x86Row(isa);
+		if (row != NULL) {
+			self->demosaicRow = row;
+			self->isa = isa;
+			return;
+		}
+	}
+#endif
+}
+
+/**
+ * Picks the fastest kernel up to _maxIsa that the CPU runs, with the
+ * default levels and no pool.
+ */
+Demosaic *Demosaic_newWith(ConvertIsa_t _maxIsa) {
+	Demosaic *demosaic = (Demosaic *) calloc(1, sizeof(Demosaic));
+	Demosaic_init(demosaic, _maxIsa);
+	return demosaic;
+}
+
+void Demosaic_dispose(Demosaic *self) {
+	if (self == NULL) {
+		return;
+	}
+
+	WorkerJob_dispose(self->job);
+	free(self->error);
+	free(self);
+}
@@ -0,0 +1,79 @@
+/**
+	This file is part of Intel Atom ISP Test App.
+
+	Intel Atom ISP Test App is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Intel Atom ISP Test App is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Intel Atom ISP Test App.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DEMOSAIC_H_
+#define DEMOSAIC_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "video.h"
+#include "color_convert.h"
+#include "worker_pool.h"
+
+#define DEMOSAIC_GAIN_ONE 256		/* gains are in 1/256 */
+#define DEMOSAIC_GAIN_MAX 4095
+#define DEMOSAIC_DEFAULT_BLACK 64	/* 10 bit pedestal of most sensors */
+
+/**
+ * Applied to the interpolated 10 bit samples before they are cut to 8 bits.
+ */
+typedef struct DEMOSAIC_LEVELS_S {
+	unsigned int blackLevel;
+	unsigned int gains[3];		/* R, G, B in DEMOSAIC_GAIN_ONE units */
+} DemosaicLevels;
+
+/**
+ * Demosaics one row of _width samples to RGBA. The rows are the one above,
+ * the row itself and the one below; the bool is true on the B G rows.
+ */
+typedef void (*DemosaicRow_t) (const uint16_t *, const uint16_t *, const uint16_t *, bool,
+							   unsigned char *, unsigned int, const DemosaicLevels *);
+
+/**
+ * Turns BA10 (SGRBG10: G R / B G, 10 bits in 16) frames into RGBA, 8 bits
+ * per channel with alpha 255, by bilinear interpolation. Edges mirror the
+ * frame, so a frame needs an even width and height of at least 2.
+ *
+ * With a pool the rows are split in tiles over its threads. prepare()
+ * gives the job of one frame, for chaining other stages after it.
+ */
+typedef struct DEMOSAIC_S {
+	ConvertIsa_t isa;		/* of the kernel in use */
+	DemosaicRow_t demosaicRow;
+	DemosaicLevels levels;
+	WorkerPool *pool;		/* not owned; NULL runs on the calling thread */
+	WorkerJob *job;
+	char *error;
+
+	// the frame prepared
+	const VideoPlane *plane;
+	unsigned char *rgba;
+	unsigned int stride;
+
+	void (*setLevels) (struct DEMOSAIC_S *, const DemosaicLevels *);
+	void (*setPool) (struct DEMOSAIC_S *, WorkerPool *);
+	WorkerJob *(*prepare) (struct DEMOSAIC_S *, const VideoPlane *, unsigned char *, unsigned int);
+	int (*demosaic) (struct DEMOSAIC_S *, const VideoPlane *, unsigned char *, unsigned int);
+} Demosaic;
+
+void Demosaic_defaultLevels(DemosaicLevels *);
+bool Demosaic_parseLevels(const char *, DemosaicLevels *);
+Demosaic *Demosaic_newWith(ConvertIsa_t);
+void Demosaic_dispose(Demosaic *);
+
+#endif /* DEMOSAIC_H_ */
@@ -0,0 +1,42 @@
+/**
+	This file is part of Intel Atom ISP Test App.
+
+	Intel Atom ISP Test App is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Intel Atom ISP Test App is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Intel Atom ISP Test App.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DEMOSAIC_KERNELS_H_
+#define DEMOSAIC_KERNELS_H_
+
+#include "demosaic.h"
+
+/**
+ * Every kernel computes, per channel,
+ *
+ *   out = clamp(((sample - blackLevel) * gain + DEMOSAIC_ROUND) >> DEMOSAIC_SHIFT)
+ *
+ * from samples masked to 10 bits and averaged as (a + b + 1) >> 1 or
+ * (a + b + c + d + 2) >> 2, so they all give the same bytes. The shift takes
+ * out the gain's 8 fraction bits and the 2 bits from 10 down to 8.
+ */
+#define DEMOSAIC_SHIFT 10
+#define DEMOSAIC_ROUND (1 << (DEMOSAIC_SHIFT - 1))
+#define DEMOSAIC_MASK 0x3ff
+
+// scalar columns [_from, _to) of a row; the SIMD kernels do the edges with it
+void Demosaic_span(const uint16_t *, const uint16_t *, const uint16_t *, bool, unsigned char *,
+				   unsigned int, const DemosaicLevels *, unsigned int, unsigned int);
+
+DemosaicRow_t Demosaic_x86Row(ConvertIsa_t);
+
+#endif /* DEMOSAIC_KERNELS_H_ */
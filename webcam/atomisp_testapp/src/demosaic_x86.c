@@ -0,0 +1,287 @@
+/**
+	This file is part of Intel Atom ISP Test App.
+
+	Intel Atom ISP Test App is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Intel Atom ISP Test App is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Intel Atom ISP Test App.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * SSE2 and AVX2 demosaic kernels, compiled for their instruction sets
+ * through target attributes like the conversion kernels.
+ *
+ * A block splits the samples of the rows above, at and below it into even
+ * and odd columns, so every interpolation is an average of whole vectors:
+ * the columns at x - 2 and x + 2 give the neighbours to the left and right.
+ * The levels are the sums of demosaic_kernels.h, formed with pmaddwd.
+ */
+
+#include "demosaic_kernels.h"
+
+#if defined(__i386__) || defined(__x86_64__)
+
+#include <immintrin.h>
+
+#define SSE2 __attribute__((target("sse2")))
+#define AVX2 __attribute__((target("avx2")))
+
+/**
+ * Even and odd columns of 16 samples from _src, masked to 10 bits.
+ */
+static inline SSE2 void split8(const uint16_t *_src, __m128i *_even, __m128i *_odd) {
+	const __m128i mask = _mm_set1_epi32(DEMOSAIC_MASK);
+	__m128i a = _mm_loadu_si128((const __m128i *) _src);
+	__m128i b = _mm_loadu_si128((const __m128i *) (_src + 8));
+
+	*_even = _mm_packs_epi32(_mm_and_si128(a, mask), _mm_and_si128(b, mask));
+	*_odd = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(a, 16), mask), _mm_and_si128(_mm_srli_epi32(b, 16), mask));
+}
+
+static inline SSE2 __m128i average4(__m128i _a, __m128i _b, __m128i _c, __m128i _d) {
+	__m128i sum = _mm_add_epi16(_mm_add_epi16(_a, _b), _mm_add_epi16(_c, _d));
+	return _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(2)), 2);
+}
+
+/**
+ * (sample - black) * gain + round, shifted, as 16 bit lanes; _gainRound
+ * holds (gain, DEMOSAIC_ROUND) pairs.
+ */
+static inline SSE2 __m128i level8(__m128i _sample, __m128i _black, __m128i _gainRound) {
+	const __m128i one = _mm_set1_epi16(1);
+	__m128i value = _mm_sub_epi16(_sample, _black);
+	__m128i lo = _mm_madd_epi16(_mm_unpacklo_epi16(value, one), _gainRound);
+	__m128i hi = _mm_madd_epi16(_mm_unpackhi_epi16(value, one), _gainRound);
+
+	return _mm_packs_epi32(_mm_srai_epi32(lo, DEMOSAIC_SHIFT), _mm_srai_epi32(hi, DEMOSAIC_SHIFT));
+}
+
+/**
+ * Interleaves the even and odd columns of a channel back into 16 bytes.
+ */
+static inline SSE2 __m128i merge8(__m128i _even, __m128i _odd) {
+	return _mm_packus_epi16(_mm_unpacklo_epi16(_even, _odd), _mm_unpackhi_epi16(_even, _odd));
+}
+
+static inline SSE2 void storeRgba(__m128i _r, __m128i _g, __m128i _b, unsigned char *_out) {
+	const __m128i alpha = _mm_set1_epi8(-1);
+	__m128i rgLo = _mm_unpacklo_epi8(_r, _g);
+	__m128i rgHi = _mm_unpackhi_epi8(_r, _g);
+	__m128i baLo = _mm_unpacklo_epi8(_b, alpha);
+	__m128i baHi = _mm_unpackhi_epi8(_b, alpha);
+
+	_mm_storeu_si128((__m128i *) _out, _mm_unpacklo_epi16(rgLo, baLo));
+	_mm_storeu_si128((__m128i *) (_out + 16), _mm_unpackhi_epi16(rgLo, baLo));
+	_mm_storeu_si128((__m128i *) (_out + 32), _mm_unpacklo_epi16(rgHi, baHi));
+	_mm_storeu_si128((__m128i *) (_out + 48), _mm_unpackhi_epi16(rgHi, baHi));
+}
+
+/**
+ * Columns [_x, _x + 16); reads from _x - 2 to _x + 18.
+ */
+static inline SSE2 void block_sse2(const uint16_t *_above, const uint16_t *_row, const uint16_t *_below, bool _isBlueRow,
+								   unsigned char *_out, unsigned int _x, const __m128i *_black, const __m128i *_gains) {
+	__m128i aE, aO, aEn, aOp, cE, cO, cEn, cOp, dE, dO, dEn, dOp, unused;
+	__m128i rE, gE, bE, rO, gO, bO;
+
+	split8(_above + _x, &aE, &aO);
+	split8(_above + _x + 2, &aEn, &unused);
+	split8(_above + _x - 2, &unused, &aOp);
+	split8(_row + _x, &cE, &cO);
+	split8(_row + _x + 2, &cEn, &unused);
+	split8(_row + _x - 2, &unused, &cOp);
+	split8(_below + _x, &dE, &dO);
+	split8(_below + _x + 2, &dEn, &unused);
+	split8(_below + _x - 2, &unused, &dOp);
+
+	if (!_isBlueRow) {
+		// G R: even columns are G, odd ones R
+		rE = _mm_avg_epu16(cOp, cO);
+		gE = cE;
+		bE = _mm_avg_epu16(aE, dE);
+		rO = cO;
+		gO = average4(cE, cEn, aO, dO);
+		bO = average4(aE, aEn, dE, dEn);
+	} else {
+		// B G: even columns are B, odd ones G
+		rE = average4(aOp, aO, dOp, dO);
+		gE = average4(cOp, cO, aE, dE);
+		bE = cE;
+		rO = _mm_avg_epu16(aO, dO);
+		gO = cO;
+		bO = _mm_avg_epu16(cE, cEn);
+	}
+
+	storeRgba(merge8(level8(rE, *_black, _gains[0]), level8(rO, *_black, _gains[0])),
+			  merge8(level8(gE, *_black, _gains[1]), level8(gO, *_black, _gains[1])),
+			  merge8(level8(bE, *_black, _gains[2]), level8(bO, *_black, _gains[2])), _out + (_x * 4));
+}
+
+static SSE2 void row_sse2(const uint16_t *_above, const uint16_t *_row, const uint16_t *_below, bool _isBlueRow,
+						  unsigned char *_out, unsigned int _width, const DemosaicLevels *_levels) {
+	const __m128i black = _mm_set1_epi16(_levels->blackLevel);
+	const __m128i gains[3] = {
+		_mm_set1_epi32((DEMOSAIC_ROUND << 16) | _levels->gains[0]),
+		_mm_set1_epi32((DEMOSAIC_ROUND << 16) | _levels->gains[1]),
+		_mm_set1_epi32((DEMOSAIC_ROUND << 16) | _levels->gains[2])
+	};
+	unsigned int x;
+
+	// the first two columns mirror the left edge
+	Demosaic_span(_above, _row, _below, _isBlueRow, _out, _width, _levels, 0, 2);
+	for (x = 2; x + 18 <= _width; x += 16) {
+		block_sse2(_above, _row, _below, _isBlueRow, _out, x, &black, gains);
+	}
+	Demosaic_span(_above, _row, _below, _isBlueRow, _out, _width, _levels, x, _width);
+}
+
+/**
+ * As split8 for 32 samples. packs works within lanes, so the columns come
+ * out in lane order; merge16 puts them back.
+ */
+static inline AVX2 void split16(const uint16_t *_src, __m256i *_even, __m256i *_odd) {
+	const __m256i mask = _mm256_set1_epi32(DEMOSAIC_MASK);
+	__m256i a = _mm256_loadu_si256((const __m256i *) _src);
+	__m256i b = _mm256_loadu_si256((const __m256i *) (_src + 16));
+
+	*_even = _mm256_packs_epi32(_mm256_and_si256(a, mask), _mm256_and_si256(b, mask));
+	*_odd = _mm256_packs_epi32(_mm256_and_si256(_mm256_srli_epi32(a, 16), mask),
+							   _mm256_and_si256(_mm256_srli_epi32(b, 16), mask));
+}
+
+static inline AVX2 __m256i average4_avx2(__m256i _a, __m256i _b, __m256i _c, __m256i _d) {
+	__m256i sum = _mm256_add_epi16(_mm256_add_epi16(_a, _b), _mm256_add_epi16(_c, _d));
+	return _mm256_srli_epi16(_mm256_add_epi16(sum, _mm256_set1_epi16(2)), 2);
+}
+
+static inline AVX2 __m256i level16(__m256i _sample, __m256i _black, __m256i _gainRound) {
+	const __m256i one = _mm256_set1_epi16(1);
+	__m256i value = _mm256_sub_epi16(_sample, _black);
+	__m256i lo = _mm256_madd_epi16(_mm256_unpacklo_epi16(value, one), _gainRound);
+	__m256i hi = _mm256_madd_epi16(_mm256_unpackhi_epi16(value, one), _gainRound);
+
+	return _mm256_packs_epi32(_mm256_srai_epi32(lo, DEMOSAIC_SHIFT), _mm256_srai_epi32(hi, DEMOSAIC_SHIFT));
+}
+
+/**
+ * 32 bytes of a channel; lane 0 holds columns 0-7 and 16-23, lane 1 the
+ * columns 8-15 and 24-31, which storeRgba16 sorts out.
+ */
+static inline AVX2 __m256i merge16(__m256i _even, __m256i _odd) {
+	return _mm256_packus_epi16(_mm256_unpacklo_epi16(_even, _odd), _mm256_unpackhi_epi16(_even, _odd));
+}
+
+static inline AVX2 void storeRgba16(__m256i _r, __m256i _g, __m256i _b, unsigned char *_out) {
+	const __m256i alpha = _mm256_set1_epi8(-1);
+	__m256i rgLo = _mm256_unpacklo_epi8(_r, _g);
+	__m256i rgHi = _mm256_unpackhi_epi8(_r, _g);
+	__m256i baLo = _mm256_unpacklo_epi8(_b, alpha);
+	__m256i baHi = _mm256_unpackhi_epi8(_b, alpha);
+
+	// pixels 0-3 | 8-11, 4-7 | 12-15, 16-19 | 24-27, 20-23 | 28-31
+	__m256i q0 = _mm256_unpacklo_epi16(rgLo, baLo);
+	__m256i q1 = _mm256_unpackhi_epi16(rgLo, baLo);
+	__m256i q2 = _mm256_unpacklo_epi16(rgHi, baHi);
+	__m256i q3 = _mm256_unpackhi_epi16(rgHi, baHi);
+
+	_mm256_storeu_si256((__m256i *) _out, _mm256_permute2x128_si256(q0, q1, 0x20));
+	_mm256_storeu_si256((__m256i *) (_out + 32), _mm256_permute2x128_si256(q0, q1, 0x31));
+	_mm256_storeu_si256((__m256i *) (_out + 64), _mm256_permute2x128_si256(q2, q3, 0x20));
+	_mm256_storeu_si256((__m256i *) (_out + 96), _mm256_permute2x128_si256(q2, q3, 0x31));
+}
+
+/**
+ * Columns [_x, _x + 32); reads from _x - 2 to _x + 34.
+ */
+static inline AVX2 void block_avx2(const uint16_t *_above, const uint16_t *_row, const uint16_t *_below, bool _isBlueRow,
+								   unsigned char *_out, unsigned int _x, const __m256i *_black, const __m256i *_gains) {
+	__m256i aE, aO, aEn, aOp, cE, cO, cEn, cOp, dE, dO, dEn, dOp, unused;
+	__m256i rE, gE, bE, rO, gO, bO;
+
+	split16(_above + _x, &aE, &aO);
+	split16(_above + _x + 2, &aEn, &unused);
+	split16(_above + _x - 2, &unused, &aOp);
+	split16(_row + _x, &cE, &cO);
+	split16(_row + _x + 2, &cEn, &unused);
+	split16(_row + _x - 2, &unused, &cOp);
+	split16(_below + _x, &dE, &dO);
+	split16(_below + _x + 2, &dEn, &unused);
+	split16(_below + _x - 2, &unused, &dOp);
+
+	if (!_isBlueRow) {
+		rE = _mm256_avg_epu16(cOp, cO);
+		gE = cE;
+		bE = _mm256_avg_epu16(aE, dE);
+		rO = cO;
+		gO = average4_avx2(cE, cEn, aO, dO);
+		bO = average4_avx2(aE, aEn, dE, dEn);
+	} else {
+		rE = average4_avx2(aOp, aO, dOp, dO);
+		gE = average4_avx2(cOp, cO, aE, dE);
+		bE = cE;
+		rO = _mm256_avg_epu16(aO, dO);
+		gO = cO;
+		bO = _mm256_avg_epu16(cE, cEn);
+	}
+
+	storeRgba16(merge16(level16(rE, *_black, _gains[0]), level16(rO, *_black, _gains[0])),
+				merge16(level16(gE, *_black, _gains[1]), level16(gO, *_black, _gains[1])),
+				merge16(level16(bE, *_black, _gains[2]), level16(bO, *_black, _gains[2])), _out + (_x * 4));
+}
+
+static AVX2 void row_avx2(const uint16_t *_above, const uint16_t *_row, const uint16_t *_below, bool _isBlueRow,
+						  unsigned char *_out, unsigned int _width, const DemosaicLevels *_levels) {
+	const __m256i black = _mm256_set1_epi16(_levels->blackLevel);
+	const __m256i gains[3] = {
+		_mm256_set1_epi32((DEMOSAIC_ROUND << 16) | _levels->gains[0]),
+		_mm256_set1_epi32((DEMOSAIC_ROUND << 16) | _levels->gains[1]),
+		_mm256_set1_epi32((DEMOSAIC_ROUND << 16) | _levels->gains[2])
+	};
+	const __m128i black8 = _mm256_castsi256_si128(black);
+	const __m128i gains8[3] = {
+		_mm256_castsi256_si128(gains[0]),
+		_mm256_castsi256_si128(gains[1]),
+		_mm256_castsi256_si128(gains[2])
+	};
+	unsigned int x;
+
+	Demosaic_span(_above, _row, _below, _isBlueRow, _out, _width, _levels, 0, 2);
+	for (x = 2; x + 34 <= _width; x += 32) {
+		block_avx2(_above, _row, _below, _isBlueRow, _out, x, &black, gains);
+	}
+	for (; x + 18 <= _width; x += 16) {
+		block_sse2(_above, _row, _below, _isBlueRow, _out, x, &black8, gains8);
+	}
+	Demosaic_span(_above, _row, _below, _isBlueRow, _out, _width, _levels, x, _width);
+}
+
+/**
+ * Indexed by ConvertIsa_t; SSSE3 adds nothing to the SSE2 kernel.
+ */
+static const DemosaicRow_t KERNELS[CONVERT_ISA_BEST + 1] = {
+	[CONVERT_ISA_SCALAR] = NULL,
+	[CONVERT_ISA_SSE2] = row_sse2,
+	[CONVERT_ISA_SSSE3] = NULL,
+	[CONVERT_ISA_AVX2] = row_avx2
+};
+
+/**
+ * The kernel written for exactly _isa; the caller checks the CPU runs it.
+ */
+DemosaicRow_t Demosaic_x86Row(ConvertIsa_t _isa) {
+	if ((unsigned int) _isa > CONVERT_ISA_BEST) {
+		return NULL;
+	}
+
+	return KERNELS[_isa];
+}
+
+#endif /* __i386__ || __x86_64__ */
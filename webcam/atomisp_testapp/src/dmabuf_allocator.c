@@ -0,0 +1,513 @@
+/**
+	This file is part of Intel Atom ISP Test App.
+
+	Intel Atom ISP Test App is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Intel Atom ISP Test App is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Intel Atom ISP Test App.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+
+#include "dmabuf_allocator.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/types.h>
+
+#include <drm/drm.h>
+#include <xf86drm.h>
+#include <intel_bufmgr.h>
+#include <gbm.h>
+
+#define ERRSTR strerror(errno)
+#define CLEAR(x) memset(&(x), 0, sizeof(x))
+#define PAGE_ALIGN_TO(x, a) (((x) + ((a) - 1)) & ~((size_t) (a) - 1))
+
+#define UDMABUF_DEV "/dev/udmabuf"
+#define DMA_HEAP_DEV "/dev/dma_heap/system"
+#define RENDER_NODE_FMT "/dev/dri/renderD%d"
+#define RENDER_NODE_FIRST 128
+#define RENDER_NODE_COUNT 8
+#define INTEL_DRM_DEV "emgd"
+#define GBM_ROW_BYTES 4096
+
+// uapi of dma-buf sync, udmabuf and dma-heap, missing from kernel headers
+// older than 4.6, 4.20 and 5.6; the ABI is fixed
+#ifndef UDMABUF_CREATE
+struct udmabuf_create {
+	__u32 memfd;
+	__u32 flags;
+	__u64 offset;
+	__u64 size;
+};
+#define UDMABUF_FLAGS_CLOEXEC 0x01
+#define UDMABUF_CREATE _IOW('u', 0x42, struct udmabuf_create)
+#endif
+
+#ifndef DMA_HEAP_IOCTL_ALLOC
+struct dma_heap_allocation_data {
+	__u64 len;
+	__u32 fd;
+	__u32 fd_flags;
+	__u64 heap_flags;
+};
+#define DMA_HEAP_IOCTL_ALLOC _IOWR('H', 0x0, struct dma_heap_allocation_data)
+#endif
+
+#ifndef DMA_BUF_IOCTL_SYNC
+struct dma_buf_sync {
+	__u64 flags;
+};
+#define DMA_BUF_SYNC_READ (1 << 0)
+#define DMA_BUF_SYNC_START (0 << 2)
+#define DMA_BUF_SYNC_END (1 << 2)
+#define DMA_BUF_IOCTL_SYNC _IOW('b', 0, struct dma_buf_sync)
+#endif
+
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS 1033
+#define F_SEAL_SHRINK 0x0002
+#endif
+
+#ifndef MFD_ALLOW_SEALING
+#define MFD_ALLOW_SEALING 0x0002U
+#endif
+
+static const char *backendNames[] = { "auto", "udmabuf", "heap", "gbm", "intel" };
+
+bool DmaBufAllocator_parseBackend(const char *_name, DmaBufBackend_t *_backend) {
+	unsigned int i;
+	for (i = 0; i < sizeof(backendNames) / sizeof(backendNames[0]); i++) {
+		if (strcasecmp(_name, backendNames[i]) == 0) {
+			*_backend = (DmaBufBackend_t) i;
+			return true;
+		}
+	}
+	return false;
+}
+
+const char *DmaBufAllocator_backendName(DmaBufBackend_t _backend) {
+	if ((unsigned int) _backend >= sizeof(backendNames) / sizeof(backendNames[0])) {
+		return "invalid";
+	}
+	return backendNames[_backend];
+}
+
+/**
+ * Begin mmap of the dma-buf itself; every backend but intel
+ */
+static void *mapDmaBuf(DmaBufAllocator *self, DMABuffer *_buffer) {
+	if (_buffer->virtual != NULL) {
+		return _buffer->virtual;
+	}
+
+	void *address = mmap(NULL, _buffer->size, PROT_READ | PROT_WRITE, MAP_SHARED, _buffer->prime_fd, 0);
+	if (address == MAP_FAILED) {
+		sprintf(self->error, "mmap(dma-buf %d): %s", _buffer->prime_fd, ERRSTR);
+		return NULL;
+	}
+
+	_buffer->virtual = address;
+	return address;
+}
+
+static void unmapDmaBuf(DmaBufAllocator *self, DMABuffer *_buffer) {
+	if (_buffer->virtual != NULL) {
+		munmap(_buffer->virtual, _buffer->size);
+		_buffer->virtual = NULL;
+	}
+}
+
+static int syncDmaBuf(DmaBufAllocator *self, DMABuffer *_buffer, __u64 _flags) {
+	struct dma_buf_sync sync;
+	CLEAR(sync);
+	sync.flags = _flags | DMA_BUF_SYNC_READ;
+
+	int ret;
+	do {
+		ret = ioctl(_buffer->prime_fd, DMA_BUF_IOCTL_SYNC, &sync);
+	} while (ret < 0 && (EINTR == errno || EAGAIN == errno));
+
+	if (ret < 0) {
+		sprintf(self->error, "DMA_BUF_IOCTL_SYNC(dma-buf %d): %s", _buffer->prime_fd, ERRSTR);
+		return 0;
+	}
+	return 1;
+}
+
+/**
+ * Brackets CPU reads of a mapped buffer so caches are coherent with what the
+ * device wrote. Kernels before 4.6 have no such ioctl; their mappings are
+ * coherent already, so ENOTTY is not an error.
+ */
+static int beginCpuAccess(DmaBufAllocator *self, DMABuffer *_buffer) {
+	if (!self->hasSync) {
+		return 1;
+	}
+
+	if (!syncDmaBuf(self, _buffer, DMA_BUF_SYNC_START)) {
+		if (ENOTTY == errno) {
+			self->hasSync = false;
+			return 1;
+		}
+		return 0;
+	}
+	return 1;
+}
+
+static int endCpuAccess(DmaBufAllocator *self, DMABuffer *_buffer) {
+	if (!self->hasSync) {
+		return 1;
+	}
+	return syncDmaBuf(self, _buffer, DMA_BUF_SYNC_END);
+}
+
+/**
+ * Begin udmabuf
+ */
+static int openUDmaBuf(DmaBufAllocator *self, size_t _totalSize) {
+	self->fd = open(UDMABUF_DEV, O_RDWR | O_CLOEXEC);
+	if (self->fd < 0) {
+		sprintf(self->error, "open(%s): %s", UDMABUF_DEV, ERRSTR);
+		return 0;
+	}
+	return 1;
+}
+
+static int allocateUDmaBuf(DmaBufAllocator *self, DMABuffer *_buffer, size_t _size) {
+	size_t size = PAGE_ALIGN_TO(_size, (size_t) sysconf(_SC_PAGESIZE));
+
+#ifdef __NR_memfd_create
+	int memFd = (int) syscall(__NR_memfd_create, "v4l2_surface", MFD_ALLOW_SEALING);
+#else
+	int memFd = -1;
+	errno = ENOSYS;
+#endif
+	if (memFd < 0) {
+		sprintf(self->error, "memfd_create: %s", ERRSTR);
+		return 0;
+	}
+
+	// udmabuf only takes memory that cannot shrink under it
+	if (0 > ftruncate(memFd, size) || 0 > fcntl(memFd, F_ADD_SEALS, F_SEAL_SHRINK)) {
+		sprintf(self->error, "memfd %zu bytes: %s", size, ERRSTR);
+		close(memFd);
+		return 0;
+	}
+
+	struct udmabuf_create create;
+	CLEAR(create);
+	create.memfd = memFd;
+	create.flags = UDMABUF_FLAGS_CLOEXEC;
+	create.offset = 0;
+	create.size = size;
+
+	int fd = ioctl(self->fd, UDMABUF_CREATE, &create);
+	if (fd < 0) {
+		sprintf(self->error, "UDMABUF_CREATE: %s", ERRSTR);
+		close(memFd);
+		return 0;
+	}
+
+	_buffer->prime_fd = fd;
+	_buffer->memFd = memFd;
+	_buffer->size = size;
+	return 1;
+}
+
+/**
+ * Begin dma-heap
+ */
+static int openHeap(DmaBufAllocator *self, size_t _totalSize) {
+	self->fd = open(DMA_HEAP_DEV, O_RDWR | O_CLOEXEC);
+	if (self->fd < 0) {
+		sprintf(self->error, "open(%s): %s", DMA_HEAP_DEV, ERRSTR);
+		return 0;
+	}
+	return 1;
+}
+
+static int allocateHeap(DmaBufAllocator *self, DMABuffer *_buffer, size_t _size) {
+	struct dma_heap_allocation_data data;
+	CLEAR(data);
+	data.len = _size;
+	data.fd_flags = O_RDWR | O_CLOEXEC;
+
+	if (0 > ioctl(self->fd, DMA_HEAP_IOCTL_ALLOC, &data)) {
+		sprintf(self->error, "DMA_HEAP_IOCTL_ALLOC(%zu): %s", _size, ERRSTR);
+		return 0;
+	}
+
+	_buffer->prime_fd = (int) data.fd;
+	_buffer->size = _size;
+	return 1;
+}
+
+/**
+ * Begin GBM
+ */
+static int openGBM(DmaBufAllocator *self, size_t _totalSize) {
+	char node[32];
+	int i;
+
+	for (i = 0; i < RENDER_NODE_COUNT; i++) {
+		snprintf(node, sizeof(node), RENDER_NODE_FMT, RENDER_NODE_FIRST + i);
+		self->fd = open(node, O_RDWR | O_CLOEXEC);
+		if (self->fd < 0) {
+			continue;
+		}
+
+		self->device = gbm_create_device(self->fd);
+		if (self->device != NULL) {
+			return 1;
+		}
+
+		close(self->fd);
+		self->fd = -1;
+	}
+
+	sprintf(self->error, "No render node with GBM under /dev/dri.");
+	return 0;
+}
+
+static int allocateGBM(DmaBufAllocator *self, DMABuffer *_buffer, size_t _size) {
+	// V4L2 fills the buffer as one linear blob; any linear bo as large will do
+	uint32_t rows = (uint32_t) ((_size + GBM_ROW_BYTES - 1) / GBM_ROW_BYTES);
+	struct gbm_bo *bo = gbm_bo_create((struct gbm_device *) self->device, GBM_ROW_BYTES, rows,
+									  GBM_FORMAT_R8, GBM_BO_USE_LINEAR | GBM_BO_USE_RENDERING);
+	if (bo == NULL) {
+		sprintf(self->error, "gbm_bo_create(%zu bytes): %s", _size, ERRSTR);
+		return 0;
+	}
+
+	int fd = gbm_bo_get_fd(bo);
+	if (fd < 0) {
+		sprintf(self->error, "gbm_bo_get_fd: %s", ERRSTR);
+		gbm_bo_destroy(bo);
+		return 0;
+	}
+
+	_buffer->handle = bo;
+	_buffer->prime_fd = fd;
+	_buffer->size = (size_t) gbm_bo_get_stride(bo) * rows;
+	return 1;
+}
+
+/**
+ * Begin libdrm_intel
+ */
+static int openIntel(DmaBufAllocator *self, size_t _totalSize) {
+	self->fd = drmOpen(INTEL_DRM_DEV, NULL);
+	if (self->fd < 0) {
+		sprintf(self->error, "drmOpen(%s): %s", INTEL_DRM_DEV, ERRSTR);
+		return 0;
+	}
+
+	self->device = intel_bufmgr_gem_init(self->fd, _totalSize);
+	if (self->device == NULL) {
+		sprintf(self->error, "intel_bufmgr_gem_init: %s", ERRSTR);
+		drmClose(self->fd);
+		self->fd = -1;
+		return 0;
+	}
+	return 1;
+}
+
+static int allocateIntel(DmaBufAllocator *self, DMABuffer *_buffer, size_t _size) {
+	drm_intel_bo *bo = drm_intel_bo_alloc_for_render((dri_bufmgr *) self->device, "v4l2_surface", _size, 0);
+	if (bo == NULL) {
+		sprintf(self->error, "drm_intel_bo_alloc: %s", ERRSTR);
+		return 0;
+	}
+
+	//get the prime handle and put it in prime_fd
+	struct drm_prime_handle prime;
+	CLEAR(prime);
+	prime.handle = bo->handle;
+	if (0 > ioctl(self->fd, DRM_IOCTL_PRIME_HANDLE_TO_FD, &prime)) {
+		sprintf(self->error, "DRM_IOCTL_PRIME_HANDLE_TO_FD: %s", ERRSTR);
+		drm_intel_bo_unreference(bo);
+		return 0;
+	}
+
+	_buffer->handle = bo;
+	_buffer->prime_fd = prime.fd;
+	_buffer->size = _size;
+	return 1;
+}
+
+static void *mapIntel(DmaBufAllocator *self, DMABuffer *_buffer) {
+	drm_intel_bo *bo = (drm_intel_bo *) _buffer->handle;
+	if (_buffer->virtual == NULL) {
+		drm_intel_bo_map(bo, 1);
+		_buffer->virtual = bo->virtual;
+	}
+	return _buffer->virtual;
+}
+
+static void unmapIntel(DmaBufAllocator *self, DMABuffer *_buffer) {
+	if (_buffer->virtual != NULL) {
+		drm_intel_bo_unmap((drm_intel_bo *) _buffer->handle);
+		_buffer->virtual = NULL;
+	}
+}
+
+/**
+ * Any backend
+ */
+static int allocate(DmaBufAllocator *self, DMABuffer *_buffer, size_t _size) {
+	_buffer->prime_fd = -1;
+	_buffer->memFd = -1;
+	_buffer->handle = NULL;
+	_buffer->virtual = NULL;
+	_buffer->size = 0;
+
+	switch (self->backend) {
+	case DMABUF_BACKEND_UDMABUF:
+		return allocateUDmaBuf(self, _buffer, _size);
+	case DMABUF_BACKEND_HEAP:
+		return allocateHeap(self, _buffer, _size);
+	case DMABUF_BACKEND_GBM:
+		return allocateGBM(self, _buffer, _size);
+	case DMABUF_BACKEND_INTEL:
+		return allocateIntel(self, _buffer, _size);
+	default:
+		sprintf(self->error, "DMA buffer allocator is not open.");
+		return 0;
+	}
+}
+
+static void destroy(DmaBufAllocator *self, DMABuffer *_buffer) {
+	self->unmap(self, _buffer);
+
+	if (_buffer->prime_fd >= 0) {
+		close(_buffer->prime_fd);
+		_buffer->prime_fd = -1;
+	}
+
+	if (_buffer->memFd >= 0) {
+		close(_buffer->memFd);
+		_buffer->memFd = -1;
+	}
+
+	if (_buffer->handle != NULL) {
+		if (self->backend == DMABUF_BACKEND_GBM) {
+			gbm_bo_destroy((struct gbm_bo *) _buffer->handle);
+		} else if (self->backend == DMABUF_BACKEND_INTEL) {
+			drm_intel_bo_unreference((drm_intel_bo *) _buffer->handle);
+		}
+		_buffer->handle = NULL;
+	}
+}
+
+static int openBackend(DmaBufAllocator *self, DmaBufBackend_t _backend, size_t _totalSize) {
+	self->backend = _backend;
+	self->name = DmaBufAllocator_backendName(_backend);
+	self->map = mapDmaBuf;
+	self->unmap = unmapDmaBuf;
+
+	switch (_backend) {
+	case DMABUF_BACKEND_UDMABUF:
+		return openUDmaBuf(self, _totalSize);
+	case DMABUF_BACKEND_HEAP:
+		return openHeap(self, _totalSize);
+	case DMABUF_BACKEND_GBM:
+		return openGBM(self, _totalSize);
+	case DMABUF_BACKEND_INTEL:
+		self->map = mapIntel;
+		self->unmap = unmapIntel;
+		return openIntel(self, _totalSize);
+	default:
+		return 0;
+	}
+}
+
+static void DmaBufAllocator_init(DmaBufAllocator *self, DmaBufBackend_t _backend, size_t _totalSize) {
+	self->backend = DMABUF_BACKEND_AUTO;
+	self->name = DmaBufAllocator_backendName(DMABUF_BACKEND_AUTO);
+	self->isReady = false;
+	self->hasSync = true;
+	self->fd = -1;
+	self->device = NULL;
+	self->error = (char *) calloc(256, sizeof(char));
+
+	// methods
+	self->allocate = allocate;
+	self->destroy = destroy;
+	self->map = mapDmaBuf;
+	self->unmap = unmapDmaBuf;
+	self->beginCpuAccess = beginCpuAccess;
+	self->endCpuAccess = endCpuAccess;
+
+	if (_backend != DMABUF_BACKEND_AUTO) {
+		self->isReady = openBackend(self, _backend, _totalSize);
+		return;
+	}
+
+	// newest interfaces first; the error of the last one tried is kept
+	DmaBufBackend_t backend;
+	for (backend = DMABUF_BACKEND_UDMABUF; backend <= DMABUF_BACKEND_INTEL; backend++) {
+		if (openBackend(self, backend, _totalSize)) {
+			self->isReady = true;
+			return;
+		}
+	}
+	self->backend = DMABUF_BACKEND_AUTO;
+	self->name = DmaBufAllocator_backendName(DMABUF_BACKEND_AUTO);
+	sprintf(self->error, "No DMA buffer allocator available (udmabuf, dma_heap, GBM or emgd).");
+}
+
+/**
+ * _totalSize is a hint of how much will be allocated in all. Check isReady
+ * (and error) on the returned allocator.
+ */
+DmaBufAllocator *DmaBufAllocator_newWith(DmaBufBackend_t _backend, size_t _totalSize) {
+	DmaBufAllocator *allocator = (DmaBufAllocator *) calloc(1, sizeof(DmaBufAllocator));
+	DmaBufAllocator_init(allocator, _backend, _totalSize);
+	return allocator;
+}
+
+/**
+ * Buffers must be destroyed first.
+ */
+void DmaBufAllocator_dispose(DmaBufAllocator *self) {
+	if (self == NULL) {
+		return;
+	}
+
+	if (self->device != NULL) {
+		if (self->backend == DMABUF_BACKEND_GBM) {
+			gbm_device_destroy((struct gbm_device *) self->device);
+		} else if (self->backend == DMABUF_BACKEND_INTEL) {
+			drm_intel_bufmgr_destroy((dri_bufmgr *) self->device);
+		}
+	}
+
+	if (self->fd >= 0) {
+		if (self->backend == DMABUF_BACKEND_INTEL) {
+			drmClose(self->fd);
+		} else {
+			close(self->fd);
+		}
+	}
+
+	free(self->error);
+	free(self);
+}
@@ -0,0 +1,67 @@
+/**
+	This file is part of Intel Atom ISP Test App.
+
+	Intel Atom ISP Test App is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Intel Atom ISP Test App is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Intel Atom ISP Test App.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DMABUF_ALLOCATOR_H_
+#define DMABUF_ALLOCATOR_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+
+typedef enum DMABUF_BACKEND {
+	DMABUF_BACKEND_AUTO,	/* first of the below that works */
+	DMABUF_BACKEND_UDMABUF,	/* memfd pages through /dev/udmabuf */
+	DMABUF_BACKEND_HEAP,	/* /dev/dma_heap/system */
+	DMABUF_BACKEND_GBM,		/* GBM on a DRM render node */
+	DMABUF_BACKEND_INTEL	/* libdrm_intel on the emgd node (legacy) */
+} DmaBufBackend_t;
+
+typedef struct DMA_BUF_S {
+	unsigned int index;
+	int prime_fd;
+	size_t size;
+	void *handle;	/* backend object: gbm_bo or drm_intel_bo */
+	int memFd;		/* memory behind a udmabuf */
+	void *virtual;	/* CPU address; mapped once for the buffer's lifetime */
+} DMABuffer;
+
+/**
+ * Hands out DMA buffers for V4L2_MEMORY_DMABUF capture from one of several
+ * kernel interfaces, picked at runtime.
+ */
+typedef struct DMABUF_ALLOCATOR_S {
+	DmaBufBackend_t backend;
+	const char *name;
+	bool isReady;
+	bool hasSync;	/* DMA_BUF_IOCTL_SYNC is available */
+	int fd;			/* udmabuf, heap or DRM node */
+	void *device;	/* gbm_device or dri_bufmgr */
+	char *error;
+
+	int (*allocate) (struct DMABUF_ALLOCATOR_S *, DMABuffer *, size_t);
+	void (*destroy) (struct DMABUF_ALLOCATOR_S *, DMABuffer *);
+	void *(*map) (struct DMABUF_ALLOCATOR_S *, DMABuffer *);
+	void (*unmap) (struct DMABUF_ALLOCATOR_S *, DMABuffer *);
+	int (*beginCpuAccess) (struct DMABUF_ALLOCATOR_S *, DMABuffer *);
+	int (*endCpuAccess) (struct DMABUF_ALLOCATOR_S *, DMABuffer *);
+} DmaBufAllocator;
+
+bool DmaBufAllocator_parseBackend(const char *, DmaBufBackend_t *);
+const char *DmaBufAllocator_backendName(DmaBufBackend_t);
+DmaBufAllocator *DmaBufAllocator_newWith(DmaBufBackend_t, size_t);
+void DmaBufAllocator_dispose(DmaBufAllocator *);
+
+#endif /* DMABUF_ALLOCATOR_H_ */
@@ -0,0 +1,297 @@
+/**
+	This file is part of Intel Atom ISP Test App.
+
+	Intel Atom ISP Test App is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Intel Atom ISP Test App is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Intel Atom ISP Test App.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dmabuf_texture.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <drm_fourcc.h>
+
+// older libdrm headers predate the single and dual channel formats
+#ifndef DRM_FORMAT_R8
+#define DRM_FORMAT_R8 fourcc_code('R', '8', ' ', ' ')
+#endif
+#ifndef DRM_FORMAT_GR88
+#define DRM_FORMAT_GR88 fourcc_code('G', 'R', '8', '8')
+#endif
+
+/**
+ * Image format per plane. Sizes, offsets and pitches are the Video's and
+ * only known at import.
+ */
+static bool describePlanes(DmaBufTexture *self) {
+	switch (self->pixelFormat) {
+	case YV16:
+		self->planesCount = 3;
+		self->planes[0].fourcc = DRM_FORMAT_R8;
+		self->planes[1].fourcc = DRM_FORMAT_R8;
+		self->planes[2].fourcc = DRM_FORMAT_R8;
+		return true;
+	case NV12:
+		self->planesCount = 2;
+		self->planes[0].fourcc = DRM_FORMAT_R8;
+		self->planes[1].fourcc = DRM_FORMAT_GR88;
+		self->fragmentShader = "nv12_rg";
+		return true;
+	case RGBP:
+		self->planesCount = 1;
+		self->planes[0].fourcc = DRM_FORMAT_RGB565;
+		return true;
+	default:
+		self->planesCount = 0;
+		return false;
+	}
+}
+
+static void releaseAll(DmaBufTexture *self) {
+	unsigned int i, count = self->buffersCount * self->planesCount;
+
+	if (self->textures != NULL) {
+		glDeleteTextures(count, self->textures);
+	}
+
+	for (i = 0; self->images != NULL && i < count; i++) {
+		if (self->images[i] != EGL_NO_IMAGE_KHR) {
+			self->eglDestroyImageKHR(self->display, self->images[i]);
+		}
+	}
+
+	free(self->images);
+	free(self->textures);
+	self->images = NULL;
+	self->textures = NULL;
+	self->buffersCount = 0;
+}
+
+/**
+ * Imports every buffer of _video, replacing whatever was imported before.
+ * On failure nothing stays imported and the caller uploads instead.
+ */
+static int importVideo(DmaBufTexture *self, Video *_video) {
+	releaseAll(self);
+
+	if (!self->isSupported) {
+		return 0;
+	}
+
+	if (_video->ioMethod != IO_METHOD_DMABUF || _video->dmaBuffers == NULL) {
+		sprintf(self->error, "%s does not capture into DMA buffers.", _video->device);
+		return 0;
+	}
+
+	if (_video->planesCount != self->planesCount) {
+		sprintf(self->error, "%s delivers %u planes, expected %u.", _video->device, _video->planesCount, self->planesCount);
+		return 0;
+	}
+
+	unsigned int i, p;
+	for (p = 0; p < self->planesCount; p++) {
+		self->planes[p].width = _video->planes[p].width;
+		self->planes[p].height = _video->planes[p].height;
+		self->planes[p].offset = _video->planes[p].offset;
+		self->planes[p].pitch = _video->planes[p].bytesperline;
+	}
+
+	unsigned int count = _video->videoBuffersCount * self->planesCount;
+	self->images = (EGLImageKHR *) calloc(count, sizeof(EGLImageKHR));
+	self->textures = (GLuint *) calloc(count, sizeof(GLuint));
+	self->buffersCount = _video->videoBuffersCount;
+	glGenTextures(count, self->textures);
+
+	for (i = 0; i < self->buffersCount; i++) {
+		for (p = 0; p < self->planesCount; p++) {
+			DmaBufPlane *plane = &self->planes[p];
+			// multi-planar capture keeps each plane in a DMA buffer of its own
+			DMABuffer *dmaBuffer = &_video->dmaBuffers[(i * _video->memoryPlanesCount) + _video->planes[p].memoryIndex];
+			EGLint attribs[] = {
+				EGL_WIDTH, plane->width,
+				EGL_HEIGHT, plane->height,
+				EGL_LINUX_DRM_FOURCC_EXT, (EGLint) plane->fourcc,
+				EGL_DMA_BUF_PLANE0_FD_EXT, dmaBuffer->prime_fd,
+				EGL_DMA_BUF_PLANE0_OFFSET_EXT, plane->offset,
+				EGL_DMA_BUF_PLANE0_PITCH_EXT, plane->pitch,
+				EGL_NONE
+			};
+
+			unsigned int k = (i * self->planesCount) + p;
+			self->images[k] = self->eglCreateImageKHR(self->display, EGL_NO_CONTEXT,
+													  EGL_LINUX_DMA_BUF_EXT, NULL, attribs);
+			if (self->images[k] == EGL_NO_IMAGE_KHR) {
+				sprintf(self->error, "eglCreateImageKHR(buffer %u, plane %u): 0x%x", i, p, eglGetError());
+				releaseAll(self);
+				return 0;
+			}
+
+			glBindTexture(GL_TEXTURE_2D, self->textures[k]);
+			self->glEGLImageTargetTexture2DOES(GL_TEXTURE_2D, (GLeglImageOES) self->images[k]);
+			glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+			if (glGetError() != GL_NO_ERROR) {
+				sprintf(self->error, "glEGLImageTargetTexture2DOES(buffer %u, plane %u) failed.", i, p);
+				releaseAll(self);
+				return 0;
+			}
+		}
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	return 1;
+}
+
+/**
+ * Binds the planes of buffer _index to texture units 0, 1, 2 and leaves
+ * unit 0 active. Returns 0 when the buffer was not imported.
+ */
+static int bind(DmaBufTexture *self, unsigned int _index) {
+	if (_index >= self->buffersCount) {
+		return 0;
+	}
+
+	unsigned int p;
+	for (p = 0; p < self->planesCount; p++) {
+		glActiveTexture(GL_TEXTURE0 + p);
+		glBindTexture(GL_TEXTURE_2D, self->textures[(_index * self->planesCount) + p]);
+	}
+	glActiveTexture(GL_TEXTURE0);
+
+	return 1;
+}
+
+/**
+ * Marks the end of the GL commands that read the bound buffer. A later
+ * fence replaces an earlier one; it signals after it anyway.
+ */
+static void fence(DmaBufTexture *self) {
+	if (self->eglCreateSyncKHR != NULL) {
+		if (self->sync != EGL_NO_SYNC_KHR) {
+			self->eglDestroySyncKHR(self->display, self->sync);
+		}
+		self->sync = self->eglCreateSyncKHR(self->display, EGL_SYNC_FENCE_KHR, NULL);
+	}
+	self->isDrawPending = true;
+}
+
+/**
+ * Blocks until the GPU is done with everything drawn before the last
+ * fence(); glFinish() when there is no fence to wait on.
+ */
+static void waitFence(DmaBufTexture *self) {
+	if (!self->isDrawPending) {
+		return;
+	}
+
+	if (self->sync != EGL_NO_SYNC_KHR) {
+		self->eglClientWaitSyncKHR(self->display, self->sync, EGL_SYNC_FLUSH_COMMANDS_BIT_KHR, EGL_FOREVER_KHR);
+		self->eglDestroySyncKHR(self->display, self->sync);
+		self->sync = EGL_NO_SYNC_KHR;
+	} else {
+		glFinish();
+	}
+	self->isDrawPending = false;
+}
+
+static void DmaBufTexture_init(DmaBufTexture *self, EGLDisplay _display, PixelFormat_t _pixelFormat, int _width, int _height) {
+	self->display = _display;
+	self->pixelFormat = _pixelFormat;
+	self->width = _width;
+	self->height = _height;
+	self->isSupported = false;
+	self->planesCount = 0;
+	self->buffersCount = 0;
+	self->images = NULL;
+	self->textures = NULL;
+	self->fragmentShader = NULL;
+	self->sync = EGL_NO_SYNC_KHR;
+	self->isDrawPending = false;
+	self->eglCreateSyncKHR = NULL;
+	self->error = (char *) calloc(256, sizeof(char));
+
+	// methods
+	self->importVideo = importVideo;
+	self->bind = bind;
+	self->releaseAll = releaseAll;
+	self->fence = fence;
+	self->waitFence = waitFence;
+
+	// needs a current context for the GL extensions
+	if (!hasExtension(eglQueryString(_display, EGL_EXTENSIONS), "EGL_EXT_image_dma_buf_import")) {
+		sprintf(self->error, "EGL_EXT_image_dma_buf_import is not supported.");
+		return;
+	}
+
+	if (!hasExtension((const char *) glGetString(GL_EXTENSIONS), "GL_OES_EGL_image")) {
+		sprintf(self->error, "GL_OES_EGL_image is not supported.");
+		return;
+	}
+
+	if (!describePlanes(self)) {
+		sprintf(self->error, "No DMA buffer import for this color format.");
+		return;
+	}
+
+	self->eglCreateImageKHR = (PFNEGLCREATEIMAGEKHRPROC) eglGetProcAddress("eglCreateImageKHR");
+	self->eglDestroyImageKHR = (PFNEGLDESTROYIMAGEKHRPROC) eglGetProcAddress("eglDestroyImageKHR");
+	self->glEGLImageTargetTexture2DOES =
+			(PFNGLEGLIMAGETARGETTEXTURE2DOESPROC) eglGetProcAddress("glEGLImageTargetTexture2DOES");
+
+	if (self->eglCreateImageKHR == NULL || self->eglDestroyImageKHR == NULL ||
+		self->glEGLImageTargetTexture2DOES == NULL) {
+		sprintf(self->error, "EGLImage entry points are missing.");
+		return;
+	}
+
+	// without fences waitFence() falls back to glFinish()
+	if (hasExtension(eglQueryString(_display, EGL_EXTENSIONS), "EGL_KHR_fence_sync")) {
+		self->eglCreateSyncKHR = (PFNEGLCREATESYNCKHRPROC) eglGetProcAddress("eglCreateSyncKHR");
+		self->eglDestroySyncKHR = (PFNEGLDESTROYSYNCKHRPROC) eglGetProcAddress("eglDestroySyncKHR");
+		self->eglClientWaitSyncKHR = (PFNEGLCLIENTWAITSYNCKHRPROC) eglGetProcAddress("eglClientWaitSyncKHR");
+		if (self->eglDestroySyncKHR == NULL || self->eglClientWaitSyncKHR == NULL) {
+			self->eglCreateSyncKHR = NULL;
+		}
+	}
+
+	self->isSupported = true;
+}
+
+/**
+ * Call with the EGL context current. Check isSupported (and error) on the
+ * returned object.
+ */
+DmaBufTexture *DmaBufTexture_newWith(EGLDisplay _display, PixelFormat_t _pixelFormat, int _width, int _height) {
+	DmaBufTexture *texture = (DmaBufTexture *) calloc(1, sizeof(DmaBufTexture));
+	DmaBufTexture_init(texture, _display, _pixelFormat, _width, _height);
+	return texture;
+}
+
+void DmaBufTexture_dispose(DmaBufTexture *self) {
+	if (self == NULL) {
+		return;
+	}
+
+	if (self->sync != EGL_NO_SYNC_KHR) {
+		self->eglDestroySyncKHR(self->display, self->sync);
+	}
+	releaseAll(self);
+
+	free(self->error);
+	free(self);
+}
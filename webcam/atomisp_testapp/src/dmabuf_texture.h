@@ -0,0 +1,89 @@
+/**
+	This file is part of Intel Atom ISP Test App.
+
+	Intel Atom ISP Test App is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Intel Atom ISP Test App is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Intel Atom ISP Test App.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DMABUF_TEXTURE_H_
+#define DMABUF_TEXTURE_H_
+
+#include <stdbool.h>
+
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include "utilities.h"
+#include "video.h"
+
+#define DMABUF_TEXTURE_MAX_PLANES 3
+
+typedef struct DMABUF_PLANE_S {
+	unsigned int fourcc;
+	int width;
+	int height;
+	int offset;
+	int pitch;
+} DmaBufPlane;
+
+/**
+ * Wraps every DMABUF capture buffer of a Video in EGLImages once, so a frame
+ * is shown by binding its textures instead of uploading its pixels.
+ *
+ * Each plane is imported as its own single-plane image (R8, GR88 or RGB565)
+ * and bound to GL_TEXTURE_2D on the texture unit the upload path uses, so
+ * the built-in shaders sample it unchanged. NV12 chroma is the exception:
+ * it comes back in .rg instead of .ra, see fragmentShader.
+ *
+ * Drawing from an imported buffer reads it on the GPU after
+ * eglSwapBuffers() has returned. Call fence() once the frame is drawn and
+ * waitFence() before the buffer goes back to the driver, so the next
+ * capture is not written into it while it is still being read.
+ */
+typedef struct DMABUF_TEXTURE_S {
+	EGLDisplay display;
+	PixelFormat_t pixelFormat;
+	int width;
+	int height;
+	bool isSupported;
+
+	unsigned int planesCount;
+	DmaBufPlane planes[DMABUF_TEXTURE_MAX_PLANES];
+	unsigned int buffersCount;
+	EGLImageKHR *images;	/* buffersCount * planesCount */
+	GLuint *textures;		/* buffersCount * planesCount */
+	const char *fragmentShader;	/* replaces the built-in one when not NULL */
+	EGLSyncKHR sync;		/* after the last draw from an imported buffer */
+	bool isDrawPending;		/* drawn since the last waitFence() */
+	char *error;
+
+	PFNEGLCREATEIMAGEKHRPROC eglCreateImageKHR;
+	PFNEGLDESTROYIMAGEKHRPROC eglDestroyImageKHR;
+	PFNGLEGLIMAGETARGETTEXTURE2DOESPROC glEGLImageTargetTexture2DOES;
+	PFNEGLCREATESYNCKHRPROC eglCreateSyncKHR;		/* NULL without EGL_KHR_fence_sync */
+	PFNEGLDESTROYSYNCKHRPROC eglDestroySyncKHR;
+	PFNEGLCLIENTWAITSYNCKHRPROC eglClientWaitSyncKHR;
+
+	int (*importVideo) (struct DMABUF_TEXTURE_S *, Video *);
+	int (*bind) (struct DMABUF_TEXTURE_S *, unsigned int);
+	void (*releaseAll) (struct DMABUF_TEXTURE_S *);
+	void (*fence) (struct DMABUF_TEXTURE_S *);
+	void (*waitFence) (struct DMABUF_TEXTURE_S *);
+} DmaBufTexture;
+
+DmaBufTexture *DmaBufTexture_newWith(EGLDisplay, PixelFormat_t, int, int);
+void DmaBufTexture_dispose(DmaBufTexture *);
+
+#endif /* DMABUF_TEXTURE_H_ */
@@ -0,0 +1,440 @@
+/**
+	This file is part of Intel Atom ISP Test App.
+
+	Intel Atom ISP Test App is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Intel Atom ISP Test App is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Intel Atom ISP Test App.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "downscale.h"
+#include "downscale_kernels.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+static const char *FILTER_NAMES[] = {
+	[SCALE_FILTER_BOX] = "box",
+	[SCALE_FILTER_BILINEAR] = "bilinear"
+};
+
+void Downscale_addRow(const unsigned char *_src, uint16_t *_sums, unsigned int _count) {
+	unsigned int x;
+
+	for (x = 0; x < _count; x++) {
+		_sums[x] += _src[x];
+	}
+}
+
+void Downscale_blendRow(const unsigned char *_a, const unsigned char *_b, unsigned char *_out,
+						unsigned int _count, unsigned int _weight) {
+	unsigned int x;
+
+	for (x = 0; x < _count; x++) {
+		_out[x] = ((_a[x] * (DOWNSCALE_WEIGHT_ONE - _weight)) + (_b[x] * _weight) + DOWNSCALE_ROUND) >> 8;
+	}
+}
+
+const char *Downscale_filterName(ScaleFilter_t _filter) {
+	if ((unsigned int) _filter >= sizeof(FILTER_NAMES) / sizeof(FILTER_NAMES[0])) {
+		return "unknown";
+	}
+
+	return FILTER_NAMES[_filter];
+}
+
+bool Downscale_parseFilter(const char *_name, ScaleFilter_t *_filter) {
+	unsigned int i;
+
+	for (i = 0; i < sizeof(FILTER_NAMES) / sizeof(FILTER_NAMES[0]); i++) {
+		if (strcasecmp(_name, FILTER_NAMES[i]) == 0) {
+			*_filter = (ScaleFilter_t) i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * Whole chroma pairs, and at most DOWNSCALE_MAX_RATIO times smaller per axis.
+ */
+bool Downscale_canScale(unsigned int _sourceWidth, unsigned int _sourceHeight, unsigned int _width,
+						unsigned int _height) {
+	return ((_sourceWidth | _sourceHeight | _width | _height) & 1) == 0 && _width > 0 && _height > 0 &&
+		   _width <= _sourceWidth && _height <= _sourceHeight &&
+		   _sourceWidth <= _width * DOWNSCALE_MAX_RATIO && _sourceHeight <= _height * DOWNSCALE_MAX_RATIO;
+}
+
+/**
+ * Box filtering splits the source samples in runs as even as they get;
+ * bilinear filtering takes the two nearest the output sample's center.
+ */
+static void initAxis(ScaleAxis *_axis, unsigned int _sourceCount, unsigned int _count, ScaleFilter_t _filter) {
+	unsigned int j;
+
+	_axis->sourceCount = _sourceCount;
+	_axis->count = _count;
+	_axis->first = (unsigned int *) calloc(_count, sizeof(unsigned int));
+	_axis->spans = (unsigned int *) calloc(_count, sizeof(unsigned int));
+	_axis->weights = (unsigned int *) calloc(_count, sizeof(unsigned int));
+	_axis->maxSpan = 1;
+
+	for (j = 0; j < _count; j++) {
+		if (_filter == SCALE_FILTER_BOX) {
+			unsigned int end = (unsigned int) (((unsigned long long) (j + 1) * _sourceCount) / _count);
+			_axis->first[j] = (unsigned int) (((unsigned long long) j * _sourceCount) / _count);
+			_axis->spans[j] = end - _axis->first[j];
+		} else {
+			// in 1/65536 of a source sample
+			long long center = ((((long long) (2 * j) + 1) * _sourceCount) << 16) / (2 * _count) - 32768;
+			if (center < 0) {
+				center = 0;
+			}
+			_axis->first[j] = (unsigned int) (center >> 16);
+			_axis->spans[j] = 1;
+			_axis->weights[j] = (unsigned int) (center >> 8) & (DOWNSCALE_WEIGHT_ONE - 1);
+			if (_axis->first[j] >= _sourceCount - 1) {
+				_axis->first[j] = _sourceCount - 1;
+				_axis->spans[j] = 0;
+				_axis->weights[j] = 0;
+			}
+		}
+
+		if (_axis->spans[j] > _axis->maxSpan) {
+			_axis->maxSpan = _axis->spans[j];
+		}
+	}
+}
+
+static void disposeAxis(ScaleAxis *_axis) {
+	free(_axis->first);
+	free(_axis->spans);
+	free(_axis->weights);
+}
+
+static void setChannel(ScalePlane *_plane, unsigned int _offset, unsigned int _step, const ScaleAxis *_columns) {
+	ScaleChannel *channel = &_plane->channels[_plane->channelsCount++];
+	channel->offset = _offset;
+	channel->step = _step;
+	channel->columns = _columns;
+}
+
+/**
+ * Where the Y, U and V samples are in the rows of each plane. Which chroma
+ * is which does not matter here, only where each of them is.
+ */
+static bool describePlanes(Downscaler *self) {
+	const ScaleAxis *columns = &self->axes[0];
+	const ScaleAxis *chromaColumns = &self->axes[1];
+	unsigned int lumaOffset = 0;
+
+	switch (self->formatInfo->format) {
+	case UYVY:
+	case VYUY:
+		lumaOffset = 1;
+		// fall through
+	case YUYV:
+	case YVYU:
+		setChannel(&self->planes[0], lumaOffset, 2, columns);
+		setChannel(&self->planes[0], 1 - lumaOffset, 4, chromaColumns);
+		setChannel(&self->planes[0], 3 - lumaOffset, 4, chromaColumns);
+		return true;
+	case YV16:
+		setChannel(&self->planes[0], 0, 1, columns);
+		setChannel(&self->planes[1], 0, 1, chromaColumns);
+		setChannel(&self->planes[2], 0, 1, chromaColumns);
+		return true;
+	case NV12:
+		setChannel(&self->planes[0], 0, 1, columns);
+		setChannel(&self->planes[1], 0, 2, chromaColumns);
+		setChannel(&self->planes[1], 1, 2, chromaColumns);
+		return true;
+	default:
+		return false;
+	}
+}
+
+static void boxColumns(const ScaleChannel *_channel, const uint16_t *_sums, unsigned char *_out, unsigned int _rowsSummed) {
+	const ScaleAxis *columns = _channel->columns;
+	uint64_t reciprocals[DOWNSCALE_MAX_RATIO + 1];
+	unsigned int j, k, span;
+
+	// the mean is taken by a multiply, in 24 bits so boxes of 64 x 64 stay exact to a byte
+	for (span = 1; span <= columns->maxSpan; span++) {
+		reciprocals[span] = (1 << 24) / (span * _rowsSummed);
+	}
+
+	const uint16_t *sums = _sums + _channel->offset;
+	unsigned char *out = _out + _channel->offset;
+	for (j = 0; j < columns->count; j++) {
+		const uint16_t *first = sums + (columns->first[j] * _channel->step);
+		uint32_t sum = 0;
+
+		for (k = 0; k < columns->spans[j]; k++) {
+			sum += first[k * _channel->step];
+		}
+		out[j * _channel->step] = (unsigned char) (((sum * reciprocals[columns->spans[j]]) + (1 << 23)) >> 24);
+	}
+}
+
+static void bilinearColumns(const ScaleChannel *_channel, const unsigned char *_row, unsigned char *_out) {
+	const ScaleAxis *columns = _channel->columns;
+	const unsigned char *row = _row + _channel->offset;
+	unsigned char *out = _out + _channel->offset;
+	unsigned int j;
+
+	for (j = 0; j < columns->count; j++) {
+		const unsigned char *first = row + (columns->first[j] * _channel->step);
+		unsigned int weight = columns->weights[j];
+
+		out[j * _channel->step] = ((first[0] * (DOWNSCALE_WEIGHT_ONE - weight)) +
+								   (first[columns->spans[j] * _channel->step] * weight) + DOWNSCALE_ROUND) >> 8;
+	}
+}
+
+/**
+ * Output row _row of plane _p: its source rows summed or blended into
+ * _scratch, then the columns of every channel filtered out of that.
+ */
+static void scaleRow(Downscaler *self, unsigned int _p, unsigned int _row, unsigned char *_scratch) {
+	const ScalePlane *plane = &self->planes[_p];
+	const VideoPlane *source = &self->source->planes[_p];
+	const ScaleAxis *rows = plane->rows;
+	unsigned char *out = self->frame.planes[_p].data + (_row * self->frame.planes[_p].bytesperline);
+	const unsigned char *first = source->data + (rows->first[_row] * source->bytesperline);
+	unsigned int c, k;
+
+	if (self->filter == SCALE_FILTER_BOX) {
+		uint16_t *sums = (uint16_t *) _scratch;
+
+		memset(sums, 0, plane->sourceBytes * sizeof(uint16_t));
+		for (k = 0; k < rows->spans[_row]; k++) {
+			self->addRow(first + (k * source->bytesperline), sums, plane->sourceBytes);
+		}
+		for (c = 0; c < plane->channelsCount; c++) {
+			boxColumns(&plane->channels[c], sums, out, rows->spans[_row]);
+		}
+		return;
+	}
+
+	const unsigned char *blended = first;
+	if (rows->spans[_row] != 0 && rows->weights[_row] != 0) {
+		self->blendRow(first, first + source->bytesperline, _scratch, plane->sourceBytes, rows->weights[_row]);
+		blended = _scratch;
+	}
+	for (c = 0; c < plane->channelsCount; c++) {
+		bilinearColumns(&plane->channels[c], blended, out);
+	}
+}
+
+/**
+ * Rows [_first, _end) of the output's first plane, and the rows of the
+ * other planes that go with them.
+ */
+static void scaleBand(void *_arg, unsigned int _first, unsigned int _end) {
+	Downscaler *self = (Downscaler *) _arg;
+	unsigned char *scratch = (unsigned char *) malloc(self->scratchBytes);
+	unsigned int y, p;
+
+	for (y = _first; y < _end; y++) {
+		for (p = 0; p < self->frame.planesCount; p++) {
+			unsigned int subsampling = self->planes[p].verticalSubsampling;
+			if (y % subsampling == 0) {
+				scaleRow(self, p, y / subsampling, scratch);
+			}
+		}
+	}
+
+	free(scratch);
+}
+
+/**
+ * The job scaling _source into frame; NULL (and error set) when it cannot.
+ * The source stays this object's until the job is done.
+ */
+static WorkerJob *prepare(Downscaler *self, const VideoFrame *_source) {
+	if (self->frame.planesCount == 0) {
+		return NULL;
+	}
+
+	if (_source->planesCount < self->frame.planesCount) {
+		sprintf(self->error, "Frame has %u planes, expected %u.", _source->planesCount, self->frame.planesCount);
+		return NULL;
+	}
+
+	if (_source->planes[0].width != self->sourceWidth || _source->planes[0].height != self->sourceHeight) {
+		sprintf(self->error, "Frame is %ux%u, expected %ux%u.", _source->planes[0].width, _source->planes[0].height,
+				self->sourceWidth, self->sourceHeight);
+		return NULL;
+	}
+
+	self->source = _source;
+	self->frame.index = _source->index;
+	self->frame.sequence = _source->sequence;
+	self->frame.flags = _source->flags;
+	self->frame.timestamp = _source->timestamp;
+	self->job->rowsCount = self->frame.planes[0].height;
+	return self->job;
+}
+
+/**
+ * Scales _source into frame and returns when done; no stage is chained.
+ */
+static int scale(Downscaler *self, const VideoFrame *_source) {
+	WorkerJob *job = prepare(self, _source);
+	if (job == NULL) {
+		return 0;
+	}
+
+	if (self->pool != NULL) {
+		WorkerJob_chain(job, NULL, 0);
+		self->pool->submit(self->pool, job);
+		self->pool->wait(self->pool, job);
+	} else {
+		scaleBand(self, 0, job->rowsCount);
+	}
+
+	return 1;
+}
+
+static void setPool(Downscaler *self, WorkerPool *_pool) {
+	self->pool = _pool;
+}
+
+/**
+ * Lays the output planes out back to back, without padding.
+ */
+static void allocateFrame(Downscaler *self, unsigned int _width, unsigned int _height) {
+	unsigned int p, size = 0;
+
+	for (p = 0; p < self->formatInfo->planesCount; p++) {
+		const PixelFormatPlane *format = &self->formatInfo->planes[p];
+		VideoPlane *plane = &self->frame.planes[p];
+
+		plane->width = _width / format->horizontalSubsampling;
+		plane->height = _height / format->verticalSubsampling;
+		plane->bytesperline = (plane->width * format->bitsPerPixel) / 8;
+		plane->memoryIndex = 0;
+		plane->offset = size;
+		plane->length = plane->bytesperline * plane->height;
+		size += plane->length;
+	}
+
+	self->frameData = (unsigned char *) calloc(size, 1);
+	for (p = 0; p < self->formatInfo->planesCount; p++) {
+		self->frame.planes[p].data = self->frameData + self->frame.planes[p].offset;
+	}
+	self->frame.data = self->frameData;
+	self->frame.bytesused = size;
+	self->frame.planesCount = self->formatInfo->planesCount;
+}
+
+static void Downscaler_init(Downscaler *self, PixelFormat_t _pixelFormat, unsigned int _sourceWidth, unsigned int _sourceHeight,
+							unsigned int _width, unsigned int _height, ScaleFilter_t _filter, ConvertIsa_t _maxIsa) {
+	self->formatInfo = PixelFormat_info(_pixelFormat);
+	self->filter = _filter;
+	self->isa = CONVERT_ISA_SCALAR;
+	self->addRow = Downscale_addRow;
+	self->blendRow = Downscale_blendRow;
+	self->sourceWidth = _sourceWidth;
+	self->sourceHeight = _sourceHeight;
+	self->scratchBytes = 0;
+	self->frameData = NULL;
+	self->pool = NULL;
+	self->job = WorkerJob_newWith(scaleBand, self, 0);
+	self->error = (char *) calloc(256, sizeof(char));
+	self->source = NULL;
+
+	// methods
+	self->setPool = setPool;
+	self->prepare = prepare;
+	self->scale = scale;
+
+	if (!describePlanes(self)) {
+		sprintf(self->error, "No downscaling for %s.", PixelFormat_name(_pixelFormat));
+		return;
+	}
+
+	if (!Downscale_canScale(_sourceWidth, _sourceHeight, _width, _height)) {
+		sprintf(self->error, "Cannot scale %ux%u to %ux%u.", _sourceWidth, _sourceHeight, _width, _height);
+		return;
+	}
+
+	initAxis(&self->axes[0], _sourceWidth, _width, _filter);
+	initAxis(&self->axes[1], _sourceWidth / 2, _width / 2, _filter);
+	initAxis(&self->axes[2], _sourceHeight, _height, _filter);
+	initAxis(&self->axes[3], _sourceHeight / 2, _height / 2, _filter);
+
+	unsigned int p;
+	for (p = 0; p < self->formatInfo->planesCount; p++) {
+		const PixelFormatPlane *format = &self->formatInfo->planes[p];
+		ScalePlane *plane = &self->planes[p];
+
+		plane->sourceBytes = ((_sourceWidth / format->horizontalSubsampling) * format->bitsPerPixel) / 8;
+		plane->verticalSubsampling = format->verticalSubsampling;
+		plane->rows = &self->axes[(format->verticalSubsampling == 1) ? 2 : 3];
+		if (plane->sourceBytes * sizeof(uint16_t) > self->scratchBytes) {
+			self->scratchBytes = plane->sourceBytes * sizeof(uint16_t);
+		}
+	}
+	allocateFrame(self, _width, _height);
+
+	ConvertIsa_t isa = ColorConvert_cpuIsa();
+	if (isa > _maxIsa) {
+		isa = _maxIsa;
+	}
+
+	// the fastest kernels there are, down to the scalar ones
+#if defined(__i386__) || defined(__x86_64__)
+	for (; isa > CONVERT_ISA_SCALAR; isa--) {
+		ScaleAddRow_t addRow = Downscale_x86AddRow(isa);
+		ScaleBlendRow_t blendRow = Downscale_x86BlendRow(isa);
+		if (addRow != NULL && blendRow != NULL) {
+			self->addRow = addRow;
+			self->blendRow = blendRow;
+			self->isa = isa;
+			return;
+		}
+	}
+#endif
+}
+
+/**
+ * Scales _pixelFormat frames of _sourceWidth x _sourceHeight down to
+ * _width x _height with the fastest kernels up to _maxIsa that the CPU
+ * runs. frame.planesCount is 0 (and error set) for formats or sizes it
+ * cannot scale.
+ */
+Downscaler *Downscaler_newWith(PixelFormat_t _pixelFormat, unsigned int _sourceWidth, unsigned int _sourceHeight,
+							   unsigned int _width, unsigned int _height, ScaleFilter_t _filter, ConvertIsa_t _maxIsa) {
+	Downscaler *downscaler = (Downscaler *) calloc(1, sizeof(Downscaler));
+	Downscaler_init(downscaler, _pixelFormat, _sourceWidth, _sourceHeight, _width, _height, _filter, _maxIsa);
+	return downscaler;
+}
+
+void Downscaler_dispose(Downscaler *self) {
+	if (self == NULL) {
+		return;
+	}
+
+	unsigned int i;
+	for (i = 0; i < sizeof(self->axes) / sizeof(self->axes[0]); i++) {
+		disposeAxis(&self->axes[i]);
+	}
+
+	WorkerJob_dispose(self->job);
+	free(self->frameData);
+	free(self->error);
+	free(self);
+}
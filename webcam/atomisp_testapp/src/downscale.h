@@ -0,0 +1,122 @@
+/**
+	This file is part of Intel Atom ISP Test App.
+
+	Intel Atom ISP Test App is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Intel Atom ISP Test App is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Intel Atom ISP Test App.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DOWNSCALE_H_
+#define DOWNSCALE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "pixel_format.h"
+#include "video.h"
+#include "color_convert.h"
+#include "worker_pool.h"
+
+#define DOWNSCALE_MAX_RATIO 64		/* per axis; keeps box sums in 16 bits */
+#define DOWNSCALE_WEIGHT_ONE 256	/* bilinear weights are in 1/256 */
+
+typedef enum SCALE_FILTER {
+	SCALE_FILTER_BOX,		/* mean of the source samples each output one covers */
+	SCALE_FILTER_BILINEAR	/* of the 2 x 2 nearest; aliases past a ratio of 2 */
+} ScaleFilter_t;
+
+/**
+ * Adds _count bytes of a source row into 16 bit sums, for box filtering.
+ */
+typedef void (*ScaleAddRow_t) (const unsigned char *, uint16_t *, unsigned int);
+
+/**
+ * Blends _count bytes of two source rows, the second with the weight given
+ * in DOWNSCALE_WEIGHT_ONE units, for bilinear filtering.
+ */
+typedef void (*ScaleBlendRow_t) (const unsigned char *, const unsigned char *, unsigned char *,
+								 unsigned int, unsigned int);
+
+/**
+ * Where the output samples of one axis come from. Box filtering sums spans
+ * samples from first; bilinear blends first and first + spans (1, or 0 at
+ * the last source sample) by weight.
+ */
+typedef struct SCALE_AXIS_S {
+	unsigned int sourceCount;
+	unsigned int count;
+	unsigned int *first;
+	unsigned int *spans;
+	unsigned int *weights;	/* bilinear, of the second sample */
+	unsigned int maxSpan;
+} ScaleAxis;
+
+/**
+ * Samples of one kind (Y, U or V) in the rows of a plane: at offset, then
+ * every step bytes.
+ */
+typedef struct SCALE_CHANNEL_S {
+	unsigned int offset;
+	unsigned int step;
+	const ScaleAxis *columns;
+} ScaleChannel;
+
+typedef struct SCALE_PLANE_S {
+	unsigned int sourceBytes;	/* of a row read */
+	unsigned int verticalSubsampling;
+	const ScaleAxis *rows;
+	unsigned int channelsCount;
+	ScaleChannel channels[3];
+} ScalePlane;
+
+/**
+ * Makes smaller frames, in the same pixel format, out of captured packed
+ * (YUYV, UYVY, YVYU, VYUY) or planar (YV16, NV12) YUV frames, so a preview
+ * does not need a stream of its own.
+ *
+ * Filtering is separable: the source rows of each output row are summed or
+ * blended with the SIMD row kernel, then the columns are filtered from that
+ * row. With a pool the output rows are split in tiles over its threads.
+ */
+typedef struct DOWNSCALER_S {
+	const PixelFormatInfo *formatInfo;
+	ScaleFilter_t filter;
+	ConvertIsa_t isa;		/* of the row kernels in use */
+	ScaleAddRow_t addRow;
+	ScaleBlendRow_t blendRow;
+	unsigned int sourceWidth;
+	unsigned int sourceHeight;
+	ScaleAxis axes[4];		/* columns and rows, of luma and of chroma */
+	ScalePlane planes[PIXEL_FORMAT_MAX_PLANES];
+	unsigned int scratchBytes;
+	VideoFrame frame;		/* the output; planesCount is 0 when it cannot scale */
+	unsigned char *frameData;
+	WorkerPool *pool;		/* not owned; NULL runs on the calling thread */
+	WorkerJob *job;
+	char *error;
+
+	// the frame prepared
+	const VideoFrame *source;
+
+	void (*setPool) (struct DOWNSCALER_S *, WorkerPool *);
+	WorkerJob *(*prepare) (struct DOWNSCALER_S *, const VideoFrame *);
+	int (*scale) (struct DOWNSCALER_S *, const VideoFrame *);
+} Downscaler;
+
+const char *Downscale_filterName(ScaleFilter_t);
+bool Downscale_parseFilter(const char *, ScaleFilter_t *);
+bool Downscale_canScale(unsigned int, unsigned int, unsigned int, unsigned int);
+Downscaler *Downscaler_newWith(PixelFormat_t, unsigned int, unsigned int, unsigned int, unsigned int,
+							   ScaleFilter_t, ConvertIsa_t);
+void Downscaler_dispose(Downscaler *);
+
+#endif /* DOWNSCALE_H_ */
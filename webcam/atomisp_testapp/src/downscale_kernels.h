@@ -0,0 +1,41 @@
+/**
+	This file is part of Intel Atom ISP Test App.
+
+	Intel Atom ISP Test App is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Intel Atom ISP Test App is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Intel Atom ISP Test App.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DOWNSCALE_KERNELS_H_
+#define DOWNSCALE_KERNELS_H_
+
+#include "downscale.h"
+
+/**
+ * Every row kernel computes exactly
+ *
+ *   sum += a                                     (box)
+ *   out = (a * (256 - w) + b * w + 128) >> 8     (bilinear)
+ *
+ * in 16 bits, so they all give the same bytes. The columns are filtered by
+ * scalar code shared by all of them.
+ */
+#define DOWNSCALE_ROUND (DOWNSCALE_WEIGHT_ONE / 2)
+
+// scalar rows; the SIMD kernels finish their rows with them
+void Downscale_addRow(const unsigned char *, uint16_t *, unsigned int);
+void Downscale_blendRow(const unsigned char *, const unsigned char *, unsigned char *, unsigned int, unsigned int);
+
+ScaleAddRow_t Downscale_x86AddRow(ConvertIsa_t);
+ScaleBlendRow_t Downscale_x86BlendRow(ConvertIsa_t);
+
+#endif /* DOWNSCALE_KERNELS_H_ */
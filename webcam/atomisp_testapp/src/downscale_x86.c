@@ -0,0 +1,157 @@
+/**
+	This file is part of Intel Atom ISP Test App.
+
+	Intel Atom ISP Test App is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Intel Atom ISP Test App is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Intel Atom ISP Test App.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * SSE2 and AVX2 row kernels of the downscaler, compiled for their
+ * instruction sets through target attributes like the conversion kernels.
+ *
+ * Both work on the bytes of a row whatever they hold, so one kernel serves
+ * every format and plane; the bytes are widened to 16 bits, where the sums
+ * and the weighted blend of downscale_kernels.h fit.
+ */
+
+#include "downscale_kernels.h"
+
+#if defined(__i386__) || defined(__x86_64__)
+
+#include <immintrin.h>
+
+#define SSE2 __attribute__((target("sse2")))
+#define AVX2 __attribute__((target("avx2")))
+
+static SSE2 void addRow_sse2(const unsigned char *_src, uint16_t *_sums, unsigned int _count) {
+	const __m128i zero = _mm_setzero_si128();
+	unsigned int x;
+
+	for (x = 0; x + 16 <= _count; x += 16) {
+		__m128i src = _mm_loadu_si128((const __m128i *) (_src + x));
+		__m128i *sums = (__m128i *) (_sums + x);
+
+		_mm_storeu_si128(sums, _mm_add_epi16(_mm_loadu_si128(sums), _mm_unpacklo_epi8(src, zero)));
+		_mm_storeu_si128(sums + 1, _mm_add_epi16(_mm_loadu_si128(sums + 1), _mm_unpackhi_epi8(src, zero)));
+	}
+	Downscale_addRow(_src + x, _sums + x, _count - x);
+}
+
+static inline SSE2 __m128i blend8(__m128i _a, __m128i _b, __m128i _aWeight, __m128i _bWeight) {
+	const __m128i round = _mm_set1_epi16(DOWNSCALE_ROUND);
+	__m128i sum = _mm_add_epi16(_mm_mullo_epi16(_a, _aWeight), _mm_mullo_epi16(_b, _bWeight));
+	return _mm_srli_epi16(_mm_add_epi16(sum, round), 8);
+}
+
+static SSE2 void blendRow_sse2(const unsigned char *_a, const unsigned char *_b, unsigned char *_out,
+							   unsigned int _count, unsigned int _weight) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i aWeight = _mm_set1_epi16(DOWNSCALE_WEIGHT_ONE - _weight);
+	const __m128i bWeight = _mm_set1_epi16(_weight);
+	unsigned int x;
+
+	for (x = 0; x + 16 <= _count; x += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i *) (_a + x));
+		__m128i b = _mm_loadu_si128((const __m128i *) (_b + x));
+		__m128i low = blend8(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero), aWeight, bWeight);
+		__m128i high = blend8(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero), aWeight, bWeight);
+
+		_mm_storeu_si128((__m128i *) (_out + x), _mm_packus_epi16(low, high));
+	}
+	Downscale_blendRow(_a + x, _b + x, _out + x, _count - x, _weight);
+}
+
+static AVX2 void addRow_avx2(const unsigned char *_src, uint16_t *_sums, unsigned int _count) {
+	unsigned int x;
+
+	for (x = 0; x + 32 <= _count; x += 32) {
+		__m256i low = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) (_src + x)));
+		__m256i high = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) (_src + x + 16)));
+		__m256i *sums = (__m256i *) (_sums + x);
+
+		_mm256_storeu_si256(sums, _mm256_add_epi16(_mm256_loadu_si256(sums), low));
+		_mm256_storeu_si256(sums + 1, _mm256_add_epi16(_mm256_loadu_si256(sums + 1), high));
+	}
+	if (x + 16 <= _count) {
+		addRow_sse2(_src + x, _sums + x, _count - x);
+		return;
+	}
+	Downscale_addRow(_src + x, _sums + x, _count - x);
+}
+
+static inline AVX2 __m256i blend16(const unsigned char *_a, const unsigned char *_b, __m256i _aWeight, __m256i _bWeight) {
+	const __m256i round = _mm256_set1_epi16(DOWNSCALE_ROUND);
+	__m256i a = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) _a));
+	__m256i b = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) _b));
+	__m256i sum = _mm256_add_epi16(_mm256_mullo_epi16(a, _aWeight), _mm256_mullo_epi16(b, _bWeight));
+	return _mm256_srli_epi16(_mm256_add_epi16(sum, round), 8);
+}
+
+static AVX2 void blendRow_avx2(const unsigned char *_a, const unsigned char *_b, unsigned char *_out,
+							   unsigned int _count, unsigned int _weight) {
+	const __m256i aWeight = _mm256_set1_epi16(DOWNSCALE_WEIGHT_ONE - _weight);
+	const __m256i bWeight = _mm256_set1_epi16(_weight);
+	unsigned int x;
+
+	for (x = 0; x + 32 <= _count; x += 32) {
+		__m256i low = blend16(_a + x, _b + x, aWeight, bWeight);
+		__m256i high = blend16(_a + x + 16, _b + x + 16, aWeight, bWeight);
+
+		// packus works within lanes; put the quarters back in order
+		__m256i packed = _mm256_packus_epi16(low, high);
+		_mm256_storeu_si256((__m256i *) (_out + x), _mm256_permute4x64_epi64(packed, 0xd8));
+	}
+	if (x + 16 <= _count) {
+		blendRow_sse2(_a + x, _b + x, _out + x, _count - x, _weight);
+		return;
+	}
+	Downscale_blendRow(_a + x, _b + x, _out + x, _count - x, _weight);
+}
+
+/**
+ * Indexed by ConvertIsa_t; SSSE3 adds nothing to the SSE2 kernels.
+ */
+static const ScaleAddRow_t ADD_KERNELS[CONVERT_ISA_BEST + 1] = {
+	[CONVERT_ISA_SCALAR] = NULL,
+	[CONVERT_ISA_SSE2] = addRow_sse2,
+	[CONVERT_ISA_SSSE3] = NULL,
+	[CONVERT_ISA_AVX2] = addRow_avx2
+};
+
+static const ScaleBlendRow_t BLEND_KERNELS[CONVERT_ISA_BEST + 1] = {
+	[CONVERT_ISA_SCALAR] = NULL,
+	[CONVERT_ISA_SSE2] = blendRow_sse2,
+	[CONVERT_ISA_SSSE3] = NULL,
+	[CONVERT_ISA_AVX2] = blendRow_avx2
+};
+
+/**
+ * The kernels written for exactly _isa; the caller checks the CPU runs them.
+ */
+ScaleAddRow_t Downscale_x86AddRow(ConvertIsa_t _isa) {
+	if ((unsigned int) _isa > CONVERT_ISA_BEST) {
+		return NULL;
+	}
+
+	return ADD_KERNELS[_isa];
+}
+
+ScaleBlendRow_t Downscale_x86BlendRow(ConvertIsa_t _isa) {
+	if ((unsigned int) _isa > CONVERT_ISA_BEST) {
+		return NULL;
+	}
+
+	return BLEND_KERNELS[_isa];
+}
+
+#endif /* __i386__ || __x86_64__ */
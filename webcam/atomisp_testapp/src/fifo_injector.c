@@ -0,0 +1,589 @@
+/**
+	This file is part of Intel Atom ISP Test App.
+
+	Intel Atom ISP Test App is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Intel Atom ISP Test App is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Intel Atom ISP Test App.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+#define _FILE_OFFSET_BITS 64	// raw sequences outgrow 2 GB on 32-bit builds
+
+#include "fifo_injector.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+#include <linux/videodev2.h>
+
+#include "pixel_format.h"
+#include "utilities.h"
+
+#define ERRSTR strerror(errno)
+#define CLEAR(x) memset(&(x), 0, sizeof(x))
+
+#define OUTPUT_MODE_FILE 0x0100		/* atomisp: frames come from memory, not the sensor */
+#define POLL_MSEC 100				/* how soon stop() is noticed */
+
+static void unmapFrame(FifoMapping *_mapping) {
+	if (_mapping->base != NULL) {
+		munmap(_mapping->base, _mapping->length);
+	}
+	_mapping->base = NULL;
+	_mapping->length = 0;
+	_mapping->size = 0;
+}
+
+/**
+ * Maps frame _index of the source and has the kernel start reading it in.
+ * Returns where the frame starts in the mapping, or NULL.
+ */
+static void *mapFrame(FifoInjector *self, unsigned int _index, FifoMapping *_mapping) {
+	int fd = self->raw.fd;
+	off_t offset = (off_t) _index * self->raw.size;
+	size_t size = self->raw.size;
+
+	if (self->files != NULL) {
+		struct stat st;
+
+		fd = open(self->files[_index], O_RDONLY | O_CLOEXEC);
+		if (fd < 0 || fstat(fd, &st) < 0) {
+			sprintf(self->error, "Cannot open %s: %d, %s", self->files[_index], errno, ERRSTR);
+			if (fd >= 0) {
+				close(fd);
+			}
+			return NULL;
+		}
+
+		// a short file fills what it has of the buffer
+		offset = 0;
+		size = ((off_t) size < st.st_size) ? size : (size_t) st.st_size;
+	}
+
+	off_t base = offset & ~((off_t) sysconf(_SC_PAGESIZE) - 1);
+	_mapping->length = (size_t) (offset - base) + size;
+	_mapping->size = size;
+	_mapping->base = mmap(NULL, _mapping->length, PROT_READ, MAP_SHARED, fd, base);
+
+	if (self->files != NULL) {
+		// the mapping keeps the file
+		close(fd);
+	}
+
+	if (_mapping->base == MAP_FAILED) {
+		_mapping->base = NULL;
+		sprintf(self->error, "Cannot map frame %u of %s: %d, %s", _index, self->source, errno, ERRSTR);
+		return NULL;
+	}
+
+	madvise(_mapping->base, _mapping->length, MADV_WILLNEED);
+
+	return (unsigned char *) _mapping->base + (offset - base);
+}
+
+/**
+ * frameBuf2 moves up to frameBuf1 and the frame after it is mapped in its
+ * place.
+ */
+static int advance(FifoInjector *self) {
+	unmapFrame(&self->current);
+	self->current = self->next;
+	self->raw.frameBuf1 = self->raw.frameBuf2;
+
+	self->next.base = NULL;
+	self->nextIndex += 1;
+	if (self->nextIndex == (unsigned int) self->raw.count) {
+		self->nextIndex = 0;
+		__atomic_add_fetch(&self->loops, 1, __ATOMIC_RELAXED);
+	}
+
+	self->raw.frameBuf2 = mapFrame(self, self->nextIndex, &self->next);
+	return self->raw.frameBuf2 != NULL;
+}
+
+/**
+ * Copies frameBuf1 into OUTPUT buffer _index, line by line when the driver
+ * pads lines. Returns the bytes copied.
+ */
+static size_t fillBuffer(FifoInjector *self, unsigned int _index) {
+	const PixelFormatInfo *info = PixelFormat_info(self->pixelFormat);
+	unsigned char *dst = (unsigned char *) self->buffers[_index].start;
+	const unsigned char *src = (const unsigned char *) self->raw.frameBuf1;
+	size_t capacity = self->buffers[_index].length;
+	size_t available = self->current.size;
+
+	if (self->bytesperline == self->rawBytesperline) {
+		size_t size = (available < capacity) ? available : capacity;
+		memcpy(dst, src, size);
+		return size;
+	}
+
+	size_t read = 0, written = 0, copied = 0;
+	unsigned int p, row;
+	for (p = 0; p < info->planesCount; p++) {
+		size_t srcStride = PixelFormat_bytesPerLine(info, p, self->rawBytesperline);
+		size_t dstStride = PixelFormat_bytesPerLine(info, p, self->bytesperline);
+		size_t line = (srcStride < dstStride) ? srcStride : dstStride;
+		unsigned int rows = self->raw.height / info->planes[p].verticalSubsampling;
+
+		for (row = 0; row < rows && read + srcStride <= available && written + dstStride <= capacity; row++) {
+			memcpy(dst + written, src + read, line);
+			read += srcStride;
+			written += dstStride;
+			copied += line;
+		}
+	}
+
+	return copied;
+}
+
+/**
+ * Fills OUTPUT buffer _index with the next frame and queues it.
+ */
+static int queue(FifoInjector *self, unsigned int _index) {
+	struct v4l2_buffer buf;
+	struct timespec now;
+	CLEAR(buf);
+
+	long long begin = monotonicUsec();
+	size_t copied = fillBuffer(self, _index);
+	unsigned long long usec = (unsigned long long) (monotonicUsec() - begin);
+
+	// drivers that copy the timestamp to the capture side get the monotonic clock
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	buf.timestamp.tv_sec = now.tv_sec;
+	buf.timestamp.tv_usec = now.tv_nsec / 1000;
+	buf.index = _index;
+	buf.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+	buf.memory = V4L2_MEMORY_MMAP;
+	buf.field = V4L2_FIELD_NONE;
+	buf.bytesused = (self->sizeimage > 0 && self->sizeimage <= self->buffers[_index].length) ?
+			self->sizeimage : (unsigned int) copied;
+
+	if (ioctl(self->fd, VIDIOC_QBUF, &buf) < 0) {
+		sprintf(self->error, "VIDIOC_QBUF(%s): %s", self->device, ERRSTR);
+		return 0;
+	}
+
+	self->copyUsecSum += usec;
+	if (usec > self->copyUsecMax) {
+		self->copyUsecMax = usec;
+	}
+	__atomic_add_fetch(&self->bytes, copied, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&self->injected, 1, __ATOMIC_RELAXED);
+
+	return advance(self);
+}
+
+/**
+ * Refills every buffer the device hands back, until stop().
+ */
+static void *injectThread(void *_arg) {
+	FifoInjector *self = (FifoInjector *) _arg;
+
+	while (__atomic_load_n(&self->isRunning, __ATOMIC_ACQUIRE)) {
+		struct pollfd pfd;
+		pfd.fd = self->fd;
+		pfd.events = POLLOUT;
+		pfd.revents = 0;
+
+		long long begin = monotonicUsec();
+		int ret = poll(&pfd, 1, POLL_MSEC);
+		self->waitUsecSum += (unsigned long long) (monotonicUsec() - begin);
+
+		if (ret < 0 && errno == EINTR) {
+			continue;
+		}
+		if (ret < 0) {
+			sprintf(self->error, "poll(%s): %s", self->device, ERRSTR);
+			break;
+		}
+		if (ret == 0) {
+			continue;
+		}
+
+		struct v4l2_buffer buf;
+		CLEAR(buf);
+		buf.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+		buf.memory = V4L2_MEMORY_MMAP;
+
+		if (ioctl(self->fd, VIDIOC_DQBUF, &buf) < 0) {
+			if (errno == EAGAIN) {
+				continue;
+			}
+			sprintf(self->error, "VIDIOC_DQBUF(%s): %s", self->device, ERRSTR);
+			break;
+		}
+
+		if (buf.index >= self->buffersCount || !queue(self, buf.index)) {
+			break;
+		}
+	}
+
+	if (__atomic_load_n(&self->isRunning, __ATOMIC_ACQUIRE)) {
+		__atomic_store_n(&self->hasFailed, true, __ATOMIC_RELEASE);
+	}
+	return NULL;
+}
+
+/**
+ * Queues every OUTPUT buffer, starts the device and then the thread that
+ * keeps it fed.
+ */
+static int start(FifoInjector *self) {
+	enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+	unsigned int i;
+
+	if (self->fd < 0 || self->isRunning) {
+		return 0;
+	}
+
+	self->injected = 0;
+	self->loops = 0;
+	self->bytes = 0;
+	self->copyUsecSum = 0;
+	self->copyUsecMax = 0;
+	self->waitUsecSum = 0;
+	self->hasFailed = false;
+	self->startedUsec = monotonicUsec();
+	self->stoppedUsec = 0;
+
+	for (i = 0; i < self->buffersCount; i++) {
+		if (!queue(self, i)) {
+			return 0;
+		}
+	}
+
+	if (ioctl(self->fd, VIDIOC_STREAMON, &type) < 0) {
+		sprintf(self->error, "VIDIOC_STREAMON(%s): %s", self->device, ERRSTR);
+		return 0;
+	}
+	self->isStreaming = true;
+
+	self->isRunning = true;
+	if (pthread_create(&self->thread, NULL, injectThread, self) != 0) {
+		self->isRunning = false;
+		sprintf(self->error, "Cannot start the injecting thread.");
+		return 0;
+	}
+
+	return 1;
+}
+
+static void stop(FifoInjector *self) {
+	enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+
+	if (self->isRunning) {
+		__atomic_store_n(&self->isRunning, false, __ATOMIC_RELEASE);
+		pthread_join(self->thread, NULL);
+	}
+
+	if (self->isStreaming) {
+		ioctl(self->fd, VIDIOC_STREAMOFF, &type);
+		self->isStreaming = false;
+		self->stoppedUsec = monotonicUsec();
+	}
+}
+
+/**
+ * Frames a second since start(), up to stop() once stopped.
+ */
+static double rate(FifoInjector *self) {
+	long long end = (self->stoppedUsec > 0) ? self->stoppedUsec : monotonicUsec();
+
+	if (self->startedUsec <= 0 || end <= self->startedUsec) {
+		return 0;
+	}
+
+	return (double) __atomic_load_n(&self->injected, __ATOMIC_RELAXED) * 1000000.0 / (double) (end - self->startedUsec);
+}
+
+/**
+ * The regular files of a directory source, in name order.
+ */
+static int listFrames(FifoInjector *self) {
+	struct dirent **entries = NULL;
+	int i, count = scandir(self->source, &entries, NULL, alphasort);
+
+	if (count < 0) {
+		sprintf(self->error, "Cannot list %s: %d, %s", self->source, errno, ERRSTR);
+		return 0;
+	}
+
+	self->files = (char **) calloc(count + 1, sizeof(char *));
+	self->raw.count = 0;
+	for (i = 0; i < count; i++) {
+		struct stat st;
+		char *path = (char *) calloc(strlen(self->source) + strlen(entries[i]->d_name) + 2, sizeof(char));
+		sprintf(path, "%s/%s", self->source, entries[i]->d_name);
+
+		if (stat(path, &st) == 0 && S_ISREG(st.st_mode)) {
+			self->files[self->raw.count++] = path;
+		} else {
+			free(path);
+		}
+		free(entries[i]);
+	}
+	free(entries);
+
+	if (self->raw.count == 0) {
+		sprintf(self->error, "%s holds no frames.", self->source);
+		return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * A file of frames back to back, or a directory of one frame per file.
+ */
+static int openSource(FifoInjector *self) {
+	const PixelFormatInfo *info = PixelFormat_info(self->pixelFormat);
+	struct stat st;
+	unsigned int p;
+
+	self->rawBytesperline = (self->raw.width * info->planes[0].bitsPerPixel) / 8;
+	self->raw.size = 0;
+	for (p = 0; p < info->planesCount; p++) {
+		self->raw.size += PixelFormat_bytesPerLine(info, p, self->rawBytesperline) *
+						  (self->raw.height / info->planes[p].verticalSubsampling);
+	}
+
+	if (self->raw.size <= 0) {
+		sprintf(self->error, "No raw frames of %dx%d.", self->raw.width, self->raw.height);
+		return 0;
+	}
+
+	if (stat(self->source, &st) < 0) {
+		sprintf(self->error, "Cannot stat %s: %d, %s", self->source, errno, ERRSTR);
+		return 0;
+	}
+
+	if (S_ISDIR(st.st_mode)) {
+		return listFrames(self);
+	}
+
+	self->raw.fd = open(self->source, O_RDONLY | O_CLOEXEC);
+	if (self->raw.fd < 0) {
+		sprintf(self->error, "Cannot open %s: %d, %s", self->source, errno, ERRSTR);
+		return 0;
+	}
+
+	// trailing bytes short of a frame are left out
+	self->raw.count = (int) (st.st_size / self->raw.size);
+	if (self->raw.count <= 0) {
+		sprintf(self->error, "%s is smaller than one %dx%d %s frame of %d bytes.", self->source,
+				self->raw.width, self->raw.height, PixelFormat_name(self->pixelFormat), self->raw.size);
+		return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * Sets the format of the OUTPUT node and maps its buffers.
+ */
+static int openDevice(FifoInjector *self) {
+	struct v4l2_capability cap;
+	struct v4l2_streamparm parm;
+	struct v4l2_format fmt;
+	struct v4l2_requestbuffers req;
+	unsigned int i;
+
+	CLEAR(cap);
+	CLEAR(parm);
+	CLEAR(fmt);
+	CLEAR(req);
+
+	self->fd = open(self->device, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+	if (self->fd < 0) {
+		sprintf(self->error, "Cannot open %s: %d, %s", self->device, errno, ERRSTR);
+		return 0;
+	}
+
+	if (ioctl(self->fd, VIDIOC_QUERYCAP, &cap) < 0) {
+		sprintf(self->error, "%s is not a device.", self->device);
+		return 0;
+	}
+
+	unsigned int capabilities = (cap.capabilities & V4L2_CAP_DEVICE_CAPS) ? cap.device_caps : cap.capabilities;
+	if (!(capabilities & V4L2_CAP_VIDEO_OUTPUT)) {
+		sprintf(self->error, "%s is not a FIFO capable device.", self->device);
+		return 0;
+	}
+
+	// only atomisp knows this mode; others refuse it and carry on
+	parm.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+	parm.parm.output.outputmode = OUTPUT_MODE_FILE;
+	ioctl(self->fd, VIDIOC_S_PARM, &parm);
+
+	fmt.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+	fmt.fmt.pix.width = self->raw.width;
+	fmt.fmt.pix.height = self->raw.height;
+	fmt.fmt.pix.pixelformat = self->raw.format;
+	fmt.fmt.pix.field = V4L2_FIELD_NONE;
+	if (ioctl(self->fd, VIDIOC_S_FMT, &fmt) < 0) {
+		sprintf(self->error, "VIDIOC_S_FMT(%s): %s", self->device, ERRSTR);
+		return 0;
+	}
+
+	if (fmt.fmt.pix.pixelformat != (unsigned int) self->raw.format ||
+		fmt.fmt.pix.width != (unsigned int) self->raw.width || fmt.fmt.pix.height != (unsigned int) self->raw.height) {
+		sprintf(self->error, "%s takes %.4s at %ux%u, not %s at %dx%d.", self->device,
+				(const char *) &fmt.fmt.pix.pixelformat, fmt.fmt.pix.width, fmt.fmt.pix.height,
+				PixelFormat_name(self->pixelFormat), self->raw.width, self->raw.height);
+		return 0;
+	}
+	self->bytesperline = (fmt.fmt.pix.bytesperline > 0) ? fmt.fmt.pix.bytesperline : self->rawBytesperline;
+	self->sizeimage = fmt.fmt.pix.sizeimage;
+
+	req.count = FIFO_BUFFER_COUNT;
+	req.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+	req.memory = V4L2_MEMORY_MMAP;
+	if (ioctl(self->fd, VIDIOC_REQBUFS, &req) < 0 || req.count == 0) {
+		sprintf(self->error, "VIDIOC_REQBUFS(%s): %s", self->device, ERRSTR);
+		return 0;
+	}
+
+	self->buffers = (FifoOutputBuffer *) calloc(req.count, sizeof(FifoOutputBuffer));
+	for (self->buffersCount = 0; self->buffersCount < req.count; self->buffersCount++) {
+		struct v4l2_buffer buf;
+		CLEAR(buf);
+		buf.index = self->buffersCount;
+		buf.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+		buf.memory = V4L2_MEMORY_MMAP;
+
+		if (ioctl(self->fd, VIDIOC_QUERYBUF, &buf) < 0) {
+			sprintf(self->error, "VIDIOC_QUERYBUF(%s): %s", self->device, ERRSTR);
+			return 0;
+		}
+
+		FifoOutputBuffer *buffer = &self->buffers[self->buffersCount];
+		buffer->length = buf.length;
+		buffer->start = mmap(NULL, buf.length, PROT_READ | PROT_WRITE, MAP_SHARED, self->fd, buf.m.offset);
+		if (buffer->start == MAP_FAILED) {
+			buffer->start = NULL;
+			sprintf(self->error, "Cannot map OUTPUT buffer %u of %s: %s", self->buffersCount, self->device, ERRSTR);
+			return 0;
+		}
+	}
+
+	for (i = 0; i < self->buffersCount; i++) {
+		// a source frame larger than the buffer is cut short
+		if (self->buffers[i].length < (size_t) self->raw.size && self->bytesperline == self->rawBytesperline) {
+			sprintf(self->error, "%s has %zu byte buffers for %d byte frames; frames are cut short.",
+					self->device, self->buffers[i].length, self->raw.size);
+			break;
+		}
+	}
+
+	return 1;
+}
+
+static void FifoInjector_init(FifoInjector *self, const char *_device, const char *_source,
+							  PixelFormat_t _pixelFormat, int _width, int _height) {
+	self->device = strdup(_device);
+	self->source = strdup(_source);
+	self->fd = -1;
+	self->pixelFormat = _pixelFormat;
+	memset(&self->raw, 0, sizeof(self->raw));
+	self->raw.fd = -1;
+	self->raw.width = _width;
+	self->raw.height = _height;
+	self->raw.format = PixelFormat_info(_pixelFormat)->fourcc;
+	memset(&self->current, 0, sizeof(self->current));
+	memset(&self->next, 0, sizeof(self->next));
+	self->files = NULL;
+	self->nextIndex = 0;
+	self->buffers = NULL;
+	self->buffersCount = 0;
+	self->isRunning = false;
+	self->isStreaming = false;
+	self->hasFailed = false;
+	self->error = (char *) calloc(256, sizeof(char));
+
+	// methods
+	self->start = start;
+	self->stop = stop;
+	self->rate = rate;
+
+	if (!openSource(self)) {
+		return;
+	}
+
+	self->raw.frameBuf1 = mapFrame(self, 0, &self->current);
+	self->nextIndex = (self->raw.count > 1) ? 1 : 0;
+	self->raw.frameBuf2 = (self->raw.frameBuf1 != NULL) ? mapFrame(self, self->nextIndex, &self->next) : NULL;
+	if (self->raw.frameBuf2 == NULL) {
+		return;
+	}
+
+	if (!openDevice(self) && self->fd >= 0) {
+		close(self->fd);
+		self->fd = -1;
+	}
+}
+
+/**
+ * Feeds frames of _width x _height in _pixelFormat from _source, a file or
+ * a directory, to the OUTPUT node _device. Check fd (and error) on the
+ * returned object; it is -1 when there is nothing to inject or nowhere to.
+ */
+FifoInjector *FifoInjector_newWith(const char *_device, const char *_source, PixelFormat_t _pixelFormat,
+								   int _width, int _height) {
+	FifoInjector *injector = (FifoInjector *) calloc(1, sizeof(FifoInjector));
+	FifoInjector_init(injector, _device, _source, _pixelFormat, _width, _height);
+	return injector;
+}
+
+void FifoInjector_dispose(FifoInjector *self) {
+	if (self == NULL) {
+		return;
+	}
+
+	stop(self);
+
+	unsigned int i;
+	for (i = 0; i < self->buffersCount; i++) {
+		munmap(self->buffers[i].start, self->buffers[i].length);
+	}
+	if (self->fd >= 0) {
+		close(self->fd);
+	}
+
+	unmapFrame(&self->current);
+	unmapFrame(&self->next);
+	if (self->raw.fd >= 0) {
+		close(self->raw.fd);
+	}
+
+	for (i = 0; self->files != NULL && self->files[i] != NULL; i++) {
+		free(self->files[i]);
+	}
+	free(self->files);
+	free(self->buffers);
+	free(self->device);
+	free(self->source);
+	free(self->error);
+	free(self);
+}
@@ -0,0 +1,110 @@
+/**
+	This file is part of Intel Atom ISP Test App.
+
+	Intel Atom ISP Test App is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Intel Atom ISP Test App is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Intel Atom ISP Test App.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FIFO_INJECTOR_H_
+#define FIFO_INJECTOR_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "utilities.h"
+
+#define FIFO_DEV_PATH "/dev/video2"	/* the ISP's input node; vivid's video output node will do too */
+#define FIFO_BUFFER_COUNT 4			/* OUTPUT buffers requested */
+
+/**
+ * The raw source, mapped a frame at a time: frameBuf1 is the frame going
+ * into the next OUTPUT buffer, frameBuf2 the one after it, read ahead.
+ */
+typedef struct FIFO_BUF_S {
+	int fd;				/* the source file; -1 for a directory */
+	void *frameBuf1;
+	void *frameBuf2;
+	int	width;
+	int	height;
+	int format;			/* V4L2 fourcc */
+	int	size;			/* bytes of a frame in the source, lines unpadded */
+	int	count;			/* frames in the source */
+	int	bayerOrder;		/* Reserved */
+	int	bitDepth;		/* Reserved */
+} FIFOBuffer;
+
+typedef struct FIFO_MAPPING_S {
+	void *base;			/* page aligned, as mapped */
+	size_t length;
+	size_t size;		/* bytes of the frame in it */
+} FifoMapping;
+
+typedef struct FIFO_OUTPUT_BUF_S {
+	void *start;
+	size_t length;
+} FifoOutputBuffer;
+
+/**
+ * Feeds raw frames into a V4L2 OUTPUT node, such as the ISP's FIFO input,
+ * for as long as it runs.
+ *
+ * The source is one file of frames back to back, or a directory with a
+ * frame per file taken in name order; either loops. Frames are mapped
+ * rather than read, and the one after the frame being copied is mapped
+ * with MADV_WILLNEED, so the disk reads ahead while the device works.
+ * Once all OUTPUT buffers are queued, a thread refills each one as the
+ * device hands it back, so the device sets the rate.
+ */
+typedef struct FIFO_INJECTOR_S {
+	char *device;
+	char *source;
+	int fd;				/* the OUTPUT node */
+	PixelFormat_t pixelFormat;
+	FIFOBuffer raw;
+	FifoMapping current;	/* behind raw.frameBuf1 */
+	FifoMapping next;		/* behind raw.frameBuf2 */
+	char **files;			/* of a directory source */
+	unsigned int nextIndex;	/* source frame in frameBuf2 */
+
+	unsigned int rawBytesperline;	/* of the source's first plane */
+	unsigned int bytesperline;		/* the driver's */
+	unsigned int sizeimage;
+	FifoOutputBuffer *buffers;
+	unsigned int buffersCount;
+
+	pthread_t thread;
+	bool isRunning;
+	bool isStreaming;
+	bool hasFailed;
+
+	// written by the injecting thread once it runs
+	unsigned long injected;
+	unsigned long loops;	/* passes over the source */
+	unsigned long long bytes;
+	unsigned long long copyUsecSum;
+	unsigned long long copyUsecMax;
+	unsigned long long waitUsecSum;	/* for the device to hand a buffer back */
+	long long startedUsec;
+	long long stoppedUsec;
+	char *error;
+
+	int (*start) (struct FIFO_INJECTOR_S *);
+	void (*stop) (struct FIFO_INJECTOR_S *);
+	double (*rate) (struct FIFO_INJECTOR_S *);
+} FifoInjector;
+
+FifoInjector *FifoInjector_newWith(const char *, const char *, PixelFormat_t, int, int);
+void FifoInjector_dispose(FifoInjector *);
+
+#endif /* FIFO_INJECTOR_H_ */
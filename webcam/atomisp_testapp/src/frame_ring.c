@@ -0,0 +1,136 @@
+/**
+	This file is part of Intel Atom ISP Test App.
+
+	Intel Atom ISP Test App is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Intel Atom ISP Test App is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Intel Atom ISP Test App.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "frame_ring.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <semaphore.h>
+
+static bool push(FrameRing *self, const FrameDesc *_desc) {
+	unsigned int head = self->head;
+	unsigned int tail = __atomic_load_n(&self->tail, __ATOMIC_ACQUIRE);
+
+	if (head - tail >= self->capacity) {
+		// consumer is behind; drop the newest frame rather than stall capture
+		__atomic_add_fetch(&self->dropped, 1, __ATOMIC_RELAXED);
+		return false;
+	}
+
+	self->slots[head & self->mask] = *_desc;
+	__atomic_store_n(&self->head, head + 1, __ATOMIC_RELEASE);
+	__atomic_add_fetch(&self->pushed, 1, __ATOMIC_RELAXED);
+
+	sem_post(&self->ready);
+	return true;
+}
+
+static FrameDesc *acquire(FrameRing *self, int _timeoutMs) {
+	struct timespec deadline;
+	int ret;
+
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += _timeoutMs / 1000;
+	deadline.tv_nsec += (long) (_timeoutMs % 1000) * 1000000L;
+	if (deadline.tv_nsec >= 1000000000L) {
+		deadline.tv_sec += 1;
+		deadline.tv_nsec -= 1000000000L;
+	}
+
+	do {
+		ret = sem_timedwait(&self->ready, &deadline);
+	} while (ret < 0 && errno == EINTR);
+
+	if (ret < 0) {
+		return NULL;
+	}
+
+	unsigned int tail = self->tail;
+	unsigned int head = __atomic_load_n(&self->head, __ATOMIC_ACQUIRE);
+	if (head == tail) {
+		return NULL;
+	}
+
+	return &self->slots[tail & self->mask];
+}
+
+static void release(FrameRing *self) {
+	__atomic_store_n(&self->tail, self->tail + 1, __ATOMIC_RELEASE);
+}
+
+static unsigned int depth(FrameRing *self) {
+	unsigned int head = __atomic_load_n(&self->head, __ATOMIC_ACQUIRE);
+	unsigned int tail = __atomic_load_n(&self->tail, __ATOMIC_ACQUIRE);
+	return head - tail;
+}
+
+/**
+ * Only call while the producer is stopped.
+ */
+static void reset(FrameRing *self) {
+	while (sem_trywait(&self->ready) == 0) {
+		// drain
+	}
+	self->head = 0;
+	self->tail = 0;
+	self->pushed = 0;
+	self->dropped = 0;
+}
+
+static void FrameRing_init(FrameRing *self, unsigned int _capacity) {
+	unsigned int slots = 1;
+
+	// round up to a power of two so the index wraps with a mask
+	while (slots < _capacity) {
+		slots <<= 1;
+	}
+
+	self->capacity = _capacity;
+	self->mask = slots - 1;
+	self->slots = (FrameDesc *) calloc(slots, sizeof(FrameDesc));
+	self->head = 0;
+	self->tail = 0;
+	self->pushed = 0;
+	self->dropped = 0;
+	sem_init(&self->ready, 0, 0);
+
+	// methods
+	self->push = push;
+	self->acquire = acquire;
+	self->release = release;
+	self->depth = depth;
+	self->reset = reset;
+}
+
+FrameRing *FrameRing_newWith(unsigned int _capacity) {
+	FrameRing *ring = (FrameRing *) calloc(1, sizeof(FrameRing));
+	FrameRing_init(ring, (_capacity > 0) ? _capacity : FRAME_RING_DEFAULT_DEPTH);
+	return ring;
+}
+
+void FrameRing_dispose(FrameRing *self) {
+	if (self == NULL) {
+		return;
+	}
+
+	sem_destroy(&self->ready);
+	free(self->slots);
+	free(self);
+}
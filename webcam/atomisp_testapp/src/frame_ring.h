@@ -0,0 +1,76 @@
+/**
+	This file is part of Intel Atom ISP Test App.
+
+	Intel Atom ISP Test App is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Intel Atom ISP Test App is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Intel Atom ISP Test App.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FRAME_RING_H_
+#define FRAME_RING_H_
+
+#include <stdbool.h>
+#include <time.h>
+#include <semaphore.h>
+
+#include "video.h"
+
+#define FRAME_RING_DEFAULT_DEPTH 4
+
+/**
+ * One captured frame as handed from the capture thread to the render thread.
+ */
+typedef struct FRAME_DESC_S {
+	long long frame;
+	VideoFrame video;	/* held from Video.acquire() until the consumer releases it */
+	struct timespec captured;	/* CLOCK_MONOTONIC at dequeue */
+
+	// CLOCK_MONOTONIC, stamped by the render thread; zero when skipped
+	struct timespec uploadStarted;
+	struct timespec uploadEnded;
+	struct timespec drawn;			/* before the buffer swap */
+	struct timespec presented;		/* after the buffer swap */
+	unsigned int textureSet;		/* uploaded into; see PlaneTextures */
+} FrameDesc;
+
+/**
+ * Bounded single-producer/single-consumer ring of frame descriptors.
+ * Holds at most `capacity` frames; the slot array is rounded up to a power
+ * of two so indices wrap with a mask.
+ *
+ * The producer owns a slot until push() publishes it. The consumer owns the
+ * slot returned by acquire() until release() hands it back, so a slot that is
+ * still being rendered is never overwritten. When the ring is full the newest
+ * frame is dropped and counted instead of blocking the producer.
+ */
+typedef struct FRAME_RING_S {
+	unsigned int capacity;
+	unsigned int mask;
+	FrameDesc *slots;
+
+	unsigned int head;	/* written by the producer only */
+	unsigned int tail;	/* written by the consumer only */
+	unsigned long pushed;
+	unsigned long dropped;
+	sem_t ready;
+
+	bool (*push) (struct FRAME_RING_S *, const FrameDesc *);
+	FrameDesc *(*acquire) (struct FRAME_RING_S *, int);
+	void (*release) (struct FRAME_RING_S *);
+	unsigned int (*depth) (struct FRAME_RING_S *);
+	void (*reset) (struct FRAME_RING_S *);
+} FrameRing;
+
+FrameRing *FrameRing_newWith(unsigned int);
+void FrameRing_dispose(FrameRing *);
+
+#endif /* FRAME_RING_H_ */
@@ -0,0 +1,1274 @@
+/**
+	This file is part of Intel Atom ISP Test App.
+
+	Intel Atom ISP Test App is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Intel Atom ISP Test App is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Intel Atom ISP Test App.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * isp-bench: runs the capture and render pipeline of isp-mipi-test without a
+ * window, rendering into an EGL pbuffer, over every combination of the
+ * resolutions, pixel formats, buffer counts and IO methods asked for, and
+ * writes throughput and latency percentiles per combination as JSON.
+ *
+ * Each combination is run -r times. The fps and p99 latency of every run can
+ * be stored as a baseline (-s) and later runs checked against it (-B); a
+ * significant regression makes the exit code 3.
+ *
+ *   isp-bench -d /dev/video0 -w 640x480,1280x720 -c NV12,YV16 -b 4,8 -i mmap,dmabuf -o bench.json
+ *   isp-bench -d /dev/video0 -c NV12 -r 5 -s nv12.baseline
+ *   isp-bench -d /dev/video0 -c NV12 -r 5 -B nv12.baseline
+ *
+ * -d also takes a recording of isp-mipi-test -o, played back instead of a
+ * camera; with -x as fast as the pipeline takes the frames, which makes
+ * runs comparable on any machine.
+ *
+ *   isp-bench -d record.raw -w 1280x720 -c YUYV -x -r 5 -B yuyv.baseline
+ *
+ * -d pattern-bars, pattern-gradient, pattern-noise or pattern-mix generates
+ * test frames of any size and format instead, at 30 fps or the rate after
+ * an '@'; with -x, again, as fast as they are taken.
+ *
+ *   isp-bench -d pattern-mix -w 640x480,1920x1080 -c NV12,YUYV,BA10 -x
+ *   isp-bench -d pattern-noise@120 -w 1280x720 -c NV12
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GLES2/gl2.h>
+
+#include "utilities.h"
+#include "pixel_format.h"
+#include "video.h"
+#include "frame_ring.h"
+#include "capture_engine.h"
+#include "plane_textures.h"
+#include "shader.h"
+#include "samples.h"
+#include "trace.h"
+#include "baseline.h"
+#include "color_convert.h"
+#include "worker_pool.h"
+
+#define APP_NAME "isp-bench"
+
+#ifndef APP_BUILD_DATE
+#define APP_BUILD "unknown"
+#else
+#define Str(arg) #arg
+#define StrValue(arg) Str(arg)
+#define APP_BUILD StrValue(APP_BUILD_DATE)
+#endif
+
+// EGL_MESA_platform_surfaceless; older eglext.h lack it
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+
+#define BENCH_MAX_VALUES 16
+#define BENCH_FRAME_COUNT 300
+#define BENCH_WARMUP_COUNT 30
+#define BENCH_REPEAT_COUNT 3
+#define BENCH_THRESHOLD_PERCENT 5.0
+#define BENCH_REPORT_FILE "isp-bench.json"
+#define BENCH_LOG_FILE "isp-bench.log"
+#define FRAME_WAIT_MSEC 100
+#define FRAME_TIMEOUT_MSEC 3000	/* a configuration without a frame for this long is given up */
+
+typedef struct BENCH_CONFIG_S {
+	char *device;
+	int mipiPort;
+	Resolution sizes[BENCH_MAX_VALUES];
+	unsigned int sizesCount;
+	PixelFormat_t formats[BENCH_MAX_VALUES];
+	unsigned int formatsCount;
+	int bufferCounts[BENCH_MAX_VALUES];
+	unsigned int bufferCountsCount;
+	IOMethod_t ioMethods[BENCH_MAX_VALUES];
+	unsigned int ioMethodsCount;
+	unsigned int textureSets[BENCH_MAX_VALUES];
+	unsigned int textureSetsCount;
+	bool isPipelined;	/* -G: swap every frame instead of glFinish */
+	DmaBufBackend_t dmaBufBackend;
+	long frameCount;
+	long warmupCount;
+	bool isConvert;		/* draw through the format's shader, not just upload */
+	bool isCpuConvert;	/* convert every frame to RGBA on the CPU as well */
+	bool isNoRender;	/* capture only */
+	bool isReplayFast;	/* a recording as device goes flat out */
+	int workerThreads;	/* 0 is one per CPU */
+	int repeatCount;	/* runs per combination */
+	double thresholdPercent;	/* smallest change reported as a regression */
+	char *reportFile;
+	char *baselineFile;	/* compared against; NULL for none */
+	char *saveFile;		/* baseline written to; NULL for none */
+} BenchConfig_t;
+
+/**
+ * What one combination measured over all its runs. Times are usec.
+ */
+typedef struct BENCH_RESULT_S {
+	Resolution size;
+	PixelFormat_t format;
+	int requestedBuffers;
+	unsigned int grantedBuffers;
+	IOMethod_t ioMethod;
+	unsigned int textureSets;
+	const char *status;		/* ok, error or timeout */
+	char error[256];
+	bool isRendered;
+	int runsCount;
+	long frames;
+	unsigned long captured;
+	double elapsed;			/* sec, over the measured frames */
+	double fps;
+	double captureFps;
+	unsigned long dropped;	/* ring full */
+	unsigned long driverDropped;
+	BaselineEntry runs;		/* fps and p99 latency of each run */
+	bool hasBaseline;
+	BaselineComparison fpsChange;
+	BaselineComparison latencyChange;
+	const char *cpuKernel;	/* NULL without -k */
+	Samples *runLatency;	/* of the current run only */
+	Samples *latency;		/* driver timestamp to rendered */
+	Samples *queued;		/* dequeued to picked up by the render loop */
+	Samples *cpuConvert;
+	Samples *upload;
+	Samples *render;		/* draw and glFinish, or draw and swap with -G */
+	Samples *draw;			/* -G only */
+	Samples *swap;			/* -G only */
+	Samples *interval;		/* between rendered frames */
+} BenchResult;
+
+typedef struct BENCH_EGL_S {
+	EGLDisplay display;
+	EGLConfig config;
+	EGLContext context;
+	EGLSurface surface;
+	Resolution surfaceSize;
+} BenchEGL;
+
+static volatile sig_atomic_t g_IsStopping = 0;
+static WorkerPool *g_Workers = NULL;	// demosaics BA10 frames and runs -k, in row tiles
+
+static GLfloat quadVertices[] = {
+	-1.0f,  1.0f, 0.0f,
+	-1.0f, -1.0f, 0.0f,
+	 1.0f,  1.0f, 0.0f,
+	 1.0f, -1.0f, 0.0f
+};
+
+static GLfloat quadTexCoords[] = {
+	0.0f, 0.0f,
+	0.0f, 1.0f,
+	1.0f, 0.0f,
+	1.0f, 1.0f
+};
+
+static GLubyte quadIndices[] = {
+	0, 1, 3, 0, 3, 2
+};
+
+static GLfloat identity[] = {
+	1.0f, 0.0f, 0.0f, 0.0f,
+	0.0f, 1.0f, 0.0f, 0.0f,
+	0.0f, 0.0f, 1.0f, 0.0f,
+	0.0f, 0.0f, 0.0f, 1.0f
+};
+
+static const char *IO_METHOD_NAMES[] = {
+	[IO_METHOD_READ] = "read",
+	[IO_METHOD_MMAP] = "mmap",
+	[IO_METHOD_USERPOINTER] = "userptr",
+	[IO_METHOD_DMABUF] = "dmabuf"
+};
+
+static void stopBench(int _signal) {
+	g_IsStopping = 1;
+}
+
+static void writeToLog(FILE *_hAppLog, const char *_fmt, ...) {
+	char buffer[1024];
+	va_list args;
+	va_start(args, _fmt);
+	vsnprintf(buffer, sizeof(buffer), _fmt, args);
+	va_end(args);
+
+	// log to screen
+	fprintf(stdout, "%s\n", buffer);
+	fflush(stdout);
+
+	// log to file
+	if (_hAppLog != NULL) {
+		fprintf(_hAppLog, "%s\n", buffer);
+		fflush(_hAppLog);
+	}
+}
+
+static void printUsage(const char *_app) {
+	fprintf(stdout, "Usage: %s [options]\n\n", _app);
+	fprintf(stdout, "Runs the capture and render pipeline headless over every combination below.\n");
+	fprintf(stdout, "Lists are comma separated.\n\n");
+	fprintf(stdout, "\t-d <device>        Device, recording or pattern-<kind>[@fps] to capture from (/dev/video0).\n");
+	fprintf(stdout, "\t-p <port>          MIPI port (0).\n");
+	fprintf(stdout, "\t-w <WxH,...>       Resolutions (640x480).\n");
+	fprintf(stdout, "\t-c <format,...>    Pixel formats: YUYV, UYVY, YVYU, VYUY, YV16, NV12, RGBP, RGB3, BA10 (NV12).\n");
+	fprintf(stdout, "\t-b <count,...>     Buffer counts to request (4).\n");
+	fprintf(stdout, "\t-i <method,...>    IO methods: mmap, userptr, dmabuf (mmap).\n");
+	fprintf(stdout, "\t-D <backend>       DMA buffer backend: auto, udmabuf, heap, gbm, intel (auto).\n");
+	fprintf(stdout, "\t-G <sets,...>      Texture sets uploaded into in turn, 1 to %d; frames are swapped, not\n"
+					"\t                   waited for with glFinish, and upload, draw and swap timed apart.\n",
+			PLANE_TEXTURES_MAX_SETS);
+	fprintf(stdout, "\t-n <frames>        Frames measured per run (%d).\n", BENCH_FRAME_COUNT);
+	fprintf(stdout, "\t-W <frames>        Frames rendered before measuring, per run (%d).\n", BENCH_WARMUP_COUNT);
+	fprintf(stdout, "\t-r <runs>          Runs per combination (%d).\n", BENCH_REPEAT_COUNT);
+	fprintf(stdout, "\t-C                 Convert: draw every frame through the format's shader.\n");
+	fprintf(stdout, "\t-k                 Also convert every frame to RGBA on the CPU.\n");
+	fprintf(stdout, "\t-j <threads>       Threads demosaicing BA10 and converting for -k (one per CPU).\n");
+	fprintf(stdout, "\t-N                 Capture only; no EGL.\n");
+	fprintf(stdout, "\t-x                 Replay a recording or generate a pattern as fast as possible.\n");
+	fprintf(stdout, "\t-o <file>          JSON report (%s).\n", BENCH_REPORT_FILE);
+	fprintf(stdout, "\t-s <file>          Store the runs as a baseline.\n");
+	fprintf(stdout, "\t-B <file>          Compare the runs against a baseline; exit with 3 on a regression.\n");
+	fprintf(stdout, "\t-t <percent>       Smallest significant change that is a regression (%.0f).\n\n",
+			BENCH_THRESHOLD_PERCENT);
+	fprintf(stdout, "Formats without a GL texture format are captured only.\n");
+	fflush(stdout);
+}
+
+static bool parseSizes(BenchConfig_t *_config, char *_list) {
+	char *save = NULL;
+	char *token;
+
+	_config->sizesCount = 0;
+	for (token = strtok_r(_list, ",", &save); token != NULL; token = strtok_r(NULL, ",", &save)) {
+		Resolution *size = &_config->sizes[_config->sizesCount];
+		if (_config->sizesCount >= BENCH_MAX_VALUES ||
+			sscanf(token, "%dx%d", &size->width, &size->height) != 2 || size->width <= 0 || size->height <= 0) {
+			fprintf(stderr, "Invalid resolution: %s\n", token);
+			return false;
+		}
+		_config->sizesCount++;
+	}
+
+	return _config->sizesCount > 0;
+}
+
+static bool parseFormats(BenchConfig_t *_config, char *_list) {
+	char *save = NULL;
+	char *token;
+
+	_config->formatsCount = 0;
+	for (token = strtok_r(_list, ",", &save); token != NULL; token = strtok_r(NULL, ",", &save)) {
+		if (_config->formatsCount >= BENCH_MAX_VALUES ||
+			!PixelFormat_parse(token, &_config->formats[_config->formatsCount])) {
+			fprintf(stderr, "Invalid pixel format: %s\n", token);
+			return false;
+		}
+		_config->formatsCount++;
+	}
+
+	return _config->formatsCount > 0;
+}
+
+static bool parseBufferCounts(BenchConfig_t *_config, char *_list) {
+	char *save = NULL;
+	char *token;
+
+	_config->bufferCountsCount = 0;
+	for (token = strtok_r(_list, ",", &save); token != NULL; token = strtok_r(NULL, ",", &save)) {
+		int count = atoi(token);
+		if (_config->bufferCountsCount >= BENCH_MAX_VALUES || count <= 0) {
+			fprintf(stderr, "Invalid buffer count: %s\n", token);
+			return false;
+		}
+		_config->bufferCounts[_config->bufferCountsCount++] = count;
+	}
+
+	return _config->bufferCountsCount > 0;
+}
+
+static bool parseIOMethods(BenchConfig_t *_config, char *_list) {
+	char *save = NULL;
+	char *token;
+
+	_config->ioMethodsCount = 0;
+	for (token = strtok_r(_list, ",", &save); token != NULL; token = strtok_r(NULL, ",", &save)) {
+		IOMethod_t method;
+		if (strcmp(token, "mmap") == 0) {
+			method = IO_METHOD_MMAP;
+		} else if (strcmp(token, "userptr") == 0) {
+			method = IO_METHOD_USERPOINTER;
+		} else if (strcmp(token, "dmabuf") == 0) {
+			method = IO_METHOD_DMABUF;
+		} else {
+			fprintf(stderr, "Invalid IO method: %s\n", token);
+			return false;
+		}
+
+		if (_config->ioMethodsCount >= BENCH_MAX_VALUES) {
+			fprintf(stderr, "Too many IO methods.\n");
+			return false;
+		}
+		_config->ioMethods[_config->ioMethodsCount++] = method;
+	}
+
+	return _config->ioMethodsCount > 0;
+}
+
+static bool parseTextureSets(BenchConfig_t *_config, char *_list) {
+	char *save = NULL;
+	char *token;
+
+	_config->textureSetsCount = 0;
+	for (token = strtok_r(_list, ",", &save); token != NULL; token = strtok_r(NULL, ",", &save)) {
+		int count = atoi(token);
+		if (_config->textureSetsCount >= BENCH_MAX_VALUES || count <= 0 || count > PLANE_TEXTURES_MAX_SETS) {
+			fprintf(stderr, "Invalid texture set count: %s (1 to %d)\n", token, PLANE_TEXTURES_MAX_SETS);
+			return false;
+		}
+		_config->textureSets[_config->textureSetsCount++] = count;
+	}
+
+	return _config->textureSetsCount > 0;
+}
+
+static bool parseArgs(BenchConfig_t *_config, int argc, char *argv[]) {
+	int option;
+
+	_config->device = "/dev/video0";
+	_config->mipiPort = 0;
+	_config->sizes[0].width = 640;
+	_config->sizes[0].height = 480;
+	_config->sizesCount = 1;
+	_config->formats[0] = NV12;
+	_config->formatsCount = 1;
+	_config->bufferCounts[0] = 4;
+	_config->bufferCountsCount = 1;
+	_config->ioMethods[0] = IO_METHOD_MMAP;
+	_config->ioMethodsCount = 1;
+	_config->textureSets[0] = 1;
+	_config->textureSetsCount = 1;
+	_config->isPipelined = false;
+	_config->dmaBufBackend = DMABUF_BACKEND_AUTO;
+	_config->frameCount = BENCH_FRAME_COUNT;
+	_config->warmupCount = BENCH_WARMUP_COUNT;
+	_config->isConvert = false;
+	_config->isCpuConvert = false;
+	_config->workerThreads = 0;
+	_config->isNoRender = false;
+	_config->isReplayFast = false;
+	_config->repeatCount = BENCH_REPEAT_COUNT;
+	_config->thresholdPercent = BENCH_THRESHOLD_PERCENT;
+	_config->reportFile = BENCH_REPORT_FILE;
+	_config->baselineFile = NULL;
+	_config->saveFile = NULL;
+
+	while ((option = getopt(argc, argv, "d:p:w:c:b:i:D:G:n:W:r:Ckj:Nxo:s:B:t:h")) != -1) {
+		switch (option) {
+		case 'd':
+			_config->device = optarg;
+			break;
+		case 'p':
+			_config->mipiPort = atoi(optarg);
+			break;
+		case 'w':
+			if (!parseSizes(_config, optarg)) {
+				return false;
+			}
+			break;
+		case 'c':
+			if (!parseFormats(_config, optarg)) {
+				return false;
+			}
+			break;
+		case 'b':
+			if (!parseBufferCounts(_config, optarg)) {
+				return false;
+			}
+			break;
+		case 'i':
+			if (!parseIOMethods(_config, optarg)) {
+				return false;
+			}
+			break;
+		case 'D':
+			if (!DmaBufAllocator_parseBackend(optarg, &_config->dmaBufBackend)) {
+				fprintf(stderr, "Invalid DMA buffer backend: %s\n", optarg);
+				return false;
+			}
+			break;
+		case 'G':
+			if (!parseTextureSets(_config, optarg)) {
+				return false;
+			}
+			_config->isPipelined = true;
+			break;
+		case 'n':
+			_config->frameCount = atol(optarg);
+			if (_config->frameCount <= 0) {
+				fprintf(stderr, "Invalid frame count: %s\n", optarg);
+				return false;
+			}
+			break;
+		case 'W':
+			_config->warmupCount = atol(optarg);
+			if (_config->warmupCount < 0) {
+				fprintf(stderr, "Invalid warm-up count: %s\n", optarg);
+				return false;
+			}
+			break;
+		case 'r':
+			_config->repeatCount = atoi(optarg);
+			if (_config->repeatCount <= 0 || _config->repeatCount > BASELINE_MAX_RUNS) {
+				fprintf(stderr, "Invalid run count: %s (1 to %d)\n", optarg, BASELINE_MAX_RUNS);
+				return false;
+			}
+			break;
+		case 'C':
+			_config->isConvert = true;
+			break;
+		case 'k':
+			_config->isCpuConvert = true;
+			break;
+		case 'j':
+			_config->workerThreads = atoi(optarg);
+			break;
+		case 'N':
+			_config->isNoRender = true;
+			break;
+		case 'x':
+			_config->isReplayFast = true;
+			break;
+		case 'o':
+			_config->reportFile = optarg;
+			break;
+		case 's':
+			_config->saveFile = optarg;
+			break;
+		case 'B':
+			_config->baselineFile = optarg;
+			break;
+		case 't':
+			_config->thresholdPercent = atof(optarg);
+			if (_config->thresholdPercent < 0) {
+				fprintf(stderr, "Invalid threshold: %s\n", optarg);
+				return false;
+			}
+			break;
+		default:
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * A GLES2 context on an off-screen display: Mesa's surfaceless platform
+ * when there is one, so no X or Wayland server is needed, the default
+ * display otherwise.
+ */
+static int initEGL(BenchEGL *_egl, FILE *_hAppLog) {
+	EGLint configAttribs[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RED_SIZE, 8,
+		EGL_GREEN_SIZE, 8,
+		EGL_BLUE_SIZE, 8,
+		EGL_DEPTH_SIZE, 16,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+		EGL_NONE
+	};
+	EGLint contextAttribs[] = {
+		EGL_CONTEXT_CLIENT_VERSION, 2,
+		EGL_NONE
+	};
+	EGLint major, minor, configsCount = 0;
+
+	memset(_egl, 0, sizeof(BenchEGL));
+	_egl->display = EGL_NO_DISPLAY;
+	_egl->context = EGL_NO_CONTEXT;
+	_egl->surface = EGL_NO_SURFACE;
+
+	// client extensions are queried without a display
+	const char *clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+	if (hasExtension(clientExtensions, "EGL_MESA_platform_surfaceless")) {
+		PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+				(PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+		if (getPlatformDisplay != NULL) {
+			_egl->display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+		}
+	}
+	if (_egl->display == EGL_NO_DISPLAY) {
+		writeToLog(_hAppLog, "No surfaceless EGL platform; using the default display.");
+		_egl->display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	}
+
+	if (_egl->display == EGL_NO_DISPLAY || !eglInitialize(_egl->display, &major, &minor)) {
+		writeToLog(_hAppLog, "eglInitialize failed: 0x%x", eglGetError());
+		return 0;
+	}
+
+	if (!eglChooseConfig(_egl->display, configAttribs, &_egl->config, 1, &configsCount) || configsCount < 1) {
+		writeToLog(_hAppLog, "No EGL config with pbuffer and GLES2 support.");
+		return 0;
+	}
+
+	eglBindAPI(EGL_OPENGL_ES_API);
+	_egl->context = eglCreateContext(_egl->display, _egl->config, EGL_NO_CONTEXT, contextAttribs);
+	if (_egl->context == EGL_NO_CONTEXT) {
+		writeToLog(_hAppLog, "eglCreateContext failed: 0x%x", eglGetError());
+		return 0;
+	}
+
+	writeToLog(_hAppLog, "EGL %d.%d: %s", major, minor, eglQueryString(_egl->display, EGL_VENDOR));
+	return 1;
+}
+
+/**
+ * Makes the context current on a pbuffer of _width x _height.
+ */
+static int resizeSurface(BenchEGL *_egl, int _width, int _height) {
+	EGLint surfaceAttribs[] = {
+		EGL_WIDTH, _width,
+		EGL_HEIGHT, _height,
+		EGL_NONE
+	};
+
+	if (_egl->surface != EGL_NO_SURFACE &&
+		_egl->surfaceSize.width == _width && _egl->surfaceSize.height == _height) {
+		return 1;
+	}
+
+	eglMakeCurrent(_egl->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	if (_egl->surface != EGL_NO_SURFACE) {
+		eglDestroySurface(_egl->display, _egl->surface);
+	}
+
+	_egl->surface = eglCreatePbufferSurface(_egl->display, _egl->config, surfaceAttribs);
+	if (_egl->surface == EGL_NO_SURFACE) {
+		return 0;
+	}
+	_egl->surfaceSize.width = _width;
+	_egl->surfaceSize.height = _height;
+
+	if (!eglMakeCurrent(_egl->display, _egl->surface, _egl->surface, _egl->context)) {
+		return 0;
+	}
+
+	glViewport(0, 0, _width, _height);
+	return 1;
+}
+
+static void disposeEGL(BenchEGL *_egl) {
+	if (_egl->display == EGL_NO_DISPLAY) {
+		return;
+	}
+
+	eglMakeCurrent(_egl->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	if (_egl->surface != EGL_NO_SURFACE) {
+		eglDestroySurface(_egl->display, _egl->surface);
+	}
+	if (_egl->context != EGL_NO_CONTEXT) {
+		eglDestroyContext(_egl->display, _egl->context);
+	}
+	eglTerminate(_egl->display);
+}
+
+/**
+ * The format's shader, with the plane samplers on the units PlaneTextures
+ * binds them to; 0 on failure.
+ */
+static GLuint buildProgram(BenchResult *_result, FILE *_hAppLog) {
+	Shader *shader = Shader_new();
+
+	shader->loadDefaultVertexShader(shader);
+	if (_result->format == RGB3) {
+		shader->loadBuiltInFragmentShader(shader, RGBP);
+	} else {
+		shader->loadBuiltInFragmentShader(shader, _result->format);
+	}
+
+	if (!shader->buildProgram(shader)) {
+		snprintf(_result->error, sizeof(_result->error), "%s", shader->error);
+		Shader_dispose(shader);
+		return 0;
+	}
+	GLuint program = shader->program;
+	writeToLog(_hAppLog, "Fragment Shader: %s", shader->fragmentShaderFile->str);
+	Shader_dispose(shader);
+
+	// unknown names are -1, which glUniform ignores
+	glUseProgram(program);
+	glUniform1i(glGetUniformLocation(program, "u_textureY"), 0);
+	glUniform1i(glGetUniformLocation(program, "u_textureU"), 1);
+	glUniform1i(glGetUniformLocation(program, "u_textureV"), 2);
+	glUniform1i(glGetUniformLocation(program, "u_textureUV"), 1);
+	glUniform2f(glGetUniformLocation(program, "u_texsize"), (float) _result->size.width, (float) _result->size.height);
+	glUniformMatrix4fv(glGetUniformLocation(program, "modelviewProjection"), 1, GL_FALSE, identity);
+
+	return program;
+}
+
+static void drawQuad(GLuint _program) {
+	// attribute locations are bound by Shader.buildProgram()
+	glUseProgram(_program);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, quadVertices);
+	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, quadTexCoords);
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(2);
+	glDrawElements(GL_TRIANGLES, 2*3, GL_UNSIGNED_BYTE, quadIndices);
+	glDisableVertexAttribArray(0);
+	glDisableVertexAttribArray(2);
+}
+
+static long long usecBetween(const struct timespec *_from, const struct timespec *_to) {
+	return Trace_usecOf(_to) - Trace_usecOf(_from);
+}
+
+/**
+ * Captures, converts on the CPU (with isCpuConvert), uploads and (with
+ * isConvert) draws warmupCount + frameCount frames of one combination,
+ * measuring the last frameCount. One call is one run; the totals of _result
+ * add up over the runs.
+ */
+static void runConfiguration(BenchConfig_t *_config, BenchEGL *_egl, BenchResult *_result, FILE *_hAppLog) {
+	PlaneTextures *textures = NULL;
+	GLuint program = 0;
+	ColorConverter *converter = NULL;
+	unsigned char *rgba = NULL;
+	CaptureEngine *engine = CaptureEngine_new();
+	engine->setLoggerWith(engine, _hAppLog);
+
+	Video *video = Video_newWith(_config->device,
+								 _result->size.width, _result->size.height,
+								 _result->format,
+#ifdef COLOR_CONVERSION
+								 _result->format,
+#endif
+								 _config->mipiPort,
+								 false);
+	video->setLoggerWith(video, _hAppLog);
+	video->setIOMethodTo(video, _result->ioMethod);
+	if (_result->ioMethod == IO_METHOD_DMABUF) {
+		video->setDmaBufBackendTo(video, _config->dmaBufBackend);
+	}
+	video->setBufferCountTo(video, _result->requestedBuffers);
+	video->setReplayPaceTo(video, (_config->isReplayFast) ? REPLAY_PACE_FAST : REPLAY_PACE_RECORDED);
+
+	CaptureStream *stream = engine->addStream(engine, video, CAPTURE_NO_AFFINITY, FRAME_RING_DEFAULT_DEPTH);
+	if (stream == NULL) {
+		snprintf(_result->error, sizeof(_result->error), "%s", engine->error);
+		Video_dispose(video);
+		goto DONE;
+	}
+
+	if (engine->initDevices(engine) != 1) {
+		snprintf(_result->error, sizeof(_result->error), "%s", engine->error);
+		goto DONE;
+	}
+	_result->grantedBuffers = video->videoBuffersCount;
+
+	// the driver may have adjusted the size
+	_result->size = video->size;
+
+	if (_config->isCpuConvert) {
+		converter = ColorConverter_newWith(_result->format, CONVERT_ISA_BEST);
+		if (converter->convertRow == NULL) {
+			snprintf(_result->error, sizeof(_result->error), "%s", converter->error);
+			goto DONE;
+		}
+		converter->setPool(converter, g_Workers);
+		rgba = (unsigned char *) malloc(video->planes[0].width * 4 * video->planes[0].height);
+		_result->cpuKernel = ColorConvert_isaName(converter->isa);
+	}
+
+	if (!_config->isNoRender) {
+		if (!resizeSurface(_egl, video->size.width, video->size.height)) {
+			snprintf(_result->error, sizeof(_result->error), "No %dx%d pbuffer: 0x%x",
+					 video->size.width, video->size.height, eglGetError());
+			goto DONE;
+		}
+
+		textures = PlaneTextures_newWith(_result->format, video, _result->textureSets);
+		if (textures->demosaic != NULL) {
+			textures->demosaic->setPool(textures->demosaic, g_Workers);
+			writeToLog(_hAppLog, "Demosaicing with the %s kernel on %u threads.",
+					   ColorConvert_isaName(textures->demosaic->isa), g_Workers->threadsCount);
+		}
+		if (textures->planesCount == 0) {
+			writeToLog(_hAppLog, "%s Capturing only.", textures->error);
+		} else if (_config->isConvert) {
+			program = buildProgram(_result, _hAppLog);
+			if (program == 0) {
+				goto DONE;
+			}
+		}
+		_result->isRendered = (textures->planesCount > 0);
+	}
+
+	if (engine->startStreams(engine) <= 0 || engine->start(engine) <= 0) {
+		snprintf(_result->error, sizeof(_result->error), "%s", engine->error);
+		goto DONE;
+	}
+
+	FrameRing *ring = stream->ring;
+	struct timespec measureStarted, measureEnded, lastPresented, renderStarted, drawEnded;
+	unsigned long capturedAtStart = 0, droppedAtStart = 0, driverDroppedAtStart = 0;
+	long frame = 0, measured = 0, total = _config->warmupCount + _config->frameCount;
+	int waitedMsec = 0;
+
+	_result->runLatency->clear(_result->runLatency);
+
+	memset(&measureStarted, 0, sizeof(measureStarted));
+	memset(&lastPresented, 0, sizeof(lastPresented));
+
+	while (frame < total && !g_IsStopping) {
+		FrameDesc *desc = ring->acquire(ring, FRAME_WAIT_MSEC);
+		if (desc == NULL) {
+			if (__atomic_load_n(&stream->isFailed, __ATOMIC_ACQUIRE)) {
+				_result->status = "error";
+				snprintf(_result->error, sizeof(_result->error), "%s stopped capturing.", video->device);
+				break;
+			}
+			waitedMsec += FRAME_WAIT_MSEC;
+			if (waitedMsec >= FRAME_TIMEOUT_MSEC) {
+				_result->status = "timeout";
+				snprintf(_result->error, sizeof(_result->error), "No frame from %s for %d ms.",
+						 video->device, FRAME_TIMEOUT_MSEC);
+				break;
+			}
+			continue;
+		}
+		waitedMsec = 0;
+
+		struct timespec pickedUp;
+		clock_gettime(CLOCK_MONOTONIC, &pickedUp);
+
+		if (frame == _config->warmupCount) {
+			measureStarted = pickedUp;
+			capturedAtStart = __atomic_load_n(&stream->captured, __ATOMIC_RELAXED);
+			droppedAtStart = ring->dropped;
+			driverDroppedAtStart = __atomic_load_n(&video->droppedFramesCount, __ATOMIC_RELAXED);
+		}
+
+		struct timespec convertEnded = pickedUp;
+		if (converter != NULL) {
+			converter->convert(converter, &desc->video, rgba, desc->video.planes[0].width * 4);
+			clock_gettime(CLOCK_MONOTONIC, &convertEnded);
+		}
+
+		desc->uploadStarted = convertEnded;
+		if (_result->isRendered) {
+			textures->upload(textures, &desc->video);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &desc->uploadEnded);
+
+		renderStarted = desc->uploadEnded;
+		if (_result->isRendered) {
+			if (program != 0) {
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				textures->bind(textures);
+				drawQuad(program);
+			}
+			clock_gettime(CLOCK_MONOTONIC, &drawEnded);
+
+			if (_config->isPipelined) {
+				// a pbuffer has nothing to swap; glFlush() hands the frame over as a swap would
+				eglSwapBuffers(_egl->display, _egl->surface);
+				glFlush();
+			} else {
+				// llvmpipe and most GPUs defer the work; wait for it so it is measured
+				glFinish();
+			}
+		}
+		clock_gettime(CLOCK_MONOTONIC, &desc->presented);
+
+		if (frame >= _config->warmupCount) {
+			long long age = VideoFrame_ageUsecAt(&desc->video, &desc->presented);
+			if (age >= 0) {
+				_result->latency->add(_result->latency, age);
+				_result->runLatency->add(_result->runLatency, age);
+			}
+			_result->queued->add(_result->queued, usecBetween(&desc->captured, &pickedUp));
+			if (converter != NULL) {
+				_result->cpuConvert->add(_result->cpuConvert, usecBetween(&pickedUp, &convertEnded));
+			}
+			_result->upload->add(_result->upload, usecBetween(&desc->uploadStarted, &desc->uploadEnded));
+			_result->render->add(_result->render, usecBetween(&renderStarted, &desc->presented));
+			if (_config->isPipelined && _result->isRendered) {
+				_result->draw->add(_result->draw, usecBetween(&renderStarted, &drawEnded));
+				_result->swap->add(_result->swap, usecBetween(&drawEnded, &desc->presented));
+			}
+			if (frame > _config->warmupCount) {
+				_result->interval->add(_result->interval, usecBetween(&lastPresented, &desc->presented));
+			}
+			measured++;
+		}
+		lastPresented = desc->presented;
+		frame++;
+
+		if (video->release(video, &desc->video) <= 0) {
+			writeToLog(_hAppLog, "%s", video->error);
+		}
+		ring->release(ring);
+	}
+
+	// swapped frames may still be drawing; they count to the run
+	if (_config->isPipelined && _result->isRendered) {
+		glFinish();
+	}
+	clock_gettime(CLOCK_MONOTONIC, &measureEnded);
+	if (measured > 0) {
+		double elapsed = (double) usecBetween(&measureStarted, &measureEnded) / 1000000.0;
+
+		_result->frames += measured;
+		_result->elapsed += elapsed;
+		_result->captured += __atomic_load_n(&stream->captured, __ATOMIC_RELAXED) - capturedAtStart;
+		_result->dropped += ring->dropped - droppedAtStart;
+		_result->driverDropped += __atomic_load_n(&video->droppedFramesCount, __ATOMIC_RELAXED) - driverDroppedAtStart;
+
+		// only complete runs go into the baseline
+		if (elapsed > 0 && measured == _config->frameCount) {
+			BaselineMetric_add(&_result->runs.fps, (double) measured / elapsed);
+			if (_result->runLatency->count > 0) {
+				BaselineMetric_add(&_result->runs.latencyP99, _result->runLatency->percentile(_result->runLatency, 99));
+			}
+		}
+	}
+	_result->runsCount++;
+
+	if (_result->status == NULL) {
+		_result->status = g_IsStopping ? "interrupted" : "ok";
+	}
+
+DONE:
+	if (_result->status == NULL) {
+		_result->status = "error";
+	}
+
+	engine->stop(engine);
+	engine->stopStreams(engine);
+	CaptureEngine_dispose(engine);
+
+	if (program != 0) {
+		glDeleteProgram(program);
+	}
+	PlaneTextures_dispose(textures);
+	ColorConverter_dispose(converter);
+	free(rgba);
+}
+
+static void writeJsonString(FILE *_report, const char *_value) {
+	const char *c;
+
+	fputc('"', _report);
+	for (c = _value; c != NULL && *c != '\0'; c++) {
+		switch (*c) {
+		case '"':
+			fputs("\\\"", _report);
+			break;
+		case '\\':
+			fputs("\\\\", _report);
+			break;
+		case '\n':
+			fputs("\\n", _report);
+			break;
+		default:
+			if ((unsigned char) *c < 0x20) {
+				fprintf(_report, "\\u%04x", *c);
+			} else {
+				fputc(*c, _report);
+			}
+			break;
+		}
+	}
+	fputc('"', _report);
+}
+
+static void writeJsonSamples(FILE *_report, const char *_name, Samples *_samples) {
+	fprintf(_report, ",\n      \"%s\": ", _name);
+	if (_samples->count == 0) {
+		fprintf(_report, "null");
+		return;
+	}
+
+	fprintf(_report, "{ \"p50\": %lld, \"p90\": %lld, \"p99\": %lld, \"max\": %lld, \"count\": %zu }",
+			_samples->percentile(_samples, 50), _samples->percentile(_samples, 90),
+			_samples->percentile(_samples, 99), _samples->max(_samples), _samples->count);
+}
+
+static void writeJsonRuns(FILE *_report, const char *_name, const BaselineMetric *_metric) {
+	unsigned int i;
+
+	fprintf(_report, "\"%s\": [", _name);
+	for (i = 0; i < _metric->count; i++) {
+		fprintf(_report, "%s%.3f", (i > 0) ? ", " : "", _metric->values[i]);
+	}
+	fprintf(_report, "]");
+}
+
+static void writeJsonComparison(FILE *_report, const char *_name, const BaselineComparison *_comparison) {
+	fprintf(_report, "\"%s\": { \"baseline\": %.3f, \"current\": %.3f, \"change_percent\": %.2f, "
+			"\"ci_low\": %.3f, \"ci_high\": %.3f, \"testable\": %s, \"significant\": %s, \"regression\": %s }",
+			_name, _comparison->baseline, _comparison->current, _comparison->changePercent,
+			_comparison->low, _comparison->high, _comparison->isTestable ? "true" : "false",
+			_comparison->isSignificant ? "true" : "false", _comparison->isRegression ? "true" : "false");
+}
+
+static void writeJsonResult(FILE *_report, BenchResult *_result, bool _isFirst) {
+	fprintf(_report, "%s    {\n", _isFirst ? "" : ",\n");
+	fprintf(_report, "      \"key\": \"%s\",\n", _result->runs.key);
+	fprintf(_report, "      \"width\": %d,\n      \"height\": %d,\n", _result->size.width, _result->size.height);
+	fprintf(_report, "      \"format\": \"%s\",\n", PixelFormat_name(_result->format));
+	fprintf(_report, "      \"io\": \"%s\",\n", IO_METHOD_NAMES[_result->ioMethod]);
+	fprintf(_report, "      \"buffers_requested\": %d,\n", _result->requestedBuffers);
+	fprintf(_report, "      \"buffers\": %u,\n", _result->grantedBuffers);
+	fprintf(_report, "      \"texture_sets\": %u,\n", _result->textureSets);
+	fprintf(_report, "      \"status\": \"%s\",\n", _result->status);
+	fprintf(_report, "      \"error\": ");
+	if (_result->error[0] != '\0') {
+		writeJsonString(_report, _result->error);
+	} else {
+		fprintf(_report, "null");
+	}
+	fprintf(_report, ",\n      \"rendered\": %s,\n", _result->isRendered ? "true" : "false");
+	fprintf(_report, "      \"cpu_kernel\": ");
+	if (_result->cpuKernel != NULL) {
+		writeJsonString(_report, _result->cpuKernel);
+	} else {
+		fprintf(_report, "null");
+	}
+	fprintf(_report, ",\n");
+	fprintf(_report, "      \"runs\": %d,\n", _result->runsCount);
+	fprintf(_report, "      \"frames\": %ld,\n", _result->frames);
+	fprintf(_report, "      \"elapsed_sec\": %.3f,\n", _result->elapsed);
+	fprintf(_report, "      \"fps\": %.3f,\n", _result->fps);
+	fprintf(_report, "      \"capture_fps\": %.3f,\n", _result->captureFps);
+	fprintf(_report, "      \"dropped\": %lu,\n", _result->dropped);
+	fprintf(_report, "      \"driver_dropped\": %lu", _result->driverDropped);
+	writeJsonSamples(_report, "latency_usec", _result->latency);
+	writeJsonSamples(_report, "queued_usec", _result->queued);
+	writeJsonSamples(_report, "cpu_convert_usec", _result->cpuConvert);
+	writeJsonSamples(_report, "upload_usec", _result->upload);
+	writeJsonSamples(_report, "render_usec", _result->render);
+	writeJsonSamples(_report, "draw_usec", _result->draw);
+	writeJsonSamples(_report, "swap_usec", _result->swap);
+	writeJsonSamples(_report, "interval_usec", _result->interval);
+
+	fprintf(_report, ",\n      \"per_run\": { ");
+	writeJsonRuns(_report, "fps", &_result->runs.fps);
+	fprintf(_report, ", ");
+	writeJsonRuns(_report, "latency_p99_usec", &_result->runs.latencyP99);
+	fprintf(_report, " }");
+
+	fprintf(_report, ",\n      \"baseline\": ");
+	if (_result->hasBaseline) {
+		fprintf(_report, "{\n        ");
+		writeJsonComparison(_report, "fps", &_result->fpsChange);
+		fprintf(_report, ",\n        ");
+		writeJsonComparison(_report, "latency_p99_usec", &_result->latencyChange);
+		fprintf(_report, "\n      }");
+	} else {
+		fprintf(_report, "null");
+	}
+	fprintf(_report, "\n    }");
+	fflush(_report);
+}
+
+static void logComparison(FILE *_hAppLog, const char *_name, const BaselineComparison *_comparison) {
+	const char *verdict = "";
+
+	if (!_comparison->isTestable) {
+		verdict = " (needs 2 runs on both sides to test)";
+	} else if (_comparison->isRegression) {
+		verdict = " REGRESSION";
+	} else if (_comparison->isSignificant) {
+		verdict = " (significant)";
+	}
+
+	writeToLog(_hAppLog, "%s: %.3f -> %.3f (%+.2f%%; %d%% CI of the change %.3f .. %.3f)%s", _name,
+			   _comparison->baseline, _comparison->current, _comparison->changePercent, BASELINE_CONFIDENCE,
+			   _comparison->low, _comparison->high, verdict);
+}
+
+/**
+ * Runs one combination repeatCount times, or until a run fails, and checks
+ * it against _baseline. Returns the number of regressions found.
+ */
+static int runCombination(BenchConfig_t *_config, BenchEGL *_egl, BenchResult *_result, Baseline *_baseline,
+						  FILE *_hAppLog) {
+	int regressions = 0;
+	int r;
+
+	for (r = 0; r < _config->repeatCount && !g_IsStopping; r++) {
+		if (_config->repeatCount > 1) {
+			writeToLog(_hAppLog, "--- run %d of %d ---", r + 1, _config->repeatCount);
+		}
+
+		_result->status = NULL;
+		runConfiguration(_config, _egl, _result, _hAppLog);
+		if (strcmp(_result->status, "ok") != 0) {
+			break;
+		}
+	}
+
+	if (_result->elapsed > 0) {
+		_result->fps = (double) _result->frames / _result->elapsed;
+		_result->captureFps = (double) _result->captured / _result->elapsed;
+	}
+
+	BaselineEntry *entry = (_baseline != NULL) ? _baseline->find(_baseline, _result->runs.key) : NULL;
+	if (entry == NULL) {
+		if (_baseline != NULL) {
+			writeToLog(_hAppLog, "No baseline for %s.", _result->runs.key);
+		}
+		return 0;
+	}
+
+	// failed combinations are reported through status instead
+	if (_result->runs.fps.count == 0) {
+		return 0;
+	}
+
+	_result->hasBaseline = true;
+	Baseline_compare(&entry->fps, &_result->runs.fps, true, _config->thresholdPercent, &_result->fpsChange);
+	Baseline_compare(&entry->latencyP99, &_result->runs.latencyP99, false, _config->thresholdPercent,
+					 &_result->latencyChange);
+
+	if (entry->fps.count > 0 && _result->runs.fps.count > 0) {
+		logComparison(_hAppLog, "fps", &_result->fpsChange);
+		regressions += _result->fpsChange.isRegression ? 1 : 0;
+	}
+	if (entry->latencyP99.count > 0 && _result->runs.latencyP99.count > 0) {
+		logComparison(_hAppLog, "latency p99 (usec)", &_result->latencyChange);
+		regressions += _result->latencyChange.isRegression ? 1 : 0;
+	}
+
+	return regressions;
+}
+
+int main(int argc, char *argv[]) {
+	BenchConfig_t config;
+	BenchEGL egl;
+	int exitCode = 0;
+
+	if (!parseArgs(&config, argc, argv)) {
+		printUsage(argv[0]);
+		return 1;
+	}
+
+	signal(SIGINT, &stopBench);
+	signal(SIGTERM, &stopBench);
+
+	FILE *hAppLog = fopen(BENCH_LOG_FILE, "w");
+	writeToLog(hAppLog, "%s.%s", APP_NAME, APP_BUILD);
+
+	Baseline *baseline = NULL;
+	if (config.baselineFile != NULL) {
+		baseline = Baseline_new();
+		if (!baseline->load(baseline, config.baselineFile)) {
+			writeToLog(hAppLog, "%s", baseline->error);
+			Baseline_dispose(baseline);
+			if (hAppLog != NULL) {
+				fclose(hAppLog);
+			}
+			return 1;
+		}
+		writeToLog(hAppLog, "Comparing against %s: %u configurations.", config.baselineFile, baseline->entriesCount);
+	}
+
+	memset(&egl, 0, sizeof(egl));
+	egl.display = EGL_NO_DISPLAY;
+	const char *renderer = "none";
+	if (!config.isNoRender) {
+		if (!initEGL(&egl, hAppLog) || !resizeSurface(&egl, config.sizes[0].width, config.sizes[0].height)) {
+			writeToLog(hAppLog, "Cannot render off-screen; run with -N to capture only.");
+			disposeEGL(&egl);
+			Baseline_dispose(baseline);
+			if (hAppLog != NULL) {
+				fclose(hAppLog);
+			}
+			return 1;
+		}
+		renderer = (const char *) glGetString(GL_RENDERER);
+		writeToLog(hAppLog, "Renderer: %s", renderer);
+	}
+
+	FILE *report = fopen(config.reportFile, "w");
+	if (report == NULL) {
+		writeToLog(hAppLog, "Cannot write %s.", config.reportFile);
+		disposeEGL(&egl);
+		Baseline_dispose(baseline);
+		if (hAppLog != NULL) {
+			fclose(hAppLog);
+		}
+		return 1;
+	}
+	g_Workers = WorkerPool_newWith(config.workerThreads);
+
+	fprintf(report, "{\n  \"tool\": \"%s\",\n  \"build\": \"%s\",\n  \"device\": ", APP_NAME, APP_BUILD);
+	writeJsonString(report, config.device);
+	fprintf(report, ",\n  \"renderer\": ");
+	writeJsonString(report, renderer);
+	fprintf(report, ",\n  \"convert\": %s,\n", config.isConvert ? "true" : "false");
+	fprintf(report, "  \"pipelined\": %s,\n", config.isPipelined ? "true" : "false");
+	fprintf(report, "  \"frames\": %ld,\n  \"warmup\": %ld,\n  \"runs\": %d,\n",
+			config.frameCount, config.warmupCount, config.repeatCount);
+	fprintf(report, "  \"configurations\": [\n");
+
+	BenchResult result;
+	result.runLatency = Samples_new();
+	result.latency = Samples_new();
+	result.queued = Samples_new();
+	result.cpuConvert = Samples_new();
+	result.upload = Samples_new();
+	result.render = Samples_new();
+	result.draw = Samples_new();
+	result.swap = Samples_new();
+	result.interval = Samples_new();
+
+	Baseline *runs = Baseline_new();
+	int regressions = 0;
+	unsigned int s, f, b, m, t;
+	bool isFirst = true;
+	for (s = 0; s < config.sizesCount && !g_IsStopping; s++) {
+		for (f = 0; f < config.formatsCount && !g_IsStopping; f++) {
+			for (b = 0; b < config.bufferCountsCount && !g_IsStopping; b++) {
+				for (m = 0; m < config.ioMethodsCount && !g_IsStopping; m++) {
+					for (t = 0; t < config.textureSetsCount && !g_IsStopping; t++) {
+						result.size = config.sizes[s];
+						result.format = config.formats[f];
+						result.requestedBuffers = config.bufferCounts[b];
+						result.grantedBuffers = 0;
+						result.ioMethod = config.ioMethods[m];
+						result.textureSets = config.textureSets[t];
+						result.status = NULL;
+						result.error[0] = '\0';
+						result.isRendered = false;
+						result.runsCount = 0;
+						result.frames = 0;
+						result.captured = 0;
+						result.elapsed = 0;
+						result.fps = 0;
+						result.captureFps = 0;
+						result.dropped = 0;
+						result.driverDropped = 0;
+						result.hasBaseline = false;
+						result.cpuKernel = NULL;
+						memset(&result.runs, 0, sizeof(result.runs));
+						result.latency->clear(result.latency);
+						result.queued->clear(result.queued);
+						result.cpuConvert->clear(result.cpuConvert);
+						result.upload->clear(result.upload);
+						result.render->clear(result.render);
+						result.draw->clear(result.draw);
+						result.swap->clear(result.swap);
+						result.interval->clear(result.interval);
+
+						// what was asked for; the driver may grant something else. Runs
+						// with glFinish keep the keys they had before -G
+						snprintf(result.runs.key, sizeof(result.runs.key), "%dx%d/%s/%s/%d",
+								 result.size.width, result.size.height, PixelFormat_name(result.format),
+								 IO_METHOD_NAMES[result.ioMethod], result.requestedBuffers);
+						if (config.isPipelined) {
+							size_t length = strlen(result.runs.key);
+							snprintf(result.runs.key + length, sizeof(result.runs.key) - length, "/g%u", result.textureSets);
+						}
+
+						writeToLog(hAppLog, "=== %dx%d %s, %d buffers, %s, %u texture sets ===", result.size.width,
+								   result.size.height, PixelFormat_name(result.format), result.requestedBuffers,
+								   IO_METHOD_NAMES[result.ioMethod], result.textureSets);
+						regressions += runCombination(&config, &egl, &result, baseline, hAppLog);
+
+						if (result.error[0] != '\0') {
+							writeToLog(hAppLog, "%s: %s", result.status, result.error);
+							exitCode = 2;
+						}
+						writeToLog(hAppLog, "%ld frames; fps: %3.3f; cap fps: %3.3f; latency p50/p99: %lld/%lld usec",
+								   result.frames, result.fps, result.captureFps,
+								   result.latency->percentile(result.latency, 50),
+								   result.latency->percentile(result.latency, 99));
+						if (result.draw->count > 0) {
+							writeToLog(hAppLog, "upload/draw/swap p50: %lld/%lld/%lld usec",
+									   result.upload->percentile(result.upload, 50),
+									   result.draw->percentile(result.draw, 50),
+									   result.swap->percentile(result.swap, 50));
+						}
+
+						if (result.runs.fps.count > 0) {
+							*runs->add(runs, result.runs.key) = result.runs;
+						}
+
+						writeJsonResult(report, &result, isFirst);
+						isFirst = false;
+					}
+				}
+			}
+		}
+	}
+
+	fprintf(report, "\n  ],\n  \"baseline\": ");
+	if (config.baselineFile != NULL) {
+		writeJsonString(report, config.baselineFile);
+	} else {
+		fprintf(report, "null");
+	}
+	fprintf(report, ",\n  \"threshold_percent\": %.2f,\n  \"regressions\": %d\n}\n", config.thresholdPercent, regressions);
+	fclose(report);
+	writeToLog(hAppLog, "Report written to %s.", config.reportFile);
+
+	if (config.saveFile != NULL) {
+		if (runs->save(runs, config.saveFile)) {
+			writeToLog(hAppLog, "Baseline of %u configurations written to %s.", runs->entriesCount, config.saveFile);
+		} else {
+			writeToLog(hAppLog, "%s", runs->error);
+			exitCode = 1;
+		}
+	}
+
+	if (regressions > 0) {
+		writeToLog(hAppLog, "%d regressions against %s.", regressions, config.baselineFile);
+		exitCode = 3;
+	}
+
+	Baseline_dispose(runs);
+	Baseline_dispose(baseline);
+	Samples_dispose(result.runLatency);
+	Samples_dispose(result.latency);
+	Samples_dispose(result.queued);
+	Samples_dispose(result.cpuConvert);
+	Samples_dispose(result.upload);
+	Samples_dispose(result.render);
+	Samples_dispose(result.draw);
+	Samples_dispose(result.swap);
+	Samples_dispose(result.interval);
+
+	WorkerPool_dispose(g_Workers);
+	disposeEGL(&egl);
+	if (hAppLog != NULL) {
+		fclose(hAppLog);
+	}
+
+	return exitCode;
+}
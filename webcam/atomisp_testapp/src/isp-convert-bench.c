@@ -0,0 +1,790 @@
+/**
+	This file is part of Intel Atom ISP Test App.
+
+	Intel Atom ISP Test App is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Intel Atom ISP Test App is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Intel Atom ISP Test App.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * isp-convert-bench: checks that every SIMD color conversion and demosaic
+ * kernel this CPU runs gives the same bytes as the scalar one, then times
+ * them all on a synthetic frame. The fastest kernel is then run on worker
+ * pools of several sizes, alone and followed by a row hash stage, once
+ * behind a barrier and once chained. The YUV formats are also scaled down
+ * to preview frames, with every downscale kernel and filter.
+ *
+ *   isp-convert-bench [-w 1280x720,2592x1944] [-c NV12,BA10] [-n 200] [-j 1,2,4] [-P 640x480] [-V]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "utilities.h"
+#include "pixel_format.h"
+#include "video.h"
+#include "color_convert.h"
+#include "demosaic.h"
+#include "demosaic_kernels.h"
+#include "downscale.h"
+#include "worker_pool.h"
+#include "samples.h"
+#include "trace.h"
+
+#define BENCH_ITERATIONS 200
+#define BENCH_MAX_VALUES 8
+#define BENCH_STRIDE_PADDING 64		/* bytes past each row, as drivers pad */
+#define VERIFY_ROWS 64
+#define VERIFY_MAX_WIDTH 1283
+
+static const PixelFormat_t ALL_FORMATS[] = { YUYV, UYVY, YVYU, VYUY, YV16, NV12, RGBP, RGB3, BA10 };
+
+/**
+ * Odd and even widths around every vector size, so the kernels' tails are
+ * checked as well as their loops.
+ */
+static const unsigned int VERIFY_WIDTHS[] = {
+	1, 2, 3, 6, 7, 8, 9, 14, 15, 16, 17, 18, 30, 31, 32, 33, 34, 63, 64, 65, 66, 640, 1282, VERIFY_MAX_WIDTH
+};
+
+/**
+ * How a frame goes through the pool: the stage alone, then the hash after
+ * it behind a barrier, or chained tile by tile.
+ */
+typedef enum BENCH_RUN {
+	RUN_ALONE,
+	RUN_BARRIER,
+	RUN_CHAINED
+} BenchRun_t;
+
+/**
+ * The color conversion or the demosaic, whichever the format needs.
+ */
+typedef struct BENCH_STAGE_S {
+	ColorConverter *converter;
+	Demosaic *demosaic;
+	ConvertIsa_t isa;
+} BenchStage;
+
+/**
+ * The stage chained after the conversion: a 64 bit hash of each RGBA row,
+ * the kind of check a test would run on every frame.
+ */
+typedef struct BENCH_HASH_S {
+	const unsigned char *rgba;
+	unsigned int stride;
+	unsigned int width;
+	unsigned long long *rows;
+} BenchHash;
+
+static void fillRandom(unsigned char *_buffer, size_t _size) {
+	size_t i;
+
+	for (i = 0; i < _size; i++) {
+		_buffer[i] = (unsigned char) (rand() >> 7);
+	}
+}
+
+/**
+ * A frame of random pixels in the layout the driver would give for
+ * _format, every plane in a buffer of its own and padded.
+ */
+static unsigned char *newFrame(VideoFrame *_frame, const PixelFormatInfo *_info, unsigned int _width, unsigned int _height) {
+	unsigned int p;
+	size_t size = 0;
+
+	memset(_frame, 0, sizeof(VideoFrame));
+	_frame->planesCount = _info->planesCount;
+	for (p = 0; p < _info->planesCount; p++) {
+		VideoPlane *plane = &_frame->planes[p];
+		plane->width = _width / _info->planes[p].horizontalSubsampling;
+		plane->height = _height / _info->planes[p].verticalSubsampling;
+		plane->bytesperline = ((plane->width * _info->planes[p].bitsPerPixel) / 8) + BENCH_STRIDE_PADDING;
+		plane->offset = size;
+		plane->length = plane->bytesperline * plane->height;
+		size += plane->length;
+	}
+
+	unsigned char *data = (unsigned char *) malloc(size);
+	fillRandom(data, size);
+	for (p = 0; p < _info->planesCount; p++) {
+		_frame->planes[p].data = data + _frame->planes[p].offset;
+	}
+	_frame->data = data;
+	_frame->bytesused = size;
+	return data;
+}
+
+/**
+ * Compares the rows _isa converts with the scalar ones. Returns false on
+ * the first difference.
+ */
+static bool verify(PixelFormat_t _format, ColorConverter *_converter, ColorConverter *_reference) {
+	const PixelFormatInfo *info = PixelFormat_info(_format);
+	// room for a full row of every plane; NV12's UV row is as wide as Y
+	size_t planeSize = ((VERIFY_MAX_WIDTH + 1) * 4) + 64;
+	unsigned char *planes[PIXEL_FORMAT_MAX_PLANES];
+	unsigned char *expected = (unsigned char *) malloc(VERIFY_MAX_WIDTH * 4);
+	unsigned char *actual = (unsigned char *) malloc(VERIFY_MAX_WIDTH * 4);
+	unsigned int w, row, p;
+	bool isSame = true;
+
+	for (p = 0; p < PIXEL_FORMAT_MAX_PLANES; p++) {
+		planes[p] = (unsigned char *) malloc(planeSize);
+	}
+
+	for (w = 0; w < sizeof(VERIFY_WIDTHS) / sizeof(VERIFY_WIDTHS[0]) && isSame; w++) {
+		unsigned int width = VERIFY_WIDTHS[w];
+
+		// packed 4:2:2 comes in pairs of pixels
+		if (info->planesCount == 1 && info->planes[0].bitsPerPixel == 16 && _format != RGBP && (width & 1)) {
+			continue;
+		}
+
+		for (row = 0; row < VERIFY_ROWS && isSame; row++) {
+			for (p = 0; p < PIXEL_FORMAT_MAX_PLANES; p++) {
+				fillRandom(planes[p], planeSize);
+			}
+			memset(expected, 0, width * 4);
+			memset(actual, 0xaa, width * 4);
+
+			_reference->convertRow(planes[0], planes[1], planes[2], expected, width);
+			_converter->convertRow(planes[0], planes[1], planes[2], actual, width);
+
+			unsigned int i;
+			for (i = 0; i < width * 4; i++) {
+				if (expected[i] != actual[i]) {
+					fprintf(stdout, "%s %s: width %u, pixel %u channel %u: %u, expected %u\n",
+							PixelFormat_name(_format), ColorConvert_isaName(_converter->isa), width,
+							i / 4, i % 4, actual[i], expected[i]);
+					isSame = false;
+					break;
+				}
+			}
+		}
+	}
+
+	for (p = 0; p < PIXEL_FORMAT_MAX_PLANES; p++) {
+		free(planes[p]);
+	}
+	free(expected);
+	free(actual);
+	return isSame;
+}
+
+/**
+ * Compares the rows _demosaic gives with the scalar ones, on both kinds of
+ * rows and with random levels, so the clamps are hit too.
+ */
+static bool verifyDemosaic(Demosaic *_demosaic) {
+	size_t rowSize = (VERIFY_MAX_WIDTH + 1) * sizeof(uint16_t);
+	uint16_t *rows[3];
+	unsigned char *expected = (unsigned char *) malloc(VERIFY_MAX_WIDTH * 4);
+	unsigned char *actual = (unsigned char *) malloc(VERIFY_MAX_WIDTH * 4);
+	unsigned int w, row, r;
+	bool isSame = true;
+
+	for (r = 0; r < 3; r++) {
+		rows[r] = (uint16_t *) malloc(rowSize);
+	}
+
+	for (w = 0; w < sizeof(VERIFY_WIDTHS) / sizeof(VERIFY_WIDTHS[0]) && isSame; w++) {
+		unsigned int width = VERIFY_WIDTHS[w];
+
+		// Bayer quads
+		if (width & 1) {
+			continue;
+		}
+
+		for (row = 0; row < VERIFY_ROWS && isSame; row++) {
+			DemosaicLevels levels;
+			levels.blackLevel = rand() % 256;
+			for (r = 0; r < 3; r++) {
+				fillRandom((unsigned char *) rows[r], rowSize);
+				levels.gains[r] = rand() % (DEMOSAIC_GAIN_MAX + 1);
+			}
+			memset(expected, 0, width * 4);
+			memset(actual, 0xaa, width * 4);
+
+			bool isBlueRow = (row & 1) != 0;
+			Demosaic_span(rows[0], rows[1], rows[2], isBlueRow, expected, width, &levels, 0, width);
+			_demosaic->demosaicRow(rows[0], rows[1], rows[2], isBlueRow, actual, width, &levels);
+
+			unsigned int i;
+			for (i = 0; i < width * 4; i++) {
+				if (expected[i] != actual[i]) {
+					fprintf(stdout, "BA10 %s: width %u, pixel %u channel %u: %u, expected %u\n",
+							ColorConvert_isaName(_demosaic->isa), width, i / 4, i % 4, actual[i], expected[i]);
+					isSame = false;
+					break;
+				}
+			}
+		}
+	}
+
+	for (r = 0; r < 3; r++) {
+		free(rows[r]);
+	}
+	free(expected);
+	free(actual);
+	return isSame;
+}
+
+/**
+ * The fastest kernel up to _maxIsa for _format. Returns false, having
+ * printed why, for formats with neither a conversion nor a demosaic.
+ */
+static bool newStage(BenchStage *_stage, PixelFormat_t _format, ConvertIsa_t _maxIsa) {
+	memset(_stage, 0, sizeof(BenchStage));
+
+	if (_format == BA10) {
+		_stage->demosaic = Demosaic_newWith(_maxIsa);
+		_stage->isa = _stage->demosaic->isa;
+		return true;
+	}
+
+	_stage->converter = ColorConverter_newWith(_format, _maxIsa);
+	_stage->isa = _stage->converter->isa;
+	if (_stage->converter->convertRow == NULL) {
+		fprintf(stdout, "%-6s %s\n", PixelFormat_name(_format), _stage->converter->error);
+		ColorConverter_dispose(_stage->converter);
+		_stage->converter = NULL;
+		return false;
+	}
+
+	return true;
+}
+
+static void disposeStage(BenchStage *_stage) {
+	ColorConverter_dispose(_stage->converter);
+	Demosaic_dispose(_stage->demosaic);
+}
+
+static void setStagePool(BenchStage *_stage, WorkerPool *_pool) {
+	if (_stage->demosaic != NULL) {
+		_stage->demosaic->setPool(_stage->demosaic, _pool);
+	} else {
+		_stage->converter->setPool(_stage->converter, _pool);
+	}
+}
+
+static WorkerJob *prepareStage(BenchStage *_stage, const VideoFrame *_frame, unsigned char *_rgba, unsigned int _stride) {
+	if (_stage->demosaic != NULL) {
+		return _stage->demosaic->prepare(_stage->demosaic, &_frame->planes[0], _rgba, _stride);
+	}
+
+	return _stage->converter->prepare(_stage->converter, _frame, _rgba, _stride);
+}
+
+static void runStage(BenchStage *_stage, const VideoFrame *_frame, unsigned char *_rgba, unsigned int _stride) {
+	if (_stage->demosaic != NULL) {
+		_stage->demosaic->demosaic(_stage->demosaic, &_frame->planes[0], _rgba, _stride);
+	} else {
+		_stage->converter->convert(_stage->converter, _frame, _rgba, _stride);
+	}
+}
+
+static void hashBand(void *_arg, unsigned int _first, unsigned int _end) {
+	BenchHash *hash = (BenchHash *) _arg;
+	unsigned int y, x;
+
+	for (y = _first; y < _end; y++) {
+		const unsigned char *row = hash->rgba + (y * hash->stride);
+		unsigned long long value = 14695981039346656037ULL;
+
+		// FNV-1a, a pixel pair at a time
+		for (x = 0; x + 2 <= hash->width; x += 2) {
+			unsigned long long pair;
+			memcpy(&pair, row + (x * 4), sizeof(pair));
+			value = (value ^ pair) * 1099511628211ULL;
+		}
+		if (x < hash->width) {
+			unsigned int pixel;
+			memcpy(&pixel, row + (x * 4), sizeof(pixel));
+			value = (value ^ pixel) * 1099511628211ULL;
+		}
+		hash->rows[y] = value;
+	}
+}
+
+/**
+ * One frame through _stage (which has _pool) and, but for RUN_ALONE, the
+ * hash stage _hashJob.
+ */
+static void runFrame(BenchStage *_stage, WorkerPool *_pool, WorkerJob *_hashJob, BenchRun_t _run,
+					 const VideoFrame *_frame, unsigned char *_rgba, unsigned int _stride) {
+	BenchHash *hash = (BenchHash *) _hashJob->arg;
+	hash->rgba = _rgba;
+	hash->stride = _stride;
+	hash->width = _frame->planes[0].width;
+
+	switch (_run) {
+	case RUN_ALONE:
+		runStage(_stage, _frame, _rgba, _stride);
+		break;
+	case RUN_BARRIER:
+		runStage(_stage, _frame, _rgba, _stride);
+		_pool->runBands(_pool, hashBand, hash, _frame->planes[0].height);
+		break;
+	case RUN_CHAINED: {
+		WorkerJob *job = prepareStage(_stage, _frame, _rgba, _stride);
+		_hashJob->rowsCount = _frame->planes[0].height;
+		WorkerJob_chain(job, _hashJob, 0);
+		_pool->submit(_pool, job);
+		_pool->wait(_pool, _hashJob);
+		break;
+	}
+	}
+}
+
+/**
+ * Median usec per frame of _iterations runs.
+ */
+static long long timeFrames(BenchStage *_stage, WorkerPool *_pool, WorkerJob *_hashJob, BenchRun_t _run,
+							const VideoFrame *_frame, unsigned char *_rgba, unsigned int _stride, int _iterations) {
+	Samples *samples = Samples_new();
+	struct timespec started, ended;
+	int i;
+
+	// once to fault the pages in
+	runFrame(_stage, _pool, _hashJob, _run, _frame, _rgba, _stride);
+
+	for (i = 0; i < _iterations; i++) {
+		clock_gettime(CLOCK_MONOTONIC, &started);
+		runFrame(_stage, _pool, _hashJob, _run, _frame, _rgba, _stride);
+		clock_gettime(CLOCK_MONOTONIC, &ended);
+		samples->add(samples, Trace_usecOf(&ended) - Trace_usecOf(&started));
+	}
+
+	long long median = samples->percentile(samples, 50);
+	Samples_dispose(samples);
+	return median;
+}
+
+/**
+ * Whether the frame and row hashes _stage gives over _pool, behind a
+ * barrier and chained, are those it gives on one thread.
+ */
+static bool verifyPool(BenchStage *_stage, WorkerPool *_pool, WorkerJob *_hashJob, const VideoFrame *_frame,
+					   unsigned int _stride) {
+	unsigned int height = _frame->planes[0].height;
+	unsigned char *expected = (unsigned char *) calloc(_stride, height);
+	unsigned char *actual = (unsigned char *) calloc(_stride, height);
+	unsigned long long *expectedRows = (unsigned long long *) calloc(height, sizeof(unsigned long long));
+	BenchHash *hash = (BenchHash *) _hashJob->arg;
+	bool isSame = true;
+	int run;
+
+	setStagePool(_stage, NULL);
+	runStage(_stage, _frame, expected, _stride);
+	hash->rgba = expected;
+	hash->stride = _stride;
+	hash->width = _frame->planes[0].width;
+	hashBand(hash, 0, height);
+	memcpy(expectedRows, hash->rows, height * sizeof(unsigned long long));
+
+	setStagePool(_stage, _pool);
+	for (run = RUN_BARRIER; run <= RUN_CHAINED && isSame; run++) {
+		memset(actual, 0, _stride * height);
+		memset(hash->rows, 0, height * sizeof(unsigned long long));
+		runFrame(_stage, _pool, _hashJob, (BenchRun_t) run, _frame, actual, _stride);
+
+		isSame = (memcmp(expected, actual, _stride * height) == 0) &&
+				 (memcmp(expectedRows, hash->rows, height * sizeof(unsigned long long)) == 0);
+	}
+
+	free(expected);
+	free(actual);
+	free(expectedRows);
+	return isSame;
+}
+
+/**
+ * Whether _downscaler gives the preview of _reference, on the calling
+ * thread and over _pool.
+ */
+static bool verifyDownscaler(Downscaler *_downscaler, Downscaler *_reference, WorkerPool *_pool, const VideoFrame *_frame) {
+	bool isSame;
+
+	_reference->scale(_reference, _frame);
+	_downscaler->setPool(_downscaler, NULL);
+	_downscaler->scale(_downscaler, _frame);
+	isSame = (memcmp(_downscaler->frameData, _reference->frameData, _reference->frame.bytesused) == 0);
+
+	memset(_downscaler->frameData, 0, _downscaler->frame.bytesused);
+	_downscaler->setPool(_downscaler, _pool);
+	_downscaler->scale(_downscaler, _frame);
+	isSame = isSame && (memcmp(_downscaler->frameData, _reference->frameData, _reference->frame.bytesused) == 0);
+
+	_downscaler->setPool(_downscaler, NULL);
+	return isSame;
+}
+
+/**
+ * Median usec per preview of _iterations downscales.
+ */
+static long long timeDownscaler(Downscaler *_downscaler, const VideoFrame *_frame, int _iterations) {
+	Samples *samples = Samples_new();
+	struct timespec started, ended;
+	int i;
+
+	_downscaler->scale(_downscaler, _frame);
+	for (i = 0; i < _iterations; i++) {
+		clock_gettime(CLOCK_MONOTONIC, &started);
+		_downscaler->scale(_downscaler, _frame);
+		clock_gettime(CLOCK_MONOTONIC, &ended);
+		samples->add(samples, Trace_usecOf(&ended) - Trace_usecOf(&started));
+	}
+
+	long long median = samples->percentile(samples, 50);
+	Samples_dispose(samples);
+	return median;
+}
+
+/**
+ * Every downscale kernel and filter for _format, checked against the scalar
+ * kernel, on one thread and over _pool. Returns false when one differs.
+ */
+static bool benchDownscale(PixelFormat_t _format, unsigned int _width, unsigned int _height, unsigned int _previewWidth,
+						   unsigned int _previewHeight, ConvertIsa_t _cpuIsa, WorkerPool *_pool, int _iterations,
+						   bool _isVerifyOnly) {
+	VideoFrame frame;
+	unsigned char *data = newFrame(&frame, PixelFormat_info(_format), _width, _height);
+	bool isAllSame = true;
+	int filter, isa;
+
+	for (filter = SCALE_FILTER_BOX; filter <= SCALE_FILTER_BILINEAR; filter++) {
+		Downscaler *reference = Downscaler_newWith(_format, _width, _height, _previewWidth, _previewHeight,
+												   (ScaleFilter_t) filter, CONVERT_ISA_SCALAR);
+		if (reference->frame.planesCount == 0) {
+			fprintf(stdout, "%-6s %s\n", PixelFormat_name(_format), reference->error);
+			Downscaler_dispose(reference);
+			break;
+		}
+
+		long long scalarUsec = 0;
+		for (isa = CONVERT_ISA_SCALAR; isa <= (int) _cpuIsa; isa++) {
+			Downscaler *downscaler = Downscaler_newWith(_format, _width, _height, _previewWidth, _previewHeight,
+														(ScaleFilter_t) filter, (ConvertIsa_t) isa);
+
+			// fell back to a lesser kernel; already covered
+			if (downscaler->isa != (ConvertIsa_t) isa) {
+				Downscaler_dispose(downscaler);
+				continue;
+			}
+
+			bool isSame = verifyDownscaler(downscaler, reference, _pool, &frame);
+			isAllSame = isAllSame && isSame;
+
+			if (_isVerifyOnly) {
+				fprintf(stdout, "%-6s %-8s %-8s %s\n", PixelFormat_name(_format), Downscale_filterName(downscaler->filter),
+						ColorConvert_isaName(downscaler->isa), isSame ? "bit-exact" : "DIFFERS");
+			} else {
+				long long usec = timeDownscaler(downscaler, &frame, _iterations);
+				downscaler->setPool(downscaler, _pool);
+				long long poolUsec = timeDownscaler(downscaler, &frame, _iterations);
+				if (isa == CONVERT_ISA_SCALAR) {
+					scalarUsec = usec;
+				}
+				fprintf(stdout, "%-6s %-8s %-8s %10lld %7.2fx %10lld %8s\n", PixelFormat_name(_format),
+						Downscale_filterName(downscaler->filter), ColorConvert_isaName(downscaler->isa), usec,
+						(usec > 0) ? (double) scalarUsec / usec : 0.0, poolUsec, isSame ? "yes" : "NO");
+			}
+			fflush(stdout);
+			Downscaler_dispose(downscaler);
+		}
+
+		Downscaler_dispose(reference);
+	}
+
+	free(data);
+	return isAllSame;
+}
+
+static bool parseSizes(char *_list, unsigned int *_widths, unsigned int *_heights, unsigned int *_count) {
+	char *save = NULL;
+	char *token;
+
+	*_count = 0;
+	for (token = strtok_r(_list, ",", &save); token != NULL; token = strtok_r(NULL, ",", &save)) {
+		if (*_count >= BENCH_MAX_VALUES ||
+			sscanf(token, "%ux%u", &_widths[*_count], &_heights[*_count]) != 2 ||
+			_widths[*_count] < 2 || _heights[*_count] < 2) {
+			fprintf(stderr, "Invalid frame size: %s\n", token);
+			return false;
+		}
+
+		// chroma planes and Bayer quads need whole pairs of pixels
+		_widths[*_count] &= ~1u;
+		_heights[*_count] &= ~1u;
+		(*_count)++;
+	}
+
+	return *_count > 0;
+}
+
+static bool parseThreads(char *_list, unsigned int *_threads, unsigned int *_count) {
+	char *save = NULL;
+	char *token;
+
+	*_count = 0;
+	for (token = strtok_r(_list, ",", &save); token != NULL; token = strtok_r(NULL, ",", &save)) {
+		int threads = atoi(token);
+		if (*_count >= BENCH_MAX_VALUES || threads <= 0) {
+			fprintf(stderr, "Invalid thread count: %s\n", token);
+			return false;
+		}
+		_threads[(*_count)++] = threads;
+	}
+
+	return *_count > 0;
+}
+
+static void printUsage(const char *_app) {
+	fprintf(stdout, "Usage: %s [-w WxH,...] [-c format,...] [-n iterations] [-j threads,...] [-P WxH] [-V]\n\n", _app);
+	fprintf(stdout, "\t-w <WxH,...>       Frame sizes (1280x720).\n");
+	fprintf(stdout, "\t-c <format,...>    Pixel formats (all of YUYV, UYVY, YVYU, VYUY, YV16, NV12, RGBP, RGB3, BA10).\n");
+	fprintf(stdout, "\t-n <iterations>    Frames timed per kernel and pool (%d).\n", BENCH_ITERATIONS);
+	fprintf(stdout, "\t-j <threads,...>   Worker pool sizes (1, 2, 4 and one per CPU).\n");
+	fprintf(stdout, "\t-P <WxH>           Preview size (a quarter of each side).\n");
+	fprintf(stdout, "\t-V                 Verify only.\n\n");
+	fprintf(stdout, "Exits with 1 when a kernel or pool differs from the scalar kernel on one thread.\n");
+	fflush(stdout);
+}
+
+int main(int argc, char *argv[]) {
+	PixelFormat_t formats[sizeof(ALL_FORMATS) / sizeof(ALL_FORMATS[0])];
+	unsigned int formatsCount = sizeof(ALL_FORMATS) / sizeof(ALL_FORMATS[0]);
+	unsigned int widths[BENCH_MAX_VALUES] = { 1280 }, heights[BENCH_MAX_VALUES] = { 720 }, sizesCount = 1;
+	unsigned int threads[BENCH_MAX_VALUES] = { 1, 2, 4 }, threadsCount = 3;
+	unsigned int previewWidth = 0, previewHeight = 0;
+	int iterations = BENCH_ITERATIONS;
+	bool isVerifyOnly = false;
+	int option;
+
+	// and one per CPU, when that is yet another count
+	unsigned int cpus = WorkerPool_onlineCpus();
+	if (cpus > 4 || cpus == 3) {
+		threads[threadsCount++] = cpus;
+	}
+
+	memcpy(formats, ALL_FORMATS, sizeof(ALL_FORMATS));
+	while ((option = getopt(argc, argv, "w:c:n:j:P:Vh")) != -1) {
+		switch (option) {
+		case 'w':
+			if (!parseSizes(optarg, widths, heights, &sizesCount)) {
+				return 1;
+			}
+			break;
+		case 'c': {
+			char *save = NULL;
+			char *token;
+			formatsCount = 0;
+			for (token = strtok_r(optarg, ",", &save); token != NULL; token = strtok_r(NULL, ",", &save)) {
+				if (formatsCount >= sizeof(formats) / sizeof(formats[0]) ||
+					!PixelFormat_parse(token, &formats[formatsCount])) {
+					fprintf(stderr, "Invalid pixel format: %s\n", token);
+					return 1;
+				}
+				formatsCount++;
+			}
+			break;
+		}
+		case 'n':
+			iterations = atoi(optarg);
+			if (iterations <= 0) {
+				fprintf(stderr, "Invalid iteration count: %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'j':
+			if (!parseThreads(optarg, threads, &threadsCount)) {
+				return 1;
+			}
+			break;
+		case 'P':
+			if (sscanf(optarg, "%ux%u", &previewWidth, &previewHeight) != 2) {
+				fprintf(stderr, "Invalid preview size: %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'V':
+			isVerifyOnly = true;
+			break;
+		default:
+			printUsage(argv[0]);
+			return 1;
+		}
+	}
+
+	ConvertIsa_t cpuIsa = ColorConvert_cpuIsa();
+	fprintf(stdout, "CPU runs up to %s on %u CPUs; %d iterations.\n", ColorConvert_isaName(cpuIsa), cpus, iterations);
+
+	WorkerPool *pools[BENCH_MAX_VALUES];
+	unsigned int s, f, t, largest = 0;
+	for (t = 0; t < threadsCount; t++) {
+		if (threads[t] > threads[largest]) {
+			largest = t;
+		}
+		pools[t] = WorkerPool_newWith(threads[t]);
+		if (pools[t]->error[0] != '\0') {
+			fprintf(stdout, "%s\n", pools[t]->error);
+		}
+	}
+
+	srand(1);
+	int exitCode = 0;
+
+	for (s = 0; s < sizesCount; s++) {
+		unsigned int width = widths[s], height = heights[s];
+		unsigned int stride = (width * 4) + BENCH_STRIDE_PADDING;
+		unsigned char *rgba = (unsigned char *) malloc(stride * height);
+		BenchHash hash = { rgba, stride, width, (unsigned long long *) calloc(height, sizeof(unsigned long long)) };
+		WorkerJob *hashJob = WorkerJob_newWith(hashBand, &hash, 0);
+
+		fprintf(stdout, "\n%ux%u frames\n", width, height);
+		if (!isVerifyOnly) {
+			fprintf(stdout, "%-6s %-8s %10s %10s %8s %8s\n", "format", "kernel", "usec/frame", "Mpixel/s", "speedup", "verified");
+		}
+
+		for (f = 0; f < formatsCount; f++) {
+			BenchStage reference;
+			if (!newStage(&reference, formats[f], CONVERT_ISA_SCALAR)) {
+				continue;
+			}
+
+			VideoFrame frame;
+			unsigned char *data = newFrame(&frame, PixelFormat_info(formats[f]), width, height);
+			long long scalarUsec = 0;
+			int isa;
+
+			// every kernel on the calling thread
+			for (isa = CONVERT_ISA_SCALAR; isa <= (int) cpuIsa; isa++) {
+				BenchStage stage;
+				newStage(&stage, formats[f], (ConvertIsa_t) isa);
+
+				// fell back to a lesser kernel; already covered
+				if (stage.isa != (ConvertIsa_t) isa) {
+					disposeStage(&stage);
+					continue;
+				}
+
+				bool isSame = (isa == CONVERT_ISA_SCALAR) ||
+							  ((stage.demosaic != NULL) ? verifyDemosaic(stage.demosaic) :
+							   verify(formats[f], stage.converter, reference.converter));
+				if (!isSame) {
+					exitCode = 1;
+				}
+
+				if (isVerifyOnly) {
+					fprintf(stdout, "%-6s %-8s %s\n", PixelFormat_name(formats[f]), ColorConvert_isaName(stage.isa),
+							isSame ? "bit-exact" : "DIFFERS");
+				} else {
+					long long usec = timeFrames(&stage, NULL, hashJob, RUN_ALONE, &frame, rgba, stride, iterations);
+					if (isa == CONVERT_ISA_SCALAR) {
+						scalarUsec = usec;
+					}
+					fprintf(stdout, "%-6s %-8s %10lld %10.1f %7.2fx %8s\n", PixelFormat_name(formats[f]),
+							ColorConvert_isaName(stage.isa), usec,
+							(usec > 0) ? ((double) width * height) / usec : 0.0,
+							(usec > 0) ? (double) scalarUsec / usec : 0.0, isSame ? "yes" : "NO");
+				}
+				fflush(stdout);
+				disposeStage(&stage);
+			}
+
+			free(data);
+			disposeStage(&reference);
+		}
+
+		// the fastest kernels over the pools
+		if (!isVerifyOnly) {
+			fprintf(stdout, "\n%-6s %-8s %7s %10s %13s %13s %8s %8s\n", "format", "kernel", "threads", "alone",
+					"barrier+hash", "chained+hash", "scaling", "verified");
+		}
+
+		for (f = 0; f < formatsCount; f++) {
+			BenchStage stage;
+			if (!newStage(&stage, formats[f], CONVERT_ISA_BEST)) {
+				continue;
+			}
+
+			VideoFrame frame;
+			unsigned char *data = newFrame(&frame, PixelFormat_info(formats[f]), width, height);
+			long long firstUsec = 0;
+
+			for (t = 0; t < threadsCount; t++) {
+				WorkerPool *pool = pools[t];
+				bool isSame = verifyPool(&stage, pool, hashJob, &frame, stride);
+				if (!isSame) {
+					exitCode = 1;
+				}
+
+				if (isVerifyOnly) {
+					fprintf(stdout, "%-6s %-8s x%-6u %s\n", PixelFormat_name(formats[f]), ColorConvert_isaName(stage.isa),
+							pool->threadsCount, isSame ? "bit-exact" : "DIFFERS");
+				} else {
+					long long alone = timeFrames(&stage, pool, hashJob, RUN_ALONE, &frame, rgba, stride, iterations);
+					long long barrier = timeFrames(&stage, pool, hashJob, RUN_BARRIER, &frame, rgba, stride, iterations);
+					long long chained = timeFrames(&stage, pool, hashJob, RUN_CHAINED, &frame, rgba, stride, iterations);
+					if (t == 0) {
+						firstUsec = alone;
+					}
+					fprintf(stdout, "%-6s %-8s %7u %10lld %13lld %13lld %7.2fx %8s\n", PixelFormat_name(formats[f]),
+							ColorConvert_isaName(stage.isa), pool->threadsCount, alone, barrier, chained,
+							(alone > 0) ? (double) firstUsec / alone : 0.0, isSame ? "yes" : "NO");
+				}
+				fflush(stdout);
+			}
+
+			free(data);
+			disposeStage(&stage);
+		}
+
+		// previews of the YUV formats, also over the largest pool
+		unsigned int scaledWidth = (previewWidth > 0) ? previewWidth : (width / 4) & ~1u;
+		unsigned int scaledHeight = (previewHeight > 0) ? previewHeight : (height / 4) & ~1u;
+		fprintf(stdout, "\n%ux%u previews\n", scaledWidth, scaledHeight);
+
+		// nothing would be checked; a verify run must not pass for that
+		if (!Downscale_canScale(width, height, scaledWidth, scaledHeight)) {
+			fprintf(stdout, "Cannot scale %ux%u to %ux%u; set -P to a size that can.\n", width, height,
+					scaledWidth, scaledHeight);
+			exitCode = 1;
+		} else {
+			if (!isVerifyOnly) {
+				fprintf(stdout, "%-6s %-8s %-8s %10s %8s %10s %8s\n", "format", "filter", "kernel", "usec/frame", "speedup",
+						"pool usec", "verified");
+			}
+
+			for (f = 0; f < formatsCount; f++) {
+				if (!benchDownscale(formats[f], width, height, scaledWidth, scaledHeight, cpuIsa, pools[largest],
+									iterations, isVerifyOnly)) {
+					exitCode = 1;
+				}
+			}
+		}
+
+		WorkerJob_dispose(hashJob);
+		free(hash.rows);
+		free(rgba);
+	}
+
+	for (t = 0; t < threadsCount; t++) {
+		WorkerPool_dispose(pools[t]);
+	}
+	return exitCode;
+}
@@ -497,7 +497,7 @@ int main(int argc, char *argv[]) {
 	initConfigWithDefaults(config);
 
 	if (parseArguments(argc, argv, config) <= 0) {
-		char *help = "\n  -d <device> \n  -c <color_format> \n  -w <width> \n  -h <height> \n  -f <raw_image_file_source> \n  -n <max_frame_count>";
+		char *help = "\n  -d <device> \n  -c <color_format> \n  -w <width> \n  -h <height> \n  -f <raw_image_file_or_directory> \n  -n <max_frame_count>";
 		fprintf(stdout, "%s %s\n\n", config->appCommand->str, help);
 		fflush(stdout);
 
@@ -524,8 +524,7 @@ int main(int argc, char *argv[]) {
 	mipi->setLoggerWith(mipi, logger);
 
 	// set FIFO active
-	mipi->isFIFO = true;
-	mipi->rawFile = fifoFile->str;
+	mipi->setFifoInjectionFrom(mipi, fifoFile->str, NULL);
 
 	// init MIPI with FIFO
 	int ret = mipi->initDevice(mipi);
@@ -29,12 +29,20 @@
 #include <signal.h>
 #include <getopt.h>
 #include <unistd.h>
+#include <pthread.h>
 #include <sys/time.h>
 
 #include "utilities.h"
 #include "str_struct.h"
 #include "video.h"
 #include "shader.h"
+#include "frame_ring.h"
+#include "reactor.h"
+#include "dmabuf_texture.h"
+#include "pixel_format.h"
+#include "trace.h"
+#include "plane_textures.h"
+#include "worker_pool.h"
 
 #ifdef WAYLAND
 #define APP_NAME "isp-mipi-test.Wayland"
@@ -56,9 +64,9 @@
 #define OV5640_2_MAIN "/dev/video8"
 #define OV5640_2_VF "/dev/video10"
 
-#define SIZE_OF_SHADER_LOG 1000
 #define VF_WIDTH 640
 #define VF_HEIGHT 480
+#define FRAME_WAIT_MSEC 100
 
 /**
  * Globals begin
@@ -71,12 +79,20 @@ ContextData contextData = {0};
 Display *x_display;
 Window win;
 #endif
-Video *mipi, *mipi_vf;
+Video *mipi;
 bool gIsForever = true;
 bool gIsUseViewfinder = false;
 int g_VideoWidth;	// used by eglCreateSurfaceWindow
 int g_VideoHeight;	// used by eglCreateSurfaceWindow
 PixelFormat_t g_PixelFormat; 	// used by drawScene
+FrameDesc *g_CurrentFrame = NULL;		// frame owned by the render thread; used by drawScene
+DmaBufTexture *g_DmaBufTexture = NULL;	// imported capture buffers, when available
+TraceRing *g_RenderTrace = NULL;		// render thread's ring; spans of drawScene
+
+// capture thread variables
+CaptureEngine *g_Engine = NULL;
+CaptureStream *g_MainStream = NULL;	// the stream that is rendered
+FrameRing *g_FrameRing = NULL;		// g_MainStream->ring
 
 // EGL variables
 EGLDisplay eglDisplay;
@@ -96,10 +112,12 @@ GLint g_texY = -1;
 GLint g_texUV = -1;
 GLint g_texU = -1;
 GLint g_texV = -1;
-GLuint g_CubeTexture = 0;
-GLuint g_UVTexture = 0;
-GLuint g_UTexture = 0;
-GLuint g_VTexture = 0;
+PlaneTextures *g_PlaneTextures = NULL;	// Y, U, V or Y, UV or packed pixels
+WorkerPool *g_Workers = NULL;			// demosaics BA10 frames and scales previews in row tiles
+Downscaler *g_Preview = NULL;			// previews of the main stream, from -P
+PlaneTextures *g_PreviewTextures = NULL;	// drawn in a corner of the window
+WorkerJob *g_PreviewJob = NULL;			// preview of g_CurrentFrame still on the workers
+Recorder *g_Recorder = NULL;			// writes the main stream's frames to disk, from -o
 GLfloat g_Draw1ViewPort[16];
 int g_Rotation = 0;
 GLuint shaderProgram;
@@ -126,11 +144,179 @@ void initConfigWithDefaults(AppConfig_t *_config) {
 #endif
 	_config->maxFrameCount = MAX_FRAME_COUNT;
 	_config->isUseDMABuf = false;
+	_config->isUseUserPtr = false;
+	_config->isUseHugePages = false;
 	_config->isInterlaced = false;
 	_config->isQuiet = false;
 	_config->isNoRender = false;
+	_config->isLatestFrameOnly = false;
+	_config->isReplayFast = false;
 	_config->requestedBufferCount = 0;
 	_config->unsafeRepeatCount = 0;
+	_config->ringDepth = FRAME_RING_DEFAULT_DEPTH;
+	_config->maxHeldFrames = 0;
+	_config->dmaBufBackend = DMABUF_BACKEND_AUTO;
+	_config->cpu = CAPTURE_NO_AFFINITY;
+	Demosaic_defaultLevels(&_config->rawLevels);
+	_config->workerThreads = 0;
+	_config->textureSets = 1;
+	_config->previewWidth = 0;
+	_config->previewHeight = 0;
+	_config->previewFilter = SCALE_FILTER_BOX;
+	_config->recordFile = Str_newWith("");
+	_config->fifoSource = Str_newWith("");
+	_config->fifoDevice = Str_newWith(FIFO_DEV_PATH);
+	_config->extraStreamsCount = 0;
+}
+
+static bool parsePixelFormat(const char *_name, PixelFormat_t *_pixelFormat) {
+	Str *colorFormat = Str_newWith((char *) _name);
+	bool isKnown = true;
+
+	if (colorFormat->isEqualsIgnoreCase(colorFormat, Str_newWith("YV16"))) {
+		*_pixelFormat = YV16;
+	} else if (colorFormat->isEqualsIgnoreCase(colorFormat, Str_newWith("RGB565")) ||
+			   colorFormat->isEqualsIgnoreCase(colorFormat, Str_newWith("RGBP"))) {
+		*_pixelFormat = RGBP;
+	} else if (colorFormat->isEqualsIgnoreCase(colorFormat, Str_newWith("RGB888")) ||
+			   colorFormat->isEqualsIgnoreCase(colorFormat, Str_newWith("RGB3"))) {
+		*_pixelFormat = RGB3;
+	} else if (colorFormat->isEqualsIgnoreCase(colorFormat, Str_newWith("YUYV8")) ||
+			   colorFormat->isEqualsIgnoreCase(colorFormat, Str_newWith("YUYV"))) {
+		*_pixelFormat = YUYV;
+	} else if (colorFormat->isEqualsIgnoreCase(colorFormat, Str_newWith("NV12"))){
+		*_pixelFormat = NV12;
+	} else if (colorFormat->isEqualsIgnoreCase(colorFormat, Str_newWith("SGRBG10")) ||
+			   colorFormat->isEqualsIgnoreCase(colorFormat, Str_newWith("BA10"))) {
+		*_pixelFormat = BA10;
+	} else {
+		isKnown = false;
+	}
+
+	Str_dispose(colorFormat);
+	return isKnown;
+}
+
+/**
+ * Parses device[:WxH[:format[:buffers[:cpu]]]] into another capture stream.
+ * Omitted fields take the main stream's values.
+ */
+static int parseStreamSpec(AppConfig_t *_config, const char *_spec) {
+	if (_config->extraStreamsCount >= CAPTURE_MAX_STREAMS - 2) {
+		fprintf(stderr, "\n\n%s : Too many capture streams.\n\n", _spec);
+		fflush(stderr);
+		return 0;
+	}
+
+	char *spec = strdup(_spec);
+	char *rest = spec;
+	char *field;
+	int n;
+
+	StreamConfig_t *stream = &_config->extraStreams[_config->extraStreamsCount];
+	stream->device = NULL;
+	stream->width = _config->width;
+	stream->height = _config->height;
+	stream->pixelFormat = _config->pixelFormat;
+	stream->requestedBufferCount = _config->requestedBufferCount;
+	stream->cpu = CAPTURE_NO_AFFINITY;
+
+	// empty fields keep their defaults
+	for (n = 0; (field = strsep(&rest, ":")) != NULL; n++) {
+		if (*field == '\0') {
+			continue;
+		}
+
+		switch (n) {
+		case 0:
+			stream->device = Str_newWith(field);
+			break;
+		case 1:
+			if (sscanf(field, "%dx%d", &stream->width, &stream->height) != 2) {
+				fprintf(stderr, "\n\n%s : Expected <width>x<height>.\n\n", field);
+				fflush(stderr);
+				free(spec);
+				return 0;
+			}
+			break;
+		case 2:
+			if (!parsePixelFormat(field, &stream->pixelFormat)) {
+				fprintf(stderr, "\n\n%s : Unrecognized colorformat for Atom ISP.\n\n", field);
+				fflush(stderr);
+				free(spec);
+				return 0;
+			}
+			break;
+		case 3:
+			stream->requestedBufferCount = atoi(field);
+			break;
+		case 4:
+			stream->cpu = atoi(field);
+			break;
+		default:
+			break;
+		}
+	}
+	free(spec);
+
+	if (stream->device == NULL) {
+		fprintf(stderr, "\n\n%s : Missing device in stream.\n\n", _spec);
+		fflush(stderr);
+		return 0;
+	}
+
+	_config->extraStreamsCount++;
+	return 1;
+}
+
+/**
+ * <width>x<height>[,box|bilinear]
+ */
+static int parsePreviewSpec(AppConfig_t *_config, const char *_spec) {
+	char filter[16] = "";
+
+	int n = sscanf(_spec, "%dx%d,%15s", &_config->previewWidth, &_config->previewHeight, filter);
+	if (n < 2 || _config->previewWidth <= 0 || _config->previewHeight <= 0 ||
+		(n == 3 && !Downscale_parseFilter(filter, &_config->previewFilter))) {
+		fprintf(stderr, "\n\n%s : Expected <width>x<height>[,box|bilinear].\n\n", _spec);
+		fflush(stderr);
+		return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * One stream spec per line; blank lines and lines starting with # are skipped.
+ */
+static int parseStreamsFile(AppConfig_t *_config, const char *_fileName) {
+	FILE *fd = fopen(_fileName, "r");
+	if (fd == NULL) {
+		fprintf(stderr, "\n\n%s : Cannot open streams file.\n\n", _fileName);
+		fflush(stderr);
+		return 0;
+	}
+
+	char line[256];
+	while (fgets(line, sizeof(line), fd) != NULL) {
+		char *spec = line;
+		while (*spec == ' ' || *spec == '\t') {
+			spec++;
+		}
+		spec[strcspn(spec, " \t\r\n")] = '\0';
+
+		if (*spec == '\0' || *spec == '#') {
+			continue;
+		}
+
+		if (!parseStreamSpec(_config, spec)) {
+			fclose(fd);
+			return 0;
+		}
+	}
+
+	fclose(fd);
+	return 1;
 }
 
 int parseArguments(int argc, char *argv[], AppConfig_t *_config) {
@@ -138,7 +324,7 @@ int parseArguments(int argc, char *argv[], AppConfig_t *_config) {
 
 	bool didProcessedOptions = false;
 
-	static const char *options = "d:c:C:w:h:p:m:v:n:iqgb:?u:2f";
+	static const char *options = "d:c:C:w:h:p:m:v:n:iqgUTb:?u:2fr:H:s:S:a:D:LR:j:P:o:xF:I:G:";
 	int c;
 	while ((c = getopt(argc, argv, options)) != -1) {
 		didProcessedOptions = true;
@@ -147,31 +333,12 @@ int parseArguments(int argc, char *argv[], AppConfig_t *_config) {
 			_config->device->set(_config->device, "%s", optarg);
 			break;
 		case 'c':
-		{
-			Str *colorFormat = Str_newWith(optarg);
-
-			if (colorFormat->isEqualsIgnoreCase(colorFormat, Str_newWith("YV16"))) {
-				_config->pixelFormat = YV16;
-			} else if (colorFormat->isEqualsIgnoreCase(colorFormat, Str_newWith("RGB565")) ||
-					   colorFormat->isEqualsIgnoreCase(colorFormat, Str_newWith("RGBP"))) {
-				_config->pixelFormat = RGBP;
-			} else if (colorFormat->isEqualsIgnoreCase(colorFormat, Str_newWith("RGB888")) ||
-					   colorFormat->isEqualsIgnoreCase(colorFormat, Str_newWith("RGB3"))) {
-				_config->pixelFormat = RGB3;
-			} else if (colorFormat->isEqualsIgnoreCase(colorFormat, Str_newWith("YUYV8")) ||
-                       colorFormat->isEqualsIgnoreCase(colorFormat, Str_newWith("YUYV"))) {
-                _config->pixelFormat = YUYV;
-            } else if (colorFormat->isEqualsIgnoreCase(colorFormat, Str_newWith("NV12"))){
-				_config->pixelFormat = NV12;
-			} else {
-				fprintf(stderr, "\n\n%s : Unrecognized colorformat for Atom ISP.\n\n", colorFormat->str);
+			if (!parsePixelFormat(optarg, &_config->pixelFormat)) {
+				fprintf(stderr, "\n\n%s : Unrecognized colorformat for Atom ISP.\n\n", optarg);
 				fflush(stderr);
 				return 0;
 			}
-
-			Str_dispose(colorFormat);
 			break;
-		}
 #ifdef COLOR_CONVERSION
 		case 'C':
 		{
@@ -257,6 +424,20 @@ int parseArguments(int argc, char *argv[], AppConfig_t *_config) {
 		case 'g':
 			_config->isUseDMABuf = true;
 			break;
+		case 'D':
+			if (!DmaBufAllocator_parseBackend(optarg, &_config->dmaBufBackend)) {
+				fprintf(stderr, "\n\n%s : Unrecognized DMA buffer allocator.\n\n", optarg);
+				fflush(stderr);
+				return 0;
+			}
+			_config->isUseDMABuf = true;
+			break;
+		case 'U':
+			_config->isUseUserPtr = true;
+			break;
+		case 'T':
+			_config->isUseHugePages = true;
+			break;
 		case 'b':
 			_config->requestedBufferCount = atoi(optarg);
 			break;
@@ -266,6 +447,58 @@ int parseArguments(int argc, char *argv[], AppConfig_t *_config) {
 		case 'f':
 			_config->isNoRender = true;
 			break;
+		case 'r':
+			_config->ringDepth = atoi(optarg);
+			break;
+		case 'H':
+			_config->maxHeldFrames = atoi(optarg);
+			break;
+		case 'L':
+			_config->isLatestFrameOnly = true;
+			break;
+		case 's':
+			if (!parseStreamSpec(_config, optarg)) {
+				return 0;
+			}
+			break;
+		case 'S':
+			if (!parseStreamsFile(_config, optarg)) {
+				return 0;
+			}
+			break;
+		case 'a':
+			_config->cpu = atoi(optarg);
+			break;
+		case 'R':
+			if (!Demosaic_parseLevels(optarg, &_config->rawLevels)) {
+				fprintf(stderr, "\n\n%s : Expected <black>[,<red>,<green>,<blue>] gains.\n\n", optarg);
+				fflush(stderr);
+				return 0;
+			}
+			break;
+		case 'j':
+			_config->workerThreads = atoi(optarg);
+			break;
+		case 'G':
+			_config->textureSets = atoi(optarg);
+			break;
+		case 'P':
+			if (!parsePreviewSpec(_config, optarg)) {
+				return 0;
+			}
+			break;
+		case 'o':
+			_config->recordFile->set(_config->recordFile, "%s", optarg);
+			break;
+		case 'x':
+			_config->isReplayFast = true;
+			break;
+		case 'F':
+			_config->fifoSource->set(_config->fifoSource, "%s", optarg);
+			break;
+		case 'I':
+			_config->fifoDevice->set(_config->fifoDevice, "%s", optarg);
+			break;
 		case '?':
 			return 0;
 		default:
@@ -299,6 +532,13 @@ bool validateConfig(AppConfig_t *_config) {
 		return false;
 	}
 
+	if (_config->textureSets < 1 || _config->textureSets > PLANE_TEXTURES_MAX_SETS) {
+		errorMsg->set(errorMsg, "Texture sets must be 1 to %d.", PLANE_TEXTURES_MAX_SETS);
+		fprintf(stdout, "%s\n", errorMsg->str);
+		fflush(stdout);
+		return false;
+	}
+
 	return true;
 }
 
@@ -399,6 +639,32 @@ void logConfig(FILE *_hAppLog, AppConfig_t *_config) {
 #endif
 
 	writeToLog(_hAppLog, "config.isInterlaced: %d", _config->isInterlaced);
+	writeToLog(_hAppLog, "config.isUseDMABuf: %d", _config->isUseDMABuf);
+	writeToLog(_hAppLog, "config.dmaBufBackend: %s", DmaBufAllocator_backendName(_config->dmaBufBackend));
+	writeToLog(_hAppLog, "config.isUseUserPtr: %d", _config->isUseUserPtr);
+	writeToLog(_hAppLog, "config.isUseHugePages: %d", _config->isUseHugePages);
+	writeToLog(_hAppLog, "config.ringDepth: %d", _config->ringDepth);
+	writeToLog(_hAppLog, "config.maxHeldFrames: %d", _config->maxHeldFrames);
+	writeToLog(_hAppLog, "config.isLatestFrameOnly: %d", _config->isLatestFrameOnly);
+	writeToLog(_hAppLog, "config.cpu: %d", _config->cpu);
+	writeToLog(_hAppLog, "config.rawLevels: black %u, gains %u/%u/%u", _config->rawLevels.blackLevel,
+			   _config->rawLevels.gains[0], _config->rawLevels.gains[1], _config->rawLevels.gains[2]);
+	writeToLog(_hAppLog, "config.workerThreads: %d", _config->workerThreads);
+	writeToLog(_hAppLog, "config.textureSets: %d", _config->textureSets);
+	writeToLog(_hAppLog, "config.preview: %dx%d %s", _config->previewWidth, _config->previewHeight,
+			   Downscale_filterName(_config->previewFilter));
+	writeToLog(_hAppLog, "config.recordFile: %s", _config->recordFile->str);
+	writeToLog(_hAppLog, "config.isReplayFast: %d", _config->isReplayFast);
+	writeToLog(_hAppLog, "config.fifoSource: %s", _config->fifoSource->str);
+	writeToLog(_hAppLog, "config.fifoDevice: %s", _config->fifoDevice->str);
+
+	int i;
+	for (i = 0; i < _config->extraStreamsCount; i++) {
+		StreamConfig_t *stream = &_config->extraStreams[i];
+		writeToLog(_hAppLog, "config.stream[%d]: %s %dx%d buffers=%d cpu=%d", i + 1,
+				   stream->device->str, stream->width, stream->height,
+				   stream->requestedBufferCount, stream->cpu);
+	}
 }
 
 #ifdef WAYLAND
@@ -549,53 +815,107 @@ void makeOrthMatrix(GLfloat left, GLfloat right,
 	m[14] = (zfar+znear)/(zfar-znear);
 }
 
+/**
+ * Hands the preview of _frame to the workers; this thread goes on with the
+ * upload and draw of the frame itself.
+ */
+static void startPreview(const VideoFrame *_frame) {
+	g_PreviewJob = g_Preview->prepare(g_Preview, _frame);
+	if (g_PreviewJob != NULL) {
+		WorkerJob_chain(g_PreviewJob, NULL, 0);
+		g_Workers->submit(g_Workers, g_PreviewJob);
+	}
+}
+
+/**
+ * Waits for the preview, helping the workers with its tiles. The frame it
+ * is scaled from can be released once this returns.
+ */
+static void finishPreview() {
+	if (g_PreviewJob == NULL) {
+		return;
+	}
+
+	TRACE_SPAN_BEGIN(previewBegin);
+	g_Workers->wait(g_Workers, g_PreviewJob);
+	g_PreviewJob = NULL;
+	TRACE_SPAN_END(g_RenderTrace, TRACE_SPAN_PREVIEW, previewBegin, g_Preview->frame.sequence, 0);
+}
+
+static void drawQuad() {
+	glVertexAttribPointer(g_attr_pos, 3, GL_FLOAT, GL_FALSE, 0, hmi_vtx);
+	glVertexAttribPointer(g_attr_tex, 2, GL_FLOAT, GL_FALSE, 0, hmi_tex);
+	glEnableVertexAttribArray(g_attr_pos);
+	glEnableVertexAttribArray(g_attr_tex);
+	glDrawElements(GL_TRIANGLES, 2*3, GL_UNSIGNED_BYTE, hmi_ind);
+	glDisableVertexAttribArray(g_attr_pos);
+	glDisableVertexAttribArray(g_attr_tex);
+}
+
+/**
+ * The preview in the bottom right corner, pixel for pixel, over the frame.
+ */
+static void drawPreview(bool _hasFrame) {
+	const VideoPlane *plane = &g_Preview->frame.planes[0];
+	GLint viewport[4];
+
+	if (_hasFrame) {
+		finishPreview();
+		g_PreviewTextures->upload(g_PreviewTextures, &g_Preview->frame);
+	}
+
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	glViewport(viewport[2] - plane->width, 0, plane->width, plane->height);
+	glDisable(GL_DEPTH_TEST);
+
+	g_PreviewTextures->bind(g_PreviewTextures);
+	glUniformMatrix4fv(g_u_matrix_p3, 1, GL_FALSE, g_Draw1ViewPort);
+	drawQuad();
+
+	glEnable(GL_DEPTH_TEST);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
+
 static int drawScene() {
 	static int rotation = 0;
+	TRACE_SPAN_BEGIN(drawBegin);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	glBindTexture(GL_TEXTURE_2D, g_CubeTexture);
-
-	switch(g_PixelFormat) {
-	case YV16: {
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, g_CubeTexture);
-		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, g_VideoWidth, g_VideoHeight, GL_LUMINANCE, GL_UNSIGNED_BYTE, mipi->lastVideoBuffer);
 
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, g_UTexture);
-		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, g_VideoWidth/2, g_VideoHeight, GL_LUMINANCE, GL_UNSIGNED_BYTE, mipi->lastVideoBuffer+(g_VideoWidth*g_VideoHeight));
+	// Wayland may redraw between frames; keep what the textures hold
+	bool hasFrame = (g_CurrentFrame != NULL);
 
-		glActiveTexture(GL_TEXTURE2);
-		glBindTexture(GL_TEXTURE_2D, g_VTexture);
-		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, g_VideoWidth/2, g_VideoHeight, GL_LUMINANCE, GL_UNSIGNED_BYTE, (mipi->lastVideoBuffer+(g_VideoWidth*g_VideoHeight) + ((g_VideoWidth/2)*g_VideoHeight)));
-
-		glActiveTexture(GL_TEXTURE0);
-		break;
+	// zero-copy: the buffer's planes are already textures
+	if (hasFrame) {
+		clock_gettime(CLOCK_MONOTONIC, &g_CurrentFrame->uploadStarted);
+	}
+	TRACE_SPAN_BEGIN(bindBegin);
+	bool isImported = hasFrame && (g_DmaBufTexture != NULL) && g_DmaBufTexture->bind(g_DmaBufTexture, g_CurrentFrame->video.index);
+	if (isImported) {
+		TRACE_SPAN_END(g_RenderTrace, TRACE_SPAN_BIND, bindBegin, g_CurrentFrame->video.sequence, 0);
 	}
-	case NV12:{
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, g_CubeTexture);
-		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, g_VideoWidth, g_VideoHeight, GL_LUMINANCE, GL_UNSIGNED_BYTE, mipi->lastVideoBuffer);
 
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, g_UVTexture);
-		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, g_VideoWidth/2, g_VideoHeight/2,GL_LUMINANCE_ALPHA, GL_UNSIGNED_BYTE, (mipi->lastVideoBuffer+(g_VideoWidth*g_VideoHeight)));
+	if (hasFrame && !isImported) {
+		unsigned int p;
 
+		g_CurrentFrame->textureSet = g_PlaneTextures->next(g_PlaneTextures);
+		for (p = 0; p < g_PlaneTextures->planesCount && p < g_CurrentFrame->video.planesCount; p++) {
+			TRACE_SPAN_BEGIN(uploadBegin);
+			g_PlaneTextures->uploadPlane(g_PlaneTextures, p, &g_CurrentFrame->video.planes[p]);
+			TRACE_SPAN_END(g_RenderTrace, TRACE_SPAN_UPLOAD, uploadBegin, g_CurrentFrame->video.sequence, p);
+		}
 		glActiveTexture(GL_TEXTURE0);
-		break;
 	}
-	case RGBP:
-		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, g_VideoWidth, g_VideoHeight, GL_RGB, GL_UNSIGNED_SHORT_5_6_5, mipi->lastVideoBuffer);
-		break;
-	default:
-		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, g_VideoWidth, g_VideoHeight, GL_RGBA, GL_UNSIGNED_BYTE, mipi->lastVideoBuffer);
-		break;
+	if (hasFrame) {
+		clock_gettime(CLOCK_MONOTONIC, &g_CurrentFrame->uploadEnded);
 	}
 
 	GLfloat mat[16], rot[16], scale[16], final[16];
 	makeIdentity(rot);
 	makeIdentity(mat);
 	makeIdentity(scale);
-	glBindTexture(GL_TEXTURE_2D, g_CubeTexture);
+	if (!isImported) {
+		g_PlaneTextures->bind(g_PlaneTextures);
+	}
 	glUseProgram(shaderProgram);
 	if (g_Rotation) {
 		rotation += 2;
@@ -606,15 +926,20 @@ static int drawScene() {
 		glUniformMatrix4fv(g_u_matrix_p3, 1, GL_FALSE, g_Draw1ViewPort);
 	}
 
-	glVertexAttribPointer(g_attr_pos, 3, GL_FLOAT, GL_FALSE, 0, hmi_vtx);
-	glVertexAttribPointer(g_attr_tex, 2, GL_FLOAT, GL_FALSE, 0, hmi_tex);
-	glEnableVertexAttribArray(g_attr_pos);
-	glEnableVertexAttribArray(g_attr_tex);
-	glDrawElements(GL_TRIANGLES, 2*3, GL_UNSIGNED_BYTE, hmi_ind);
-	glDisableVertexAttribArray(g_attr_pos);
-	glDisableVertexAttribArray(g_attr_tex);
+	drawQuad();
+
+	if (g_PreviewTextures != NULL) {
+		drawPreview(hasFrame);
+	}
 	glBindTexture(GL_TEXTURE_2D, 0);
+	if (isImported) {
+		g_DmaBufTexture->fence(g_DmaBufTexture);
+	}
+	if (hasFrame) {
+		clock_gettime(CLOCK_MONOTONIC, &g_CurrentFrame->drawn);
+	}
 
+	TRACE_SPAN_END(g_RenderTrace, TRACE_SPAN_DRAW, drawBegin, hasFrame ? g_CurrentFrame->video.sequence : 0, 0);
 	return 0;
 }
 
@@ -641,7 +966,9 @@ void redraw(void *_data, struct wl_callback *_callback, uint32_t _time) {
 	}
 	ctx->callback = wl_surface_frame(ctx->surface);
 	wl_callback_add_listener(ctx->callback, &frameListener, ctx);
+	TRACE_SPAN_BEGIN(swapBegin);
 	eglSwapBuffers(eglDisplay, eglSurface0);
+	TRACE_SPAN_END(g_RenderTrace, TRACE_SPAN_SWAP, swapBegin, g_CurrentFrame ? g_CurrentFrame->video.sequence : 0, 0);
 }
 
 void configureCallback(void *_data, struct wl_callback *_callback, uint32_t _time) {
@@ -682,7 +1009,7 @@ int getAppLogFileName(char **_logFileName, bool _isFPS) {
 		ext = "log";
 	} else {
 		baseName = "frames";
-		ext = "fps";
+		ext = "trace";
 	}
 
 	while (true) {
@@ -717,6 +1044,52 @@ void finishApp(int _signal) {
 	gIsForever = false;
 }
 
+/**
+ * Applies the command line's IO options to a capture stream.
+ */
+static void configureVideo(Video *_video, AppConfig_t *_config, int _bufferCount, FILE *_hAppLog) {
+	//Set IO Method based on the command line argument
+	if (_config->isUseDMABuf) {
+		_video->setIOMethodTo(_video, IO_METHOD_DMABUF);
+		_video->setDmaBufBackendTo(_video, _config->dmaBufBackend);
+	} else if (_config->isUseUserPtr) {
+		int userPtrFlags = USERPTR_POOL_LOCK;
+		if (_config->isUseHugePages) {
+			userPtrFlags |= USERPTR_POOL_HUGETLB | USERPTR_POOL_THP;
+		}
+
+		_video->setIOMethodTo(_video, IO_METHOD_USERPOINTER);
+		_video->setUserPtrFlagsTo(_video, userPtrFlags);
+	}
+
+	if (_bufferCount > 0) {
+		_video->setBufferCountTo(_video, _bufferCount);
+	}
+
+	if (_config->maxHeldFrames > 0) {
+		_video->setMaxHeldFramesTo(_video, _config->maxHeldFrames);
+	}
+
+	_video->setIsLatestFrameOnly(_video, _config->isLatestFrameOnly);
+	_video->setReplayPaceTo(_video, (_config->isReplayFast) ? REPLAY_PACE_FAST : REPLAY_PACE_RECORDED);
+
+	_video->setLoggerWith(_video, _hAppLog);
+}
+
+/**
+ * The pool shared by the CPU stages, started by the first that needs it.
+ */
+static WorkerPool *startWorkers(AppConfig_t *_config, FILE *_hAppLog) {
+	if (g_Workers == NULL) {
+		g_Workers = WorkerPool_newWith(_config->workerThreads);
+		if (g_Workers->error[0] != '\0') {
+			writeToLog(_hAppLog, "%s", g_Workers->error);
+		}
+	}
+
+	return g_Workers;
+}
+
 int main(int argc, char *argv[]) {
 	// 0. prep all the app for test
     signal(SIGABRT, &finishApp);
@@ -743,15 +1116,24 @@ int main(int argc, char *argv[]) {
 	free(strNow);
 
 	AppConfig_t *config, *vfConfig;
+	int exitCode = 0;
+
+	// set up just before streaming; failures before then still reach CRAP_1
+	Tracer *tracer = NULL;
+	char *perfFile = NULL;
+	FILE *streamsLog = NULL;
 
 	config = (AppConfig_t *) calloc(1, sizeof(AppConfig_t));
 	initConfigWithDefaults(config);
 
 	if (parseArguments(argc, argv, config) <= 0) {
 #ifdef COLOR_CONVERSION
-		const char *help = "\n  -d <device> \
+		const char *help = "\n  -d <device, recording or pattern-<bars|gradient|noise|mix>[@fps]> \
 				            \n  -b <number_of_buffers> \
 				            \n  -g (use DMA buffer sharing) \
+				            \n  -D <auto|udmabuf|heap|gbm|intel> (DMA buffer allocator; implies -g) \
+				            \n  -U (capture into app-owned user pointer buffers) \
+				            \n  -T (back user pointer buffers with huge pages) \
 				            \n  -c <out color_format> \
 				            \n  -C <in color_format> \
 				            \n  -w <width> \
@@ -763,11 +1145,28 @@ int main(int argc, char *argv[]) {
 							\n  -i (to enable interlace mode) \
 							\n  -q (Turn off logging) \
 							\n  -2 (Activate viewfinder stream on) \
-				            \n  -f (Do not render frames)";
+				            \n  -f (Do not render frames) \
+				            \n  -r <frame_ring_depth> \
+				            \n  -H <max_frames_held_by_app> \
+				            \n  -L (low latency; show only the newest frame) \
+				            \n  -a <cpu_for_main_capture_thread> \
+				            \n  -s <device[:WxH[:format[:buffers[:cpu]]]]> (capture another stream; repeatable) \
+				            \n  -S <streams_file> (one -s spec per line) \
+				            \n  -R <black[,red,green,blue]> (BA10 black level and gains, e.g. 64,1.9,1,1.6) \
+				            \n  -j <worker_threads> (for demosaicing BA10 and previews; one per CPU by default) \
+				            \n  -G <texture_sets> (per stream, 1 to 4, uploaded into in turn so uploads do not wait on drawing) \
+				            \n  -P <WxH[,box|bilinear]> (preview scaled from the main stream; no -2 needed) \
+				            \n  -o <record_file> (raw frames of the main stream; index in <record_file>.idx) \
+				            \n  -x (replay recordings and generate patterns as fast as possible, not at their pace) \
+				            \n  -F <raw_file_or_directory> (frames injected into the ISP's FIFO input; they loop) \
+				            \n  -I <fifo_output_node> (where -F injects; /dev/video2 by default)";
 #else
-		const char *help = "\n  -d <device> \
+		const char *help = "\n  -d <device, recording or pattern-<bars|gradient|noise|mix>[@fps]> \
 				            \n  -b <number_of_buffers> \
 				            \n  -g (use DMA buffer sharing) \
+				            \n  -D <auto|udmabuf|heap|gbm|intel> (DMA buffer allocator; implies -g) \
+				            \n  -U (capture into app-owned user pointer buffers) \
+				            \n  -T (back user pointer buffers with huge pages) \
 				            \n  -c <out color_format> \
 				            \n  -w <width> \
 							\n  -h <height> \
@@ -778,7 +1177,21 @@ int main(int argc, char *argv[]) {
 							\n  -i (to enable interlace mode) \
 							\n  -q (Turn off logging) \
 							\n  -2 (Activate viewfinder stream on) \
-				            \n  -f (Do not render frames)";
+				            \n  -f (Do not render frames) \
+				            \n  -r <frame_ring_depth> \
+				            \n  -H <max_frames_held_by_app> \
+				            \n  -L (low latency; show only the newest frame) \
+				            \n  -a <cpu_for_main_capture_thread> \
+				            \n  -s <device[:WxH[:format[:buffers[:cpu]]]]> (capture another stream; repeatable) \
+				            \n  -S <streams_file> (one -s spec per line) \
+				            \n  -R <black[,red,green,blue]> (BA10 black level and gains, e.g. 64,1.9,1,1.6) \
+				            \n  -j <worker_threads> (for demosaicing BA10 and previews; one per CPU by default) \
+				            \n  -G <texture_sets> (per stream, 1 to 4, uploaded into in turn so uploads do not wait on drawing) \
+				            \n  -P <WxH[,box|bilinear]> (preview scaled from the main stream; no -2 needed) \
+				            \n  -o <record_file> (raw frames of the main stream; index in <record_file>.idx) \
+				            \n  -x (replay recordings and generate patterns as fast as possible, not at their pace) \
+				            \n  -F <raw_file_or_directory> (frames injected into the ISP's FIFO input; they loop) \
+				            \n  -I <fifo_output_node> (where -F injects; /dev/video2 by default)";
 #endif
 		fprintf(stdout, "%s %s\n\n", config->appCommand->str, help);
 		fflush(stdout);
@@ -805,6 +1218,24 @@ int main(int argc, char *argv[]) {
 		return 0;
 	}
 
+	// 1. init the capture streams; stream 0 is the one rendered
+	g_Engine = CaptureEngine_new();
+	g_Engine->setLoggerWith(g_Engine, hAppLog);
+
+	mipi = Video_newWith(config->device->str,
+				         config->width, config->height,
+				         config->pixelFormat,
+#ifdef COLOR_CONVERSION
+				         config->inpixelFormat,
+#endif
+				         config->mipiPort,
+				         config->isInterlaced);
+	configureVideo(mipi, config, config->requestedBufferCount, hAppLog);
+	if (config->fifoSource->str[0] != '\0') {
+		mipi->setFifoInjectionFrom(mipi, config->fifoSource->str, config->fifoDevice->str);
+	}
+	g_MainStream = g_Engine->addStream(g_Engine, mipi, config->cpu, config->ringDepth);
+
 	// is using viewfinder?
 	if (gIsUseViewfinder) {
 		vfConfig = (AppConfig_t *) calloc(1, sizeof(AppConfig_t));
@@ -819,20 +1250,8 @@ int main(int argc, char *argv[]) {
 		writeToLog(hAppLog, "=== viewfinder active ===");
 		logConfig(hAppLog, vfConfig);
 		writeToLog(hAppLog, "=== viewfinder active ===");
-	}
 
-	// 1. init main video
-	mipi = Video_newWith(config->device->str,
-				         config->width, config->height,
-				         config->pixelFormat,
-#ifdef COLOR_CONVERSION
-				         config->inpixelFormat,
-#endif
-				         config->mipiPort,
-				         config->isInterlaced);
-
-	if (gIsUseViewfinder) {
-		mipi_vf = Video_newWith(vfConfig->device->str,
+		Video *viewFinder = Video_newWith(vfConfig->device->str,
 						        vfConfig->width, vfConfig->height,
 							    vfConfig->pixelFormat,
 #ifdef COLOR_CONVERSION
@@ -842,52 +1261,74 @@ int main(int argc, char *argv[]) {
 							    vfConfig->isInterlaced);
 
 		mipi->setHasViewFinder(mipi, true);
-		mipi_vf->setIsFromViewFinder(mipi_vf, true);
-		mipi_vf->setHasViewFinder(mipi_vf, true);
+		viewFinder->setIsFromViewFinder(viewFinder, true);
+		viewFinder->setHasViewFinder(viewFinder, true);
+		configureVideo(viewFinder, config, 0, hAppLog);
+		g_Engine->addStream(g_Engine, viewFinder, CAPTURE_NO_AFFINITY, 0);
 	}
 
-	//Set IO Method based on the command line argument
-	if (config->isUseDMABuf) {
-		mipi->setIOMethodTo(mipi, IO_METHOD_DMABUF);
-
-		if (gIsUseViewfinder) {
-			mipi_vf->setIOMethodTo(mipi_vf, IO_METHOD_DMABUF);
+	// any further streams from -s or -S
+	int k;
+	for (k = 0; k < config->extraStreamsCount; k++) {
+		StreamConfig_t *extra = &config->extraStreams[k];
+		Video *video = Video_newWith(extra->device->str,
+							         extra->width, extra->height,
+							         extra->pixelFormat,
+#ifdef COLOR_CONVERSION
+							         extra->pixelFormat,
+#endif
+							         config->mipiPort,
+							         false);
+		configureVideo(video, config, extra->requestedBufferCount, hAppLog);
+		if (g_Engine->addStream(g_Engine, video, extra->cpu, 0) == NULL) {
+			writeToErr(hAppLog, "%s", g_Engine->error);
+			Video_dispose(video);
+			CaptureEngine_dispose(g_Engine);
+			goto CRAP_5;
+			return 0;
 		}
 	}
 
-	if (config->requestedBufferCount > 0) {
-		mipi->setBufferCountTo(mipi, config->requestedBufferCount);
-	}
-
-	mipi->setLoggerWith(mipi, hAppLog);
-	if (gIsUseViewfinder) {
-		mipi_vf->setLoggerWith(mipi_vf, hAppLog);
-	}
-
-
-	int ret = mipi->initDevice(mipi);
-
-	if (ret != 1) {
-		writeToErr(hAppLog, "%s", mipi->error);
-		Video_dispose(mipi);
-
-		if (gIsUseViewfinder) {
-			Video_dispose(mipi_vf);
-		}
-
+	if (g_Engine->initDevices(g_Engine) != 1) {
+		writeToErr(hAppLog, "%s", g_Engine->error);
+		CaptureEngine_dispose(g_Engine);
 		goto CRAP_5;
 		return 0;
 	}
 
-	if (gIsUseViewfinder) {
-		ret = mipi_vf->initDevice(mipi_vf);
+	// frames travel from the main stream's capture thread to this (render) thread
+	g_FrameRing = g_MainStream->ring;
+
+	// previews are scaled from the main stream by the workers; no second stream
+	if (config->previewWidth > 0) {
+		g_Preview = Downscaler_newWith(config->pixelFormat, mipi->planes[0].width, mipi->planes[0].height,
+									   config->previewWidth, config->previewHeight, config->previewFilter,
+									   CONVERT_ISA_BEST);
+		if (g_Preview->frame.planesCount == 0) {
+			writeToErr(hAppLog, "%s No preview.", g_Preview->error);
+			Downscaler_dispose(g_Preview);
+			g_Preview = NULL;
+		} else {
+			g_Preview->setPool(g_Preview, startWorkers(config, hAppLog));
+			writeToLog(hAppLog, "Scaling previews to %dx%d with the %s filter and %s kernels on %u threads.",
+					   config->previewWidth, config->previewHeight, Downscale_filterName(g_Preview->filter),
+					   ColorConvert_isaName(g_Preview->isa), g_Workers->threadsCount);
+		}
+	}
 
-		if (ret != 1) {
-			writeToErr(hAppLog, "%s", mipi_vf->error);
-			Video_dispose(mipi_vf);
-			Video_dispose(mipi);
-			goto CRAP_5;
-			return 0;
+	// frames are written from the capture buffers by the recorder's own thread
+	if (config->recordFile->str[0] != '\0') {
+		g_Recorder = Recorder_newWith(config->recordFile->str, RECORDER_DEFAULT_DEPTH);
+		if (g_Recorder->fd < 0) {
+			writeToErr(hAppLog, "%s Not recording.", g_Recorder->error);
+			Recorder_dispose(g_Recorder);
+			g_Recorder = NULL;
+		} else {
+			if (g_Recorder->error[0] != '\0') {
+				writeToLog(hAppLog, "%s", g_Recorder->error);
+			}
+			writeToLog(hAppLog, "Recording frames to %s, indexed in %s; up to %u held while written.",
+					   g_Recorder->path, g_Recorder->indexPath, g_Recorder->capacity);
 		}
 	}
 
@@ -908,10 +1349,7 @@ int main(int argc, char *argv[]) {
 		x_display = XOpenDisplay(NULL);
 		if (x_display == NULL) {
 			writeToErr(hAppLog, "Cannot connect to X server.\n");
-			Video_dispose(mipi);
-			if (gIsUseViewfinder) {
-				Video_dispose(mipi_vf);
-			}
+			CaptureEngine_dispose(g_Engine);
 			goto CRAP_5;
 			return 0;
 		}
@@ -1014,93 +1452,44 @@ int main(int argc, char *argv[]) {
 
 		writeToLog(hAppLog, "Starting EGL... done");
 
-		// init scene
+		// with DMA buffers, try to sample the capture buffers directly
+		if (config->isUseDMABuf) {
+			g_DmaBufTexture = DmaBufTexture_newWith(eglDisplay, config->pixelFormat, config->width, config->height);
+			if (g_DmaBufTexture->importVideo(g_DmaBufTexture, mipi)) {
+				writeToLog(hAppLog, "Imported %u DMA buffers as EGLImages.", g_DmaBufTexture->buffersCount);
+			} else {
+				writeToLog(hAppLog, "%s Uploading frames instead.", g_DmaBufTexture->error);
+				DmaBufTexture_dispose(g_DmaBufTexture);
+				g_DmaBufTexture = NULL;
+			}
+		}
+
+		// init scene; one texture per color plane, sized like the driver's planes
 		writeToLog(hAppLog, "Initializing scene...");
-		switch (config->pixelFormat) {
-			case YV16: {
-				glGenTextures(1, &g_CubeTexture);
-				glGenTextures(1, &g_UTexture);
-				glGenTextures(1, &g_VTexture);
-
-				glActiveTexture(GL_TEXTURE0);
-				glBindTexture(GL_TEXTURE_2D, g_CubeTexture);
-				glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, config->width, config->height, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, NULL);
-				glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-				glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-				glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-				glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-				glUniform1i(g_texY, 0);
-
-				glActiveTexture(GL_TEXTURE1);
-				glBindTexture(GL_TEXTURE_2D, g_UTexture);
-				glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, config->width/2, config->height, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, NULL);
-				glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-				glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-				glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-				glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-				glUniform1i(g_texU, 1);
-
-				glActiveTexture(GL_TEXTURE2);
-				glBindTexture(GL_TEXTURE_2D, g_VTexture);
-				glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, config->width/2, config->height, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, NULL);
-				glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-				glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-				glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-				glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-				glUniform1i(g_texV, 2);
-
-				glActiveTexture(GL_TEXTURE0);
+		g_PlaneTextures = PlaneTextures_newWith(config->pixelFormat, mipi, config->textureSets);
+		if (g_PlaneTextures->planesCount == 0) {
+			fprintf(stderr, "\n\nUnrecognized colorformat for Atom ISP.\n\n");
+			fflush(stderr);
+			goto CRAP_1;
+		}
 
-				break;
-			}
-			case NV12:{
-				glGenTextures(1, &g_CubeTexture);
-				glGenTextures(1, &g_UVTexture);
-
-				glActiveTexture(GL_TEXTURE0);
-				glBindTexture(GL_TEXTURE_2D, g_CubeTexture);
-				glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, config->width, config->height, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, NULL);
-				glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-				glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-				glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-				glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-				glUniform1i(g_texY, 0);
-
-				glActiveTexture(GL_TEXTURE1);
-				glBindTexture(GL_TEXTURE_2D, g_UVTexture);
-				glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE_ALPHA, config->width/2, config->height/2, 0, GL_LUMINANCE_ALPHA, GL_UNSIGNED_BYTE, NULL);
-				glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-				glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-				glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-				glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-				glUniform1i(g_texUV, 1);
-
-				glActiveTexture(GL_TEXTURE0);
-				break;
-			}
-			case RGBP:
-			case RGB3: {
-				glGenTextures(1, &g_CubeTexture);
-
-				glActiveTexture(GL_TEXTURE0);
-				glBindTexture(GL_TEXTURE_2D, g_CubeTexture);
-				if (config->pixelFormat == RGBP) {
-					glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, config->width, config->height, 0, GL_RGB, GL_UNSIGNED_SHORT_5_6_5, NULL);
-				} else {
-					glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, config->width, config->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-				}
+		// raw Bayer is demosaiced on the CPU, in row tiles over the workers
+		if (g_PlaneTextures->demosaic != NULL) {
+			g_PlaneTextures->demosaic->setLevels(g_PlaneTextures->demosaic, &config->rawLevels);
+			g_PlaneTextures->demosaic->setPool(g_PlaneTextures->demosaic, startWorkers(config, hAppLog));
+			writeToLog(hAppLog, "Demosaicing with the %s kernel on %u threads.",
+					   ColorConvert_isaName(g_PlaneTextures->demosaic->isa), g_Workers->threadsCount);
+		}
 
-				glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-				glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-				glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-				glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-				break;
-			}
-			default: {
-				fprintf(stderr, "\n\nUnrecognized colorformat for Atom ISP.\n\n");
-				fflush(stderr);
-				goto CRAP_1;
-				return 0;
+		// the preview is drawn with the frame's shader, from textures of its own
+		if (g_Preview != NULL && g_DmaBufTexture != NULL && g_DmaBufTexture->fragmentShader != NULL) {
+			writeToLog(hAppLog, "Previews are not drawn with the shader of imported buffers.");
+		} else if (g_Preview != NULL) {
+			g_PreviewTextures = PlaneTextures_newWithPlanes(config->pixelFormat, g_Preview->frame.planes, config->textureSets);
+			if (g_PreviewTextures->planesCount == 0) {
+				writeToLog(hAppLog, "%s Previews are not drawn.", g_PreviewTextures->error);
+				PlaneTextures_dispose(g_PreviewTextures);
+				g_PreviewTextures = NULL;
 			}
 		}
 
@@ -1117,6 +1506,13 @@ int main(int argc, char *argv[]) {
 		case RGBP:
 			shader->loadBuiltInFragmentShader(shader, RGBP);
 			break;
+		case NV12:
+			if (g_DmaBufTexture != NULL && g_DmaBufTexture->fragmentShader != NULL) {
+				shader->loadFragmentShader(shader, g_DmaBufTexture->fragmentShader);
+			} else {
+				shader->loadBuiltInFragmentShader(shader, config->pixelFormat);
+			}
+			break;
 		default:
 			shader->loadBuiltInFragmentShader(shader, config->pixelFormat);
 			break;
@@ -1126,54 +1522,14 @@ int main(int argc, char *argv[]) {
 		writeToLog(hAppLog, "Vertex Shader: %s", shader->vertexShaderFile->str);
 		writeToLog(hAppLog, "Fragment Shader: %s", shader->fragmentShaderFile->str);
 
-		// create shaders
-		// compile
-		char shaderLog[SIZE_OF_SHADER_LOG];
-		int shaderStat;
-		GLsizei shaderLen;
-		GLuint vertShader, fragShader;
-
-		// frag shader
-		fragShader = glCreateShader(GL_FRAGMENT_SHADER);
-		glShaderSource(fragShader, 1, (const char **) &shader->fragmentShader->str, NULL);
-		glCompileShader(fragShader);
-		glGetShaderiv(fragShader, GL_COMPILE_STATUS, &shaderStat);
-
-		if (!shaderStat) {
-			glGetShaderInfoLog(fragShader, SIZE_OF_SHADER_LOG, &shaderLen, shaderLog);
-			writeToErr(hAppLog, "Error Compiling Fragment Shader %s: %s", shader->fragmentShaderFile->str, shaderLog);
-			goto CRAP_1;
-			return 0;
-		}
-
-		// vert shader
-		vertShader = glCreateShader(GL_VERTEX_SHADER);
-		glShaderSource(vertShader, 1, (const char **) &shader->vertexShader->str, NULL);
-		glCompileShader(vertShader);
-		glGetShaderiv(vertShader, GL_COMPILE_STATUS, &shaderStat);
-
-		if (!shaderStat) {
-			glGetShaderInfoLog(fragShader, SIZE_OF_SHADER_LOG, &shaderLen, shaderLog);
-			writeToErr(hAppLog, "Error Compiling Vertex Shader %s: %s", shader->vertexShaderFile->str, shaderLog);
-			goto CRAP_1;
-			return 0;
-		}
-
-		shaderProgram = glCreateProgram();
-		glAttachShader(shaderProgram, fragShader);
-		glAttachShader(shaderProgram, vertShader);
-		glBindAttribLocation(shaderProgram, 0, "pos");
-		glBindAttribLocation(shaderProgram, 1, "color");
-		glBindAttribLocation(shaderProgram, 2, "itexcoord");
-		glLinkProgram(shaderProgram);
-		glGetProgramiv(shaderProgram, GL_LINK_STATUS, &shaderStat);
-
-		if (!shaderStat) {
-			glGetProgramInfoLog(shaderProgram, SIZE_OF_SHADER_LOG, &shaderLen, shaderLog);
-			writeToErr(hAppLog, "Error Linking Shader: %s", shaderLog);
+		// compile and link
+		if (!shader->buildProgram(shader)) {
+			writeToErr(hAppLog, "%s", shader->error);
+			Shader_dispose(shader);
 			goto CRAP_1;
 			return 0;
 		}
+		shaderProgram = shader->program;
 
 		// dispose shader object after use
 		Shader_dispose(shader);
@@ -1211,205 +1567,315 @@ int main(int argc, char *argv[]) {
 
 	// 4. start streaming
 
-	// prepare frames logging
-	char *perfFile;
+	// prepare frames tracing; records are written by a background thread
 	getAppLogFileName(&perfFile, true);
-	FILE *perfLog = fopen(perfFile, "w");
-	if (perfLog) {
+	tracer = Tracer_newWith(perfFile, TRACE_RING_DEFAULT_CAPACITY);
+	TraceRing *perfTrace = NULL;
+	if (tracer->file == NULL) {
+		writeToErr(hAppLog, "%s", tracer->error);
+	} else if (g_Engine->setTracerWith(g_Engine, tracer) <= 0) {
+		writeToErr(hAppLog, "%s", g_Engine->error);
+	} else {
+		perfTrace = tracer->addRing(tracer, "render");
+		g_RenderTrace = perfTrace;
+		tracer->start(tracer);
+		writeToLog(hAppLog, "Tracing frames to %s.", perfFile);
+	}
+
+	// prepare per-stream logging, numbered like the frames trace
+	int perfFileNumber = 0;
+	sscanf(perfFile, "frames.%d.trace", &perfFileNumber);
+	char streamsFile[80];
+	snprintf(streamsFile, sizeof(streamsFile), "streams.%d.fps", perfFileNumber);
+	streamsLog = fopen(streamsFile, "w");
+	if (streamsLog) {
 		// write header
-		fprintf(perfLog, "frame,capture_time (usec),render_time (usec),total_time (usec),fps\n");
-		fflush(perfLog);
+		fprintf(streamsLog, "time (sec),stream,device,frames,fps,dropped,latency_avg (usec),latency_max (usec),driver_dropped\n");
+		fflush(streamsLog);
 	}
+	unsigned long lastStreamCaptured[CAPTURE_MAX_STREAMS];
+	double streamsElapsed = 0;
 
-	// prepare clocking variables
-	struct timeval captureClockIn, captureClockOut;
-	struct timeval renderClockIn, renderClockOut;
-	time_t frameIn, frameOut;
+	// prepare clocking variables; all CLOCK_MONOTONIC, like the driver timestamps
+	struct timespec captureClockIn, captureClockOut;
+	struct timespec renderClockIn, renderClockOut;
+	struct timespec frameIn, frameOut;
 	long captureElapsed, renderElapsed;
-	long long totalElapsed;
 	double framerate = 0.000;
+	double captureFramerate = 0.000;
+	double injectFramerate = 0.000;
+	unsigned long capturedCount, lastCapturedCount = 0;
+	unsigned long lastInjectedCount = 0;
+	unsigned long renderSkipped = 0;
+	TraceRecord perfRecord;
 
 	long long i = 0, lastFrameCount = 0;
 	writeToLog(hAppLog, "Going into main loop...");
-	time(&frameIn);
+	clock_gettime(CLOCK_MONOTONIC, &frameIn);
 
 UNSAFE_0:
-	if (mipi->startStream(mipi) <= 0) {
-		writeToErr(hAppLog, "%s", mipi->error);
-		fprintf(stdout, "\n\n%s\n\n", mipi->error);
+	if (g_Engine->startStreams(g_Engine) <= 0) {
+		writeToErr(hAppLog, "%s", g_Engine->error);
+		fprintf(stdout, "\n\n%s\n\n", g_Engine->error);
 		fflush(stdout);
 
-		Str *temp = Str_newWith(mipi->error);
+		Str *temp = Str_newWith(g_Engine->error);
 		if (temp->has(temp, "VIDIOC_STREAMON")) {
 			Str_dispose(temp);
 			config->unsafeRepeatCount = 0;
 			goto CRAP_0;
 		} else {
 			Str_dispose(temp);
-			Video_dispose(mipi);
-			if (gIsUseViewfinder) {
-				Video_dispose(mipi_vf);
-			}
+			CaptureEngine_dispose(g_Engine);
+			g_Engine = NULL;
 			goto CRAP_1;
 
 		}
 		return 0;
 	}
-	writeToLog(hAppLog, "MIPI Started Streaming.");
-
-	if (gIsUseViewfinder) {
-		if (mipi_vf->startStream(mipi_vf) <= 0) {
-			writeToErr(hAppLog, "%s", mipi_vf->error);
-			fprintf(stdout, "\n\n%s\n\n", mipi_vf->error);
-			fflush(stdout);
 
-			Str *temp = Str_newWith(mipi_vf->error);
-			if (temp->has(temp, "VIDIOC_STREAMON")) {
-				Str_dispose(temp);
-				config->unsafeRepeatCount = 0;
-				goto CRAP_0;
-			} else {
-				Str_dispose(temp);
-				Video_dispose(mipi_vf);
-				goto CRAP_1;
+	// hand the dequeueing over to one capture thread per stream
+	lastCapturedCount = 0;
+	memset(lastStreamCaptured, 0, sizeof(lastStreamCaptured));
 
-			}
-			return 0;
-		}
-		writeToLog(hAppLog, "=== viewfinder active ===");
-		writeToLog(hAppLog, "MIPI Viewfinder Started Streaming.");
-		writeToLog(hAppLog, "=== viewfinder active ===");
+	if (g_Engine->start(g_Engine) <= 0) {
+		writeToErr(hAppLog, "%s", g_Engine->error);
+		config->unsafeRepeatCount = 0;
+		goto CRAP_0;
 	}
 
-	// make sure viewfinder did dequeue
-	long long vf_frame = 0;
+	if (g_Recorder != NULL && g_Recorder->start(g_Recorder) <= 0) {
+		writeToErr(hAppLog, "%s Not recording.", g_Recorder->error);
+		Recorder_dispose(g_Recorder);
+		g_Recorder = NULL;
+	}
 
 	while(gIsForever) {
-		++i;
-
 		// capture clocking - fence-start
-		gettimeofday(&captureClockIn, NULL);
-		mipi->autoDequeue(mipi);
-		gettimeofday(&captureClockOut, NULL);
+		clock_gettime(CLOCK_MONOTONIC, &captureClockIn);
+		TRACE_SPAN_BEGIN(waitBegin);
+		FrameDesc *desc = g_FrameRing->acquire(g_FrameRing, FRAME_WAIT_MSEC);
+
+		// latest frame wins: frames queued behind this one make it stale
+		while (config->isLatestFrameOnly && desc != NULL && g_FrameRing->depth(g_FrameRing) > 1) {
+			if (mipi->release(mipi, &desc->video) <= 0) {
+				writeToErr(hAppLog, "%s", mipi->error);
+			}
+			g_FrameRing->release(g_FrameRing);
+			desc = g_FrameRing->acquire(g_FrameRing, 0);
+			++renderSkipped;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &captureClockOut);
 		// capture clocking - fence-stop
+		TRACE_SPAN_END(g_RenderTrace, TRACE_SPAN_WAIT, waitBegin, desc ? desc->video.sequence : 0, 0);
+
+		if (desc == NULL) {
+			// nothing captured yet; the capture thread logs its own errors
+			if (__atomic_load_n(&g_MainStream->isFailed, __ATOMIC_ACQUIRE)) {
+				writeToErr(hAppLog, "Stream %u: %s stopped capturing.", g_MainStream->id, mipi->device);
+				gIsForever = false;
+				exitCode = 1;
+			}
+			continue;
+		}
 
-		// dequeue viewfinder too
-		if (gIsUseViewfinder) {
-			mipi_vf->autoDequeue(mipi_vf);
-			vf_frame++;
+		++i;
+		g_CurrentFrame = desc;
+		if (g_Preview != NULL) {
+			startPreview(&desc->video);
 		}
 
 		if (!config->isNoRender) {
 			// TODO: need a better way to render viewfinder in a separate window.
 			//       Wayland is blocking this.
 			// render clocking - fence-start
-			gettimeofday(&renderClockIn, NULL);
+			clock_gettime(CLOCK_MONOTONIC, &renderClockIn);
 #ifdef WAYLAND
+			TRACE_SPAN_BEGIN(waylandBegin);
 			waylandRun();
+			TRACE_SPAN_END(g_RenderTrace, TRACE_SPAN_WAYLAND, waylandBegin, desc->video.sequence, 0);
 #else
 			drawScene();
+			TRACE_SPAN_BEGIN(swapBegin);
 			eglSwapBuffers(eglDisplay, eglSurface0);
+			TRACE_SPAN_END(g_RenderTrace, TRACE_SPAN_SWAP, swapBegin, desc->video.sequence, 0);
 #endif
-			gettimeofday(&renderClockOut, NULL);
+			clock_gettime(CLOCK_MONOTONIC, &renderClockOut);
 			// render clocking - fence-stop
 		} // isNoRender
 
+		clock_gettime(CLOCK_MONOTONIC, &desc->presented);
+
+		// the slot is reused once released; keep its record for the trace
+		memset(&perfRecord, 0, sizeof(perfRecord));
+		perfRecord.event = TRACE_EVENT_FRAME;
+		perfRecord.sequence = desc->video.sequence;
+		perfRecord.flags = desc->video.flags;
+		perfRecord.frame = i;
+		perfRecord.timestamp = ((long long) desc->video.timestamp.tv_sec * 1000000LL) + desc->video.timestamp.tv_usec;
+		perfRecord.dequeued = Trace_usecOf(&desc->captured);
+		perfRecord.uploadStarted = Trace_usecOf(&desc->uploadStarted);
+		perfRecord.uploadEnded = Trace_usecOf(&desc->uploadEnded);
+		perfRecord.presented = Trace_usecOf(&desc->presented);
+		perfRecord.drawn = Trace_usecOf(&desc->drawn);
+		perfRecord.textureSet = desc->textureSet;
+		// imported buffers are textures of their own
+		perfRecord.textureSets = (g_PlaneTextures != NULL && g_DmaBufTexture == NULL) ? g_PlaneTextures->setsCount : 0;
+
+		// done with this frame; re-queue the buffer (once recorded) and give the slot back.
+		// An imported buffer may still be read by the GPU after the swap
+		finishPreview();
+		if (g_DmaBufTexture != NULL) {
+			g_DmaBufTexture->waitFence(g_DmaBufTexture);
+		}
+		g_CurrentFrame = NULL;
+		if (g_Recorder == NULL || !g_Recorder->submit(g_Recorder, mipi, &desc->video)) {
+			if (mipi->release(mipi, &desc->video) <= 0) {
+				writeToErr(hAppLog, "%s", mipi->error);
+			}
+		}
+		g_FrameRing->release(g_FrameRing);
+
 		// do performance calculations
-		if (config->maxFrameCount > 0) {
+		if (config->maxFrameCount > 0 && config->maxFrameCount <= i) {
 			// not infinity
-			if (config->maxFrameCount <= i) {
-				fprintf(stdout, "\n");
-				fflush(stdout);
-				finishApp(0);
-			} else {
-				fprintf(stdout, "\r");
-				fflush(stdout);
-			}
+			finishApp(0);
 		}
 
-		time(&frameOut);
+		clock_gettime(CLOCK_MONOTONIC, &frameOut);
 
-		captureElapsed = ((captureClockOut.tv_sec - captureClockIn.tv_sec)*1000000L) + (captureClockOut.tv_usec - captureClockIn.tv_usec);
+		captureElapsed = Trace_usecOf(&captureClockOut) - Trace_usecOf(&captureClockIn);
 		renderElapsed = 0;
 		if (!config->isNoRender) {
-			renderElapsed = ((renderClockOut.tv_sec - renderClockIn.tv_sec)*1000000L) + (renderClockOut.tv_usec - renderClockIn.tv_usec);
+			renderElapsed = Trace_usecOf(&renderClockOut) - Trace_usecOf(&renderClockIn);
 		} // isNoRender
-		totalElapsed = captureElapsed + renderElapsed;
 
-		double timeDiff = difftime(frameOut, frameIn);
+		if (perfTrace != NULL) {
+			// no write here; the tracer's thread drains the ring to the file
+			perfRecord.waited = captureElapsed;
+			perfRecord.rendered = renderElapsed;
+			perfRecord.queueDepth = g_FrameRing->depth(g_FrameRing);
+			perfRecord.captured = g_FrameRing->pushed + g_FrameRing->dropped;
+			perfRecord.dropped = g_FrameRing->dropped;
+			perfRecord.skipped = __atomic_load_n(&mipi->skippedFramesCount, __ATOMIC_RELAXED) + renderSkipped;
+			perfRecord.driverDropped = __atomic_load_n(&mipi->droppedFramesCount, __ATOMIC_RELAXED);
+			perfTrace->record(perfTrace, &perfRecord);
+		}
+
+		double timeDiff = (double) (Trace_usecOf(&frameOut) - Trace_usecOf(&frameIn)) / 1000000.0;
 		if (timeDiff >= 1) {
+			// capture rate counts every dequeued frame, including the dropped ones
+			capturedCount = g_FrameRing->pushed + g_FrameRing->dropped;
+			captureFramerate = (double) (capturedCount - lastCapturedCount) / timeDiff;
+			lastCapturedCount = capturedCount;
+
+			if (mipi->injector != NULL) {
+				unsigned long injected = __atomic_load_n(&mipi->injector->injected, __ATOMIC_RELAXED);
+				injectFramerate = (double) (injected - lastInjectedCount) / timeDiff;
+				lastInjectedCount = injected;
+			}
+
+			if (streamsLog) {
+				// one row per stream and one for all of them
+				unsigned long allFrames = 0, allDropped = 0, allDriverDropped = 0;
+				unsigned int k;
+
+				streamsElapsed += timeDiff;
+				for (k = 0; k < g_Engine->streamsCount; k++) {
+					CaptureStream *stream = g_Engine->streams[k];
+					unsigned long captured = __atomic_load_n(&stream->captured, __ATOMIC_RELAXED);
+					unsigned long latencyCount = __atomic_load_n(&stream->latencyCount, __ATOMIC_RELAXED);
+					unsigned long long latencySum = __atomic_load_n(&stream->latencySumUsec, __ATOMIC_RELAXED);
+					unsigned long dropped = stream->ring ? stream->ring->dropped : 0;
+					unsigned long driverDropped = __atomic_load_n(&stream->video->droppedFramesCount, __ATOMIC_RELAXED);
+
+					fprintf(streamsLog, "%.3f,%u,%s,%lu,%3.3f,%lu,%llu,%llu,%lu\n",
+							streamsElapsed, stream->id, stream->video->device, captured,
+							(double) (captured - lastStreamCaptured[k]) / timeDiff, dropped,
+							latencyCount ? latencySum / latencyCount : 0,
+							__atomic_load_n(&stream->latencyMaxUsec, __ATOMIC_RELAXED), driverDropped);
+
+					allFrames += captured - lastStreamCaptured[k];
+					allDropped += dropped;
+					allDriverDropped += driverDropped;
+					lastStreamCaptured[k] = captured;
+				}
+				fprintf(streamsLog, "%.3f,all,,%lu,%3.3f,%lu,,,%lu\n",
+						streamsElapsed, allFrames, (double) allFrames / timeDiff, allDropped, allDriverDropped);
+				fflush(streamsLog);
+			}
+
 			framerate = (double) (i - lastFrameCount) / timeDiff;
 			lastFrameCount = i;
 			frameIn = frameOut;
-		}
-
-		if (perfLog) {
-    		// log frame data to file
-    		fprintf(perfLog, "%lld,%ld,%ld,%lld,%3.3f\n",
-    				          i, captureElapsed, renderElapsed, totalElapsed, framerate);
-    		fflush(perfLog);
-		}
 
-        if (!config->isQuiet) {
-        	// fps on screen
-    		fprintf(stdout, "frm: %lld; fps: %3.3f", i, framerate);
-    		fflush(stdout);
-
-    		// infinity
-    		if (config->maxFrameCount <= 0) {
+			if (!config->isQuiet) {
+				// fps on screen, once a second; a write per frame would show in the timings
+				fprintf(stdout, "frm: %lld; fps: %3.3f; cap fps: %3.3f; drop: %lu", i, framerate, captureFramerate, g_FrameRing->dropped);
+				if (mipi->injector != NULL) {
+					fprintf(stdout, "; inj fps: %3.3f", injectFramerate);
+				}
 				fprintf(stdout, "\r");
 				fflush(stdout);
-    		}
+			}
 		}
 	}
+	if (!config->isQuiet) {
+		fprintf(stdout, "frm: %lld; fps: %3.3f; cap fps: %3.3f; drop: %lu\n", i, framerate, captureFramerate, g_FrameRing->dropped);
+		fflush(stdout);
+	}
 	writeToLog(hAppLog, "\nGone out of main loop...");
 
-	// close the frame log
-	if (config->unsafeRepeatCount <= 0) {
-		fclose(perfLog);
+	// the frames still being written go back to the driver before it stops
+	if (g_Recorder != NULL) {
+		g_Recorder->stop(g_Recorder);
+		writeToLog(hAppLog, "Recorded %lu frames, %llu MB, to %s; %lu dropped; write avg %llu usec, max %llu usec.",
+				   g_Recorder->written, g_Recorder->bytes / 1000000ULL, g_Recorder->path, g_Recorder->dropped,
+				   g_Recorder->written ? g_Recorder->writeUsecSum / g_Recorder->written : 0, g_Recorder->writeUsecMax);
+		if (g_Recorder->error[0] != '\0') {
+			writeToLog(hAppLog, "%s", g_Recorder->error);
+		}
 	}
 
+	// wake the capture threads out of epoll_wait and wait for them
+	g_Engine->stop(g_Engine);
+	writeToLog(hAppLog, "Capture threads stopped; %lu frames dropped, %lu skipped.", g_FrameRing->dropped,
+			   __atomic_load_n(&mipi->skippedFramesCount, __ATOMIC_RELAXED) + renderSkipped);
+
 CRAP_0:
 	// 5. stop streaming
-	if (gIsUseViewfinder) {
-		mipi_vf->stopStream(mipi_vf);
-		writeToLog(hAppLog, "=== viewfinder active ===");
-		writeToLog(hAppLog, "MIPI Viewfinder Stopped Stream.");
-		writeToLog(hAppLog, "=== viewfinder active ===");
-	}
-
-	mipi->stopStream(mipi);
-	writeToLog(hAppLog, "MIPI Stopped Stream.");
+	g_Engine->stop(g_Engine);
+	g_Engine->stopStreams(g_Engine);
 
 	if (config->unsafeRepeatCount <= 0) {
-		if (gIsUseViewfinder) {
-			Video_dispose(mipi_vf);
-			writeToLog(hAppLog, "=== viewfinder active ===");
-			writeToLog(hAppLog, "Freed viewfinder video self.");
-			writeToLog(hAppLog, "MIPI viewfinder object disposed");
-			writeToLog(hAppLog, "MIPI viewfinder streamed %lld frames.", vf_frame);
-			writeToLog(hAppLog, "=== viewfinder active ===");
+		unsigned int k;
+		for (k = 0; k < g_Engine->streamsCount; k++) {
+			CaptureStream *stream = g_Engine->streams[k];
+			writeToLog(hAppLog, "Stream %u: %s captured %lu frames.", k, stream->video->device, stream->captured);
 		}
-		Video_dispose(mipi);
+		g_Engine->setTracerWith(g_Engine, NULL);
+		CaptureEngine_dispose(g_Engine);
+		g_Engine = NULL;
+		g_MainStream = NULL;
+		g_FrameRing = NULL;
+		mipi = NULL;
 		writeToLog(hAppLog, "Freed video self.");
 		writeToLog(hAppLog, "MIPI object disposed");
 	} else {
 		// test of unsafe use of ISP driver
 		config->unsafeRepeatCount--;
-		if (mipi->initDevice(mipi) != 1) {
-			writeToErr(hAppLog, "%s", mipi->error);
-			Video_dispose(mipi);
-			if (gIsUseViewfinder) {
-				Video_dispose(mipi_vf);
-			}
+		if (g_Engine->initDevices(g_Engine) != 1) {
+			writeToErr(hAppLog, "%s", g_Engine->error);
+			CaptureEngine_dispose(g_Engine);
+			g_Engine = NULL;
 			goto CRAP_1;
 		}
 
-		if (mipi_vf->initDevice(mipi_vf) != 1) {
-			writeToErr(hAppLog, "%s", mipi_vf->error);
-			Video_dispose(mipi_vf);
-			Video_dispose(mipi);
-			goto CRAP_1;
+		// the buffers were re-allocated
+		if (g_DmaBufTexture != NULL && !g_DmaBufTexture->importVideo(g_DmaBufTexture, mipi)) {
+			writeToLog(hAppLog, "%s Uploading frames instead.", g_DmaBufTexture->error);
+			DmaBufTexture_dispose(g_DmaBufTexture);
+			g_DmaBufTexture = NULL;
 		}
 
 		gIsForever = true;
@@ -1418,6 +1884,19 @@ CRAP_0:
 	}
 
 CRAP_1:
+	// close the frame trace; every way here ends the run and no capture thread is left
+	g_RenderTrace = NULL;
+	if (tracer != NULL) {
+		tracer->stop(tracer);
+		writeToLog(hAppLog, "Traced %lu records to %s; %lu lost.", tracer->written, perfFile, tracer->lost);
+		Tracer_dispose(tracer);
+		tracer = NULL;
+	}
+	if (streamsLog) {
+		fclose(streamsLog);
+		streamsLog = NULL;
+	}
+
 	if (!config->isNoRender) {
 #ifdef WAYLAND
 		// 6. close window
@@ -1433,6 +1912,12 @@ CRAP_1:
 
 //CRAP_3:
 		// stop EGL
+		DmaBufTexture_dispose(g_DmaBufTexture);
+		g_DmaBufTexture = NULL;
+		PlaneTextures_dispose(g_PlaneTextures);
+		g_PlaneTextures = NULL;
+		PlaneTextures_dispose(g_PreviewTextures);
+		g_PreviewTextures = NULL;
 		eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
 		eglDestroySurface(eglDisplay, eglSurface0);
 		eglDestroyContext(eglDisplay, eglContext0);
@@ -1467,6 +1952,13 @@ CRAP_1:
 
 CRAP_5:
 	// dispose and free all the buffers, structs, callocs and etc
+	WorkerPool_dispose(g_Workers);
+	g_Workers = NULL;
+	Downscaler_dispose(g_Preview);
+	g_Preview = NULL;
+	Recorder_dispose(g_Recorder);
+	g_Recorder = NULL;
+
 	// print end time
 	strNow = (char *) calloc(20, sizeof(char));
 	time(&now);
@@ -1479,5 +1971,5 @@ CRAP_5:
 	fclose(hAppLog);
 
 	free(config);
-	return 0;
+	return exitCode;
 }
@@ -21,6 +21,10 @@
 #include "utilities.h"
 #include "str_struct.h"
 #include "video.h"
+#include "capture_engine.h"
+#include "demosaic.h"
+#include "downscale.h"
+#include "recorder.h"
 
 #include <stdio.h>
 #include <stdbool.h>
@@ -46,6 +50,18 @@
 #define DO_ORTH_MATRIX(V,M) makeOrthMatrix(-V, V, -V, V, -V, V, M);
 #define DO_MATRIX(matrix,row,col)  matrix[(col<<2)+row]
 
+/**
+ * One extra capture stream from -s or -S.
+ */
+typedef struct StreamConfig {
+	Str *device;
+	int width;
+	int height;
+	PixelFormat_t pixelFormat;
+	int requestedBufferCount;
+	int cpu;
+} StreamConfig_t;
+
 typedef struct AppConfig {
 	Str *appCommand;
 	Str *device;
@@ -61,10 +77,29 @@ typedef struct AppConfig {
 	int maxFrameCount;
 	int requestedBufferCount;
 	int unsafeRepeatCount;
+	int ringDepth;
+	int maxHeldFrames;
+	DmaBufBackend_t dmaBufBackend;
+	int cpu;
+	DemosaicLevels rawLevels;	/* BA10 black level and white balance */
+	int workerThreads;			/* for CPU stages; 0 is one per CPU */
+	int textureSets;			/* per stream, uploaded into in turn */
+	int previewWidth;			/* of the preview scaled from the main stream; 0 for none */
+	int previewHeight;
+	ScaleFilter_t previewFilter;
+	Str *recordFile;			/* raw frames of the main stream go here; empty for none */
+	Str *fifoSource;			/* raw frames injected into fifoDevice; empty for none */
+	Str *fifoDevice;
+	int extraStreamsCount;
+	StreamConfig_t extraStreams[CAPTURE_MAX_STREAMS];
 	bool isInterlaced;
 	bool isQuiet;
 	bool isUseDMABuf;
+	bool isUseUserPtr;
+	bool isUseHugePages;
 	bool isNoRender;
+	bool isLatestFrameOnly;
+	bool isReplayFast;			/* recordings given as devices go flat out, not at their pace */
 } AppConfig_t;
 
 #ifdef WAYLAND
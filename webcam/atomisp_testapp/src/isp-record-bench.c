@@ -0,0 +1,414 @@
+/**
+	This file is part of Intel Atom ISP Test App.
+
+	Intel Atom ISP Test App is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Intel Atom ISP Test App is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Intel Atom ISP Test App.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * isp-record-bench: pushes synthetic frames through the Recorder as a
+ * capture thread would, first as fast as the disk takes them, then at the
+ * camera's frame rate, and reads every recorded frame back through the
+ * index to check it.
+ *
+ *   isp-record-bench [-o record.raw] [-w 1280x720] [-c YUYV] [-n 300] [-f 30] [-b 4] [-d 2] [-a 0] [-k]
+ */
+
+#define _FILE_OFFSET_BITS 64
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "utilities.h"
+#include "pixel_format.h"
+#include "video.h"
+#include "recorder.h"
+#include "trace.h"
+
+#define BENCH_FRAMES 300
+#define BENCH_FPS 30
+#define BENCH_BUFFERS 4
+#define BENCH_MAX_BUFFERS 32
+#define BENCH_PAGE_SIZE 4096
+
+/**
+ * What one run of frames did.
+ */
+typedef struct BENCH_RESULT_S {
+	unsigned long submitted;
+	unsigned long driverDropped;	/* no buffer was free when the frame came */
+	long long elapsedUsec;			/* first frame to the last one on disk */
+} BenchResult;
+
+/**
+ * Capture buffers as a driver would map them, page aligned; isHeld is set
+ * from submit until the recorder hands the buffer back.
+ */
+static unsigned char *g_Buffers[BENCH_MAX_BUFFERS];
+static bool g_IsHeld[BENCH_MAX_BUFFERS];
+static unsigned int g_HeldCount = 0;
+
+/**
+ * Stands in for VIDIOC_QBUF.
+ */
+static int releaseBuffer(Video *_video, VideoFrame *_frame) {
+	__atomic_store_n(&g_IsHeld[_frame->index], false, __ATOMIC_RELEASE);
+	__atomic_sub_fetch(&g_HeldCount, 1, __ATOMIC_RELEASE);
+	return 1;
+}
+
+/**
+ * The layout of one frame from buffer _index: planes one after the other,
+ * _offset bytes into the buffer, as in a single-planar capture.
+ */
+static void layoutFrame(VideoFrame *_frame, const PixelFormatInfo *_info, unsigned int _width, unsigned int _height,
+						unsigned int _offset, unsigned int _index) {
+	unsigned int p, offset = _offset;
+
+	memset(_frame, 0, sizeof(VideoFrame));
+	_frame->index = _index;
+	_frame->data = g_Buffers[_index];
+	_frame->planesCount = _info->planesCount;
+	for (p = 0; p < _info->planesCount; p++) {
+		VideoPlane *plane = &_frame->planes[p];
+		plane->width = _width / _info->planes[p].horizontalSubsampling;
+		plane->height = _height / _info->planes[p].verticalSubsampling;
+		plane->bytesperline = PixelFormat_bytesPerLine(_info, p, _width * _info->planes[0].bitsPerPixel / 8);
+		plane->offset = offset;
+		plane->length = plane->bytesperline * plane->height;
+		plane->data = g_Buffers[_index] + offset;
+		offset += plane->length;
+	}
+	_frame->bytesused = offset - _offset;
+}
+
+static void sleepUntil(const struct timespec *_deadline) {
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, _deadline, NULL) == EINTR) {
+		// retry
+	}
+}
+
+/**
+ * Submits _count frames, cycling through _buffersCount buffers like a
+ * driver's queue. At _fps of 0 every frame waits until its buffer is back
+ * and the recorder has room; otherwise frames come on time and are lost to
+ * the driver when their buffer is still held.
+ */
+static void runFrames(Recorder *_recorder, Video *_video, const PixelFormatInfo *_info, unsigned int _width,
+					  unsigned int _height, unsigned int _offset, unsigned int _buffersCount, unsigned long _count,
+					  unsigned int _fps, BenchResult *_result) {
+	struct timespec started, next, ended;
+	unsigned long sequence;
+
+	memset(_result, 0, sizeof(BenchResult));
+	clock_gettime(CLOCK_MONOTONIC, &started);
+	next = started;
+
+	for (sequence = 0; sequence < _count; sequence++) {
+		unsigned int index = sequence % _buffersCount;
+
+		if (_fps > 0) {
+			next.tv_nsec += 1000000000L / _fps;
+			while (next.tv_nsec >= 1000000000L) {
+				next.tv_sec += 1;
+				next.tv_nsec -= 1000000000L;
+			}
+			sleepUntil(&next);
+
+			if (__atomic_load_n(&g_IsHeld[index], __ATOMIC_ACQUIRE)) {
+				_result->driverDropped++;
+				continue;
+			}
+		} else {
+			while (__atomic_load_n(&g_IsHeld[index], __ATOMIC_ACQUIRE) ||
+				   __atomic_load_n(&g_HeldCount, __ATOMIC_ACQUIRE) >= _recorder->capacity) {
+				usleep(100);
+			}
+		}
+
+		VideoFrame frame;
+		struct timespec now;
+		layoutFrame(&frame, _info, _width, _height, _offset, index);
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		frame.sequence = sequence;
+		frame.flags = 0;
+		frame.timestamp.tv_sec = now.tv_sec;
+		frame.timestamp.tv_usec = now.tv_nsec / 1000;
+		// tells the frames of one buffer apart when read back
+		memcpy(frame.planes[0].data, &frame.sequence, sizeof(frame.sequence));
+
+		g_IsHeld[index] = true;
+		__atomic_add_fetch(&g_HeldCount, 1, __ATOMIC_RELEASE);
+		if (!_recorder->submit(_recorder, _video, &frame)) {
+			releaseBuffer(_video, &frame);
+		}
+		_result->submitted++;
+	}
+
+	_recorder->stop(_recorder);
+	clock_gettime(CLOCK_MONOTONIC, &ended);
+	_result->elapsedUsec = Trace_usecOf(&ended) - Trace_usecOf(&started);
+}
+
+/**
+ * Reads every frame of the index back and compares it with its buffer.
+ * Returns the number of frames checked, or -1 on the first mismatch.
+ */
+static long verifyRecording(const Recorder *_recorder, const PixelFormatInfo *_info, unsigned int _width,
+							unsigned int _height, unsigned int _offset, unsigned int _buffersCount) {
+	FILE *index = fopen(_recorder->indexPath, "rb");
+	int fd = open(_recorder->path, O_RDONLY);
+	RecordHeader header;
+	RecordEntry entry;
+	long checked = -1;
+
+	if (index == NULL || fd < 0 || fread(&header, sizeof(header), 1, index) != 1 ||
+		memcmp(header.magic, RECORD_MAGIC, sizeof(header.magic)) != 0 || header.entrySize != sizeof(RecordEntry)) {
+		fprintf(stdout, "Cannot read %s.\n", _recorder->indexPath);
+		goto done;
+	}
+
+	unsigned char *frameData = NULL;
+	size_t frameSize = 0;
+	long long expectedOffset = 0;
+	long long lastSequence = -1;
+
+	checked = 0;
+	while (fread(&entry, sizeof(entry), 1, index) == 1) {
+		VideoFrame frame;
+		unsigned int p;
+
+		layoutFrame(&frame, _info, _width, _height, _offset, entry.sequence % _buffersCount);
+		if (entry.offset != expectedOffset || (entry.offset % header.blockSize) != 0 ||
+			(long long) entry.sequence <= lastSequence || entry.planesCount != frame.planesCount ||
+			entry.fourcc != _info->fourcc || entry.width != _width || entry.height != _height) {
+			fprintf(stdout, "Index entry %ld is off: offset %lld, sequence %u.\n", checked, (long long) entry.offset,
+					entry.sequence);
+			checked = -1;
+			break;
+		}
+		expectedOffset += entry.size;
+		lastSequence = entry.sequence;
+
+		if (frameSize < entry.size) {
+			free(frameData);
+			frameSize = entry.size;
+			frameData = (unsigned char *) malloc(frameSize);
+		}
+		if (pread(fd, frameData, entry.size, entry.offset) != (ssize_t) entry.size) {
+			fprintf(stdout, "Cannot read frame %u back.\n", entry.sequence);
+			checked = -1;
+			break;
+		}
+
+		// the sequence stamped into the buffer was overwritten by later frames
+		unsigned int stamped;
+		memcpy(&stamped, frameData + entry.planes[0].offset, sizeof(stamped));
+		bool isSame = (stamped == entry.sequence);
+		for (p = 0; isSame && p < entry.planesCount; p++) {
+			size_t skip = (p == 0) ? sizeof(stamped) : 0;
+			isSame = entry.planes[p].length == frame.planes[p].length &&
+					 memcmp(frameData + entry.planes[p].offset + skip, frame.planes[p].data + skip,
+							frame.planes[p].length - skip) == 0;
+		}
+		if (!isSame) {
+			fprintf(stdout, "Frame %u differs from its buffer.\n", entry.sequence);
+			checked = -1;
+			break;
+		}
+		checked++;
+	}
+	free(frameData);
+
+done:
+	if (index != NULL) {
+		fclose(index);
+	}
+	if (fd >= 0) {
+		close(fd);
+	}
+	return checked;
+}
+
+/**
+ * Headroom is how many times the camera's frame rate the disk took flat
+ * out; a paced run shows whether that rate is kept without losing frames.
+ */
+static void printResult(const char *_name, const Recorder *_recorder, const BenchResult *_result, unsigned int _fps,
+						bool _isFlatOut, long _verified) {
+	double seconds = (double) _result->elapsedUsec / 1000000.0;
+	double fps = (seconds > 0) ? _recorder->written / seconds : 0.0;
+	double copied = (_recorder->bytes > 0) ? (100.0 * _recorder->copiedBytes) / _recorder->bytes : 0.0;
+
+	char headroom[16] = "-";
+
+	if (_isFlatOut) {
+		snprintf(headroom, sizeof(headroom), "%.2fx", fps / _fps);
+	}
+	fprintf(stdout, "%-9s %7lu %7lu %7lu %8.1f %8.1f %9llu %9llu %7.1f%% %8s %8s\n", _name, _recorder->written,
+			_recorder->dropped, _result->driverDropped, fps, (seconds > 0) ? _recorder->bytes / seconds / 1000000.0 : 0.0,
+			_recorder->written ? _recorder->writeUsecSum / _recorder->written : 0, _recorder->writeUsecMax, copied,
+			headroom, (_verified < 0) ? "NO" : "yes");
+	fflush(stdout);
+}
+
+static void printUsage(const char *_app) {
+	fprintf(stdout, "Usage: %s [-o path] [-w WxH] [-c format] [-n frames] [-f fps] [-b buffers] [-d depth] [-a offset] [-k]\n\n", _app);
+	fprintf(stdout, "\t-o <path>          Data file; the index goes to <path>%s (record.raw).\n", RECORD_INDEX_SUFFIX);
+	fprintf(stdout, "\t-w <WxH>           Frame size (1280x720).\n");
+	fprintf(stdout, "\t-c <format>        Pixel format (YUYV).\n");
+	fprintf(stdout, "\t-n <frames>        Frames per run (%d).\n", BENCH_FRAMES);
+	fprintf(stdout, "\t-f <fps>           Camera frame rate the paced run keeps and headroom is against (%d).\n", BENCH_FPS);
+	fprintf(stdout, "\t-b <buffers>       Capture buffers (%d).\n", BENCH_BUFFERS);
+	fprintf(stdout, "\t-d <depth>         Frames the recorder may hold (%d).\n", RECORDER_DEFAULT_DEPTH);
+	fprintf(stdout, "\t-a <offset>        Bytes into its buffer each frame starts (0).\n");
+	fprintf(stdout, "\t-k                 Keep the recording.\n\n");
+	fprintf(stdout, "Exits with 1 when a recorded frame differs from the one submitted.\n");
+	fflush(stdout);
+}
+
+int main(int argc, char *argv[]) {
+	const char *path = "record.raw";
+	unsigned int width = 1280, height = 720;
+	PixelFormat_t format = YUYV;
+	unsigned long count = BENCH_FRAMES;
+	unsigned int fps = BENCH_FPS, buffersCount = BENCH_BUFFERS, depth = RECORDER_DEFAULT_DEPTH, offset = 0;
+	bool isKeep = false;
+	int option;
+
+	while ((option = getopt(argc, argv, "o:w:c:n:f:b:d:a:kh")) != -1) {
+		switch (option) {
+		case 'o':
+			path = optarg;
+			break;
+		case 'w':
+			if (sscanf(optarg, "%ux%u", &width, &height) != 2 || width < 2 || height < 2) {
+				fprintf(stderr, "Invalid frame size: %s\n", optarg);
+				return 1;
+			}
+			width &= ~1u;
+			height &= ~1u;
+			break;
+		case 'c':
+			if (!PixelFormat_parse(optarg, &format)) {
+				fprintf(stderr, "Invalid pixel format: %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'n':
+			count = strtoul(optarg, NULL, 10);
+			break;
+		case 'f':
+			fps = atoi(optarg);
+			break;
+		case 'b':
+			buffersCount = atoi(optarg);
+			break;
+		case 'd':
+			depth = atoi(optarg);
+			break;
+		case 'a':
+			offset = atoi(optarg);
+			break;
+		case 'k':
+			isKeep = true;
+			break;
+		default:
+			printUsage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (count == 0 || fps == 0 || buffersCount < 2 || buffersCount > BENCH_MAX_BUFFERS || depth == 0 ||
+		depth >= buffersCount) {
+		fprintf(stderr, "Needs frames, a frame rate and 2 to %d buffers, more than the recorder's depth.\n",
+				BENCH_MAX_BUFFERS);
+		return 1;
+	}
+
+	const PixelFormatInfo *info = PixelFormat_info(format);
+	VideoFrame frame;
+	unsigned int i;
+	size_t bufferSize;
+
+	// as a driver sizes its buffers: whole pages
+	g_Buffers[0] = NULL;
+	layoutFrame(&frame, info, width, height, offset, 0);
+	bufferSize = (offset + frame.bytesused + BENCH_PAGE_SIZE - 1) & ~((size_t) BENCH_PAGE_SIZE - 1);
+	srand(1);
+	for (i = 0; i < buffersCount; i++) {
+		if (0 != posix_memalign((void **) &g_Buffers[i], BENCH_PAGE_SIZE, bufferSize)) {
+			fprintf(stderr, "Cannot allocate %u buffers of %zu bytes.\n", buffersCount, bufferSize);
+			return 1;
+		}
+		size_t k;
+		for (k = 0; k < bufferSize; k++) {
+			g_Buffers[i][k] = (unsigned char) (rand() >> 7);
+		}
+	}
+
+	// only what the recorder asks of a Video
+	Video *video = (Video *) calloc(1, sizeof(Video));
+	video->pixelFormat = format;
+	video->error = (char *) calloc(256, sizeof(char));
+	video->release = releaseBuffer;
+
+	fprintf(stdout, "%ux%u %s, %u bytes a frame, %u buffers, recorder depth %u, %lu frames a run.\n", width, height,
+			PixelFormat_name(format), frame.bytesused, buffersCount, depth, count);
+	fprintf(stdout, "%-9s %7s %7s %7s %8s %8s %9s %9s %8s %8s %8s\n", "run", "written", "dropped", "lost", "fps", "MB/s",
+			"avg usec", "max usec", "copied", "headroom", "verified");
+
+	int exitCode = 0;
+	int run;
+	for (run = 0; run < 2; run++) {
+		Recorder *recorder = Recorder_newWith(path, depth);
+		if (recorder->fd < 0 || !recorder->start(recorder)) {
+			fprintf(stdout, "%s\n", recorder->error);
+			Recorder_dispose(recorder);
+			exitCode = 1;
+			break;
+		}
+
+		BenchResult result;
+		runFrames(recorder, video, info, width, height, offset, buffersCount, count, (run == 0) ? 0 : fps, &result);
+
+		long verified = verifyRecording(recorder, info, width, height, offset, buffersCount);
+		if (verified < 0 || (unsigned long) verified != recorder->written) {
+			verified = -1;
+			exitCode = 1;
+		}
+		printResult((run == 0) ? "flat out" : "paced", recorder, &result, fps, run == 0, verified);
+		if (recorder->error[0] != '\0') {
+			fprintf(stdout, "%s\n", recorder->error);
+		}
+
+		if (!isKeep) {
+			unlink(recorder->path);
+			unlink(recorder->indexPath);
+		}
+		Recorder_dispose(recorder);
+	}
+
+	for (i = 0; i < buffersCount; i++) {
+		free(g_Buffers[i]);
+	}
+	free(video->error);
+	free(video);
+	return exitCode;
+}
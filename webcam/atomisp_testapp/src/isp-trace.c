@@ -0,0 +1,355 @@
+/**
+	This file is part of Intel Atom ISP Test App.
+
+	Intel Atom ISP Test App is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Intel Atom ISP Test App is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Intel Atom ISP Test App.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * isp-trace: turns a frames.[number].trace file of isp-mipi-test into the
+ * CSV frames log and a Chrome trace-event timeline, and prints latency
+ * percentiles.
+ *
+ *   isp-trace frames.0.trace [frames.0.fps [frames.0.json]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <errno.h>
+
+#include <linux/videodev2.h>
+
+#include "trace.h"
+#include "samples.h"
+
+#define JSON_PID 1
+#define JSON_FRAMES_TID 1000	/* frames overlap each other, so they get a track of their own */
+
+static const char *SPAN_NAMES[] = {
+	[TRACE_SPAN_DEQUEUE] = "dequeue",
+	[TRACE_SPAN_WAIT] = "wait",
+	[TRACE_SPAN_UPLOAD] = "upload",
+	[TRACE_SPAN_BIND] = "bind",
+	[TRACE_SPAN_DRAW] = "draw",
+	[TRACE_SPAN_SWAP] = "eglSwapBuffers",
+	[TRACE_SPAN_WAYLAND] = "waylandRun",
+	[TRACE_SPAN_PREVIEW] = "preview"
+};
+
+static void printSummary(const char *_name, Samples *_samples) {
+	if (_samples->count == 0) {
+		fprintf(stdout, "%-24s %10s\n", _name, "-");
+		return;
+	}
+
+	fprintf(stdout, "%-24s %10lld %10lld %10lld %10lld %10zu\n", _name,
+			_samples->percentile(_samples, 50), _samples->percentile(_samples, 90),
+			_samples->percentile(_samples, 99), _samples->max(_samples), _samples->count);
+}
+
+/**
+ * Age of the frame at _now from its driver timestamp; -1 when the driver
+ * does not stamp with the monotonic clock.
+ */
+static long long ageOf(const TraceRecord *_record, long long _now) {
+	if ((_record->flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_COPY ||
+		_record->timestamp == 0 || _now == 0 || _now < _record->timestamp) {
+		return -1;
+	}
+	return _now - _record->timestamp;
+}
+
+/**
+ * Replaces the extension of _path, if it is .trace, with _ext.
+ */
+static void nameAfter(char *_name, size_t _size, const char *_path, const char *_ext) {
+	snprintf(_name, _size, "%s", _path);
+	char *ext = strrchr(_name, '.');
+	if (ext == NULL || strcmp(ext, ".trace") != 0) {
+		ext = _name + strlen(_name);
+	}
+	snprintf(ext, _size - (ext - _name), "%s", _ext);
+}
+
+/**
+ * Chrome trace-event JSON: one object per event, ts and dur in usec.
+ */
+static void writeJsonEvent(FILE *_json, bool *_isFirst, const char *_format, ...) {
+	va_list args;
+
+	fprintf(_json, "%s\n", *_isFirst ? "" : ",");
+	*_isFirst = false;
+
+	va_start(args, _format);
+	vfprintf(_json, _format, args);
+	va_end(args);
+}
+
+static void writeJsonSpan(FILE *_json, bool *_isFirst, const TraceRecord *_record) {
+	const char *name = "span";
+	if (_record->span < sizeof(SPAN_NAMES) / sizeof(SPAN_NAMES[0]) && SPAN_NAMES[_record->span] != NULL) {
+		name = SPAN_NAMES[_record->span];
+	}
+
+	if (_record->span == TRACE_SPAN_UPLOAD) {
+		writeJsonEvent(_json, _isFirst,
+					   "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,"
+					   "\"args\":{\"sequence\":%u,\"plane\":%u}}",
+					   name, JSON_PID, _record->stream, (double) _record->begin / 1000.0,
+					   (double) (_record->end - _record->begin) / 1000.0, _record->sequence, _record->argument);
+	} else {
+		writeJsonEvent(_json, _isFirst,
+					   "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,"
+					   "\"args\":{\"sequence\":%u}}",
+					   name, JSON_PID, _record->stream, (double) _record->begin / 1000.0,
+					   (double) (_record->end - _record->begin) / 1000.0, _record->sequence);
+	}
+}
+
+int main(int argc, char *argv[]) {
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s <frames.[number].trace> [<csv_file> [<json_file>]]\n", argv[0]);
+		return 1;
+	}
+
+	FILE *trace = fopen(argv[1], "rb");
+	if (trace == NULL) {
+		fprintf(stderr, "Cannot open %s: %d, %s\n", argv[1], errno, strerror(errno));
+		return 1;
+	}
+
+	TraceHeader header;
+	if (fread(&header, sizeof(header), 1, trace) != 1 ||
+		memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0) {
+		fprintf(stderr, "%s is not a trace file.\n", argv[1]);
+		fclose(trace);
+		return 1;
+	}
+
+	if (header.version != TRACE_VERSION || header.recordSize != sizeof(TraceRecord)) {
+		fprintf(stderr, "%s: version %u with %u-byte records; expected version %d with %zu-byte records.\n",
+				argv[1], header.version, header.recordSize, TRACE_VERSION, sizeof(TraceRecord));
+		fclose(trace);
+		return 1;
+	}
+
+	// frames.0.trace becomes frames.0.fps, the name of the old CSV log
+	char csvFile[256], jsonFile[256];
+	if (argc > 2) {
+		snprintf(csvFile, sizeof(csvFile), "%s", argv[2]);
+	} else {
+		nameAfter(csvFile, sizeof(csvFile), argv[1], ".fps");
+	}
+	if (argc > 3) {
+		snprintf(jsonFile, sizeof(jsonFile), "%s", argv[3]);
+	} else {
+		nameAfter(jsonFile, sizeof(jsonFile), argv[1], ".json");
+	}
+
+	FILE *csv = fopen(csvFile, "w");
+	if (csv == NULL) {
+		fprintf(stderr, "Cannot open %s: %d, %s\n", csvFile, errno, strerror(errno));
+		fclose(trace);
+		return 1;
+	}
+	FILE *json = fopen(jsonFile, "w");
+	if (json == NULL) {
+		fprintf(stderr, "Cannot open %s: %d, %s\n", jsonFile, errno, strerror(errno));
+		fclose(csv);
+		fclose(trace);
+		return 1;
+	}
+	bool isFirstEvent = true;
+	fprintf(json, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+	writeJsonEvent(json, &isFirstEvent, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"isp-mipi-test\"}}", JSON_PID);
+	writeJsonEvent(json, &isFirstEvent, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"frames\"}}",
+				   JSON_PID, JSON_FRAMES_TID);
+
+	fprintf(csv, "frame,capture_time (usec),render_time (usec),total_time (usec),fps,capture_fps,queue_depth,dropped,skipped,latency (usec),"
+				 "sequence,flags,timestamp (usec),dequeued (usec),upload_start (usec),upload_end (usec),presented (usec),driver_dropped,"
+				 "drawn (usec),texture_set,texture_sets\n");
+
+	Samples *latency = Samples_new();
+	Samples *waited = Samples_new();
+	Samples *rendered = Samples_new();
+	Samples *upload = Samples_new();
+	Samples *drawing = Samples_new();
+	Samples *swap = Samples_new();
+	Samples *interval = Samples_new();
+	Samples *dequeue[TRACE_MAX_RINGS];
+	char dequeueNames[TRACE_MAX_RINGS][32];
+	unsigned long captures[TRACE_MAX_RINGS];
+	unsigned long lost[TRACE_MAX_RINGS];
+	unsigned int k;
+
+	for (k = 0; k < TRACE_MAX_RINGS; k++) {
+		snprintf(dequeueNames[k], sizeof(dequeueNames[k]), "stream %u dequeue (usec)", k);
+		dequeue[k] = Samples_new();
+		captures[k] = 0;
+		lost[k] = 0;
+	}
+
+	// rates are taken over windows of a second or more, like the app's own
+	double framerate = 0.000, captureFramerate = 0.000;
+	long long windowStart = 0, windowFrame = 0, windowCaptured = 0;
+	long long lastPresented = 0;
+	unsigned long framesCount = 0;
+	unsigned long spansCount = 0;
+	unsigned int textureSets = 0;
+	TraceRecord record;
+
+	while (fread(&record, sizeof(record), 1, trace) == 1) {
+		switch (record.event) {
+		case TRACE_EVENT_RING: {
+			TraceRingName ringName;
+			memcpy(&ringName, &record, sizeof(ringName));
+			ringName.name[sizeof(ringName.name) - 1] = '\0';
+			writeJsonEvent(json, &isFirstEvent, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+						   JSON_PID, ringName.ring, ringName.name);
+			break;
+		}
+
+		case TRACE_EVENT_SPAN:
+			writeJsonSpan(json, &isFirstEvent, &record);
+			spansCount++;
+			break;
+
+		case TRACE_EVENT_CAPTURE:
+			if (record.stream < TRACE_MAX_RINGS) {
+				long long age = ageOf(&record, record.dequeued);
+				if (age >= 0) {
+					dequeue[record.stream]->add(dequeue[record.stream], age);
+				}
+				captures[record.stream]++;
+			}
+			break;
+
+		case TRACE_EVENT_LOST:
+			if (record.stream < TRACE_MAX_RINGS) {
+				lost[record.stream] += record.frame;
+			}
+			writeJsonEvent(json, &isFirstEvent, "{\"name\":\"lost\",\"ph\":\"i\",\"s\":\"t\",\"pid\":%d,\"tid\":%u,\"ts\":%lld,"
+						   "\"args\":{\"records\":%lld}}", JSON_PID, record.stream, lastPresented, (long long) record.frame);
+			break;
+
+		case TRACE_EVENT_FRAME: {
+			long long age = ageOf(&record, record.presented);
+			if (windowStart == 0) {
+				windowStart = record.presented;
+				windowFrame = record.frame;
+				windowCaptured = record.captured;
+			} else if (record.presented - windowStart >= 1000000LL) {
+				double seconds = (double) (record.presented - windowStart) / 1000000.0;
+				framerate = (double) (record.frame - windowFrame) / seconds;
+				captureFramerate = (double) (record.captured - windowCaptured) / seconds;
+				windowStart = record.presented;
+				windowFrame = record.frame;
+				windowCaptured = record.captured;
+			}
+
+			fprintf(csv, "%lld,%lld,%lld,%lld,%3.3f,%3.3f,%u,%u,%u,%lld,%u,0x%x,%lld,%lld,%lld,%lld,%lld,%u,%lld,%u,%u\n",
+					(long long) record.frame, (long long) record.waited, (long long) record.rendered,
+					(long long) (record.waited + record.rendered), framerate, captureFramerate,
+					record.queueDepth, record.dropped, record.skipped, age, record.sequence, record.flags,
+					(long long) record.timestamp, (long long) record.dequeued, (long long) record.uploadStarted,
+					(long long) record.uploadEnded, (long long) record.presented, record.driverDropped,
+					(long long) record.drawn, record.textureSet, record.textureSets);
+
+			// from dequeue to the screen, as async so overlapping frames stack
+			if (record.dequeued > 0 && record.presented >= record.dequeued) {
+				writeJsonEvent(json, &isFirstEvent, "{\"name\":\"frame %lld\",\"cat\":\"frame\",\"ph\":\"b\",\"id\":%lld,\"pid\":%d,\"tid\":%d,\"ts\":%lld,"
+							   "\"args\":{\"sequence\":%u,\"latency\":%lld,\"texture_set\":%u}}",
+							   (long long) record.frame, (long long) record.frame, JSON_PID, JSON_FRAMES_TID,
+							   (long long) record.dequeued, record.sequence, age, record.textureSet);
+				writeJsonEvent(json, &isFirstEvent, "{\"name\":\"frame %lld\",\"cat\":\"frame\",\"ph\":\"e\",\"id\":%lld,\"pid\":%d,\"tid\":%d,\"ts\":%lld}",
+							   (long long) record.frame, (long long) record.frame, JSON_PID, JSON_FRAMES_TID,
+							   (long long) record.presented);
+			}
+
+			if (age >= 0) {
+				latency->add(latency, age);
+			}
+			waited->add(waited, record.waited);
+			rendered->add(rendered, record.rendered);
+			if (record.uploadStarted > 0 && record.uploadEnded >= record.uploadStarted) {
+				upload->add(upload, record.uploadEnded - record.uploadStarted);
+			}
+			if (record.drawn > 0 && record.drawn >= record.uploadEnded && record.presented >= record.drawn) {
+				drawing->add(drawing, record.drawn - record.uploadEnded);
+				swap->add(swap, record.presented - record.drawn);
+			}
+			if (record.textureSets > textureSets) {
+				textureSets = record.textureSets;
+			}
+			if (lastPresented > 0) {
+				interval->add(interval, record.presented - lastPresented);
+			}
+			lastPresented = record.presented;
+			framesCount++;
+			break;
+		}
+
+		default:
+			fprintf(stderr, "Skipping unknown event %u.\n", record.event);
+			break;
+		}
+	}
+
+	fprintf(json, "\n]}\n");
+
+	fclose(trace);
+	fclose(csv);
+	fclose(json);
+
+	fprintf(stdout, "%s: %lu frames written to %s\n", argv[1], framesCount, csvFile);
+	fprintf(stdout, "%s: %lu spans written to %s\n\n", argv[1], spansCount, jsonFile);
+	fprintf(stdout, "%-24s %10s %10s %10s %10s %10s\n", "", "p50", "p90", "p99", "max", "samples");
+	printSummary("latency (usec)", latency);
+	printSummary("capture_time (usec)", waited);
+	printSummary("render_time (usec)", rendered);
+	printSummary("upload_time (usec)", upload);
+	printSummary("draw_time (usec)", drawing);
+	printSummary("swap_time (usec)", swap);
+	printSummary("frame_interval (usec)", interval);
+	for (k = 0; k < TRACE_MAX_RINGS; k++) {
+		if (captures[k] > 0) {
+			printSummary(dequeueNames[k], dequeue[k]);
+		}
+	}
+
+	for (k = 0; k < TRACE_MAX_RINGS; k++) {
+		if (lost[k] > 0) {
+			fprintf(stdout, "\nring %u lost %lu records; the flusher fell behind.", k, lost[k]);
+		}
+	}
+	if (textureSets > 0) {
+		fprintf(stdout, "\ntexture sets per stream: %u", textureSets);
+	}
+	fprintf(stdout, "\n");
+
+	Samples_dispose(latency);
+	Samples_dispose(waited);
+	Samples_dispose(rendered);
+	Samples_dispose(upload);
+	Samples_dispose(drawing);
+	Samples_dispose(swap);
+	Samples_dispose(interval);
+	for (k = 0; k < TRACE_MAX_RINGS; k++) {
+		Samples_dispose(dequeue[k]);
+	}
+
+	return 0;
+}
@@ -0,0 +1,684 @@
+/**
+	This file is part of Intel Atom ISP Test App.
+
+	Intel Atom ISP Test App is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Intel Atom ISP Test App is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Intel Atom ISP Test App.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+
+#include "pattern.h"
+#include "pattern_kernels.h"
+#include "utilities.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/timerfd.h>
+
+#define BAR_STEP 4				/* pixels the bars move per frame; even */
+#define BARS_COUNT 8
+#define HUE_RANGE (6 * 256)		/* of the gradient's hue ramp */
+#define DIGIT_COLUMNS 3
+#define DIGIT_ROWS 5
+#define COUNTER_DIGITS "%06u"
+
+/**
+ * Indexed by PatternKind_t; what follows PATTERN_DEVICE_PREFIX.
+ */
+static const char *KIND_NAMES[] = {
+	[PATTERN_BARS] = "bars",
+	[PATTERN_GRADIENT] = "gradient",
+	[PATTERN_NOISE] = "noise",
+	[PATTERN_MIX] = "mix"
+};
+
+static const unsigned char BAR_COLORS[BARS_COUNT][3] = {
+	{ 255, 255, 255 },	// white
+	{ 255, 255, 0 },	// yellow
+	{ 0, 255, 255 },	// cyan
+	{ 0, 255, 0 },		// green
+	{ 255, 0, 255 },	// magenta
+	{ 255, 0, 0 },		// red
+	{ 0, 0, 255 },		// blue
+	{ 0, 0, 0 }			// black
+};
+
+static const unsigned char BLACK[3] = { 0, 0, 0 };
+static const unsigned char WHITE[3] = { 255, 255, 255 };
+
+/**
+ * Rows of 3 pixels, the leftmost in bit 2.
+ */
+static const unsigned char DIGITS[10][DIGIT_ROWS] = {
+	{ 7, 5, 5, 5, 7 }, { 2, 6, 2, 2, 7 }, { 7, 1, 7, 4, 7 }, { 7, 1, 7, 1, 7 }, { 5, 5, 7, 1, 1 },
+	{ 7, 4, 7, 1, 7 }, { 7, 4, 7, 5, 7 }, { 7, 1, 1, 1, 1 }, { 7, 5, 7, 5, 7 }, { 7, 5, 7, 1, 7 }
+};
+
+/**
+ * Byte of Y0, U, Y1 and V in a pair of packed YUV pixels. Indexed by
+ * PixelFormat_t, whose packed formats come first.
+ */
+static const unsigned char PACKED_ORDER[][4] = {
+	[YVYU] = { 0, 3, 2, 1 },
+	[YUYV] = { 0, 1, 2, 3 },
+	[UYVY] = { 1, 0, 3, 2 },
+	[VYUY] = { 1, 2, 3, 0 }
+};
+
+void Pattern_noiseSteps(unsigned char *_dst, unsigned int _count, uint32_t *_lanes, uint32_t _mask) {
+	uint32_t words[PATTERN_NOISE_LANES];
+	unsigned int x, i;
+
+	for (x = 0; x < _count; x += sizeof(words)) {
+		for (i = 0; i < PATTERN_NOISE_LANES; i++) {
+			uint32_t state = _lanes[i];
+			state ^= state << 13;
+			state ^= state >> 17;
+			state ^= state << 5;
+			_lanes[i] = state;
+			words[i] = state & _mask;
+		}
+		memcpy(_dst + x, words, (_count - x < sizeof(words)) ? _count - x : sizeof(words));
+	}
+}
+
+void Pattern_noiseRow(unsigned char *_dst, unsigned int _count, uint32_t _seed, uint32_t _mask) {
+	uint32_t lanes[PATTERN_NOISE_LANES];
+
+	Pattern_seedLanes(_seed, lanes);
+	Pattern_noiseSteps(_dst, _count, lanes, _mask);
+}
+
+bool Pattern_isSpec(const char *_device) {
+	return _device != NULL && strncmp(_device, PATTERN_DEVICE_PREFIX, strlen(PATTERN_DEVICE_PREFIX)) == 0;
+}
+
+const char *Pattern_kindName(PatternKind_t _kind) {
+	if ((unsigned int) _kind >= sizeof(KIND_NAMES) / sizeof(KIND_NAMES[0])) {
+		return "unknown";
+	}
+
+	return KIND_NAMES[_kind];
+}
+
+// BT.601 with headroom, as the fragment shaders undo it
+static inline unsigned char lumaOf(const unsigned char *_rgb) {
+	return (unsigned char) (16 + ((66 * _rgb[0] + 129 * _rgb[1] + 25 * _rgb[2] + 128) >> 8));
+}
+
+static inline unsigned char blueDifferenceOf(const unsigned char *_rgb) {
+	return (unsigned char) ((-38 * _rgb[0] - 74 * _rgb[1] + 112 * _rgb[2] + 32896) >> 8);
+}
+
+static inline unsigned char redDifferenceOf(const unsigned char *_rgb) {
+	return (unsigned char) ((112 * _rgb[0] - 94 * _rgb[1] - 18 * _rgb[2] + 32896) >> 8);
+}
+
+static inline void putLittleEndian16(unsigned char *_out, unsigned int _value) {
+	_out[0] = (unsigned char) (_value & 0xff);
+	_out[1] = (unsigned char) (_value >> 8);
+}
+
+/**
+ * Encodes _count RGB pixels, an even number, as the bytes plane _p of the
+ * format has for them. _parity tells even rows from odd ones, which only
+ * Bayer formats tell apart; chroma is taken from both pixels of a pair.
+ */
+static void encodeRow(const PatternSource *self, unsigned int _p, unsigned int _parity,
+					  const unsigned char *_rgb, unsigned int _count, unsigned char *_out) {
+	PixelFormat_t format = self->formatInfo->format;
+	unsigned int x;
+
+	for (x = 0; x < _count; x += 2) {
+		const unsigned char *first = _rgb + (x * 3);
+		const unsigned char *second = first + 3;
+		unsigned char mean[3] = {
+			(unsigned char) ((first[0] + second[0] + 1) / 2),
+			(unsigned char) ((first[1] + second[1] + 1) / 2),
+			(unsigned char) ((first[2] + second[2] + 1) / 2)
+		};
+
+		switch (format) {
+		case YVYU:
+		case YUYV:
+		case UYVY:
+		case VYUY:
+		{
+			unsigned char *pair = _out + (x * 2);
+			pair[PACKED_ORDER[format][0]] = lumaOf(first);
+			pair[PACKED_ORDER[format][1]] = blueDifferenceOf(mean);
+			pair[PACKED_ORDER[format][2]] = lumaOf(second);
+			pair[PACKED_ORDER[format][3]] = redDifferenceOf(mean);
+			break;
+		}
+		case YV16:
+		case NV12:
+			if (_p == 0) {
+				_out[x] = lumaOf(first);
+				_out[x + 1] = lumaOf(second);
+			} else if (format == NV12) {
+				_out[x] = blueDifferenceOf(mean);
+				_out[x + 1] = redDifferenceOf(mean);
+			} else {
+				_out[x / 2] = (_p == 1) ? blueDifferenceOf(mean) : redDifferenceOf(mean);
+			}
+			break;
+		case RGBP:
+			putLittleEndian16(_out + (x * 2), ((first[0] >> 3) << 11) | ((first[1] >> 2) << 5) | (first[2] >> 3));
+			putLittleEndian16(_out + (x * 2) + 2, ((second[0] >> 3) << 11) | ((second[1] >> 2) << 5) | (second[2] >> 3));
+			break;
+		case RGB3:
+			memcpy(_out + (x * 3), first, 6);
+			break;
+		case BA10:
+			// GRBG: G R on even rows, B G on odd ones; 8 bits widened to 10
+			if (_parity == 0) {
+				putLittleEndian16(_out + (x * 2), (first[1] << 2) | (first[1] >> 6));
+				putLittleEndian16(_out + (x * 2) + 2, (second[0] << 2) | (second[0] >> 6));
+			} else {
+				putLittleEndian16(_out + (x * 2), (first[2] << 2) | (first[2] >> 6));
+				putLittleEndian16(_out + (x * 2) + 2, (second[1] << 2) | (second[1] >> 6));
+			}
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+/**
+ * Bytes from the start of a row of plane _plane to pixel _x (even) of the
+ * frame.
+ */
+static inline unsigned int bytesTo(const PatternPlane *_plane, unsigned int _x) {
+	return ((_x / _plane->horizontalSubsampling) * _plane->bitsPerPixel) / 8;
+}
+
+static void hueOf(unsigned int _hue, unsigned char *_rgb) {
+	unsigned char rising = (unsigned char) (_hue % 256);
+	unsigned char falling = (unsigned char) (255 - rising);
+
+	switch (_hue / 256) {
+	case 0: _rgb[0] = 255; _rgb[1] = rising; _rgb[2] = 0; break;
+	case 1: _rgb[0] = falling; _rgb[1] = 255; _rgb[2] = 0; break;
+	case 2: _rgb[0] = 0; _rgb[1] = 255; _rgb[2] = rising; break;
+	case 3: _rgb[0] = 0; _rgb[1] = falling; _rgb[2] = 255; break;
+	case 4: _rgb[0] = rising; _rgb[1] = 0; _rgb[2] = 255; break;
+	default: _rgb[0] = 255; _rgb[1] = 0; _rgb[2] = falling; break;
+	}
+}
+
+/**
+ * Both patterns repeat every width pixels, so any row of them is a window
+ * of width pixels into rows twice as wide.
+ */
+static void buildTemplates(PatternSource *self) {
+	unsigned int count = 2 * self->width;
+	unsigned int x, p, parity;
+
+	for (x = 0; x < count; x++) {
+		memcpy(self->scratch + (x * 3), BAR_COLORS[((x % self->width) * BARS_COUNT) / self->width], 3);
+	}
+	for (p = 0; p < self->planesCount; p++) {
+		for (parity = 0; parity < 2; parity++) {
+			encodeRow(self, p, parity, self->scratch, count, self->planes[p].barRows[parity]);
+		}
+	}
+
+	for (x = 0; x < count; x++) {
+		hueOf(((x % self->width) * HUE_RANGE) / self->width, self->scratch + (x * 3));
+	}
+	for (p = 0; p < self->planesCount; p++) {
+		for (parity = 0; parity < 2; parity++) {
+			encodeRow(self, p, parity, self->scratch, count, self->planes[p].gradientRows[parity]);
+		}
+	}
+}
+
+/**
+ * Frame rows _y0 to _y1 (even), the bars moved left by BAR_STEP a frame.
+ */
+static void drawBars(PatternSource *self, unsigned char *_frame, unsigned int _sequence, unsigned int _y0, unsigned int _y1) {
+	unsigned int shift = (unsigned int) (((unsigned long long) _sequence * BAR_STEP) % self->width);
+	unsigned int p, row;
+
+	for (p = 0; p < self->planesCount; p++) {
+		PatternPlane *plane = &self->planes[p];
+		unsigned int skip = bytesTo(plane, shift);
+
+		for (row = _y0 / plane->verticalSubsampling; row < _y1 / plane->verticalSubsampling; row++) {
+			memcpy(_frame + plane->offset + (row * plane->bytesperline), plane->barRows[row & 1] + skip,
+				   plane->bytesperline);
+		}
+	}
+}
+
+/**
+ * Frame rows _y0 to _y1 (even); every second row is shifted one pixel pair
+ * further, and the whole of it one pixel pair a frame.
+ */
+static void drawGradient(PatternSource *self, unsigned char *_frame, unsigned int _sequence, unsigned int _y0, unsigned int _y1) {
+	unsigned int p, row;
+
+	for (p = 0; p < self->planesCount; p++) {
+		PatternPlane *plane = &self->planes[p];
+
+		for (row = _y0 / plane->verticalSubsampling; row < _y1 / plane->verticalSubsampling; row++) {
+			unsigned int y = row * plane->verticalSubsampling;
+			unsigned int shift = (unsigned int) ((2 * ((unsigned long long) _sequence + (y / 2))) % self->width);
+
+			memcpy(_frame + plane->offset + (row * plane->bytesperline),
+				   plane->gradientRows[row & 1] + bytesTo(plane, shift), plane->bytesperline);
+		}
+	}
+}
+
+/**
+ * Frame rows _y0 to _y1 (even), seeded by sequence, plane and row alone.
+ */
+static void drawNoise(PatternSource *self, unsigned char *_frame, unsigned int _sequence, unsigned int _y0, unsigned int _y1) {
+	unsigned int p, row;
+
+	for (p = 0; p < self->planesCount; p++) {
+		PatternPlane *plane = &self->planes[p];
+
+		for (row = _y0 / plane->verticalSubsampling; row < _y1 / plane->verticalSubsampling; row++) {
+			uint32_t seed = (_sequence * 0x9e3779b1u) ^ ((row << 2) | p);
+			self->noiseRow(_frame + plane->offset + (row * plane->bytesperline), plane->bytesperline, seed,
+						   self->noiseMask);
+		}
+	}
+}
+
+/**
+ * Fills a rectangle whose corners are on even pixels: the first row of
+ * each parity is encoded, the others copied from it.
+ */
+static void fillRect(PatternSource *self, unsigned char *_frame, unsigned int _x, unsigned int _y,
+					 unsigned int _width, unsigned int _height, const unsigned char *_rgb) {
+	unsigned int i, p, row;
+
+	for (i = 0; i < _width; i++) {
+		memcpy(self->scratch + (i * 3), _rgb, 3);
+	}
+
+	for (p = 0; p < self->planesCount; p++) {
+		PatternPlane *plane = &self->planes[p];
+		unsigned int first = _y / plane->verticalSubsampling;
+		unsigned int last = (_y + _height) / plane->verticalSubsampling;
+		unsigned int bytes = bytesTo(plane, _width);
+
+		for (row = first; row < last; row++) {
+			unsigned char *out = _frame + plane->offset + (row * plane->bytesperline) + bytesTo(plane, _x);
+			if (row < first + 2) {
+				encodeRow(self, p, row & 1, self->scratch, _width, out);
+			} else {
+				memcpy(out, out - (2 * plane->bytesperline), bytes);
+			}
+		}
+	}
+}
+
+/**
+ * The sequence number in white on black in the top left corner, scaled
+ * with the height. Frames too small for it go without.
+ */
+static void drawCounter(PatternSource *self, unsigned char *_frame, unsigned int _sequence) {
+	char digits[16];
+	int count = snprintf(digits, sizeof(digits), COUNTER_DIGITS, _sequence);
+	unsigned int scale = 2 * (1 + (self->height / 240));	// even, like every corner
+	unsigned int boxWidth = ((count * (DIGIT_COLUMNS + 1)) + 1) * scale;
+	unsigned int boxHeight = (DIGIT_ROWS + 2) * scale;
+	int i;
+	unsigned int row, column;
+
+	if (boxWidth > self->width || boxHeight > self->height) {
+		return;
+	}
+
+	fillRect(self, _frame, 0, 0, boxWidth, boxHeight, BLACK);
+	for (i = 0; i < count; i++) {
+		const unsigned char *glyph = DIGITS[digits[i] - '0'];
+
+		for (row = 0; row < DIGIT_ROWS; row++) {
+			for (column = 0; column < DIGIT_COLUMNS; column++) {
+				if (glyph[row] & (1 << (DIGIT_COLUMNS - 1 - column))) {
+					fillRect(self, _frame, (1 + (i * (DIGIT_COLUMNS + 1)) + column) * scale, (1 + row) * scale,
+							 scale, scale, WHITE);
+				}
+			}
+		}
+	}
+}
+
+static void render(PatternSource *self, unsigned char *_frame, unsigned int _sequence) {
+	// thirds, on even rows
+	unsigned int first = (self->height / 3) & ~1u;
+	unsigned int second = ((2 * self->height) / 3) & ~1u;
+
+	switch (self->kind) {
+	case PATTERN_BARS:
+		drawBars(self, _frame, _sequence, 0, self->height);
+		break;
+	case PATTERN_GRADIENT:
+		drawGradient(self, _frame, _sequence, 0, self->height);
+		break;
+	case PATTERN_NOISE:
+		drawNoise(self, _frame, _sequence, 0, self->height);
+		break;
+	case PATTERN_MIX:
+		drawBars(self, _frame, _sequence, 0, first);
+		drawGradient(self, _frame, _sequence, first, second);
+		drawNoise(self, _frame, _sequence, second, self->height);
+		break;
+	}
+
+	drawCounter(self, _frame, _sequence);
+}
+
+static int start(PatternSource *self) {
+	self->sequence = 0;
+	// frames left in the app's ring at the last stop are never given back;
+	// as after STREAMON, every buffer is free again
+	__atomic_store_n(&self->busyMask, 0, __ATOMIC_RELEASE);
+	self->nextBuffer = 0;
+	self->generated = 0;
+	self->renderUsecSum = 0;
+	self->renderUsecMax = 0;
+	self->startedUsec = monotonicUsec();
+	self->dueUsec = self->startedUsec;
+	armTimerFdAt(self->fd, self->dueUsec);
+	return 1;
+}
+
+static void stop(PatternSource *self) {
+	disarmTimerFd(self->fd);
+}
+
+/**
+ * Draws the newest frame that is due into a free buffer and hands it out,
+ * or NULL with errno EAGAIN before one is due. _dueUsec gets when it fell
+ * due (CLOCK_MONOTONIC), _sequence its sequence and _index its buffer,
+ * which is the source's again after giveBack().
+ */
+static unsigned char *take(PatternSource *self, long long *_dueUsec, unsigned int *_sequence, unsigned int *_index) {
+	long long now = monotonicUsec();
+
+	drainTimerFd(self->fd);
+	if (now < self->dueUsec) {
+		armTimerFdAt(self->fd, self->dueUsec);
+		errno = EAGAIN;
+		return NULL;
+	}
+
+	unsigned int sequence = self->sequence;
+	long long due = now;
+	if (self->intervalUsec > 0) {
+		// a camera does not wait for a late reader either
+		long long newest = (now - self->startedUsec) / self->intervalUsec;
+		if (newest > (long long) sequence) {
+			sequence = (unsigned int) newest;
+		}
+		due = self->startedUsec + ((long long) sequence * self->intervalUsec);
+	}
+
+	unsigned int busy = __atomic_load_n(&self->busyMask, __ATOMIC_ACQUIRE);
+	unsigned int i, index = self->buffersCount;
+	for (i = 0; i < self->buffersCount; i++) {
+		unsigned int candidate = (self->nextBuffer + i) % self->buffersCount;
+		if ((busy & (1u << candidate)) == 0) {
+			index = candidate;
+			break;
+		}
+	}
+
+	if (index == self->buffersCount) {
+		sprintf(self->error, "All %u buffers of %s are held.", self->buffersCount, self->spec);
+		armTimerFdAt(self->fd, self->dueUsec);
+		errno = ENOBUFS;
+		return NULL;
+	}
+	__atomic_fetch_or(&self->busyMask, 1u << index, __ATOMIC_ACQ_REL);
+	self->nextBuffer = (index + 1) % self->buffersCount;
+
+	long long renderStart = monotonicUsec();
+	render(self, self->buffers[index], sequence);
+	long long renderUsec = monotonicUsec() - renderStart;
+
+	self->generated += 1;
+	self->renderUsecSum += renderUsec;
+	if (renderUsec > self->renderUsecMax) {
+		self->renderUsecMax = renderUsec;
+	}
+
+	self->sequence = sequence + 1;
+	self->dueUsec = (self->intervalUsec > 0) ? self->startedUsec + ((long long) self->sequence * self->intervalUsec) : now;
+	armTimerFdAt(self->fd, self->dueUsec);
+
+	*_dueUsec = due;
+	*_sequence = sequence;
+	*_index = index;
+	return self->buffers[index];
+}
+
+/**
+ * Hands buffer _index back for drawing into. May be called from a
+ * different thread than take().
+ */
+static void giveBack(PatternSource *self, unsigned int _index) {
+	if (_index < self->buffersCount) {
+		__atomic_fetch_and(&self->busyMask, ~(1u << _index), __ATOMIC_ACQ_REL);
+	}
+}
+
+/**
+ * pattern-<kind>[@<fps>]
+ */
+static int parseSpec(PatternSource *self) {
+	const char *kind = self->spec + strlen(PATTERN_DEVICE_PREFIX);
+	const char *at = strchr(kind, '@');
+	size_t length = (at != NULL) ? (size_t) (at - kind) : strlen(kind);
+	unsigned int i;
+
+	for (i = 0; i < sizeof(KIND_NAMES) / sizeof(KIND_NAMES[0]); i++) {
+		if (strlen(KIND_NAMES[i]) == length && strncasecmp(kind, KIND_NAMES[i], length) == 0) {
+			break;
+		}
+	}
+
+	if (i == sizeof(KIND_NAMES) / sizeof(KIND_NAMES[0])) {
+		sprintf(self->error, "%.64s: the pattern is one of bars, gradient, noise or mix.", self->spec);
+		return 0;
+	}
+	self->kind = (PatternKind_t) i;
+
+	if (at != NULL) {
+		char *end;
+		self->fps = strtod(at + 1, &end);
+		if (end == at + 1 || *end != '\0' || !(self->fps > 0 && self->fps <= 10000)) {
+			sprintf(self->error, "%.64s: expected a frame rate after '@'.", self->spec);
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/**
+ * Planes follow each other in one buffer with tight rows, as V4L2 lays out
+ * contiguous planar formats.
+ */
+static int describePlanes(PatternSource *self) {
+	const PixelFormatInfo *info = self->formatInfo;
+
+	if (self->width == 0 || self->height == 0 || (self->width % 2) != 0 || (self->height % 2) != 0) {
+		sprintf(self->error, "%.64s needs an even width and height, not %ux%u.", self->spec, self->width, self->height);
+		return 0;
+	}
+
+	unsigned int bytesPerLine = (self->width * info->planes[0].bitsPerPixel) / 8;
+	unsigned int offset = 0;
+	unsigned int p;
+
+	self->planesCount = info->planesCount;
+	for (p = 0; p < self->planesCount; p++) {
+		PatternPlane *plane = &self->planes[p];
+		plane->horizontalSubsampling = info->planes[p].horizontalSubsampling;
+		plane->verticalSubsampling = info->planes[p].verticalSubsampling;
+		plane->bitsPerPixel = info->planes[p].bitsPerPixel;
+		plane->bytesperline = PixelFormat_bytesPerLine(info, p, bytesPerLine);
+		plane->rows = self->height / plane->verticalSubsampling;
+		plane->offset = offset;
+		offset += plane->bytesperline * plane->rows;
+	}
+	self->frameSize = offset;
+
+	return 1;
+}
+
+static void pickKernel(PatternSource *self) {
+	self->noiseRow = Pattern_noiseRow;
+	self->isaName = ColorConvert_isaName(CONVERT_ISA_SCALAR);
+
+	// the fastest kernel there is, down to the scalar one
+#if defined(__i386__) || defined(__x86_64__)
+	ConvertIsa_t isa;
+	for (isa = ColorConvert_cpuIsa(); isa > CONVERT_ISA_SCALAR; isa--) {
+		PatternNoiseRow_t noiseRow = Pattern_x86NoiseRow(isa);
+		if (noiseRow != NULL) {
+			self->noiseRow = noiseRow;
+			self->isaName = ColorConvert_isaName(isa);
+			return;
+		}
+	}
+#endif
+}
+
+static int allocate(PatternSource *self) {
+	unsigned int i, p;
+
+	self->buffers = (unsigned char **) calloc(self->buffersCount, sizeof(unsigned char *));
+	for (i = 0; i < self->buffersCount; i++) {
+		if (posix_memalign((void **) &self->buffers[i], 64, self->frameSize) != 0) {
+			self->buffers[i] = NULL;
+			sprintf(self->error, "Cannot allocate %u frames of %u bytes.", self->buffersCount, self->frameSize);
+			return 0;
+		}
+		// fault the pages in now rather than in the first frames
+		memset(self->buffers[i], 0, self->frameSize);
+	}
+
+	for (p = 0; p < self->planesCount; p++) {
+		for (i = 0; i < 2; i++) {
+			self->planes[p].barRows[i] = (unsigned char *) malloc(2 * self->planes[p].bytesperline);
+			self->planes[p].gradientRows[i] = (unsigned char *) malloc(2 * self->planes[p].bytesperline);
+		}
+	}
+	self->scratch = (unsigned char *) malloc(2 * self->width * 3);
+
+	return 1;
+}
+
+static void PatternSource_init(PatternSource *self, const char *_spec, PixelFormat_t _pixelFormat,
+							   unsigned int _width, unsigned int _height, unsigned int _buffersCount,
+							   bool _isFreeRunning) {
+	self->spec = strdup(_spec);
+	self->kind = PATTERN_BARS;
+	self->formatInfo = PixelFormat_info(_pixelFormat);
+	self->width = _width;
+	self->height = _height;
+	self->fps = PATTERN_DEFAULT_FPS;
+	self->intervalUsec = 0;
+	self->fd = -1;
+	self->buffersCount = (_buffersCount < PATTERN_MAX_BUFFERS) ? _buffersCount : PATTERN_MAX_BUFFERS;
+	self->buffers = NULL;
+	self->busyMask = 0;
+	self->scratch = NULL;
+	self->error = (char *) calloc(256, sizeof(char));
+
+	// methods
+	self->start = start;
+	self->stop = stop;
+	self->take = take;
+	self->giveBack = giveBack;
+
+	if (self->buffersCount == 0) {
+		sprintf(self->error, "%.64s needs at least one buffer.", self->spec);
+		return;
+	}
+
+	if (!parseSpec(self) || !describePlanes(self)) {
+		return;
+	}
+
+	self->intervalUsec = _isFreeRunning ? 0 : (long long) ((1000000.0 / self->fps) + 0.5);
+	// 10 bit samples are 16 bits little endian
+	self->noiseMask = (self->formatInfo->bitsPerSample == 10) ? 0x03ff03ffu : 0xffffffffu;
+	pickKernel(self);
+
+	if (!allocate(self)) {
+		return;
+	}
+	buildTemplates(self);
+
+	self->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (self->fd < 0) {
+		sprintf(self->error, "timerfd_create: %d, %s", errno, strerror(errno));
+	}
+}
+
+/**
+ * _spec is pattern-<kind>[@<fps>]; frames are _width x _height (even) in
+ * _pixelFormat, drawn into _buffersCount buffers (at most
+ * PATTERN_MAX_BUFFERS). _isFreeRunning ignores the frame rate. Check fd
+ * (and error) on the returned object; it is -1 when nothing can be
+ * generated.
+ */
+PatternSource *PatternSource_newWith(const char *_spec, PixelFormat_t _pixelFormat, unsigned int _width,
+									 unsigned int _height, unsigned int _buffersCount, bool _isFreeRunning) {
+	PatternSource *pattern = (PatternSource *) calloc(1, sizeof(PatternSource));
+	PatternSource_init(pattern, _spec, _pixelFormat, _width, _height, _buffersCount, _isFreeRunning);
+	return pattern;
+}
+
+void PatternSource_dispose(PatternSource *self) {
+	if (self == NULL) {
+		return;
+	}
+
+	if (self->fd >= 0) {
+		close(self->fd);
+	}
+
+	unsigned int i, p;
+	for (i = 0; self->buffers != NULL && i < self->buffersCount; i++) {
+		free(self->buffers[i]);
+	}
+	for (p = 0; p < self->planesCount; p++) {
+		for (i = 0; i < 2; i++) {
+			free(self->planes[p].barRows[i]);
+			free(self->planes[p].gradientRows[i]);
+		}
+	}
+
+	free(self->buffers);
+	free(self->scratch);
+	free(self->spec);
+	free(self->error);
+	free(self);
+}
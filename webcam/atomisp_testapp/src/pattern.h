@@ -0,0 +1,112 @@
+/**
+	This file is part of Intel Atom ISP Test App.
+
+	Intel Atom ISP Test App is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Intel Atom ISP Test App is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Intel Atom ISP Test App.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PATTERN_H_
+#define PATTERN_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "utilities.h"
+#include "pixel_format.h"
+
+#define PATTERN_DEVICE_PREFIX "pattern-"	/* pattern-<kind>[@<fps>] stands in for a device */
+#define PATTERN_DEFAULT_FPS 30.0
+#define PATTERN_MAX_BUFFERS 32				/* bits of busyMask */
+
+typedef enum PATTERN_KIND {
+	PATTERN_BARS,		/* 8 colour bars scrolling sideways */
+	PATTERN_GRADIENT,	/* a hue ramp in diagonal stripes, drifting */
+	PATTERN_NOISE,		/* every byte random, new every frame */
+	PATTERN_MIX			/* bars, gradient and noise a third of the height each */
+} PatternKind_t;
+
+/**
+ * Fills _count bytes with the noise of the row seeded _seed, every 32 bit
+ * word ANDed with _mask. See pattern_kernels.h.
+ */
+typedef void (*PatternNoiseRow_t) (unsigned char *, unsigned int, uint32_t, uint32_t);
+
+/**
+ * One color plane of a generated frame. The rows of bars and gradients are
+ * copied out of templates twice the frame's width, at the offset the
+ * pattern has moved to; Bayer formats alternate two kinds of row.
+ */
+typedef struct PATTERN_PLANE_S {
+	unsigned int horizontalSubsampling;
+	unsigned int verticalSubsampling;
+	unsigned int bitsPerPixel;
+	unsigned int offset;		/* from the start of the frame */
+	unsigned int bytesperline;
+	unsigned int rows;
+	unsigned char *barRows[2];	/* even and odd rows */
+	unsigned char *gradientRows[2];
+} PatternPlane;
+
+/**
+ * Generates test frames, as the ISP's test pattern generator would, for
+ * running everything after capture without a camera.
+ *
+ * Frames are drawn into buffers of its own, one per frame held, when they
+ * are taken. Each shows the pattern moved on by its sequence, with the
+ * sequence number in the top left corner, so the same sequence always
+ * gives the same bytes. fd is a timerfd that turns readable when the next
+ * frame falls due. A consumer that falls behind gets the newest frame, and
+ * the ones passed over show up as gaps in the sequence, as with a camera.
+ * Without an interval, frames fall due as soon as the one before is taken.
+ */
+typedef struct PATTERN_SOURCE_S {
+	char *spec;
+	PatternKind_t kind;
+	const PixelFormatInfo *formatInfo;
+	unsigned int width;
+	unsigned int height;
+	double fps;
+	long long intervalUsec;	/* 0 runs free */
+	int fd;					/* timerfd on CLOCK_MONOTONIC */
+	const char *isaName;	/* of the noise kernel */
+	PatternNoiseRow_t noiseRow;
+	uint32_t noiseMask;		/* keeps 10 bit samples within 10 bits */
+	unsigned int planesCount;
+	PatternPlane planes[PIXEL_FORMAT_MAX_PLANES];
+	unsigned int frameSize;
+	unsigned int buffersCount;
+	unsigned char **buffers;
+	unsigned int busyMask;	/* buffers taken and not given back yet */
+	unsigned int nextBuffer;
+	unsigned char *scratch;	/* one row of RGB pixels, for encoding */
+
+	long long startedUsec;	/* CLOCK_MONOTONIC when sequence 0 fell due */
+	long long dueUsec;		/* when the next frame falls due */
+	unsigned int sequence;	/* of the next frame */
+	unsigned long generated;
+	long long renderUsecSum;
+	long long renderUsecMax;
+	char *error;
+
+	int (*start) (struct PATTERN_SOURCE_S *);
+	void (*stop) (struct PATTERN_SOURCE_S *);
+	unsigned char *(*take) (struct PATTERN_SOURCE_S *, long long *, unsigned int *, unsigned int *);
+	void (*giveBack) (struct PATTERN_SOURCE_S *, unsigned int);
+} PatternSource;
+
+bool Pattern_isSpec(const char *);
+const char *Pattern_kindName(PatternKind_t);
+PatternSource *PatternSource_newWith(const char *, PixelFormat_t, unsigned int, unsigned int, unsigned int, bool);
+void PatternSource_dispose(PatternSource *);
+
+#endif /* PATTERN_H_ */
@@ -0,0 +1,53 @@
+/**
+	This file is part of Intel Atom ISP Test App.
+
+	Intel Atom ISP Test App is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Intel Atom ISP Test App is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Intel Atom ISP Test App.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PATTERN_KERNELS_H_
+#define PATTERN_KERNELS_H_
+
+#include "pattern.h"
+#include "color_convert.h"
+
+/**
+ * The noise of a row comes from 8 xorshift32 generators side by side,
+ * seeded from the row's seed. Every step advances all of them and puts out
+ * 32 bytes, the 4 bytes of each generator's state in turn, as one SIMD
+ * register or two hold them. The kernels all give the same bytes.
+ */
+#define PATTERN_NOISE_LANES 8
+
+static inline void Pattern_seedLanes(uint32_t _seed, uint32_t *_lanes) {
+	unsigned int i;
+
+	for (i = 0; i < PATTERN_NOISE_LANES; i++) {
+		// murmur3's finalizer; xorshift must not start from 0
+		uint32_t x = _seed + ((i + 1) * 0x9e3779b9u);
+		x ^= x >> 16;
+		x *= 0x85ebca6bu;
+		x ^= x >> 13;
+		x *= 0xc2b2ae35u;
+		x ^= x >> 16;
+		_lanes[i] = (x != 0) ? x : 1;
+	}
+}
+
+// scalar; the SIMD kernels finish their rows with Pattern_noiseSteps
+void Pattern_noiseSteps(unsigned char *, unsigned int, uint32_t *, uint32_t);
+void Pattern_noiseRow(unsigned char *, unsigned int, uint32_t, uint32_t);
+
+PatternNoiseRow_t Pattern_x86NoiseRow(ConvertIsa_t);
+
+#endif /* PATTERN_KERNELS_H_ */
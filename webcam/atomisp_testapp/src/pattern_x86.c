@@ -0,0 +1,112 @@
+/**
+	This file is part of Intel Atom ISP Test App.
+
+	Intel Atom ISP Test App is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Intel Atom ISP Test App is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Intel Atom ISP Test App.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * SSE2 and AVX2 noise kernels of the test patterns, compiled for their
+ * instruction sets through target attributes like the conversion kernels.
+ * The 8 generators of a row are two registers of SSE2 or one of AVX2.
+ */
+
+#include "pattern_kernels.h"
+
+#if defined(__i386__) || defined(__x86_64__)
+
+#include <immintrin.h>
+
+#define SSE2 __attribute__((target("sse2")))
+#define AVX2 __attribute__((target("avx2")))
+
+static inline SSE2 __m128i xorshift_sse2(__m128i _x) {
+	_x = _mm_xor_si128(_x, _mm_slli_epi32(_x, 13));
+	_x = _mm_xor_si128(_x, _mm_srli_epi32(_x, 17));
+	return _mm_xor_si128(_x, _mm_slli_epi32(_x, 5));
+}
+
+static SSE2 void noiseRow_sse2(unsigned char *_dst, unsigned int _count, uint32_t _seed, uint32_t _mask) {
+	uint32_t lanes[PATTERN_NOISE_LANES];
+	const __m128i mask = _mm_set1_epi32((int) _mask);
+	unsigned int x;
+
+	Pattern_seedLanes(_seed, lanes);
+	__m128i low = _mm_loadu_si128((const __m128i *) lanes);
+	__m128i high = _mm_loadu_si128((const __m128i *) (lanes + 4));
+
+	for (x = 0; x + 32 <= _count; x += 32) {
+		low = xorshift_sse2(low);
+		high = xorshift_sse2(high);
+		_mm_storeu_si128((__m128i *) (_dst + x), _mm_and_si128(low, mask));
+		_mm_storeu_si128((__m128i *) (_dst + x + 16), _mm_and_si128(high, mask));
+	}
+
+	_mm_storeu_si128((__m128i *) lanes, low);
+	_mm_storeu_si128((__m128i *) (lanes + 4), high);
+	Pattern_noiseSteps(_dst + x, _count - x, lanes, _mask);
+}
+
+static inline AVX2 __m256i xorshift_avx2(__m256i _x) {
+	_x = _mm256_xor_si256(_x, _mm256_slli_epi32(_x, 13));
+	_x = _mm256_xor_si256(_x, _mm256_srli_epi32(_x, 17));
+	return _mm256_xor_si256(_x, _mm256_slli_epi32(_x, 5));
+}
+
+static AVX2 void noiseRow_avx2(unsigned char *_dst, unsigned int _count, uint32_t _seed, uint32_t _mask) {
+	uint32_t lanes[PATTERN_NOISE_LANES];
+	const __m256i mask = _mm256_set1_epi32((int) _mask);
+	unsigned int x;
+
+	Pattern_seedLanes(_seed, lanes);
+	__m256i state = _mm256_loadu_si256((const __m256i *) lanes);
+
+	// two steps at a time keep two stores in flight
+	for (x = 0; x + 64 <= _count; x += 64) {
+		state = xorshift_avx2(state);
+		_mm256_storeu_si256((__m256i *) (_dst + x), _mm256_and_si256(state, mask));
+		state = xorshift_avx2(state);
+		_mm256_storeu_si256((__m256i *) (_dst + x + 32), _mm256_and_si256(state, mask));
+	}
+	if (x + 32 <= _count) {
+		state = xorshift_avx2(state);
+		_mm256_storeu_si256((__m256i *) (_dst + x), _mm256_and_si256(state, mask));
+		x += 32;
+	}
+
+	_mm256_storeu_si256((__m256i *) lanes, state);
+	Pattern_noiseSteps(_dst + x, _count - x, lanes, _mask);
+}
+
+/**
+ * Indexed by ConvertIsa_t; SSSE3 adds nothing to the SSE2 kernel.
+ */
+static const PatternNoiseRow_t NOISE_KERNELS[CONVERT_ISA_BEST + 1] = {
+	[CONVERT_ISA_SCALAR] = NULL,
+	[CONVERT_ISA_SSE2] = noiseRow_sse2,
+	[CONVERT_ISA_SSSE3] = NULL,
+	[CONVERT_ISA_AVX2] = noiseRow_avx2
+};
+
+/**
+ * The kernel written for exactly _isa; the caller checks the CPU runs it.
+ */
+PatternNoiseRow_t Pattern_x86NoiseRow(ConvertIsa_t _isa) {
+	if ((unsigned int) _isa > CONVERT_ISA_BEST) {
+		return NULL;
+	}
+
+	return NOISE_KERNELS[_isa];
+}
+
+#endif /* __i386__ || __x86_64__ */
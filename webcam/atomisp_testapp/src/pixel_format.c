@@ -0,0 +1,123 @@
+/**
+	This file is part of Intel Atom ISP Test App.
+
+	Intel Atom ISP Test App is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Intel Atom ISP Test App is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Intel Atom ISP Test App.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "pixel_format.h"
+
+#include <stddef.h>
+#include <strings.h>
+
+#include <linux/videodev2.h>
+#include <GLES2/gl2.h>
+
+// older kernel headers lack the non-contiguous 4:2:2 variant
+#ifndef V4L2_PIX_FMT_YUV422M
+#define V4L2_PIX_FMT_YUV422M v4l2_fourcc('Y', 'M', '1', '6')
+#endif
+
+#define FULL(bits, glFormat, glType) { 1, 1, bits, glFormat, glType }
+
+/**
+ * Indexed by PixelFormat_t. Packed YUV has no shader, so it is not uploaded.
+ */
+static const PixelFormatInfo formats[] = {
+	[YVYU] = { YVYU, V4L2_PIX_FMT_YVYU, V4L2_PIX_FMT_YVYU, 8, 1, { FULL(16, 0, 0) } },
+	[YUYV] = { YUYV, V4L2_PIX_FMT_YUYV, V4L2_PIX_FMT_YUYV, 8, 1, { FULL(16, 0, 0) } },
+	[UYVY] = { UYVY, V4L2_PIX_FMT_UYVY, V4L2_PIX_FMT_UYVY, 8, 1, { FULL(16, 0, 0) } },
+	[VYUY] = { VYUY, V4L2_PIX_FMT_VYUY, V4L2_PIX_FMT_VYUY, 8, 1, { FULL(16, 0, 0) } },
+	[YV16] = { YV16, V4L2_PIX_FMT_YUV422P, V4L2_PIX_FMT_YUV422M, 8, 3, {
+		FULL(8, GL_LUMINANCE, GL_UNSIGNED_BYTE),
+		{ 2, 1, 8, GL_LUMINANCE, GL_UNSIGNED_BYTE },
+		{ 2, 1, 8, GL_LUMINANCE, GL_UNSIGNED_BYTE } } },
+	[NV12] = { NV12, V4L2_PIX_FMT_NV12, V4L2_PIX_FMT_NV12M, 8, 2, {
+		FULL(8, GL_LUMINANCE, GL_UNSIGNED_BYTE),
+		{ 2, 2, 16, GL_LUMINANCE_ALPHA, GL_UNSIGNED_BYTE } } },
+	[RGBP] = { RGBP, V4L2_PIX_FMT_RGB565, V4L2_PIX_FMT_RGB565, 6, 1, { FULL(16, GL_RGB, GL_UNSIGNED_SHORT_5_6_5) } },
+	[RGB3] = { RGB3, V4L2_PIX_FMT_RGB24, V4L2_PIX_FMT_RGB24, 8, 1, { FULL(24, GL_RGB, GL_UNSIGNED_BYTE) } },
+	[BA10] = { BA10, V4L2_PIX_FMT_SGRBG10, V4L2_PIX_FMT_SGRBG10, 10, 1, { FULL(16, 0, 0) } }
+};
+
+/**
+ * Indexed by PixelFormat_t; the names the enum has.
+ */
+static const char *names[] = {
+	[YVYU] = "YVYU",
+	[YUYV] = "YUYV",
+	[UYVY] = "UYVY",
+	[VYUY] = "VYUY",
+	[YV16] = "YV16",
+	[NV12] = "NV12",
+	[RGBP] = "RGBP",
+	[RGB3] = "RGB3",
+	[BA10] = "BA10"
+};
+
+const char *PixelFormat_name(PixelFormat_t _format) {
+	if ((unsigned int) _format >= sizeof(names) / sizeof(names[0])) {
+		return "unknown";
+	}
+
+	return names[_format];
+}
+
+/**
+ * Case-insensitive; takes the names PixelFormat_name() gives.
+ */
+bool PixelFormat_parse(const char *_name, PixelFormat_t *_format) {
+	unsigned int i;
+
+	for (i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+		if (strcasecmp(_name, names[i]) == 0) {
+			*_format = (PixelFormat_t) i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+const PixelFormatInfo *PixelFormat_info(PixelFormat_t _format) {
+	if ((unsigned int) _format >= sizeof(formats) / sizeof(formats[0])) {
+		return &formats[YV16]; // what unknown formats have always been asked for
+	}
+
+	return &formats[_format];
+}
+
+/**
+ * Bits per pixel of the whole frame, all planes together.
+ */
+unsigned int PixelFormat_bitsPerPixel(const PixelFormatInfo *_info) {
+	unsigned int p, bits = 0;
+
+	for (p = 0; p < _info->planesCount; p++) {
+		const PixelFormatPlane *plane = &_info->planes[p];
+		bits += plane->bitsPerPixel / (plane->horizontalSubsampling * plane->verticalSubsampling);
+	}
+
+	return bits;
+}
+
+/**
+ * Stride of plane _plane in a buffer whose first plane has stride
+ * _bytesPerLine, the way V4L2 defines it for contiguous planar formats.
+ */
+unsigned int PixelFormat_bytesPerLine(const PixelFormatInfo *_info, unsigned int _plane, unsigned int _bytesPerLine) {
+	const PixelFormatPlane *first = &_info->planes[0];
+	const PixelFormatPlane *plane = &_info->planes[_plane];
+
+	return (_bytesPerLine * plane->bitsPerPixel) / (first->bitsPerPixel * plane->horizontalSubsampling);
+}
@@ -0,0 +1,58 @@
+/**
+	This file is part of Intel Atom ISP Test App.
+
+	Intel Atom ISP Test App is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Intel Atom ISP Test App is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Intel Atom ISP Test App.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PIXEL_FORMAT_H_
+#define PIXEL_FORMAT_H_
+
+#include <stdbool.h>
+
+#include "utilities.h"
+
+#define PIXEL_FORMAT_MAX_PLANES 3
+
+/**
+ * One color plane as stored in memory and uploaded to GL.
+ */
+typedef struct PIXEL_FORMAT_PLANE_S {
+	unsigned int horizontalSubsampling;	/* 2 = half the frame's width */
+	unsigned int verticalSubsampling;
+	unsigned int bitsPerPixel;		/* per pixel of this plane, e.g. 16 for NV12 UV pairs */
+	unsigned int glFormat;			/* 0 when GL cannot take it as is */
+	unsigned int glType;
+} PixelFormatPlane;
+
+/**
+ * What every stage needs to know about a PixelFormat_t. The byte layout of a
+ * frame still comes from the driver's bytesperline and sizeimage; this only
+ * says how to read them.
+ */
+typedef struct PIXEL_FORMAT_INFO_S {
+	PixelFormat_t format;
+	unsigned int fourcc;			/* V4L2 */
+	unsigned int multiPlanarFourcc;	/* V4L2; each plane in a buffer of its own */
+	unsigned int bitsPerSample;		/* widest component */
+	unsigned int planesCount;
+	PixelFormatPlane planes[PIXEL_FORMAT_MAX_PLANES];
+} PixelFormatInfo;
+
+const PixelFormatInfo *PixelFormat_info(PixelFormat_t);
+const char *PixelFormat_name(PixelFormat_t);
+bool PixelFormat_parse(const char *, PixelFormat_t *);
+unsigned int PixelFormat_bitsPerPixel(const PixelFormatInfo *);
+unsigned int PixelFormat_bytesPerLine(const PixelFormatInfo *, unsigned int, unsigned int);
+
+#endif /* PIXEL_FORMAT_H_ */
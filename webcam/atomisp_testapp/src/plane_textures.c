@@ -0,0 +1,192 @@
+/**
+	This file is part of Intel Atom ISP Test App.
+
+	Intel Atom ISP Test App is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Intel Atom ISP Test App is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Intel Atom ISP Test App.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "plane_textures.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// GL_EXT_unpack_subimage; older gl2ext.h lack it
+#ifndef GL_UNPACK_ROW_LENGTH_EXT
+#define GL_UNPACK_ROW_LENGTH_EXT 0x0CF2
+#endif
+
+/**
+ * Uploads plane _index to its texture of the current set, leaving it bound to texture unit
+ * _index, whatever stride the driver chose: in one call when the rows are
+ * packed or GL_EXT_unpack_subimage can skip the padding, row by row
+ * otherwise. BA10 is demosaiced first.
+ */
+static void uploadPlane(PlaneTextures *self, unsigned int _index, const VideoPlane *_plane) {
+	const PixelFormatPlane *format = &self->formatInfo->planes[_index];
+	unsigned int rowBytes = (_plane->width * format->bitsPerPixel) / 8;
+
+	glActiveTexture(GL_TEXTURE0 + _index);
+	glBindTexture(GL_TEXTURE_2D, self->textures[self->current][_index]);
+
+	if (self->demosaic != NULL) {
+		if (self->demosaic->demosaic(self->demosaic, _plane, self->rgba, _plane->width * 4)) {
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, _plane->width, _plane->height, GL_RGBA, GL_UNSIGNED_BYTE, self->rgba);
+		}
+	} else if (_plane->bytesperline == rowBytes) {
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, _plane->width, _plane->height, format->glFormat, format->glType, _plane->data);
+	} else if (self->hasUnpackSubImage && ((_plane->bytesperline * 8) % format->bitsPerPixel) == 0) {
+		glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, (_plane->bytesperline * 8) / format->bitsPerPixel);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, _plane->width, _plane->height, format->glFormat, format->glType, _plane->data);
+		glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, 0);
+	} else {
+		unsigned int y;
+		for (y = 0; y < _plane->height; y++) {
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, y, _plane->width, 1, format->glFormat, format->glType,
+							_plane->data + (y * _plane->bytesperline));
+		}
+	}
+}
+
+/**
+ * Moves on to the next set of the ring and returns its index.
+ */
+static unsigned int next(PlaneTextures *self) {
+	self->current = (self->current + 1) % self->setsCount;
+	return self->current;
+}
+
+/**
+ * Uploads every plane of _frame into the next set and leaves unit 0 active.
+ */
+static void upload(PlaneTextures *self, const VideoFrame *_frame) {
+	unsigned int p;
+
+	next(self);
+	for (p = 0; p < self->planesCount && p < _frame->planesCount; p++) {
+		uploadPlane(self, p, &_frame->planes[p]);
+	}
+	glActiveTexture(GL_TEXTURE0);
+}
+
+/**
+ * Binds the planes of the current set to texture units 0, 1, 2 and leaves
+ * unit 0 active.
+ */
+static void bind(PlaneTextures *self) {
+	unsigned int p;
+
+	for (p = 0; p < self->planesCount; p++) {
+		glActiveTexture(GL_TEXTURE0 + p);
+		glBindTexture(GL_TEXTURE_2D, self->textures[self->current][p]);
+	}
+	glActiveTexture(GL_TEXTURE0);
+}
+
+static void PlaneTextures_init(PlaneTextures *self, PixelFormat_t _pixelFormat, const VideoPlane *_planes,
+							   unsigned int _setsCount) {
+	self->formatInfo = PixelFormat_info(_pixelFormat);
+	self->planesCount = 0;
+	self->setsCount = _setsCount;
+	if (self->setsCount < 1) {
+		self->setsCount = 1;
+	} else if (self->setsCount > PLANE_TEXTURES_MAX_SETS) {
+		self->setsCount = PLANE_TEXTURES_MAX_SETS;
+	}
+	self->current = 0;
+	self->hasUnpackSubImage = false;
+	self->demosaic = NULL;
+	self->rgba = NULL;
+	self->error = (char *) calloc(256, sizeof(char));
+
+	// methods
+	self->uploadPlane = uploadPlane;
+	self->upload = upload;
+	self->bind = bind;
+	self->next = next;
+
+	// rows of odd widths are not padded to 4 bytes
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	self->hasUnpackSubImage = hasExtension((const char *) glGetString(GL_EXTENSIONS), "GL_EXT_unpack_subimage");
+
+	if (_pixelFormat == BA10) {
+		self->demosaic = Demosaic_newWith(CONVERT_ISA_BEST);
+		self->rgba = (unsigned char *) malloc(_planes[0].width * 4 * _planes[0].height);
+		self->planesCount = 1;
+	} else if (self->formatInfo->planes[0].glFormat == 0) {
+		sprintf(self->error, "No GL texture format for pixel format %d.", _pixelFormat);
+		return;
+	} else {
+		self->planesCount = self->formatInfo->planesCount;
+	}
+
+	unsigned int set, p;
+	for (set = 0; set < self->setsCount; set++) {
+		glGenTextures(self->planesCount, self->textures[set]);
+
+		for (p = 0; p < self->planesCount; p++) {
+			const PixelFormatPlane *format = &self->formatInfo->planes[p];
+			GLenum glFormat = (self->demosaic != NULL) ? GL_RGBA : format->glFormat;
+			GLenum glType = (self->demosaic != NULL) ? GL_UNSIGNED_BYTE : format->glType;
+
+			glActiveTexture(GL_TEXTURE0 + p);
+			glBindTexture(GL_TEXTURE_2D, self->textures[set][p]);
+			glTexImage2D(GL_TEXTURE_2D, 0, glFormat, _planes[p].width, _planes[p].height, 0,
+						 glFormat, glType, NULL);
+			glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		}
+	}
+	glActiveTexture(GL_TEXTURE0);
+}
+
+/**
+ * Call with a GL context current, once _video is initialized. _setsCount
+ * sets of textures are made, 1 to PLANE_TEXTURES_MAX_SETS. planesCount is 0
+ * (and error set) when the format has no GL textures.
+ */
+PlaneTextures *PlaneTextures_newWith(PixelFormat_t _pixelFormat, const Video *_video, unsigned int _setsCount) {
+	PlaneTextures *textures = (PlaneTextures *) calloc(1, sizeof(PlaneTextures));
+	PlaneTextures_init(textures, _pixelFormat, _video->planes, _setsCount);
+	return textures;
+}
+
+/**
+ * As PlaneTextures_newWith(), for frames made by the app, such as the
+ * previews of a Downscaler, sized like _planes.
+ */
+PlaneTextures *PlaneTextures_newWithPlanes(PixelFormat_t _pixelFormat, const VideoPlane *_planes,
+										   unsigned int _setsCount) {
+	PlaneTextures *textures = (PlaneTextures *) calloc(1, sizeof(PlaneTextures));
+	PlaneTextures_init(textures, _pixelFormat, _planes, _setsCount);
+	return textures;
+}
+
+void PlaneTextures_dispose(PlaneTextures *self) {
+	if (self == NULL) {
+		return;
+	}
+
+	unsigned int set;
+	for (set = 0; set < self->setsCount && self->planesCount > 0; set++) {
+		glDeleteTextures(self->planesCount, self->textures[set]);
+	}
+
+	Demosaic_dispose(self->demosaic);
+	free(self->rgba);
+
+	free(self->error);
+	free(self);
+}
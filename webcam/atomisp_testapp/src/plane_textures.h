@@ -0,0 +1,65 @@
+/**
+	This file is part of Intel Atom ISP Test App.
+
+	Intel Atom ISP Test App is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Intel Atom ISP Test App is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Intel Atom ISP Test App.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PLANE_TEXTURES_H_
+#define PLANE_TEXTURES_H_
+
+#include <stdbool.h>
+
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+
+#include "utilities.h"
+#include "pixel_format.h"
+#include "video.h"
+#include "demosaic.h"
+
+#define PLANE_TEXTURES_MAX_SETS 4
+
+/**
+ * One GL texture per color plane of a Video, sized like the driver's
+ * planes: Y, U, V or Y, UV or the packed pixels. Frames are uploaded
+ * straight from the capture buffers, but for BA10: raw Bayer frames are
+ * demosaiced on the CPU and uploaded as one RGBA texture.
+ *
+ * With more than one set the textures are a ring: each frame goes into the
+ * set after the last one, so an upload does not wait for the GPU to finish
+ * drawing the frame before. next() moves to the following set; upload()
+ * calls it, callers of uploadPlane() call it once per frame themselves.
+ */
+typedef struct PLANE_TEXTURES_S {
+	const PixelFormatInfo *formatInfo;
+	unsigned int planesCount;
+	unsigned int setsCount;
+	unsigned int current;		/* the set uploaded into and bound */
+	GLuint textures[PLANE_TEXTURES_MAX_SETS][PIXEL_FORMAT_MAX_PLANES];
+	bool hasUnpackSubImage;		/* GL_UNPACK_ROW_LENGTH_EXT for padded strides */
+	Demosaic *demosaic;			/* BA10 only; levels and pool are the app's to set */
+	unsigned char *rgba;		/* BA10 only; the demosaiced frame */
+	char *error;
+
+	void (*uploadPlane) (struct PLANE_TEXTURES_S *, unsigned int, const VideoPlane *);
+	void (*upload) (struct PLANE_TEXTURES_S *, const VideoFrame *);
+	void (*bind) (struct PLANE_TEXTURES_S *);
+	unsigned int (*next) (struct PLANE_TEXTURES_S *);
+} PlaneTextures;
+
+PlaneTextures *PlaneTextures_newWith(PixelFormat_t, const Video *, unsigned int);
+PlaneTextures *PlaneTextures_newWithPlanes(PixelFormat_t, const VideoPlane *, unsigned int);
+void PlaneTextures_dispose(PlaneTextures *);
+
+#endif /* PLANE_TEXTURES_H_ */
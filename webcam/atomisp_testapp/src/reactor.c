@@ -0,0 +1,279 @@
+/**
+	This file is part of Intel Atom ISP Test App.
+
+	Intel Atom ISP Test App is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Intel Atom ISP Test App is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Intel Atom ISP Test App.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "reactor.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#define ERRSTR strerror(errno)
+#define CLEAR(x) memset(&(x), 0, sizeof(x))
+
+#define DEFAULT_TIMEOUT_MSEC 2000
+#define FIFO_TIMEOUT_MSEC 60000	/* longer timeout since raw files can be large */
+
+// epoll_event.data.u64 = (source index << 1) | kind
+#define TAG_VIDEO 0
+#define TAG_TIMER 1
+#define TAG_WAKE UINT64_MAX
+#define MAKE_TAG(index, kind) ((((uint64_t) (index)) << 1) | (kind))
+
+static void armTimer(ReactorSource *_source, int _msec) {
+	struct itimerspec spec;
+	CLEAR(spec);
+	spec.it_value.tv_sec = _msec / 1000;
+	spec.it_value.tv_nsec = (long) (_msec % 1000) * 1000000L;
+	timerfd_settime(_source->timerFd, 0, &spec, NULL);
+}
+
+static int setVideoInterest(Reactor *self, unsigned int _index, bool _isInterested) {
+	struct epoll_event ev;
+	CLEAR(ev);
+	ev.events = _isInterested ? EPOLLIN : 0;
+	ev.data.u64 = MAKE_TAG(_index, TAG_VIDEO);
+	return epoll_ctl(self->epollFd, EPOLL_CTL_MOD, self->sources[_index].video->fd, &ev);
+}
+
+static bool isAtHeldCap(Video *_video) {
+	return __atomic_load_n(&_video->heldFramesCount, __ATOMIC_ACQUIRE) >= _video->maxHeldFrames;
+}
+
+static int addVideo(Reactor *self, Video *_video, FrameHandler _handler, void *_data) {
+	if (self->sourcesCount >= REACTOR_MAX_SOURCES) {
+		sprintf(self->error, "Reactor: cannot watch more than %d devices.", REACTOR_MAX_SOURCES);
+		return 0;
+	}
+
+	unsigned int index = self->sourcesCount;
+	ReactorSource *source = &self->sources[index];
+	source->video = _video;
+	source->handler = _handler;
+	source->data = _data;
+	source->timeoutMsec = _video->isFIFO ? FIFO_TIMEOUT_MSEC : DEFAULT_TIMEOUT_MSEC;
+	source->isThrottled = false;
+
+	source->timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (source->timerFd < 0) {
+		sprintf(self->error, "timerfd_create: %s", ERRSTR);
+		return 0;
+	}
+
+	struct epoll_event ev;
+	CLEAR(ev);
+	ev.events = EPOLLIN;
+	ev.data.u64 = MAKE_TAG(index, TAG_VIDEO);
+	if (0 > epoll_ctl(self->epollFd, EPOLL_CTL_ADD, _video->fd, &ev)) {
+		sprintf(self->error, "epoll_ctl(%s): %s", _video->device, ERRSTR);
+		close(source->timerFd);
+		return 0;
+	}
+
+	CLEAR(ev);
+	ev.events = EPOLLIN;
+	ev.data.u64 = MAKE_TAG(index, TAG_TIMER);
+	if (0 > epoll_ctl(self->epollFd, EPOLL_CTL_ADD, source->timerFd, &ev)) {
+		sprintf(self->error, "epoll_ctl(timerfd): %s", ERRSTR);
+		epoll_ctl(self->epollFd, EPOLL_CTL_DEL, _video->fd, NULL);
+		close(source->timerFd);
+		return 0;
+	}
+
+	_video->setReleaseWakeFdTo(_video, self->wakeFd);
+	self->sourcesCount++;
+	return 1;
+}
+
+/**
+ * A source whose app-held frames reached the cap stops being polled, or its
+ * level-triggered fd would spin; poll it again once frames are released,
+ * which writes wakeFd.
+ */
+static void rearmThrottled(Reactor *self) {
+	unsigned int i;
+
+	for (i = 0; i < self->sourcesCount; i++) {
+		ReactorSource *source = &self->sources[i];
+		if (!source->isThrottled) {
+			continue;
+		}
+
+		if (isAtHeldCap(source->video)) {
+			continue;
+		}
+
+		source->isThrottled = false;
+		setVideoInterest(self, i, true);
+		armTimer(source, source->timeoutMsec);
+	}
+}
+
+/**
+ * Returns 1 after shutdown() or when a handler asks to stop, 0 when a device
+ * stalls and -1 when one fails (see error). Call again to resume after a
+ * stall; a failed device will only fail again.
+ */
+static int run(Reactor *self) {
+	struct epoll_event events[REACTOR_MAX_SOURCES * 2 + 1];
+	unsigned int i;
+
+	for (i = 0; i < self->sourcesCount; i++) {
+		if (!self->sources[i].isThrottled) {
+			armTimer(&self->sources[i], self->sources[i].timeoutMsec);
+		}
+	}
+
+	while (!__atomic_load_n(&self->isShutdown, __ATOMIC_ACQUIRE)) {
+		int n = epoll_wait(self->epollFd, events, REACTOR_MAX_SOURCES * 2 + 1, -1);
+		if (n < 0) {
+			if (EINTR == errno) {
+				continue;
+			}
+			sprintf(self->error, "epoll_wait: %s", ERRSTR);
+			return -1;
+		}
+
+		int k;
+		for (k = 0; k < n; k++) {
+			uint64_t tag = events[k].data.u64;
+			uint64_t counter;
+
+			if (tag == TAG_WAKE) {
+				if (read(self->wakeFd, &counter, sizeof(counter)) < 0) {
+					// nothing to drain; the flag and rearmThrottled() do the rest
+				}
+				continue;
+			}
+
+			unsigned int index = (unsigned int) (tag >> 1);
+			ReactorSource *source = &self->sources[index];
+
+			if ((tag & 1) == TAG_TIMER) {
+				if (read(source->timerFd, &counter, sizeof(counter)) < 0) {
+					continue;
+				}
+				sprintf(self->error, "%s: no frame for %d ms", source->video->device, source->timeoutMsec);
+				return 0;
+			}
+
+			if (isAtHeldCap(source->video)) {
+				source->isThrottled = true;
+				setVideoInterest(self, index, false);
+				armTimer(source, 0);
+				continue;
+			}
+
+			VideoFrame frame;
+			TRACE_SPAN_BEGIN(dequeueBegin);
+			if (!source->video->acquire(source->video, &frame)) {
+				if (EAGAIN == errno) {
+					continue;
+				}
+				sprintf(self->error, "%s", source->video->error);
+				return -1;
+			}
+			TRACE_SPAN_END(self->trace, TRACE_SPAN_DEQUEUE, dequeueBegin, frame.sequence, frame.index);
+
+			armTimer(source, source->timeoutMsec);
+
+			if (!source->handler(self, source->video, &frame, source->data)) {
+				return 1;
+			}
+		}
+
+		rearmThrottled(self);
+	}
+
+	return 1;
+}
+
+/**
+ * Safe to call from any thread.
+ */
+static void shutdown(Reactor *self) {
+	uint64_t one = 1;
+	__atomic_store_n(&self->isShutdown, true, __ATOMIC_RELEASE);
+	if (write(self->wakeFd, &one, sizeof(one)) < 0) {
+		// counter overflow is impossible here; the flag is already set
+	}
+}
+
+/**
+ * Only call before run() starts.
+ */
+static void setTraceWith(Reactor *self, TraceRing *_trace) {
+	self->trace = _trace;
+}
+
+static void Reactor_init(Reactor *self) {
+	self->sourcesCount = 0;
+	self->isShutdown = false;
+	self->trace = NULL;
+	self->error = (char *) calloc(256, sizeof(char));
+
+	self->epollFd = epoll_create1(EPOLL_CLOEXEC);
+	self->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+	if (self->epollFd >= 0 && self->wakeFd >= 0) {
+		struct epoll_event ev;
+		CLEAR(ev);
+		ev.events = EPOLLIN;
+		ev.data.u64 = TAG_WAKE;
+		epoll_ctl(self->epollFd, EPOLL_CTL_ADD, self->wakeFd, &ev);
+	}
+
+	// methods
+	self->addVideo = addVideo;
+	self->run = run;
+	self->shutdown = shutdown;
+	self->setTraceWith = setTraceWith;
+}
+
+Reactor *Reactor_new() {
+	Reactor *reactor = (Reactor *) calloc(1, sizeof(Reactor));
+	Reactor_init(reactor);
+	return reactor;
+}
+
+void Reactor_dispose(Reactor *self) {
+	if (self == NULL) {
+		return;
+	}
+
+	unsigned int i;
+	for (i = 0; i < self->sourcesCount; i++) {
+		Video *video = self->sources[i].video;
+		video->setReleaseWakeFdTo(video, -1);
+		close(self->sources[i].timerFd);
+	}
+
+	if (self->wakeFd >= 0) {
+		close(self->wakeFd);
+	}
+	if (self->epollFd >= 0) {
+		close(self->epollFd);
+	}
+
+	free(self->error);
+	free(self);
+}
@@ -0,0 +1,72 @@
+/**
+	This file is part of Intel Atom ISP Test App.
+
+	Intel Atom ISP Test App is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Intel Atom ISP Test App is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Intel Atom ISP Test App.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef REACTOR_H_
+#define REACTOR_H_
+
+#include <stdbool.h>
+
+#include "video.h"
+#include "trace.h"
+
+#define REACTOR_MAX_SOURCES 16
+
+struct REACTOR_S;
+
+/**
+ * Called with a frame freshly acquired from _video. The handler owns the
+ * frame and must release it, now or later. Return 0 to stop run().
+ */
+typedef int (*FrameHandler) (struct REACTOR_S *, Video *, VideoFrame *, void *);
+
+typedef struct REACTOR_SOURCE_S {
+	Video *video;
+	FrameHandler handler;
+	void *data;
+	int timerFd;
+	int timeoutMsec;
+	bool isThrottled;
+} ReactorSource;
+
+/**
+ * epoll loop over any number of streaming Video instances.
+ *
+ * Each ready device is dequeued as soon as epoll reports it, so a slow
+ * stream never holds up a fast one. Every source has a timerfd that is
+ * re-armed on each frame and reports a stalled device, and an eventfd lets
+ * another thread stop the loop. A source whose held frames reach the cap is
+ * polled again when a release writes that eventfd.
+ */
+typedef struct REACTOR_S {
+	int epollFd;
+	int wakeFd;
+	unsigned int sourcesCount;
+	ReactorSource sources[REACTOR_MAX_SOURCES];
+	bool isShutdown;
+	TraceRing *trace;	/* spans of the thread running the loop; may be NULL */
+	char *error;
+
+	int (*addVideo) (struct REACTOR_S *, Video *, FrameHandler, void *);
+	int (*run) (struct REACTOR_S *);
+	void (*shutdown) (struct REACTOR_S *);
+	void (*setTraceWith) (struct REACTOR_S *, TraceRing *);
+} Reactor;
+
+Reactor *Reactor_new();
+void Reactor_dispose(Reactor *);
+
+#endif /* REACTOR_H_ */
@@ -0,0 +1,73 @@
+/**
+	This file is part of Intel Atom ISP Test App.
+
+	Intel Atom ISP Test App is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Intel Atom ISP Test App is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Intel Atom ISP Test App.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RECORD_FORMAT_H_
+#define RECORD_FORMAT_H_
+
+#include <stdint.h>
+
+/**
+ * The files a Recorder writes and a ReplaySource plays back: a data file of
+ * block aligned frames and an index file (data path + ".idx") of one
+ * RecordHeader followed by one RecordEntry per frame.
+ */
+
+#define RECORD_MAGIC "ISPRAWIX"
+#define RECORD_VERSION 1
+#define RECORD_INDEX_SUFFIX ".idx"
+#define RECORD_BLOCK_SIZE 4096		/* O_DIRECT alignment of memory, file offsets and sizes */
+#define RECORD_MAX_PLANES 3			/* VIDEO_FRAME_MAX_PLANES */
+
+/**
+ * Where one plane of a recorded frame lives, from the frame's offset.
+ */
+typedef struct RECORD_PLANE_S {
+	uint32_t offset;
+	uint32_t length;
+	uint32_t bytesperline;
+	uint32_t height;
+} RecordPlane;
+
+/**
+ * One frame in the index file. The layout is the same for 32- and 64-bit
+ * builds; the file is in the byte order of the machine that wrote it.
+ */
+typedef struct RECORD_ENTRY_S {
+	int64_t offset;			/* in the data file; a multiple of the header's blockSize */
+	uint32_t size;			/* bytes in the data file, padding included */
+	uint32_t sequence;		/* driver's */
+	uint32_t flags;			/* driver's */
+	uint32_t fourcc;		/* V4L2 */
+	uint32_t width;
+	uint32_t height;
+	int64_t timestamp;		/* driver's, usec */
+	int64_t written;		/* usec of CLOCK_MONOTONIC once on disk */
+	uint32_t planesCount;
+	uint32_t reserved;
+	RecordPlane planes[RECORD_MAX_PLANES];
+} RecordEntry;
+
+typedef struct RECORD_HEADER_S {
+	char magic[8];
+	uint32_t version;
+	uint32_t entrySize;
+	uint32_t blockSize;
+	uint32_t reserved;
+	int64_t started;		/* usec of CLOCK_MONOTONIC */
+} RecordHeader;
+
+#endif /* RECORD_FORMAT_H_ */
@@ -0,0 +1,499 @@
+/**
+	This file is part of Intel Atom ISP Test App.
+
+	Intel Atom ISP Test App is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Intel Atom ISP Test App is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Intel Atom ISP Test App.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+#define _FILE_OFFSET_BITS 64	// recordings outgrow 2 GB on 32-bit builds
+
+#include "recorder.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "pixel_format.h"
+#include "trace.h"
+
+#define BLOCK_MASK ((uintptr_t) RECORD_BLOCK_SIZE - 1)
+
+/**
+ * Planes that follow one another in memory, written as one piece.
+ */
+typedef struct RECORDER_RUN_S {
+	const unsigned char *start;
+	size_t length;
+	unsigned int lead;		/* start's offset within its block */
+	unsigned int span;		/* whole blocks covering it */
+	unsigned int offset;	/* of the first block, from the frame's */
+} RecorderRun;
+
+static size_t roundUpToBlock(size_t _size) {
+	return (_size + BLOCK_MASK) & ~((size_t) BLOCK_MASK);
+}
+
+/**
+ * Splits _frame in runs and lays them out one after the other, each from a
+ * block boundary plus the offset its start has in memory, so that the
+ * blocks in between can be written from where they are. Fills in the
+ * planes of _entry and returns how many runs there are.
+ */
+static unsigned int layoutRuns(const VideoFrame *_frame, RecorderRun *_runs, RecordEntry *_entry) {
+	unsigned int runOf[VIDEO_FRAME_MAX_PLANES];
+	unsigned int p, r, count = 0, size = 0;
+	RecorderRun *run = NULL;
+
+	for (p = 0; p < _frame->planesCount; p++) {
+		const VideoPlane *plane = &_frame->planes[p];
+
+		if (run == NULL || plane->data != run->start + run->length) {
+			run = &_runs[count++];
+			run->start = plane->data;
+			run->length = 0;
+		}
+
+		runOf[p] = count - 1;
+		_entry->planes[p].offset = run->length;	/* from the run's start, for now */
+		_entry->planes[p].length = plane->length;
+		_entry->planes[p].bytesperline = plane->bytesperline;
+		_entry->planes[p].height = plane->height;
+		run->length += plane->length;
+	}
+
+	for (r = 0; r < count; r++) {
+		run = &_runs[r];
+		run->lead = (uintptr_t) run->start & BLOCK_MASK;
+		run->span = roundUpToBlock(run->lead + run->length);
+		run->offset = size;
+		size += run->span;
+	}
+
+	_entry->planesCount = _frame->planesCount;
+	for (p = 0; p < _frame->planesCount; p++) {
+		_entry->planes[p].offset += _runs[runOf[p]].offset + _runs[runOf[p]].lead;
+	}
+
+	_entry->size = size;
+	return count;
+}
+
+/**
+ * The blocks of each run: its partial first and last ones from bounce,
+ * the ones in between straight from the capture buffer.
+ */
+static unsigned int directIovecs(Recorder *self, const RecorderRun *_runs, unsigned int _runsCount) {
+	unsigned int r, count = 0;
+	unsigned char *bounce = self->bounce;
+
+	for (r = 0; r < _runsCount; r++) {
+		const RecorderRun *run = &_runs[r];
+		const unsigned char *end = run->start + run->length;
+		const unsigned char *body = run->start - run->lead;
+		const unsigned char *bodyEnd = (const unsigned char *) ((uintptr_t) end & ~BLOCK_MASK);
+
+		if (run->span == RECORD_BLOCK_SIZE) {
+			memset(bounce, 0, RECORD_BLOCK_SIZE);
+			memcpy(bounce + run->lead, run->start, run->length);
+			self->iovecs[count].iov_base = bounce;
+			self->iovecs[count++].iov_len = RECORD_BLOCK_SIZE;
+			bounce += RECORD_BLOCK_SIZE;
+			self->copiedBytes += run->length;
+			continue;
+		}
+
+		if (run->lead > 0) {
+			memset(bounce, 0, run->lead);
+			memcpy(bounce + run->lead, run->start, RECORD_BLOCK_SIZE - run->lead);
+			self->iovecs[count].iov_base = bounce;
+			self->iovecs[count++].iov_len = RECORD_BLOCK_SIZE;
+			bounce += RECORD_BLOCK_SIZE;
+			body += RECORD_BLOCK_SIZE;
+			self->copiedBytes += RECORD_BLOCK_SIZE - run->lead;
+		}
+
+		if (bodyEnd > body) {
+			self->iovecs[count].iov_base = (void *) body;
+			self->iovecs[count++].iov_len = bodyEnd - body;
+		}
+
+		if (end > bodyEnd) {
+			memcpy(bounce, bodyEnd, end - bodyEnd);
+			memset(bounce + (end - bodyEnd), 0, RECORD_BLOCK_SIZE - (end - bodyEnd));
+			self->iovecs[count].iov_base = bounce;
+			self->iovecs[count++].iov_len = RECORD_BLOCK_SIZE;
+			bounce += RECORD_BLOCK_SIZE;
+			self->copiedBytes += end - bodyEnd;
+		}
+	}
+
+	return count;
+}
+
+/**
+ * The whole frame copied into staging, laid out as in the file.
+ */
+static unsigned int stagedIovecs(Recorder *self, const RecorderRun *_runs, unsigned int _runsCount, size_t _size) {
+	if (self->stagingSize < _size) {
+		free(self->staging);
+		self->staging = NULL;
+		self->stagingSize = 0;
+		if (0 != posix_memalign((void **) &self->staging, RECORD_BLOCK_SIZE, _size)) {
+			self->staging = NULL;
+			return 0;
+		}
+		self->stagingSize = _size;
+	}
+
+	unsigned int r;
+	for (r = 0; r < _runsCount; r++) {
+		const RecorderRun *run = &_runs[r];
+		unsigned char *block = self->staging + run->offset;
+
+		memset(block, 0, run->lead);
+		memcpy(block + run->lead, run->start, run->length);
+		memset(block + run->lead + run->length, 0, run->span - run->lead - run->length);
+		self->copiedBytes += run->length;
+	}
+
+	self->iovecs[0].iov_base = self->staging;
+	self->iovecs[0].iov_len = _size;
+	return 1;
+}
+
+/**
+ * Writes _count iovecs at _offset, resuming after short writes. Returns 0
+ * or the errno of the write that failed.
+ */
+static int writeAll(Recorder *self, unsigned int _count, long long _offset) {
+	struct iovec *iov = self->iovecs;
+
+	while (_count > 0) {
+		ssize_t ret = pwritev(self->fd, iov, _count, _offset);
+		if (ret < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return errno;
+		}
+
+		_offset += ret;
+		while (_count > 0 && (size_t) ret >= iov->iov_len) {
+			ret -= iov->iov_len;
+			iov++;
+			_count--;
+		}
+		if (_count > 0) {
+			iov->iov_base = (unsigned char *) iov->iov_base + ret;
+			iov->iov_len -= ret;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Writes one frame at the end of the data file, stepping down to buffered
+ * or staged writes when the kernel refuses direct ones.
+ */
+static bool writeFrame(Recorder *self, const RecorderSlot *_slot, RecordEntry *_entry) {
+	RecorderRun runs[RECORDER_MAX_RUNS];
+	unsigned int runsCount = layoutRuns(&_slot->frame, runs, _entry);
+
+	while (true) {
+		unsigned int count = self->isZeroCopy ? directIovecs(self, runs, runsCount)
+											  : stagedIovecs(self, runs, runsCount, _entry->size);
+		if (count == 0) {
+			sprintf(self->error, "Cannot stage a frame of %u bytes.", _entry->size);
+			return false;
+		}
+
+		int error = writeAll(self, count, self->offset);
+		if (error == 0) {
+			break;
+		}
+
+		if (error == EINVAL && self->isDirect) {
+			// the file system took O_DIRECT at open() but not for writes
+			int flags = fcntl(self->fd, F_GETFL);
+			if (flags < 0 || fcntl(self->fd, F_SETFL, flags & ~O_DIRECT) < 0) {
+				sprintf(self->error, "Cannot write %s without O_DIRECT: %d, %s", self->path, errno, strerror(errno));
+				return false;
+			}
+			self->isDirect = false;
+			sprintf(self->error, "%s takes no O_DIRECT writes; writing through the page cache.", self->path);
+		} else if (error == EFAULT && self->isZeroCopy) {
+			// the capture buffers are mapped in a way the kernel cannot pin
+			self->isZeroCopy = false;
+			sprintf(self->error, "Capture buffers cannot be written directly; copying frames.");
+		} else {
+			sprintf(self->error, "Cannot write %s: %d, %s", self->path, error, strerror(error));
+			return false;
+		}
+	}
+
+	_entry->offset = self->offset;
+	self->offset += _entry->size;
+	return true;
+}
+
+static void recordSlot(Recorder *self, const RecorderSlot *_slot) {
+	const PixelFormatInfo *info = PixelFormat_info(_slot->video->pixelFormat);
+	const VideoFrame *frame = &_slot->frame;
+	struct timespec begin, end;
+	RecordEntry entry;
+
+	memset(&entry, 0, sizeof(entry));
+	entry.sequence = frame->sequence;
+	entry.flags = frame->flags;
+	entry.fourcc = (_slot->video->isMultiPlanar) ? info->multiPlanarFourcc : info->fourcc;
+	entry.width = frame->planes[0].width;
+	entry.height = frame->planes[0].height;
+	entry.timestamp = ((long long) frame->timestamp.tv_sec * 1000000LL) + frame->timestamp.tv_usec;
+
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	if (!writeFrame(self, _slot, &entry)) {
+		__atomic_store_n(&self->hasFailed, true, __ATOMIC_RELEASE);
+		__atomic_add_fetch(&self->dropped, 1, __ATOMIC_RELAXED);
+		return;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	// the index only ever points at frames that are on disk
+	entry.written = Trace_usecOf(&end);
+	fwrite(&entry, sizeof(entry), 1, self->index);
+	fflush(self->index);
+
+	unsigned long long usec = Trace_usecOf(&end) - Trace_usecOf(&begin);
+	self->writeUsecSum += usec;
+	if (usec > self->writeUsecMax) {
+		self->writeUsecMax = usec;
+	}
+	self->bytes += entry.size;
+	__atomic_add_fetch(&self->written, 1, __ATOMIC_RELAXED);
+}
+
+static void *writerThread(void *_data) {
+	Recorder *self = (Recorder *) _data;
+
+	while (true) {
+		while (sem_wait(&self->ready) < 0 && errno == EINTR) {
+			// retry
+		}
+
+		unsigned int tail = self->tail;
+		unsigned int head = __atomic_load_n(&self->head, __ATOMIC_ACQUIRE);
+		if (head == tail) {
+			// only stop() posts without a frame
+			break;
+		}
+
+		RecorderSlot slot = self->slots[tail & self->mask];
+		if (!__atomic_load_n(&self->hasFailed, __ATOMIC_ACQUIRE)) {
+			recordSlot(self, &slot);
+		} else {
+			__atomic_add_fetch(&self->dropped, 1, __ATOMIC_RELAXED);
+		}
+
+		// room for the next frame before its buffer can come back
+		__atomic_store_n(&self->tail, tail + 1, __ATOMIC_RELEASE);
+
+		// the driver gets the buffer back only once it is on disk
+		if (slot.video->release(slot.video, &slot.frame) <= 0) {
+			sprintf(self->error, "%s", slot.video->error);
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Takes over _frame, held from _video, until it is written. Returns false
+ * when the recorder holds depth frames already, is stopped or has failed;
+ * the caller keeps the frame then and releases it as usual.
+ */
+static bool submit(Recorder *self, Video *_video, const VideoFrame *_frame) {
+	if (!self->isRunning || __atomic_load_n(&self->hasFailed, __ATOMIC_ACQUIRE)) {
+		return false;
+	}
+
+	unsigned int head = self->head;
+	unsigned int tail = __atomic_load_n(&self->tail, __ATOMIC_ACQUIRE);
+	if (head - tail >= self->capacity) {
+		// the disk is behind; skip this frame rather than hold up the driver
+		__atomic_add_fetch(&self->dropped, 1, __ATOMIC_RELAXED);
+		return false;
+	}
+
+	RecorderSlot *slot = &self->slots[head & self->mask];
+	slot->video = _video;
+	slot->frame = *_frame;
+	__atomic_store_n(&self->head, head + 1, __ATOMIC_RELEASE);
+
+	sem_post(&self->ready);
+	return true;
+}
+
+static int start(Recorder *self) {
+	if (self->fd < 0) {
+		return 0;
+	}
+
+	if (self->isRunning) {
+		return 1;
+	}
+
+	if (0 != pthread_create(&self->thread, NULL, writerThread, self)) {
+		sprintf(self->error, "Cannot start the recorder's writer.");
+		return 0;
+	}
+	self->isRunning = true;
+
+	return 1;
+}
+
+/**
+ * Writes what is still queued, hands those frames back and stops the
+ * writer. Call before the frames' Video stops streaming; submit() refuses
+ * frames until start() again.
+ */
+static void stop(Recorder *self) {
+	if (!self->isRunning) {
+		return;
+	}
+
+	self->isRunning = false;
+	sem_post(&self->ready);
+	pthread_join(self->thread, NULL);
+}
+
+static void Recorder_init(Recorder *self, const char *_path, unsigned int _depth) {
+	unsigned int slots = 1;
+
+	self->capacity = (_depth > 0) ? _depth : RECORDER_DEFAULT_DEPTH;
+	// round up to a power of two so the index wraps with a mask
+	while (slots < self->capacity) {
+		slots <<= 1;
+	}
+
+	self->path = strdup(_path);
+	self->indexPath = (char *) calloc(strlen(_path) + sizeof(RECORD_INDEX_SUFFIX), sizeof(char));
+	sprintf(self->indexPath, "%s%s", _path, RECORD_INDEX_SUFFIX);
+	self->fd = -1;
+	self->index = NULL;
+	self->isDirect = true;
+	self->isZeroCopy = true;
+	self->hasFailed = false;
+	self->mask = slots - 1;
+	self->slots = (RecorderSlot *) calloc(slots, sizeof(RecorderSlot));
+	self->head = 0;
+	self->tail = 0;
+	self->isRunning = false;
+	self->offset = 0;
+	self->bounce = NULL;
+	self->staging = NULL;
+	self->stagingSize = 0;
+	self->error = (char *) calloc(256, sizeof(char));
+	sem_init(&self->ready, 0, 0);
+
+	// methods
+	self->submit = submit;
+	self->start = start;
+	self->stop = stop;
+
+	if (0 != posix_memalign((void **) &self->bounce, RECORD_BLOCK_SIZE, 2 * RECORDER_MAX_RUNS * RECORD_BLOCK_SIZE)) {
+		self->bounce = NULL;
+		sprintf(self->error, "Cannot allocate the recorder's blocks.");
+		return;
+	}
+
+	self->fd = open(_path, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+	if (self->fd < 0 && errno == EINVAL) {
+		// e.g. tmpfs
+		self->isDirect = false;
+		self->fd = open(_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	}
+	if (self->fd < 0) {
+		sprintf(self->error, "Cannot open %s: %d, %s", _path, errno, strerror(errno));
+		return;
+	}
+
+	self->index = fopen(self->indexPath, "wb");
+	if (self->index == NULL) {
+		sprintf(self->error, "Cannot open %s: %d, %s", self->indexPath, errno, strerror(errno));
+		close(self->fd);
+		self->fd = -1;
+		return;
+	}
+
+	RecordHeader header;
+	struct timespec now;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, RECORD_MAGIC, sizeof(header.magic));
+	header.version = RECORD_VERSION;
+	header.entrySize = sizeof(RecordEntry);
+	header.blockSize = RECORD_BLOCK_SIZE;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	header.started = Trace_usecOf(&now);
+	fwrite(&header, sizeof(header), 1, self->index);
+	fflush(self->index);
+
+	if (!self->isDirect) {
+		sprintf(self->error, "%s takes no O_DIRECT; writing through the page cache.", _path);
+	}
+}
+
+/**
+ * Check fd (and error) on the returned object; without a file nothing is
+ * recorded and submit() refuses every frame. _depth of 0 takes
+ * RECORDER_DEFAULT_DEPTH.
+ */
+Recorder *Recorder_newWith(const char *_path, unsigned int _depth) {
+	Recorder *recorder = (Recorder *) calloc(1, sizeof(Recorder));
+	Recorder_init(recorder, _path, _depth);
+	return recorder;
+}
+
+void Recorder_dispose(Recorder *self) {
+	if (self == NULL) {
+		return;
+	}
+
+	stop(self);
+
+	if (self->fd >= 0) {
+		close(self->fd);
+	}
+	if (self->index != NULL) {
+		fclose(self->index);
+	}
+
+	sem_destroy(&self->ready);
+	free(self->bounce);
+	free(self->staging);
+	free(self->slots);
+	free(self->path);
+	free(self->indexPath);
+	free(self->error);
+	free(self);
+}
@@ -0,0 +1,102 @@
+/**
+	This file is part of Intel Atom ISP Test App.
+
+	Intel Atom ISP Test App is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Intel Atom ISP Test App is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Intel Atom ISP Test App.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RECORDER_H_
+#define RECORDER_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/uio.h>
+
+#include "video.h"
+#include "record_format.h"
+
+#define RECORDER_DEFAULT_DEPTH 2	/* frames held by the recorder at most */
+#define RECORDER_MAX_RUNS VIDEO_FRAME_MAX_PLANES
+#define RECORDER_MAX_IOVECS (3 * RECORDER_MAX_RUNS)
+
+/**
+ * A frame on loan to the recorder until it is on disk.
+ */
+typedef struct RECORDER_SLOT_S {
+	Video *video;
+	VideoFrame frame;
+} RecorderSlot;
+
+/**
+ * Streams captured frames to a data file with a background writer, and one
+ * RecordEntry per frame to an index file next to it (path + ".idx"), so any
+ * frame can be read back with a single seek.
+ *
+ * submit() takes over a held frame; the writer hands it back to its Video
+ * once written, so the render thread never waits on the disk. Frames are
+ * written straight from the capture buffers with O_DIRECT: every frame
+ * starts on a block and runs of contiguous planes keep their offset within
+ * it, so only the partial blocks at the ends of a run are copied. When the
+ * file system takes no O_DIRECT, or the kernel cannot pin the buffers (as
+ * with some driver mappings), the writer falls back to buffered writes or
+ * to staging whole frames, and says so in error.
+ *
+ * At most depth frames are held; further ones are handed back at once and
+ * counted as dropped, so a slow disk costs recorded frames, not captured
+ * ones.
+ */
+typedef struct RECORDER_S {
+	char *path;
+	char *indexPath;
+	int fd;
+	FILE *index;
+	bool isDirect;			/* fd has O_DIRECT */
+	bool isZeroCopy;		/* writes straight from the capture buffers */
+	bool hasFailed;			/* a write failed; nothing more is recorded */
+	unsigned int capacity;
+	unsigned int mask;
+	RecorderSlot *slots;
+
+	unsigned int head;		/* written by submit() only */
+	unsigned int tail;		/* written by the writer only */
+	sem_t ready;
+	pthread_t thread;
+	bool isRunning;
+
+	// written by the writer only
+	long long offset;		/* end of the data file */
+	unsigned char *bounce;	/* partial blocks; two per run */
+	unsigned char *staging;	/* whole frames, when not zero copy */
+	size_t stagingSize;
+	struct iovec iovecs[RECORDER_MAX_IOVECS];
+	unsigned long written;
+	unsigned long long bytes;
+	unsigned long long copiedBytes;
+	unsigned long long writeUsecSum;
+	unsigned long long writeUsecMax;
+
+	unsigned long dropped;	/* handed back unwritten */
+	char *error;
+
+	bool (*submit) (struct RECORDER_S *, Video *, const VideoFrame *);
+	int (*start) (struct RECORDER_S *);
+	void (*stop) (struct RECORDER_S *);
+} Recorder;
+
+Recorder *Recorder_newWith(const char *, unsigned int);
+void Recorder_dispose(Recorder *);
+
+#endif /* RECORDER_H_ */
@@ -0,0 +1,293 @@
+/**
+	This file is part of Intel Atom ISP Test App.
+
+	Intel Atom ISP Test App is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Intel Atom ISP Test App is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Intel Atom ISP Test App.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+#define _FILE_OFFSET_BITS 64	// recordings outgrow 2 GB on 32-bit builds
+
+#include "replay.h"
+#include "utilities.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/timerfd.h>
+
+#define DEFAULT_INTERVAL_USEC 33333	/* 30 fps, for recordings without timestamps */
+
+static int start(ReplaySource *self) {
+	self->next = 0;
+	self->loops = 0;
+	self->startedUsec = monotonicUsec();
+	self->dueUsec = self->startedUsec;
+	armTimerFdAt(self->fd, self->dueUsec);
+	return 1;
+}
+
+static void stop(ReplaySource *self) {
+	disarmTimerFd(self->fd);
+}
+
+/**
+ * Hands out the next entry once it is due, or NULL with errno EAGAIN
+ * before. _dueUsec gets when it fell due (CLOCK_MONOTONIC) and _sequence
+ * its sequence, counted from the recording's first and on across loops.
+ */
+static const RecordEntry *take(ReplaySource *self, long long *_dueUsec, unsigned int *_sequence) {
+	long long now = monotonicUsec();
+
+	drainTimerFd(self->fd);
+	if (now < self->dueUsec) {
+		armTimerFdAt(self->fd, self->dueUsec);
+		errno = EAGAIN;
+		return NULL;
+	}
+
+	const RecordEntry *entry = &self->entries[self->next];
+	*_dueUsec = (self->pace == REPLAY_PACE_FAST) ? now : self->dueUsec;
+	*_sequence = (entry->sequence - self->entries[0].sequence) + (unsigned int) (self->loops * self->sequenceSpan);
+
+	self->next += 1;
+	if (self->next == self->entriesCount) {
+		self->next = 0;
+		self->loops += 1;
+	}
+
+	if (self->pace == REPLAY_PACE_FAST) {
+		self->dueUsec = now;
+	} else {
+		self->dueUsec = self->startedUsec + ((long long) self->loops * self->loopUsec) + self->dueOffsets[self->next];
+	}
+	armTimerFdAt(self->fd, self->dueUsec);
+
+	// have the next frame read in while this one is in use
+	const RecordEntry *following = &self->entries[self->next];
+	uintptr_t pageMask = (uintptr_t) sysconf(_SC_PAGESIZE) - 1;
+	uintptr_t begin = (uintptr_t) (self->data + following->offset) & ~pageMask;
+	madvise((void *) begin, (uintptr_t) (self->data + following->offset + following->size) - begin, MADV_WILLNEED);
+
+	return entry;
+}
+
+static unsigned char *frameAt(ReplaySource *self, const RecordEntry *_entry) {
+	return self->data + _entry->offset;
+}
+
+static int loadIndex(ReplaySource *self) {
+	FILE *index = fopen(self->indexPath, "rb");
+	struct stat st;
+
+	if (index == NULL) {
+		sprintf(self->error, "Cannot open %s: %d, %s", self->indexPath, errno, strerror(errno));
+		return 0;
+	}
+
+	if (fread(&self->header, sizeof(self->header), 1, index) != 1 ||
+		memcmp(self->header.magic, RECORD_MAGIC, sizeof(self->header.magic)) != 0) {
+		sprintf(self->error, "%s is no recording index.", self->indexPath);
+		fclose(index);
+		return 0;
+	}
+
+	if (self->header.version != RECORD_VERSION || self->header.entrySize != sizeof(RecordEntry)) {
+		sprintf(self->error, "%s is version %u with %u byte entries; expected %d with %u.", self->indexPath,
+				self->header.version, self->header.entrySize, RECORD_VERSION, (unsigned int) sizeof(RecordEntry));
+		fclose(index);
+		return 0;
+	}
+
+	// a recording cut short may end in part of an entry; it is left out
+	fstat(fileno(index), &st);
+	self->entriesCount = (unsigned int) ((st.st_size - sizeof(RecordHeader)) / sizeof(RecordEntry));
+	if (self->entriesCount == 0) {
+		sprintf(self->error, "%s holds no frames.", self->indexPath);
+		fclose(index);
+		return 0;
+	}
+
+	self->entries = (RecordEntry *) malloc(self->entriesCount * sizeof(RecordEntry));
+	self->dueOffsets = (long long *) malloc(self->entriesCount * sizeof(long long));
+	if (self->entries == NULL || self->dueOffsets == NULL ||
+		fread(self->entries, sizeof(RecordEntry), self->entriesCount, index) != self->entriesCount) {
+		sprintf(self->error, "Cannot read %u frames from %s.", self->entriesCount, self->indexPath);
+		fclose(index);
+		return 0;
+	}
+
+	fclose(index);
+	return 1;
+}
+
+static int mapData(ReplaySource *self) {
+	struct stat st;
+
+	self->dataFd = open(self->path, O_RDONLY | O_CLOEXEC);
+	if (self->dataFd < 0 || fstat(self->dataFd, &st) < 0) {
+		sprintf(self->error, "Cannot open %s: %d, %s", self->path, errno, strerror(errno));
+		return 0;
+	}
+
+	if (st.st_size <= 0 || (unsigned long long) st.st_size > SIZE_MAX) {
+		sprintf(self->error, "Cannot map %s of %lld bytes.", self->path, (long long) st.st_size);
+		return 0;
+	}
+	self->dataSize = (size_t) st.st_size;
+
+	// private and writable, so a stage writing into a frame gets a copy of
+	// the page rather than a fault
+	self->data = (unsigned char *) mmap(NULL, self->dataSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, self->dataFd, 0);
+	if (self->data == MAP_FAILED) {
+		self->data = NULL;
+		sprintf(self->error, "Cannot map %s of %lld bytes: %d, %s", self->path, (long long) st.st_size,
+				errno, strerror(errno));
+		return 0;
+	}
+	madvise(self->data, self->dataSize, MADV_SEQUENTIAL);
+
+	return 1;
+}
+
+/**
+ * Every frame has to lie within the data file and look like the first, and
+ * gets the time it falls due at from its timestamp.
+ */
+static int checkEntries(ReplaySource *self) {
+	const RecordEntry *first = &self->entries[0];
+	const RecordEntry *last = &self->entries[self->entriesCount - 1];
+	long long latest = 0;
+	unsigned int i, p;
+
+	for (i = 0; i < self->entriesCount; i++) {
+		const RecordEntry *entry = &self->entries[i];
+
+		if (entry->offset < 0 || (unsigned long long) entry->offset + entry->size > self->dataSize) {
+			sprintf(self->error, "Frame %u of %s lies past its end.", i, self->path);
+			return 0;
+		}
+
+		if (entry->fourcc != first->fourcc || entry->width != first->width || entry->height != first->height ||
+			entry->planesCount != first->planesCount || entry->planesCount == 0 ||
+			entry->planesCount > RECORD_MAX_PLANES) {
+			sprintf(self->error, "Frame %u of %s is not laid out like the first.", i, self->path);
+			return 0;
+		}
+
+		for (p = 0; p < entry->planesCount; p++) {
+			if ((unsigned long long) entry->planes[p].offset + entry->planes[p].length > entry->size) {
+				sprintf(self->error, "Plane %u of frame %u of %s lies past the frame.", p, i, self->path);
+				return 0;
+			}
+		}
+
+		// a timestamp going back does not move its frame ahead of the ones before
+		long long offset = entry->timestamp - first->timestamp;
+		latest = (offset > latest) ? offset : latest;
+		self->dueOffsets[i] = latest;
+	}
+
+	long long interval = DEFAULT_INTERVAL_USEC;
+	if (latest > 0) {
+		interval = latest / (self->entriesCount - 1);
+	} else {
+		// no timestamps to go by
+		for (i = 0; i < self->entriesCount; i++) {
+			self->dueOffsets[i] = i * interval;
+		}
+	}
+	self->loopUsec = self->dueOffsets[self->entriesCount - 1] + interval;
+
+	self->sequenceSpan = (last->sequence >= first->sequence) ? last->sequence - first->sequence + 1 : self->entriesCount;
+
+	return 1;
+}
+
+static void ReplaySource_init(ReplaySource *self, const char *_path, ReplayPace_t _pace) {
+	self->path = strdup(_path);
+	self->indexPath = (char *) calloc(strlen(_path) + sizeof(RECORD_INDEX_SUFFIX), sizeof(char));
+	sprintf(self->indexPath, "%s%s", _path, RECORD_INDEX_SUFFIX);
+	self->pace = _pace;
+	self->fd = -1;
+	self->dataFd = -1;
+	self->data = NULL;
+	self->dataSize = 0;
+	self->entries = NULL;
+	self->entriesCount = 0;
+	self->dueOffsets = NULL;
+	self->loopUsec = 0;
+	self->sequenceSpan = 0;
+	self->startedUsec = 0;
+	self->dueUsec = 0;
+	self->next = 0;
+	self->loops = 0;
+	self->error = (char *) calloc(256, sizeof(char));
+
+	// methods
+	self->start = start;
+	self->stop = stop;
+	self->take = take;
+	self->frameAt = frameAt;
+
+	if (!loadIndex(self) || !mapData(self) || !checkEntries(self)) {
+		return;
+	}
+
+	self->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (self->fd < 0) {
+		sprintf(self->error, "timerfd_create: %d, %s", errno, strerror(errno));
+	}
+}
+
+/**
+ * _path is the data file; its index is _path + ".idx". Check fd (and
+ * error) on the returned object; it is -1 when the recording cannot be
+ * played back.
+ */
+ReplaySource *ReplaySource_newWith(const char *_path, ReplayPace_t _pace) {
+	ReplaySource *replay = (ReplaySource *) calloc(1, sizeof(ReplaySource));
+	ReplaySource_init(replay, _path, _pace);
+	return replay;
+}
+
+void ReplaySource_dispose(ReplaySource *self) {
+	if (self == NULL) {
+		return;
+	}
+
+	if (self->fd >= 0) {
+		close(self->fd);
+	}
+	if (self->data != NULL) {
+		munmap(self->data, self->dataSize);
+	}
+	if (self->dataFd >= 0) {
+		close(self->dataFd);
+	}
+
+	free(self->entries);
+	free(self->dueOffsets);
+	free(self->path);
+	free(self->indexPath);
+	free(self->error);
+	free(self);
+}
@@ -0,0 +1,74 @@
+/**
+	This file is part of Intel Atom ISP Test App.
+
+	Intel Atom ISP Test App is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Intel Atom ISP Test App is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Intel Atom ISP Test App.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef REPLAY_H_
+#define REPLAY_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "record_format.h"
+
+typedef enum REPLAY_PACE {
+	REPLAY_PACE_RECORDED,	/* frames fall due as far apart as they were captured */
+	REPLAY_PACE_FAST		/* each frame is due as soon as the one before is taken */
+} ReplayPace_t;
+
+/**
+ * Plays back a recording (see record_format.h) as if it came from a camera.
+ *
+ * The data file is mapped once and frames are handed out where they lie in
+ * the mapping, so nothing is copied or read ahead into buffers of its own.
+ * fd is a timerfd that turns readable when the next frame falls due; it can
+ * be polled like a capture device. The recording loops: after its last
+ * frame comes its first again, one frame interval later.
+ *
+ * No frame is ever skipped. A consumer that falls behind the recorded pace
+ * gets every frame late rather than fewer frames, so two runs over the same
+ * recording see the same frames in the same order.
+ */
+typedef struct REPLAY_SOURCE_S {
+	char *path;
+	char *indexPath;
+	ReplayPace_t pace;
+	int fd;					/* timerfd on CLOCK_MONOTONIC */
+	int dataFd;
+	unsigned char *data;	/* the whole data file */
+	size_t dataSize;
+	RecordHeader header;
+	RecordEntry *entries;
+	unsigned int entriesCount;
+	long long *dueOffsets;	/* usec of each entry from the first, never decreasing */
+	long long loopUsec;		/* one pass, including the interval back to the first frame */
+	unsigned int sequenceSpan;	/* recorded sequences one pass covers */
+
+	long long startedUsec;	/* CLOCK_MONOTONIC of the first frame of the first pass */
+	long long dueUsec;		/* when next falls due */
+	unsigned int next;
+	unsigned long loops;	/* passes completed */
+	char *error;
+
+	int (*start) (struct REPLAY_SOURCE_S *);
+	void (*stop) (struct REPLAY_SOURCE_S *);
+	const RecordEntry *(*take) (struct REPLAY_SOURCE_S *, long long *, unsigned int *);
+	unsigned char *(*frameAt) (struct REPLAY_SOURCE_S *, const RecordEntry *);
+} ReplaySource;
+
+ReplaySource *ReplaySource_newWith(const char *, ReplayPace_t);
+void ReplaySource_dispose(ReplaySource *);
+
+#endif /* REPLAY_H_ */
@@ -0,0 +1,92 @@
+/**
+	This file is part of Intel Atom ISP Test App.
+
+	Intel Atom ISP Test App is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Intel Atom ISP Test App is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Intel Atom ISP Test App.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "samples.h"
+
+#include <stdlib.h>
+
+static void add(Samples *self, long long _value) {
+	if (self->count == self->size) {
+		self->size = (self->size > 0) ? self->size * 2 : SAMPLES_INITIAL_SIZE;
+		self->values = (long long *) realloc(self->values, self->size * sizeof(long long));
+	}
+	self->values[self->count++] = _value;
+	self->isSorted = false;
+}
+
+static int compareValues(const void *_a, const void *_b) {
+	long long a = *(const long long *) _a;
+	long long b = *(const long long *) _b;
+	return (a > b) - (a < b);
+}
+
+static void sort(Samples *self) {
+	if (!self->isSorted) {
+		qsort(self->values, self->count, sizeof(long long), compareValues);
+		self->isSorted = true;
+	}
+}
+
+/**
+ * Nearest rank; 0 without samples.
+ */
+static long long percentile(Samples *self, unsigned int _percent) {
+	if (self->count == 0) {
+		return 0;
+	}
+
+	sort(self);
+	size_t rank = (self->count * _percent + 99) / 100;
+	return self->values[(rank > 0) ? rank - 1 : 0];
+}
+
+static long long max(Samples *self) {
+	return percentile(self, 100);
+}
+
+static void clear(Samples *self) {
+	self->count = 0;
+	self->isSorted = true;
+}
+
+static void Samples_init(Samples *self) {
+	self->values = NULL;
+	self->count = 0;
+	self->size = 0;
+	self->isSorted = true;
+
+	// methods
+	self->add = add;
+	self->percentile = percentile;
+	self->max = max;
+	self->clear = clear;
+}
+
+Samples *Samples_new() {
+	Samples *samples = (Samples *) calloc(1, sizeof(Samples));
+	Samples_init(samples);
+	return samples;
+}
+
+void Samples_dispose(Samples *self) {
+	if (self == NULL) {
+		return;
+	}
+
+	free(self->values);
+	free(self);
+}
@@ -0,0 +1,44 @@
+/**
+	This file is part of Intel Atom ISP Test App.
+
+	Intel Atom ISP Test App is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Intel Atom ISP Test App is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Intel Atom ISP Test App.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SAMPLES_H_
+#define SAMPLES_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#define SAMPLES_INITIAL_SIZE 1024
+
+/**
+ * A growing list of measurements for percentile summaries.
+ */
+typedef struct SAMPLES_S {
+	long long *values;
+	size_t count;
+	size_t size;
+	bool isSorted;
+
+	void (*add) (struct SAMPLES_S *, long long);
+	long long (*percentile) (struct SAMPLES_S *, unsigned int);
+	long long (*max) (struct SAMPLES_S *);
+	void (*clear) (struct SAMPLES_S *);
+} Samples;
+
+Samples *Samples_new();
+void Samples_dispose(Samples *);
+
+#endif /* SAMPLES_H_ */
@@ -164,6 +164,7 @@ static int loadBuiltInFragmentShader(Shader *self, PixelFormat_t _format) {
 	case YV16:
 		return loadFragmentShader(self, "yv16");
 	case RGBP:
+	case BA10:		// demosaiced to RGBA on the CPU
 		return loadFragmentShader(self, "rgb_passthru");
 	case NV12:
 		return loadFragmentShader(self, "nv12");
@@ -182,6 +183,67 @@ static int loadDefaultFragmentShader(Shader *self) {
 	return loadBuiltInFragmentShader(self, YUYV);
 }
 
+static GLuint compileShader(Shader *self, GLenum _type, Str *_source, Str *_file) {
+	GLuint shader = glCreateShader(_type);
+	GLint status;
+
+	glShaderSource(shader, 1, (const char **) &_source->str, NULL);
+	glCompileShader(shader);
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+
+	if (!status) {
+		char shaderLog[SHADER_ERROR_SIZE / 2];
+		glGetShaderInfoLog(shader, sizeof(shaderLog), NULL, shaderLog);
+		snprintf(self->error, SHADER_ERROR_SIZE, "Error Compiling %s: %s", _file->str, shaderLog);
+		glDeleteShader(shader);
+		return 0;
+	}
+
+	return shader;
+}
+
+/**
+ * Compiles and links the loaded shaders with a GL context current. The
+ * program keeps pos, color and itexcoord at attribute locations 0, 1, 2.
+ */
+static int buildProgram(Shader *self) {
+	GLuint fragShader = compileShader(self, GL_FRAGMENT_SHADER, self->fragmentShader, self->fragmentShaderFile);
+	if (fragShader == 0) {
+		return 0;
+	}
+
+	GLuint vertShader = compileShader(self, GL_VERTEX_SHADER, self->vertexShader, self->vertexShaderFile);
+	if (vertShader == 0) {
+		glDeleteShader(fragShader);
+		return 0;
+	}
+
+	GLuint program = glCreateProgram();
+	GLint status;
+	glAttachShader(program, fragShader);
+	glAttachShader(program, vertShader);
+	glBindAttribLocation(program, 0, "pos");
+	glBindAttribLocation(program, 1, "color");
+	glBindAttribLocation(program, 2, "itexcoord");
+	glLinkProgram(program);
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
+
+	// the program holds on to them until it is deleted itself
+	glDeleteShader(fragShader);
+	glDeleteShader(vertShader);
+
+	if (!status) {
+		char programLog[SHADER_ERROR_SIZE / 2];
+		glGetProgramInfoLog(program, sizeof(programLog), NULL, programLog);
+		snprintf(self->error, SHADER_ERROR_SIZE, "Error Linking Shader: %s", programLog);
+		glDeleteProgram(program);
+		return 0;
+	}
+
+	self->program = program;
+	return 1;
+}
+
 static void Shader_init(Shader *self, const char *_vertexPath, const char *_fragPath) {
 	if (strlen(_vertexPath) <= 0) {
 		int size = strlen(vertexShadersPath)+1;
@@ -208,7 +270,8 @@ static void Shader_init(Shader *self, const char *_vertexPath, const char *_frag
 
 	self->vertexShader = Str_new();
 	self->fragmentShader = Str_new();
-	self->error = (char *) calloc(256, sizeof(char));
+	self->program = 0;
+	self->error = (char *) calloc(SHADER_ERROR_SIZE, sizeof(char));
 
 	// methods
 	self->loadVertexShader = loadVertexShader;
@@ -216,6 +279,7 @@ static void Shader_init(Shader *self, const char *_vertexPath, const char *_frag
 	self->loadDefaultVertexShader = loadDefaultVertexShader;
 	self->loadBuiltInFragmentShader = loadBuiltInFragmentShader;
 	self->loadDefaultFragmentShader = loadDefaultFragmentShader;
+	self->buildProgram = buildProgram;
 }
 
 Shader *Shader_new() {
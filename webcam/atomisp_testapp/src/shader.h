@@ -23,6 +23,10 @@
 
 #include <stdbool.h>
 
+#include <GLES2/gl2.h>
+
+#define SHADER_ERROR_SIZE 256
+
 typedef enum SHADER_TYPE {
 	VERTEX, FRAGMENT
 } ShaderType_t;
@@ -38,11 +42,14 @@ typedef struct SHADER_S {
 	struct STR_S *vertexShader;
 	struct STR_S *fragmentShader;
 
+	GLuint program;		/* 0 until buildProgram() succeeds */
+
 	int (*loadVertexShader) (struct SHADER_S *, const char*);
 	int (*loadDefaultVertexShader) (struct SHADER_S *);
 	int (*loadFragmentShader) (struct SHADER_S *, const char*);
 	int (*loadDefaultFragmentShader) (struct SHADER_S *);
 	int (*loadBuiltInFragmentShader) (struct SHADER_S *, PixelFormat_t);
+	int (*buildProgram) (struct SHADER_S *);
 } Shader;
 
 Shader *Shader_new();
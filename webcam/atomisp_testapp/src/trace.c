@@ -0,0 +1,301 @@
+/**
+	This file is part of Intel Atom ISP Test App.
+
+	Intel Atom ISP Test App is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Intel Atom ISP Test App is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Intel Atom ISP Test App.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+long long Trace_usecOf(const struct timespec *_time) {
+	return ((long long) _time->tv_sec * 1000000LL) + (_time->tv_nsec / 1000);
+}
+
+static bool record(TraceRing *self, const TraceRecord *_record) {
+	unsigned int head = self->head;
+	unsigned int tail = __atomic_load_n(&self->tail, __ATOMIC_ACQUIRE);
+
+	if (head - tail >= self->capacity) {
+		// flusher is behind; lose the record rather than wait for it
+		__atomic_add_fetch(&self->lost, 1, __ATOMIC_RELAXED);
+		return false;
+	}
+
+	self->records[head & self->mask] = *_record;
+	__atomic_store_n(&self->head, head + 1, __ATOMIC_RELEASE);
+	return true;
+}
+
+/**
+ * Records a span from _begin to now.
+ */
+static void span(TraceRing *self, TraceSpan_t _span, const struct timespec *_begin,
+				 unsigned int _sequence, unsigned int _argument) {
+	TraceRecord entry;
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	memset(&entry, 0, sizeof(entry));
+	entry.event = TRACE_EVENT_SPAN;
+	entry.stream = self->id;
+	entry.sequence = _sequence;
+	entry.span = _span;
+	entry.argument = _argument;
+	entry.begin = ((long long) _begin->tv_sec * 1000000000LL) + _begin->tv_nsec;
+	entry.end = ((long long) now.tv_sec * 1000000000LL) + now.tv_nsec;
+
+	record(self, &entry);
+}
+
+static TraceRing *TraceRing_newWith(unsigned int _id, const char *_name, unsigned int _capacity) {
+	TraceRing *ring = (TraceRing *) calloc(1, sizeof(TraceRing));
+	unsigned int slots = 1;
+
+	// round up to a power of two so the index wraps with a mask
+	while (slots < _capacity) {
+		slots <<= 1;
+	}
+
+	ring->id = _id;
+	snprintf(ring->name, sizeof(ring->name), "%s", _name);
+	ring->capacity = slots;
+	ring->mask = slots - 1;
+	ring->records = (TraceRecord *) calloc(slots, sizeof(TraceRecord));
+	ring->head = 0;
+	ring->tail = 0;
+	ring->lost = 0;
+	ring->reportedLost = 0;
+
+	// methods
+	ring->record = record;
+	ring->span = span;
+
+	return ring;
+}
+
+static void TraceRing_dispose(TraceRing *self) {
+	if (self == NULL) {
+		return;
+	}
+
+	free(self->records);
+	free(self);
+}
+
+/**
+ * Writes what the ring holds now, in at most two runs, then hands the
+ * slots back to the producer.
+ */
+static void drainRing(Tracer *self, TraceRing *_ring) {
+	unsigned int tail = _ring->tail;
+	unsigned int head = __atomic_load_n(&_ring->head, __ATOMIC_ACQUIRE);
+	unsigned int count = head - tail;
+
+	while (count > 0) {
+		unsigned int start = tail & _ring->mask;
+		unsigned int run = _ring->capacity - start;
+		if (run > count) {
+			run = count;
+		}
+
+		fwrite(&_ring->records[start], sizeof(TraceRecord), run, self->file);
+		self->written += run;
+		tail += run;
+		count -= run;
+	}
+	__atomic_store_n(&_ring->tail, tail, __ATOMIC_RELEASE);
+
+	unsigned long lost = __atomic_load_n(&_ring->lost, __ATOMIC_RELAXED);
+	if (lost > _ring->reportedLost) {
+		TraceRecord marker;
+		memset(&marker, 0, sizeof(marker));
+		marker.event = TRACE_EVENT_LOST;
+		marker.stream = _ring->id;
+		marker.frame = lost - _ring->reportedLost;
+
+		fwrite(&marker, sizeof(marker), 1, self->file);
+		self->lost += lost - _ring->reportedLost;
+		_ring->reportedLost = lost;
+	}
+}
+
+static void drainAll(Tracer *self) {
+	unsigned int i;
+
+	for (i = 0; i < self->ringsCount; i++) {
+		drainRing(self, self->rings[i]);
+	}
+	fflush(self->file);
+}
+
+static void *flushThread(void *_data) {
+	Tracer *self = (Tracer *) _data;
+	struct timespec deadline;
+
+	while (!__atomic_load_n(&self->isStopping, __ATOMIC_ACQUIRE)) {
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_nsec += TRACE_FLUSH_PERIOD_MS * 1000000L;
+		while (deadline.tv_nsec >= 1000000000L) {
+			deadline.tv_sec += 1;
+			deadline.tv_nsec -= 1000000000L;
+		}
+
+		// woken early only by stop()
+		while (sem_timedwait(&self->wake, &deadline) < 0 && errno == EINTR) {
+			// retry
+		}
+
+		drainAll(self);
+	}
+
+	return NULL;
+}
+
+/**
+ * Only call before start(); the flusher walks the rings without a lock.
+ */
+static TraceRing *addRing(Tracer *self, const char *_name) {
+	if (self->isRunning) {
+		sprintf(self->error, "Cannot add a trace ring while flushing.");
+		return NULL;
+	}
+
+	if (self->ringsCount >= TRACE_MAX_RINGS) {
+		sprintf(self->error, "Cannot trace more than %d threads.", TRACE_MAX_RINGS);
+		return NULL;
+	}
+
+	TraceRing *ring = TraceRing_newWith(self->ringsCount, _name, self->ringCapacity);
+	self->rings[self->ringsCount++] = ring;
+	return ring;
+}
+
+static int start(Tracer *self) {
+	if (self->file == NULL) {
+		return 0;
+	}
+
+	if (self->isRunning) {
+		return 1;
+	}
+
+	// the flusher is not running yet; name the rings ahead of their records
+	unsigned int i;
+	for (i = 0; i < self->ringsCount; i++) {
+		TraceRingName ringName;
+		memset(&ringName, 0, sizeof(ringName));
+		ringName.event = TRACE_EVENT_RING;
+		ringName.ring = self->rings[i]->id;
+		snprintf(ringName.name, sizeof(ringName.name), "%s", self->rings[i]->name);
+		fwrite(&ringName, sizeof(ringName), 1, self->file);
+	}
+
+	self->isStopping = false;
+	if (0 != pthread_create(&self->thread, NULL, flushThread, self)) {
+		sprintf(self->error, "Cannot start the trace flusher.");
+		return 0;
+	}
+	self->isRunning = true;
+
+	return 1;
+}
+
+/**
+ * Stops the flusher after one last drain. Stop the recording threads first
+ * or their latest records may miss the file.
+ */
+static void stop(Tracer *self) {
+	if (!self->isRunning) {
+		return;
+	}
+
+	__atomic_store_n(&self->isStopping, true, __ATOMIC_RELEASE);
+	sem_post(&self->wake);
+	pthread_join(self->thread, NULL);
+	self->isRunning = false;
+
+	drainAll(self);
+}
+
+static void Tracer_init(Tracer *self, const char *_path, unsigned int _ringCapacity) {
+	self->path = strdup(_path);
+	self->ringCapacity = (_ringCapacity > 0) ? _ringCapacity : TRACE_RING_DEFAULT_CAPACITY;
+	self->ringsCount = 0;
+	self->isRunning = false;
+	self->isStopping = false;
+	self->written = 0;
+	self->lost = 0;
+	self->error = (char *) calloc(256, sizeof(char));
+	sem_init(&self->wake, 0, 0);
+
+	// methods
+	self->addRing = addRing;
+	self->start = start;
+	self->stop = stop;
+
+	self->file = fopen(_path, "wb");
+	if (self->file == NULL) {
+		sprintf(self->error, "Cannot open %s: %d, %s", _path, errno, strerror(errno));
+		return;
+	}
+
+	TraceHeader header;
+	struct timespec now;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+	header.version = TRACE_VERSION;
+	header.recordSize = sizeof(TraceRecord);
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	header.started = Trace_usecOf(&now);
+	fwrite(&header, sizeof(header), 1, self->file);
+}
+
+/**
+ * Check file (and error) on the returned object; without a file nothing is
+ * flushed and the rings just fill up.
+ */
+Tracer *Tracer_newWith(const char *_path, unsigned int _ringCapacity) {
+	Tracer *tracer = (Tracer *) calloc(1, sizeof(Tracer));
+	Tracer_init(tracer, _path, _ringCapacity);
+	return tracer;
+}
+
+void Tracer_dispose(Tracer *self) {
+	if (self == NULL) {
+		return;
+	}
+
+	stop(self);
+
+	unsigned int i;
+	for (i = 0; i < self->ringsCount; i++) {
+		TraceRing_dispose(self->rings[i]);
+	}
+
+	if (self->file != NULL) {
+		fclose(self->file);
+	}
+
+	sem_destroy(&self->wake);
+	free(self->path);
+	free(self->error);
+	free(self);
+}
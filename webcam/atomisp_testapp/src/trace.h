@@ -0,0 +1,181 @@
+/**
+	This file is part of Intel Atom ISP Test App.
+
+	Intel Atom ISP Test App is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Intel Atom ISP Test App is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Intel Atom ISP Test App.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#define TRACE_MAGIC "ISPTRACE"
+#define TRACE_VERSION 3
+#define TRACE_MAX_RINGS 16
+#define TRACE_NAME_LENGTH 32
+#define TRACE_RING_DEFAULT_CAPACITY 4096
+#define TRACE_FLUSH_PERIOD_MS 250
+
+typedef enum TRACE_EVENT {
+	TRACE_EVENT_CAPTURE = 1,	/* a capture thread dequeued a frame */
+	TRACE_EVENT_FRAME,			/* the render loop presented a frame */
+	TRACE_EVENT_LOST,			/* a ring was full; frame holds how many records were lost */
+	TRACE_EVENT_SPAN,			/* a stage of a thread; built with -DTRACE_SPANS only */
+	TRACE_EVENT_RING			/* a TraceRingName */
+} TraceEvent_t;
+
+typedef enum TRACE_SPAN {
+	TRACE_SPAN_DEQUEUE = 1,		/* VIDIOC_DQBUF of a capture thread */
+	TRACE_SPAN_WAIT,			/* render loop waiting for a captured frame */
+	TRACE_SPAN_UPLOAD,			/* glTexSubImage2D of one plane */
+	TRACE_SPAN_BIND,			/* binding an imported DMA buffer */
+	TRACE_SPAN_DRAW,
+	TRACE_SPAN_SWAP,			/* eglSwapBuffers */
+	TRACE_SPAN_WAYLAND,			/* waylandRun */
+	TRACE_SPAN_PREVIEW			/* render loop waiting for the preview's tiles */
+} TraceSpan_t;
+
+/**
+ * One event as written to the trace file. Times are usec of CLOCK_MONOTONIC,
+ * the clock of the driver timestamps, so they subtract from one another.
+ * The layout is the same for 32- and 64-bit builds; the file is in the
+ * byte order of the machine that wrote it.
+ */
+typedef struct TRACE_RECORD_S {
+	uint16_t event;
+	uint16_t stream;
+	uint32_t sequence;		/* driver's */
+	uint32_t flags;			/* driver's */
+	uint32_t queueDepth;
+	int64_t frame;
+	int64_t timestamp;		/* driver's */
+	int64_t dequeued;
+	int64_t uploadStarted;
+	int64_t uploadEnded;
+	int64_t presented;
+	int64_t waited;			/* usec the render loop waited for the frame */
+	int64_t rendered;		/* usec spent drawing and presenting it */
+	uint32_t captured;		/* frames dequeued by the stream so far */
+	uint32_t dropped;		/* frames the stream's ring dropped so far */
+	uint32_t skipped;
+	uint32_t driverDropped;
+	uint32_t span;			/* TraceSpan_t */
+	uint32_t argument;		/* plane of an upload */
+	int64_t begin;			/* nsec; spans can be shorter than a usec */
+	int64_t end;
+	int64_t drawn;			/* after drawing, before the buffer swap */
+	uint32_t textureSet;	/* of the ring the frame was uploaded into */
+	uint32_t textureSets;	/* depth of that ring */
+} TraceRecord;
+
+/**
+ * Names the thread of a ring. Written in place of a TraceRecord, once per
+ * ring, before any of the ring's records.
+ */
+typedef struct TRACE_RING_NAME_S {
+	uint16_t event;
+	uint16_t ring;
+	char name[sizeof(TraceRecord) - 4];
+} TraceRingName;
+
+typedef struct TRACE_HEADER_S {
+	char magic[8];
+	uint32_t version;
+	uint32_t recordSize;
+	int64_t started;
+} TraceHeader;
+
+/**
+ * Single-producer/single-consumer ring of records. Each recording thread
+ * owns one ring; the flusher is the only consumer. Recording never blocks
+ * and makes no system call: when the ring is full the record is lost and
+ * counted.
+ */
+typedef struct TRACE_RING_S {
+	unsigned int id;
+	char name[TRACE_NAME_LENGTH];
+	unsigned int capacity;	/* power of two */
+	unsigned int mask;
+	TraceRecord *records;
+
+	unsigned int head;		/* written by the producer only */
+	unsigned int tail;		/* written by the flusher only */
+	unsigned long lost;
+	unsigned long reportedLost;	/* flusher only */
+
+	bool (*record) (struct TRACE_RING_S *, const TraceRecord *);
+	void (*span) (struct TRACE_RING_S *, TraceSpan_t, const struct timespec *, unsigned int, unsigned int);
+} TraceRing;
+
+/**
+ * Spans cost two clock reads and a record each, so they are only built with
+ * -DTRACE_SPANS; without it these expand to nothing and their arguments are
+ * never evaluated.
+ *
+ *   TRACE_SPAN_BEGIN(begin);
+ *   eglSwapBuffers(...);
+ *   TRACE_SPAN_END(ring, TRACE_SPAN_SWAP, begin, sequence, 0);
+ */
+#ifdef TRACE_SPANS
+#define TRACE_SPAN_BEGIN(_begin) \
+	struct timespec _begin; \
+	clock_gettime(CLOCK_MONOTONIC, &_begin)
+#define TRACE_SPAN_END(_ring, _span, _begin, _sequence, _argument) \
+	do { \
+		if ((_ring) != NULL) { \
+			(_ring)->span((_ring), (_span), &(_begin), (_sequence), (_argument)); \
+		} \
+	} while (0)
+#else
+#define TRACE_SPAN_BEGIN(_begin)
+#define TRACE_SPAN_END(_ring, _span, _begin, _sequence, _argument) do { } while (0)
+#endif
+
+/**
+ * Drains every ring into a binary trace file from a background thread, so
+ * the threads being measured never write to the file themselves.
+ *
+ * Add all rings before start(); stop() writes whatever is still queued.
+ * isp-trace turns the file into CSV and latency percentiles.
+ */
+typedef struct TRACER_S {
+	char *path;
+	FILE *file;
+	unsigned int ringCapacity;
+	unsigned int ringsCount;
+	TraceRing *rings[TRACE_MAX_RINGS];
+
+	pthread_t thread;
+	bool isRunning;
+	bool isStopping;
+	sem_t wake;
+	unsigned long written;
+	unsigned long lost;
+	char *error;
+
+	TraceRing *(*addRing) (struct TRACER_S *, const char *);
+	int (*start) (struct TRACER_S *);
+	void (*stop) (struct TRACER_S *);
+} Tracer;
+
+long long Trace_usecOf(const struct timespec *);
+Tracer *Tracer_newWith(const char *, unsigned int);
+void Tracer_dispose(Tracer *);
+
+#endif /* TRACE_H_ */
@@ -0,0 +1,138 @@
+/**
+	This file is part of Intel Atom ISP Test App.
+
+	Intel Atom ISP Test App is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Intel Atom ISP Test App is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Intel Atom ISP Test App.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "userptr_pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define ERRSTR strerror(errno)
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+#define ALIGN_TO(x, a) (((x) + ((a) - 1)) & ~((size_t) (a) - 1))
+
+#ifndef MAP_HUGETLB
+#define MAP_HUGETLB 0x40000
+#endif
+
+static void *bufferAt(UserPtrPool *self, unsigned int _index) {
+	if (_index >= self->count) {
+		return NULL;
+	}
+	return (unsigned char *) self->base + (_index * self->bufferStride);
+}
+
+static void *mapPool(size_t _length, int _extraFlags) {
+	int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE | _extraFlags;
+#ifdef I64
+	// keep the same 32-bit addressing as the MMAP buffers
+	flags |= MAP_32BIT;
+#endif
+	return mmap(NULL, _length, PROT_READ | PROT_WRITE, flags, -1, 0);
+}
+
+static int UserPtrPool_init(UserPtrPool *self, unsigned int _count, size_t _bufferSize, int _flags) {
+	size_t pageSize = (size_t) sysconf(_SC_PAGESIZE);
+
+	self->count = _count;
+	self->bufferSize = _bufferSize;
+	self->bufferStride = ALIGN_TO(_bufferSize, pageSize);
+	self->length = self->bufferStride * _count;
+	self->base = MAP_FAILED;
+	self->isHugeTLB = false;
+	self->isTransparentHugePage = false;
+	self->isLocked = false;
+	self->error = (char *) calloc(256, sizeof(char));
+
+	// methods
+	self->bufferAt = bufferAt;
+
+	if (_count == 0 || _bufferSize == 0) {
+		sprintf(self->error, "UserPtrPool: invalid pool of %u x %zu bytes.", _count, _bufferSize);
+		return 0;
+	}
+
+	if (_flags & USERPTR_POOL_HUGETLB) {
+		size_t hugeLength = ALIGN_TO(self->length, HUGE_PAGE_SIZE);
+		self->base = mapPool(hugeLength, MAP_HUGETLB);
+		if (self->base != MAP_FAILED) {
+			self->length = hugeLength;
+			self->isHugeTLB = true;
+		}
+	}
+
+	if (self->base == MAP_FAILED) {
+		// no reserved huge pages; fall back to normal pages
+		self->base = mapPool(self->length, 0);
+		if (self->base == MAP_FAILED) {
+			sprintf(self->error, "UserPtrPool: mmap of %zu bytes: %s", self->length, ERRSTR);
+			return 0;
+		}
+
+#ifdef MADV_HUGEPAGE
+		if ((_flags & (USERPTR_POOL_HUGETLB | USERPTR_POOL_THP)) &&
+			0 == madvise(self->base, self->length, MADV_HUGEPAGE)) {
+			self->isTransparentHugePage = true;
+		}
+#endif
+	}
+
+	// MAP_POPULATE is only a hint; touch every page so none faults in the driver
+	size_t offset;
+	for (offset = 0; offset < self->length; offset += pageSize) {
+		((volatile unsigned char *) self->base)[offset] = 0;
+	}
+
+	if (_flags & USERPTR_POOL_LOCK) {
+		// RLIMIT_MEMLOCK may refuse this; the pool still works unlocked
+		self->isLocked = (0 == mlock(self->base, self->length));
+	}
+
+	return 1;
+}
+
+/**
+ * Returns NULL only when out of memory. Check error on the returned pool:
+ * base is MAP_FAILED when the mapping could not be created.
+ */
+UserPtrPool *UserPtrPool_newWith(unsigned int _count, size_t _bufferSize, int _flags) {
+	UserPtrPool *pool = (UserPtrPool *) calloc(1, sizeof(UserPtrPool));
+	if (pool == NULL) {
+		return NULL;
+	}
+	UserPtrPool_init(pool, _count, _bufferSize, _flags);
+	return pool;
+}
+
+void UserPtrPool_dispose(UserPtrPool *self) {
+	if (self == NULL) {
+		return;
+	}
+
+	if (self->base != MAP_FAILED) {
+		if (self->isLocked) {
+			munlock(self->base, self->length);
+		}
+		munmap(self->base, self->length);
+	}
+
+	free(self->error);
+	free(self);
+}
@@ -0,0 +1,52 @@
+/**
+	This file is part of Intel Atom ISP Test App.
+
+	Intel Atom ISP Test App is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Intel Atom ISP Test App is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Intel Atom ISP Test App.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef USERPTR_POOL_H_
+#define USERPTR_POOL_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define USERPTR_POOL_HUGETLB	0x01	/* try MAP_HUGETLB first */
+#define USERPTR_POOL_THP		0x02	/* madvise(MADV_HUGEPAGE) when not hugetlb */
+#define USERPTR_POOL_LOCK		0x04	/* mlock() the whole pool */
+
+/**
+ * Application-owned capture memory for V4L2_MEMORY_USERPTR.
+ *
+ * All buffers live in one mapping. Every buffer starts on a page boundary and
+ * the whole pool is pre-faulted at creation, so the first frames do not pay
+ * for page faults inside the driver.
+ */
+typedef struct USERPTR_POOL_S {
+	unsigned int count;
+	size_t bufferSize;	/* requested size of one buffer */
+	size_t bufferStride;	/* distance between buffers; page aligned */
+	size_t length;		/* length of the whole mapping */
+	void *base;
+	bool isHugeTLB;
+	bool isTransparentHugePage;
+	bool isLocked;
+	char *error;
+
+	void *(*bufferAt) (struct USERPTR_POOL_S *, unsigned int);
+} UserPtrPool;
+
+UserPtrPool *UserPtrPool_newWith(unsigned int, size_t, int);
+void UserPtrPool_dispose(UserPtrPool *);
+
+#endif /* USERPTR_POOL_H_ */
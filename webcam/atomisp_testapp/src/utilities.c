@@ -20,3 +20,74 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+/**
+ * Looks for _name in a space-separated EGL or GL extension string. Whole
+ * names only; GL_OES_EGL_image must not match GL_OES_EGL_image_external.
+ */
+bool hasExtension(const char *_extensions, const char *_name) {
+	if (_extensions == NULL) {
+		return false;
+	}
+
+	size_t length = strlen(_name);
+	const char *found = _extensions;
+	while ((found = strstr(found, _name)) != NULL) {
+		if ((found == _extensions || found[-1] == ' ') &&
+			(found[length] == ' ' || found[length] == '\0')) {
+			return true;
+		}
+		found += length;
+	}
+
+	return false;
+}
+
+/**
+ * usec of CLOCK_MONOTONIC, the clock of the driver timestamps and the traces.
+ */
+long long monotonicUsec(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((long long) now.tv_sec * 1000000LL) + (now.tv_nsec / 1000);
+}
+
+/**
+ * Makes the CLOCK_MONOTONIC timerfd _fd readable at _dueUsec; at once when
+ * that has passed already.
+ */
+void armTimerFdAt(int _fd, long long _dueUsec) {
+	struct itimerspec spec;
+	// an all zero time disarms instead
+	long long due = (_dueUsec > 0) ? _dueUsec : 1;
+
+	memset(&spec, 0, sizeof(spec));
+	spec.it_value.tv_sec = due / 1000000LL;
+	spec.it_value.tv_nsec = (due % 1000000LL) * 1000;
+	timerfd_settime(_fd, TFD_TIMER_ABSTIME, &spec, NULL);
+}
+
+/**
+ * Stops _fd firing and drops an expiration nobody read yet.
+ */
+void disarmTimerFd(int _fd) {
+	struct itimerspec spec;
+	memset(&spec, 0, sizeof(spec));
+	timerfd_settime(_fd, 0, &spec, NULL);
+	drainTimerFd(_fd);
+}
+
+/**
+ * Reads the expirations of a non-blocking timerfd so it stops being readable.
+ */
+void drainTimerFd(int _fd) {
+	uint64_t expirations;
+	if (read(_fd, &expirations, sizeof(expirations)) < 0) {
+		// EAGAIN: it had not fired
+	}
+}
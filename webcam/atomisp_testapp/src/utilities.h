@@ -18,6 +18,8 @@
 #ifndef UTILITIES_H_
 #define UTILITIES_H_
 
+#include <stdbool.h>
+
 typedef enum PIXEL_FORMAT {
 	YVYU,
 	YUYV,
@@ -31,5 +33,10 @@ typedef enum PIXEL_FORMAT {
 } PixelFormat_t;
 
 int strWithFormat(char**, const char*, ...);
+bool hasExtension(const char *, const char *);
+long long monotonicUsec(void);
+void armTimerFdAt(int, long long);
+void disarmTimerFd(int);
+void drainTimerFd(int);
 
 #endif /* UTILITIES_H_ */
@@ -21,6 +21,7 @@
 #include <stdlib.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
 #include <errno.h>
 #include <fcntl.h>
@@ -31,18 +32,13 @@
 #include <sys/types.h>
 #include <sys/time.h>
 
-#include <drm/drm.h>
-#include <drm/drm_mode.h>
-#include <intel_bufmgr.h>
 #include <linux/videodev2.h>
 #include <linux/v4l2-mediabus.h>
 #include <linux/v4l2-subdev.h>
 
-#include <xf86drm.h>
-#include <xf86drmMode.h>
-
 #include "utilities.h"
 #include "str_struct.h"
+#include "pixel_format.h"
 
 #define PAGE_ALIGN(x) ((x + 0xfff) & 0xfffff000)
 #define ERRSTR strerror(errno)
@@ -59,9 +55,6 @@ do { \
     } \
 } while(0)
 
-#define OUTPUT_MODE_FILE 0x0100
-#define OUTPUT_MODE_TEXT 0x0200
-
 //#define COLOR_CONVERSION
 
 #define _ISP_MODE_PREVIEW	0x8000
@@ -71,34 +64,6 @@ do { \
 #define DMABUF_COUNT	4
 #define FRMBUF_COUNT	6
 
-#define DRM_DEV "emgd"
-#define FIFO_DEV_PATH "/dev/video2"
-
-static int bytesperlineFactor = 2; // default = (bits per pixel / bits per byte) = 16 / 8
-
-static int getV4L2FourCC(PixelFormat_t _format) {
-	switch (_format) {
-	case RGBP:
-		bytesperlineFactor = 2;
-		return V4L2_PIX_FMT_RGB565;
-	case RGB3:
-		bytesperlineFactor = 3;
-		return V4L2_PIX_FMT_RGB24;
-	case NV12:
-		bytesperlineFactor = 2;
-		return V4L2_PIX_FMT_NV12;
-	case BA10:
-		bytesperlineFactor = 2;
-		return V4L2_PIX_FMT_SGRBG10;
-	case YUYV:
-		bytesperlineFactor = 2;
-		return V4L2_PIX_FMT_YUYV;
-	default: // YV16
-		bytesperlineFactor = 2;
-		return V4L2_PIX_FMT_YUV422P;
-	}
-}
-
 static void setLoggerWith(Video *self, FILE *_hAppLog) {
 	self->hAppLog = _hAppLog;
 }
@@ -137,47 +102,6 @@ static void writeToLog(Video *self, const char *_fmt, ...) {
 	}
 }
 
-static int readRawFileForFIFO(Video *self) {
-	if (self->rawFile == NULL || strlen(self->rawFile) <= 0) {
-		sprintf(self->error, "Raw image file not set.");
-		return 0;
-	}
-
-	self->rawFileInfo = (FIFOBuffer *) calloc(1, sizeof(FIFOBuffer));
-	struct stat st;
-	CLEAR(st);
-
-	FILE *handle = fopen(self->rawFile, "r");
-	if (handle == NULL) {
-		sprintf(self->error, "Raw image file cannot be opened.");
-		return 0;
-	}
-
-	self->rawFileInfo->fd = fileno(handle);
-
-	if (0 > fstat(self->rawFileInfo->fd, &st)) {
-		sprintf(self->error, "Raw image file cannot be fstat-ed.");
-		fclose(handle);
-		return 0;
-	}
-
-	self->rawFileInfo->format = getV4L2FourCC(self->pixelFormat);
-	self->rawFileInfo->width = self->size.width;
-	self->rawFileInfo->height = self->size.height;
-	self->rawFileInfo->size = PAGE_ALIGN(st.st_size);
-
-	self->rawFileInfo->frameBuf1 = calloc(1, PAGE_ALIGN(self->rawFileInfo->size));
-	size_t readin = 0;
-	char *ptr = (char *) self->rawFileInfo->frameBuf1;
-	while(!feof(handle)) {
-		readin = fread (ptr, self->rawFileInfo->size, 1, handle);
-		ptr += readin;
-	}
-
-	fclose(handle);
-	return 1;
-}
-
 static int openDevicePath(Video *self, const char *_devicePath) {
 	if (_devicePath == NULL || strlen(_devicePath) <= 1) {
 		return -1;
@@ -205,30 +129,6 @@ static int openDevicePath(Video *self, const char *_devicePath) {
 	return fd;
 }
 
-static int openDevicesForFifo(Video *self) {
-	if (self->device) {
-		free(self->device);
-		self->device = NULL;
-	}
-
-	// open stream device for stream
-	self->fd = openDevicePath(self, self->device);
-	if (0 > self->fd) {
-		return 0;
-	}
-
-	// open FIFO device for injection
-	// this is hard-coded paths from Intel Atom ISP driver
-	Str *deviceInput = Str_newWith(FIFO_DEV_PATH);
-	self->fifoFd = openDevicePath(self, deviceInput->str);
-	if (0 > self->fifoFd) {
-		return 0;
-	}
-	Str_dispose(deviceInput);
-
-	return 1;
-}
-
 static int openDevice(Video *self) {
 	self->fd = openDevicePath(self, self->device);
 
@@ -256,36 +156,6 @@ static int openDevice(Video *self) {
 	return 1;
 }
 
-static int initFifoDeviceWithRawImage(Video *self) {
-	struct v4l2_format fmt;
-	struct v4l2_streamparm parm;
-	struct v4l2_capability cap;
-	struct v4l2_requestbuffers req;
-
-	int ret = -1;
-
-	CLEAR(fmt);
-	CLEAR(parm);
-	CLEAR(cap);
-	CLEAR(req);
-
-	ret = ioctl(self->fifoFd, VIDIOC_QUERYCAP, &cap);
-	if (0 > ret) {
-		sprintf(self->error, "%s is not a device.", FIFO_DEV_PATH);
-		return -1;
-	}
-
-	if (!(cap.capabilities & V4L2_CAP_VIDEO_OUTPUT)) {
-		sprintf(self->error, "%s is not a FIFO capable device.", FIFO_DEV_PATH);
-		return -1;
-	}
-
-	CLEAR(parm);
-	parm.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
-	parm.parm.output.outputmode = OUTPUT_MODE_FILE;
-	return 1;
-}
-
 #ifdef COLOR_CONVERSION
 static int getMbuscode(int inpixelformat_fourcc, int outpixelformat_fourcc){
 
@@ -320,9 +190,388 @@ static int getMbuscode(int inpixelformat_fourcc, int outpixelformat_fourcc){
 }
 #endif
 
+/**
+ * Destroys the DMA buffers and their allocator, if any.
+ */
+static void freeDmaBuffers(Video *self) {
+	int i;
+
+	if (self->dmaBuffers != NULL) {
+		for (i=0; i < self->videoBuffersCount * self->memoryPlanesCount; i++) {
+			self->dmaBufAllocator->destroy(self->dmaBufAllocator, &self->dmaBuffers[i]);
+		}
+		free(self->dmaBuffers);
+		self->dmaBuffers = NULL;
+	}
+
+	DmaBufAllocator_dispose(self->dmaBufAllocator);
+	self->dmaBufAllocator = NULL;
+}
+
+static void logFormat(Video *self, const char *_label, struct v4l2_format *_fmt) {
+	if (self->isMultiPlanar) {
+		writeToLog(self, "%s: %dx%d, %.4s, %d planes, %d, %d, %d", _label,
+				   _fmt->fmt.pix_mp.width,
+				   _fmt->fmt.pix_mp.height,
+				   (char *)&_fmt->fmt.pix_mp.pixelformat,
+				   _fmt->fmt.pix_mp.num_planes,
+				   _fmt->fmt.pix_mp.plane_fmt[0].bytesperline,
+				   _fmt->fmt.pix_mp.plane_fmt[0].sizeimage,
+				   _fmt->fmt.pix_mp.field);
+	} else {
+		writeToLog(self, "%s: %dx%d, %.4s, %d, %d, %d", _label,
+				   _fmt->fmt.pix.width,
+				   _fmt->fmt.pix.height,
+				   (char *)&_fmt->fmt.pix.pixelformat,
+				   _fmt->fmt.pix.bytesperline,
+				   _fmt->fmt.pix.sizeimage,
+				   _fmt->fmt.pix.field);
+	}
+}
+
+/**
+ * Works out from the negotiated format where each color plane of a frame
+ * lives, so acquire() can hand out plane pointers and nobody downstream
+ * has to guess offsets from the resolution.
+ */
+static int describePlanes(Video *self, struct v4l2_format *_fmt) {
+	const PixelFormatInfo *info = PixelFormat_info(self->pixelFormat);
+	unsigned int width, height, p;
+
+	if (self->isMultiPlanar) {
+		self->memoryPlanesCount = _fmt->fmt.pix_mp.num_planes;
+		width = _fmt->fmt.pix_mp.width;
+		height = _fmt->fmt.pix_mp.height;
+	} else {
+		self->memoryPlanesCount = 1;
+		width = _fmt->fmt.pix.width;
+		height = _fmt->fmt.pix.height;
+	}
+
+	if (self->memoryPlanesCount <= 0 || self->memoryPlanesCount > VIDEO_FRAME_MAX_PLANES) {
+		sprintf(self->error, "Unsupported number of buffer planes: %d", self->memoryPlanesCount);
+		return 0;
+	}
+
+	if (self->memoryPlanesCount != 1 && self->memoryPlanesCount != info->planesCount) {
+		sprintf(self->error, "Cannot lay out %d color planes over %d buffer planes.", info->planesCount, self->memoryPlanesCount);
+		return 0;
+	}
+
+	for (p = 0; p < self->memoryPlanesCount; p++) {
+		self->memoryPlaneSizes[p] = (self->isMultiPlanar) ? _fmt->fmt.pix_mp.plane_fmt[p].sizeimage : _fmt->fmt.pix.sizeimage;
+	}
+
+	unsigned int bytesperline = (self->isMultiPlanar) ? _fmt->fmt.pix_mp.plane_fmt[0].bytesperline : _fmt->fmt.pix.bytesperline;
+	if (self->memoryPlanesCount == 1 && info->planesCount > 1) {
+		// the spec makes bytesperline the stride of the first plane; atomisp
+		// counts the bytes of the other planes in it too
+		unsigned int frameSize = 0;
+		for (p = 0; p < info->planesCount; p++) {
+			frameSize += PixelFormat_bytesPerLine(info, p, bytesperline) * (height / info->planes[p].verticalSubsampling);
+		}
+		if (frameSize > self->memoryPlaneSizes[0]) {
+			bytesperline = (bytesperline * info->planes[0].bitsPerPixel) / PixelFormat_bitsPerPixel(info);
+		}
+	}
+
+	unsigned int offset = 0;
+	self->planesCount = info->planesCount;
+	for (p = 0; p < self->planesCount; p++) {
+		VideoPlane *plane = &self->planes[p];
+
+		plane->data = NULL;
+		plane->width = width / info->planes[p].horizontalSubsampling;
+		plane->height = height / info->planes[p].verticalSubsampling;
+
+		if (self->memoryPlanesCount > 1) {
+			// one memory plane per color plane, e.g. NV12M
+			plane->memoryIndex = p;
+			plane->offset = 0;
+			plane->bytesperline = _fmt->fmt.pix_mp.plane_fmt[p].bytesperline;
+			plane->length = self->memoryPlaneSizes[p];
+		} else {
+			// one after the other in a single memory plane
+			plane->memoryIndex = 0;
+			plane->offset = offset;
+			plane->bytesperline = PixelFormat_bytesPerLine(info, p, bytesperline);
+			plane->length = plane->bytesperline * plane->height;
+			offset += plane->length;
+		}
+	}
+
+	if (self->planesCount == 1) {
+		self->planes[0].length = self->memoryPlaneSizes[0];
+	}
+
+	return 1;
+}
+
+/**
+ * Sets type and memory of _buf for this Video's IO method; multi-planar
+ * buffers also get _planes to carry their memory planes.
+ */
+static int setBufferTypeOf(Video *self, struct v4l2_buffer *_buf, struct v4l2_plane *_planes) {
+	_buf->type = self->bufType;
+
+	switch (self->ioMethod) {
+		case IO_METHOD_DMABUF:
+			_buf->memory = V4L2_MEMORY_DMABUF;
+			break;
+		case IO_METHOD_MMAP:
+			_buf->memory = V4L2_MEMORY_MMAP;
+			break;
+		case IO_METHOD_USERPOINTER:
+			_buf->memory = V4L2_MEMORY_USERPTR;
+			break;
+		case IO_METHOD_READ:
+		default:
+			sprintf(self->error, "IO method %d is not supported.", self->ioMethod);
+			return 0;
+	}
+
+	if (self->isMultiPlanar) {
+		_buf->m.planes = _planes;
+		_buf->length = self->memoryPlanesCount;
+	}
+
+	return 1;
+}
+
+/**
+ * Points _buf at the memory of buffer _index before it is queued.
+ */
+static void setBufferMemoryOf(Video *self, struct v4l2_buffer *_buf, unsigned int _index) {
+	unsigned int p;
+
+	_buf->index = _index;
+
+	for (p = 0; p < self->memoryPlanesCount; p++) {
+		unsigned int k = (_index * self->memoryPlanesCount) + p;
+
+		if (self->ioMethod == IO_METHOD_DMABUF) {
+			if (self->isMultiPlanar) {
+				_buf->m.planes[p].m.fd = self->dmaBuffers[k].prime_fd;
+			} else {
+				_buf->m.fd = self->dmaBuffers[k].prime_fd;
+			}
+		} else if (self->ioMethod == IO_METHOD_USERPOINTER) {
+			if (self->isMultiPlanar) {
+				_buf->m.planes[p].m.userptr = (unsigned long) self->videoBuffers[k].start;
+				_buf->m.planes[p].length = self->videoBuffers[k].length;
+			} else {
+				_buf->m.userptr = (unsigned long) self->videoBuffers[k].start;
+				_buf->length = self->videoBuffers[k].length;
+			}
+		}
+	}
+}
+
+static unsigned char *memoryPlaneAt(Video *self, unsigned int _index, unsigned int _plane) {
+	unsigned int k = (_index * self->memoryPlanesCount) + _plane;
+
+	if (self->ioMethod == IO_METHOD_DMABUF) {
+		return (unsigned char *) self->dmaBuffers[k].virtual;
+	}
+
+	return (unsigned char *) self->videoBuffers[k].start;
+}
+
+static void limitHeldFrames(Video *self) {
+	// at least one buffer must stay queued or the stream stalls
+	if (self->maxHeldFrames <= 0 || self->maxHeldFrames >= self->videoBuffersCount) {
+		self->maxHeldFrames = (self->videoBuffersCount > 1) ? self->videoBuffersCount - 1 : 1;
+	}
+	writeToLog(self, "Application may hold up to %d of %d buffers.", self->maxHeldFrames, self->videoBuffersCount);
+}
+
+/**
+ * Sets up feeding rawFile to fifoDevice; the device captured from is the
+ * one the ISP puts the processed frames out on. The raw frames are in the
+ * input format where there is one, and the size captured at.
+ */
+static int initInjector(Video *self) {
+	PixelFormat_t format = self->pixelFormat;
+#ifdef COLOR_CONVERSION
+	format = self->inpixelFormat;
+#endif
+
+	if (self->rawFile == NULL || strlen(self->rawFile) <= 0) {
+		sprintf(self->error, "Raw image file not set.");
+		return 0;
+	}
+
+	self->injector = FifoInjector_newWith((self->fifoDevice != NULL) ? self->fifoDevice : FIFO_DEV_PATH,
+										  self->rawFile, format, self->size.width, self->size.height);
+	if (self->injector->fd < 0) {
+		sprintf(self->error, "%s", self->injector->error);
+		return 0;
+	}
+
+	writeToLog(self, "Injecting %d %s frames of %d bytes from %s into %s through %u buffers.",
+			   self->injector->raw.count, PixelFormat_name(format), self->injector->raw.size, self->rawFile,
+			   self->injector->device, self->injector->buffersCount);
+	if (self->injector->error[0] != '\0') {
+		writeToLog(self, "%s", self->injector->error);
+	}
+
+	return 1;
+}
+
+static bool isRecording(const char *_path) {
+	struct stat st;
+	return _path != NULL && stat(_path, &st) == 0 && S_ISREG(st.st_mode);
+}
+
+/**
+ * Where plane _p of a replayed frame lies, from the frame's start.
+ */
+static void describeReplayedPlane(VideoPlane *_plane, const PixelFormatInfo *_info, unsigned int _p,
+								  const RecordEntry *_entry) {
+	_plane->width = _entry->width / _info->planes[_p].horizontalSubsampling;
+	_plane->height = _entry->planes[_p].height;
+	_plane->memoryIndex = 0;
+	_plane->offset = _entry->planes[_p].offset;
+	_plane->bytesperline = _entry->planes[_p].bytesperline;
+	_plane->length = _entry->planes[_p].length;
+}
+
+/**
+ * Plays a recording back instead of opening a device. It has to be in the
+ * color format and size asked for. Frames are handed out from the mapped
+ * file whatever the IO method, and fd is the replay's timer.
+ */
+static int initReplay(Video *self) {
+	const PixelFormatInfo *info = PixelFormat_info(self->pixelFormat);
+
+	self->replay = ReplaySource_newWith(self->device, self->replayPace);
+	if (self->replay->fd < 0) {
+		sprintf(self->error, "%s", self->replay->error);
+		return 0;
+	}
+
+	const RecordEntry *first = &self->replay->entries[0];
+	if ((first->fourcc != info->fourcc && first->fourcc != info->multiPlanarFourcc) ||
+		first->planesCount != info->planesCount) {
+		sprintf(self->error, "%s was recorded as %.4s, not %s.", self->device, (const char *) &first->fourcc,
+				PixelFormat_name(self->pixelFormat));
+		return 0;
+	}
+
+	if ((int) first->width != self->size.width || (int) first->height != self->size.height) {
+		sprintf(self->error, "%s was recorded at %ux%u, not %dx%d.", self->device, first->width, first->height,
+				self->size.width, self->size.height);
+		return 0;
+	}
+
+	if (self->ioMethod != IO_METHOD_MMAP) {
+		writeToLog(self, "%s is replayed from its mapping; the IO method asked for does not apply.", self->device);
+		self->ioMethod = IO_METHOD_MMAP;
+	}
+
+	self->fd = self->replay->fd;
+	self->isMultiPlanar = false;
+	self->bufType = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	self->memoryPlanesCount = 1;
+	self->memoryPlaneSizes[0] = first->size;
+	self->planesCount = first->planesCount;
+
+	unsigned int p;
+	for (p = 0; p < self->planesCount; p++) {
+		self->planes[p].data = NULL;
+		describeReplayedPlane(&self->planes[p], info, p, first);
+	}
+
+	// there are no buffers of its own; the count only bounds the frames held
+	self->videoBuffersCount = (self->requestedBuffersCount > 0) ? self->requestedBuffersCount : FRMBUF_COUNT;
+
+	writeToLog(self, "Replaying %u frames of %s %s.", self->replay->entriesCount, self->device,
+			   (self->replayPace == REPLAY_PACE_FAST) ? "as fast as they are taken" : "at the recorded pace");
+	limitHeldFrames(self);
+
+	return 1;
+}
+
+/**
+ * Generates test frames instead of opening a device; see pattern.h. Frames
+ * are drawn into buffers of the pattern's whatever the IO method, and fd
+ * is the pattern's timer.
+ */
+static int initPattern(Video *self) {
+	const PixelFormatInfo *info = PixelFormat_info(self->pixelFormat);
+	unsigned int buffersCount = (self->requestedBuffersCount > 0) ? self->requestedBuffersCount : FRMBUF_COUNT;
+
+	if (self->size.width <= 0 || self->size.height <= 0) {
+		sprintf(self->error, "%s needs a size.", self->device);
+		return 0;
+	}
+
+	self->pattern = PatternSource_newWith(self->device, self->pixelFormat, self->size.width, self->size.height,
+										  buffersCount, self->replayPace == REPLAY_PACE_FAST);
+	if (self->pattern->fd < 0) {
+		sprintf(self->error, "%s", self->pattern->error);
+		return 0;
+	}
+
+	if (self->ioMethod != IO_METHOD_MMAP) {
+		writeToLog(self, "%s is drawn into buffers of its own; the IO method asked for does not apply.", self->device);
+		self->ioMethod = IO_METHOD_MMAP;
+	}
+
+	self->fd = self->pattern->fd;
+	self->isMultiPlanar = false;
+	self->bufType = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	self->memoryPlanesCount = 1;
+	self->memoryPlaneSizes[0] = self->pattern->frameSize;
+	self->planesCount = self->pattern->planesCount;
+
+	unsigned int p;
+	for (p = 0; p < self->planesCount; p++) {
+		const PatternPlane *source = &self->pattern->planes[p];
+		VideoPlane *plane = &self->planes[p];
+		plane->data = NULL;
+		plane->width = self->size.width / info->planes[p].horizontalSubsampling;
+		plane->height = source->rows;
+		plane->memoryIndex = 0;
+		plane->offset = source->offset;
+		plane->bytesperline = source->bytesperline;
+		plane->length = source->bytesperline * source->rows;
+	}
+
+	self->videoBuffersCount = self->pattern->buffersCount;
+
+	if (self->pattern->intervalUsec > 0) {
+		writeToLog(self, "Generating %s %s frames of %dx%d at %.2f fps; noise by the %s kernel.",
+				   Pattern_kindName(self->pattern->kind), PixelFormat_name(self->pixelFormat), self->size.width,
+				   self->size.height, self->pattern->fps, self->pattern->isaName);
+	} else {
+		writeToLog(self, "Generating %s %s frames of %dx%d as fast as they are taken; noise by the %s kernel.",
+				   Pattern_kindName(self->pattern->kind), PixelFormat_name(self->pixelFormat), self->size.width,
+				   self->size.height, self->pattern->isaName);
+	}
+	limitHeldFrames(self);
+
+	return 1;
+}
+
 static int initDevice(Video *self) {
 	struct v4l2_streamparm parm;
 
+	// a recording or pattern stays open from the first init to dispose; fd
+	// is then its timerfd, which takes no V4L2 ioctls. Re-inits, as with
+	// -u, keep it
+	if (self->replay != NULL || self->pattern != NULL) {
+		return 1;
+	}
+
+	if (self->fd < 0 && !self->isFIFO && Pattern_isSpec(self->device)) {
+		return initPattern(self);
+	}
+
+	if (self->fd < 0 && !self->isFIFO && isRecording(self->device)) {
+		return initReplay(self);
+	}
+
     CLEAR(parm);
 	parm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 	parm.parm.capture.capturemode = _ISP_MODE_STILL;
@@ -331,35 +580,9 @@ static int initDevice(Video *self) {
 		parm.parm.capture.capturemode = _ISP_MODE_VIDEO;
 	}
 
-	if (self->isFIFO) {
-		parm.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
-		parm.parm.output.outputmode = OUTPUT_MODE_FILE;
-
-		if (0 >= readRawFileForFIFO(self)) {
-			return 0;
-		}
-	}
-
 	if (self->fd < 0) {
-		if (self->isFIFO) {
-			/**
-			 * NOTE for FIFO: Open /dev/video2 for FIFO capture and /dev/video0 for normal
-			 */
-			if (0 >= openDevicesForFifo(self)) {
-				return 0;
-			}
-
-			// Init /dev/video2 with raw image
-			if (0 >= initFifoDeviceWithRawImage(self)) {
-				return 0;
-			}
-		} else {
-			/**
-			 * Open like normal
-			 */
-			if (0 >= openDevice(self)) {
-				return 0;
-			}
+		if (0 >= openDevice(self)) {
+			return 0;
 		}
 	}
 
@@ -367,56 +590,67 @@ static int initDevice(Video *self) {
 	CLEAR(caps);
 	int ret;
 
+	ret = ioctl(self->fd, VIDIOC_QUERYCAP, &caps);
+	if (ret) {
+		sprintf(self->error, "VIDIOC_QUERYCAP: %s", ERRSTR);
+		return 0;
+	}
+
+	// stay single-planar where the driver offers both; vivid can be MPLANE only
+	unsigned int capabilities = (caps.capabilities & V4L2_CAP_DEVICE_CAPS) ? caps.device_caps : caps.capabilities;
+	self->isMultiPlanar = !(capabilities & V4L2_CAP_VIDEO_CAPTURE) && (capabilities & V4L2_CAP_VIDEO_CAPTURE_MPLANE);
+	self->bufType = (self->isMultiPlanar) ? V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE : V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	if (self->isMultiPlanar) {
+		writeToLog(self, "%s is multi-planar.", self->device);
+	}
+
     if (!self->isFromViewFinder) {
-		if (!self->isFIFO) {
-			ret = ioctl(self->fd, VIDIOC_S_INPUT, &self->port);
-		} else {
-			ret = ioctl(self->fifoFd, VIDIOC_S_INPUT, -1);
-		}
+		ret = ioctl(self->fd, VIDIOC_S_INPUT, &self->port);
+		parm.type = self->bufType;
 		ret = ioctl(self->fd, VIDIOC_S_PARM, &parm);
-
-		ret = ioctl(self->fd, VIDIOC_QUERYCAP, &caps);
-		if (ret) {
-			sprintf(self->error, "VIDIOC_QUERYCAP: %s", ERRSTR);
-			return 0;
-		}
     }
 
 	struct v4l2_format fmt;
 	CLEAR(fmt);
-	fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	fmt.type = self->bufType;
     ret = ioctl(self->fd, VIDIOC_G_FMT, &fmt);
     if (ret < 0) {
     	sprintf(self->error, "PRE VIDIOC_G_FMT: %s", ERRSTR);
     	return 0;
     }
 
-    writeToLog(self, "BASE VIDIOC_G_FMT: %dx%d, %.4s, %d, %d, %d", fmt.fmt.pix.width,
-																   fmt.fmt.pix.height,
-																   (char *)&fmt.fmt.pix.pixelformat,
-																   fmt.fmt.pix.bytesperline,
-																   fmt.fmt.pix.sizeimage,
-																   fmt.fmt.pix.field);
-
-    fmt.fmt.pix.width = self->size.width;
-    fmt.fmt.pix.height = self->size.height;
-    fmt.fmt.pix.pixelformat = getV4L2FourCC(self->pixelFormat);
-    fmt.fmt.pix.bytesperline = self->size.width * 2;
-    fmt.fmt.pix.sizeimage = fmt.fmt.pix.bytesperline * self->size.height;
-    fmt.fmt.pix.field = V4L2_FIELD_NONE;
-
-    // reset height if interlace is set
-    if (self->isInterlaced) {
-    	fmt.fmt.pix.height = self->size.height / 2;
-    	fmt.fmt.pix.field = V4L2_FIELD_ALTERNATE;
+    logFormat(self, "BASE VIDIOC_G_FMT", &fmt);
+
+    if (self->isMultiPlanar) {
+		// the driver picks num_planes and the plane strides
+		fmt.fmt.pix_mp.width = self->size.width;
+		fmt.fmt.pix_mp.height = self->size.height;
+		fmt.fmt.pix_mp.pixelformat = PixelFormat_info(self->pixelFormat)->multiPlanarFourcc;
+		fmt.fmt.pix_mp.field = V4L2_FIELD_NONE;
+		fmt.fmt.pix_mp.num_planes = 0;
+		memset(fmt.fmt.pix_mp.plane_fmt, 0, sizeof(fmt.fmt.pix_mp.plane_fmt));
+
+		if (self->isInterlaced) {
+			fmt.fmt.pix_mp.height = self->size.height / 2;
+			fmt.fmt.pix_mp.field = V4L2_FIELD_ALTERNATE;
+		}
+    } else {
+		fmt.fmt.pix.width = self->size.width;
+		fmt.fmt.pix.height = self->size.height;
+		fmt.fmt.pix.pixelformat = PixelFormat_info(self->pixelFormat)->fourcc;
+		// a hint only; the driver answers with its own, possibly padded, strides
+		fmt.fmt.pix.bytesperline = (self->size.width * PixelFormat_info(self->pixelFormat)->planes[0].bitsPerPixel) / 8;
+		fmt.fmt.pix.sizeimage = (self->size.width * self->size.height * PixelFormat_bitsPerPixel(PixelFormat_info(self->pixelFormat))) / 8;
+		fmt.fmt.pix.field = V4L2_FIELD_NONE;
+
+		// reset height if interlace is set
+		if (self->isInterlaced) {
+			fmt.fmt.pix.height = self->size.height / 2;
+			fmt.fmt.pix.field = V4L2_FIELD_ALTERNATE;
+		}
     }
 
-    writeToLog(self, "PRE VIDIOC_S_FMT: %dx%d, %.4s, %d, %d, %d", fmt.fmt.pix.width,
-																  fmt.fmt.pix.height,
-																  (char *)&fmt.fmt.pix.pixelformat,
-																  fmt.fmt.pix.bytesperline,
-																  fmt.fmt.pix.sizeimage,
-																  fmt.fmt.pix.field);
+    logFormat(self, "PRE VIDIOC_S_FMT", &fmt);
 
 //setting of subdev format for input
 #ifdef COLOR_CONVERSION
@@ -434,7 +668,7 @@ static int initDevice(Video *self) {
 				                                                     subdev_fmt.format.height);
 		writeToLog(self, "=== viewfinder active ===");
     } else {
-		subdev_fmt.format.code = getMbuscode(getV4L2FourCC(self->inpixelFormat), getV4L2FourCC(self->pixelFormat));
+		subdev_fmt.format.code = getMbuscode(PixelFormat_info(self->inpixelFormat)->fourcc, PixelFormat_info(self->pixelFormat)->fourcc);
 		subdev_fmt.format.width = fmt.fmt.pix.width;
 		subdev_fmt.format.height = fmt.fmt.pix.height;
     }
@@ -458,8 +692,13 @@ static int initDevice(Video *self) {
 
 	// decrease the main resolutions by 12px to conform with the rectangle spec it has viewfinder
 	if (self->hasViewFinder && !self->isFromViewFinder) {
-		fmt.fmt.pix.width = self->size.width - 12;
-		fmt.fmt.pix.height = self->size.height - 12;
+		if (self->isMultiPlanar) {
+			fmt.fmt.pix_mp.width = self->size.width - 12;
+			fmt.fmt.pix_mp.height = self->size.height - 12;
+		} else {
+			fmt.fmt.pix.width = self->size.width - 12;
+			fmt.fmt.pix.height = self->size.height - 12;
+		}
 	}
 
     ret = ioctl(self->fd, VIDIOC_S_FMT, &fmt);
@@ -474,12 +713,19 @@ static int initDevice(Video *self) {
 		return 0;
 	}
 
-    writeToLog(self, "POST VIDIOC_S_FMT: %dx%d, %.4s, %d, %d, %d", fmt.fmt.pix.width,
-																   fmt.fmt.pix.height,
-																   (char *)&fmt.fmt.pix.pixelformat,
-																   fmt.fmt.pix.bytesperline,
-																   fmt.fmt.pix.sizeimage,
-																   fmt.fmt.pix.field);
+    logFormat(self, "POST VIDIOC_S_FMT", &fmt);
+
+	if (!describePlanes(self, &fmt)) {
+		return 0;
+	}
+
+	unsigned int p, planesSize = 0, largestPlaneSize = 0;
+	for (p = 0; p < self->memoryPlanesCount; p++) {
+		planesSize += self->memoryPlaneSizes[p];
+		if (self->memoryPlaneSizes[p] > largestPlaneSize) {
+			largestPlaneSize = self->memoryPlaneSizes[p];
+		}
+	}
 
 	struct v4l2_requestbuffers requestBuffers;
 	CLEAR(requestBuffers);
@@ -489,13 +735,13 @@ static int initDevice(Video *self) {
 		 * Begin DMABUF init
 		 */
 
-		self->drm = (DRMContext *) calloc(1,  sizeof (DRMContext));
+		freeDmaBuffers(self);
 
 		requestBuffers.count = DMABUF_COUNT;
 		if (self->requestedBuffersCount > 0) {
 			requestBuffers.count = self->requestedBuffersCount;
 		}
-		requestBuffers.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		requestBuffers.type = self->bufType;
 		requestBuffers.memory = V4L2_MEMORY_DMABUF;
 
 		writeToLog(self, "DMA Requesting buffers for %d...", requestBuffers.count);
@@ -515,67 +761,58 @@ static int initDevice(Video *self) {
 		}
 		self->videoBuffersCount = requestBuffers.count;
 
-		self->drm->format = getV4L2FourCC(self->pixelFormat);
-		self->drm->width = self->size.width;
-		self->drm->height = self->size.height;
-
-		writeToLog(self, "DMA opening DRM...");
-
-		self->drm->fd = drmOpen(DRM_DEV, NULL);
-		if (self->drm->fd < 0) {
-			sprintf(self->error, "drmOpen(%s): %s", DRM_DEV, ERRSTR);
-			return 0;
-		}
-
-		int batchSize = fmt.fmt.pix.sizeimage * self->videoBuffersCount;
+		writeToLog(self, "DMA opening %s allocator...", DmaBufAllocator_backendName(self->dmaBufBackend));
 
-		self->drm->bufmgr = intel_bufmgr_gem_init(self->drm->fd, batchSize);
-		if (self->drm->bufmgr == NULL) {
-			sprintf(self->error, "intel_bufmgr_gem_init: %s", ERRSTR);
+		size_t totalSize = (size_t) planesSize * self->videoBuffersCount;
+		self->dmaBufAllocator = DmaBufAllocator_newWith(self->dmaBufBackend, totalSize);
+		if (!self->dmaBufAllocator->isReady) {
+			sprintf(self->error, "%s", self->dmaBufAllocator->error);
 			return 0;
 		}
 
-		writeToLog(self, "DMA opening DRM... done");
+		writeToLog(self, "DMA opening %s allocator... done; using %s", DmaBufAllocator_backendName(self->dmaBufBackend),
+																	   self->dmaBufAllocator->name);
 
 		writeToLog(self, "DMA initializing buffers...");
 
-		// init buffers
-		self->dmaBuffers = (DMABuffer *) calloc(self->videoBuffersCount, sizeof(DMABuffer));
+		// init buffers; one per memory plane
+		unsigned int dmaBuffersCount = self->videoBuffersCount * self->memoryPlanesCount;
+		self->dmaBuffers = (DMABuffer *) calloc(dmaBuffersCount, sizeof(DMABuffer));
 
 		int i;
-		for (i=0; i < self->videoBuffersCount; i++) {
+		for (i=0; i < dmaBuffersCount; i++) {
 			self->dmaBuffers[i].index = i;
 			self->dmaBuffers[i].prime_fd = -1;
-			self->dmaBuffers[i].bo = NULL;
+			self->dmaBuffers[i].memFd = -1;
+			self->dmaBuffers[i].handle = NULL;
+			self->dmaBuffers[i].virtual = NULL;
 		}
 
 		writeToLog(self, "DMA initializing buffers... done");
-		writeToLog(self, "DMA allocating Intel BO to buffers for render...");
+		writeToLog(self, "DMA allocating %d buffers of %d bytes in %d planes with %s...", self->videoBuffersCount,
+																						  planesSize,
+																						  self->memoryPlanesCount,
+																						  self->dmaBufAllocator->name);
 
 		// create buffers
-		unsigned int name;
-		struct drm_prime_handle prime;
-		memset(&prime, 0, sizeof prime);
-
-		for (i=0; i < self->videoBuffersCount; i++) {
-			self->dmaBuffers[i].bo = drm_intel_bo_alloc_for_render(self->drm->bufmgr, "v4l2_surface", fmt.fmt.pix.sizeimage, 0);
-			if (self->dmaBuffers[i].bo == NULL) {
-				sprintf(self->error, "drm_intel_bo_alloc: %s", ERRSTR);
+		for (i=0; i < dmaBuffersCount; i++) {
+			unsigned int size = self->memoryPlaneSizes[i % self->memoryPlanesCount];
+			if (!self->dmaBufAllocator->allocate(self->dmaBufAllocator, &self->dmaBuffers[i], size)) {
+				sprintf(self->error, "%s", self->dmaBufAllocator->error);
 				return 0;
 			}
 
-			//get the prime handle and put it in prime_fd of dmaBuffers
-			prime.handle = self->dmaBuffers[i].bo->handle;
-			ret = ioctl(self->drm->fd, DRM_IOCTL_PRIME_HANDLE_TO_FD, &prime);
-			self->dmaBuffers[i].prime_fd = prime.fd;
-
-			if (0 != drm_intel_bo_flink(self->dmaBuffers[i].bo, &name)) {
-				sprintf(self->error, "drm_intel_bo_flink: %s", ERRSTR);
+			// mapped once here and unmapped by Video_dispose(); frames only sync
+			if (self->dmaBufAllocator->map(self->dmaBufAllocator, &self->dmaBuffers[i]) == NULL) {
+				sprintf(self->error, "%s", self->dmaBufAllocator->error);
 				return 0;
 			}
 		}
 
-		writeToLog(self, "DMA allocating Intel BO to buffers for render... done");
+		writeToLog(self, "DMA allocating %d buffers of %d bytes in %d planes with %s... done", self->videoBuffersCount,
+																							   planesSize,
+																							   self->memoryPlanesCount,
+																							   self->dmaBufAllocator->name);
 
 		/**
 		 * Finish DMABUF init
@@ -589,11 +826,7 @@ static int initDevice(Video *self) {
 		if (self->requestedBuffersCount > 0) {
 			requestBuffers.count = self->requestedBuffersCount;
 		}
-		requestBuffers.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-		if (self->isFIFO) {
-			requestBuffers.count = 1;
-			//requestBuffers.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
-		}
+		requestBuffers.type = self->bufType;
 
 		requestBuffers.memory = V4L2_MEMORY_MMAP;
 
@@ -608,7 +841,7 @@ static int initDevice(Video *self) {
 			return 0;
 		}
 
-		self->videoBuffers = (VideoBuffer *) calloc(requestBuffers.count, sizeof(*self->videoBuffers));
+		self->videoBuffers = (VideoBuffer *) calloc(requestBuffers.count * self->memoryPlanesCount, sizeof(*self->videoBuffers));
 		if (!self->videoBuffers) {
 			sprintf(self->error, "Not enough memory.");
 			return 0;
@@ -616,13 +849,11 @@ static int initDevice(Video *self) {
 
 		for (self->videoBuffersCount = 0; self->videoBuffersCount < requestBuffers.count; ++self->videoBuffersCount) {
 			struct v4l2_buffer buf;
+			struct v4l2_plane planes[VIDEO_FRAME_MAX_PLANES];
 			CLEAR(buf);
+			CLEAR(planes);
 
-			buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-			if (self->isFIFO) {
-				buf.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
-			}
-			buf.memory = V4L2_MEMORY_MMAP;
+			setBufferTypeOf(self, &buf, planes);
 			buf.index = self->videoBuffersCount;
 
 			ret = ioctl(self->fd, VIDIOC_QUERYBUF, &buf);
@@ -631,16 +862,22 @@ static int initDevice(Video *self) {
 				return 0;
 			}
 
-			self->videoBuffers[self->videoBuffersCount].length = buf.length;
+			for (p = 0; p < self->memoryPlanesCount; p++) {
+				unsigned int k = (self->videoBuffersCount * self->memoryPlanesCount) + p;
+				size_t length = (self->isMultiPlanar) ? buf.m.planes[p].length : buf.length;
+				off_t offset = (self->isMultiPlanar) ? buf.m.planes[p].m.mem_offset : buf.m.offset;
+
+				self->videoBuffers[k].length = length;
 #ifdef I64
-			self->videoBuffers[self->videoBuffersCount].start = mmap(NULL, buf.length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_32BIT, self->fd, buf.m.offset);
+				self->videoBuffers[k].start = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_32BIT, self->fd, offset);
 #else
-			self->videoBuffers[self->videoBuffersCount].start = mmap(NULL, buf.length, PROT_READ | PROT_WRITE, MAP_SHARED, self->fd, buf.m.offset);
+				self->videoBuffers[k].start = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, self->fd, offset);
 #endif
 
-			if (MAP_FAILED == self->videoBuffers[self->videoBuffersCount].start) {
-				sprintf(self->error, "Failed to MMAP videoBuffers[%d].", self->videoBuffersCount);
-				return 0;
+				if (MAP_FAILED == self->videoBuffers[k].start) {
+					sprintf(self->error, "Failed to MMAP videoBuffers[%d] plane %d.", self->videoBuffersCount, p);
+					return 0;
+				}
 			}
 		}
 
@@ -662,64 +899,113 @@ static int initDevice(Video *self) {
 		 * Begin USERPOINTER init
 		 */
 
-		// TODO: implement io_userpointer here
-
+		requestBuffers.count = FRMBUF_COUNT;
+		if (self->requestedBuffersCount > 0) {
+			requestBuffers.count = self->requestedBuffersCount;
+		}
+		requestBuffers.type = self->bufType;
+		requestBuffers.memory = V4L2_MEMORY_USERPTR;
+
+		ret = ioctl(self->fd, VIDIOC_REQBUFS, &requestBuffers);
+		if (ret < 0) {
+			sprintf(self->error, "VIDIOC_REQBUFS: %s", ERRSTR);
+			return 0;
+		}
+
+		if (requestBuffers.count <= 0) {
+			sprintf(self->error, "VIDIOC_REQBUFS: Not enough buffers allocated. %d", requestBuffers.count);
+			return 0;
+		}
+
+		// the pool's buffers are all alike, so each memory plane gets the largest plane size
+		unsigned int poolCount = requestBuffers.count * self->memoryPlanesCount;
+
+		writeToLog(self, "USERPTR allocating pool of %d x %d bytes...", poolCount, largestPlaneSize);
+
+		UserPtrPool_dispose(self->userPtrPool);
+		self->userPtrPool = UserPtrPool_newWith(poolCount, largestPlaneSize, self->userPtrFlags);
+		if (self->userPtrPool == NULL || self->userPtrPool->base == MAP_FAILED) {
+			sprintf(self->error, "%s", (self->userPtrPool != NULL) ? self->userPtrPool->error : "Not enough memory.");
+			return 0;
+		}
+
+		writeToLog(self, "USERPTR allocating pool of %d x %d bytes... done; hugetlb: %d, thp: %d, locked: %d",
+				   poolCount, largestPlaneSize,
+				   self->userPtrPool->isHugeTLB, self->userPtrPool->isTransparentHugePage, self->userPtrPool->isLocked);
+
+		// the pool backs videoBuffers so the frame path is the same as MMAP
+		free(self->videoBuffers);
+		self->videoBuffers = (VideoBuffer *) calloc(poolCount, sizeof(*self->videoBuffers));
+		if (!self->videoBuffers) {
+			sprintf(self->error, "Not enough memory.");
+			return 0;
+		}
+
+		for (p = 0; p < poolCount; p++) {
+			self->videoBuffers[p].start = self->userPtrPool->bufferAt(self->userPtrPool, p);
+			self->videoBuffers[p].length = self->userPtrPool->bufferSize;
+		}
+		self->videoBuffersCount = requestBuffers.count;
+
 		/**
 		 * Finish USERPOINTER init
 		 */
 	}
 
+	limitHeldFrames(self);
+
+	if (self->isFIFO) {
+		return initInjector(self);
+	}
+
 	return 1; // all good
 }
 
+static void resetFrameCounters(Video *self) {
+	self->frame = -1;
+	self->frameCount = 0;
+	self->heldFramesCount = 0;
+	self->hasLastFrame = false;
+	self->skippedFramesCount = 0;
+	self->droppedFramesCount = 0;
+	self->hasSequence = false;
+}
+
 static int startStream(Video *self) {
 	int ret;
 	enum v4l2_buf_type type;
 
-	type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	type = self->bufType;
 
-	if (self->isFIFO) {
-		/**
-		 * FIFO only need to queue once.
-		 */
-		struct v4l2_buffer buf;
-		CLEAR(buf);
+	if (self->replay != NULL) {
+		self->replay->start(self->replay);
+		resetFrameCounters(self);
+		return 1;
+	}
 
-		int i;
-		for (i=0; i < self->videoBuffersCount; i++) {
-			buf.index = i;
-			buf.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
-			buf.memory = V4L2_MEMORY_MMAP;
+	if (self->pattern != NULL) {
+		self->pattern->start(self->pattern);
+		resetFrameCounters(self);
+		return 1;
+	}
 
-			memcpy(self->videoBuffers[i].start, self->rawFileInfo->frameBuf1, self->rawFileInfo->size);
+	struct v4l2_buffer buf;
+	struct v4l2_plane planes[VIDEO_FRAME_MAX_PLANES];
 
-			ret = ioctl(self->fd, VIDIOC_QBUF, &buf);
-			if (ret < 0) {
-				sprintf(self->error, "VIDIOC_QBUF: %s", ERRSTR);
-				return 0;
-			}
-		}
-	} else {
-		struct v4l2_buffer buf;
+	int i;
+	for (i=0; i < self->videoBuffersCount; i++) {
 		CLEAR(buf);
+		CLEAR(planes);
 
-		int i;
-		for (i=0; i < self->videoBuffersCount; i++) {
-			buf.index = i;
-			buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-			buf.memory = V4L2_MEMORY_MMAP;
-
-			if (self->ioMethod == IO_METHOD_DMABUF) {
-				buf.memory = V4L2_MEMORY_DMABUF;
-				buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-				buf.m.fd = self->dmaBuffers[i].prime_fd;
-			}
+		if (!setBufferTypeOf(self, &buf, planes)) {
+			return 0;
+		}
+		setBufferMemoryOf(self, &buf, i);
 
-			ret = ioctl(self->fd, VIDIOC_QBUF, &buf);
-			if (ret < 0) {
-				sprintf(self->error, "VIDIOC_QBUF: %s", ERRSTR);
-				return 0;
-			}
+		ret = ioctl(self->fd, VIDIOC_QBUF, &buf);
+		if (ret < 0) {
+			sprintf(self->error, "VIDIOC_QBUF: %s", ERRSTR);
+			return 0;
 		}
 	}
 
@@ -729,9 +1015,13 @@ static int startStream(Video *self) {
 		return 0;
 	}
 
-	// reset frame counters
-	self->frame = -1;
-	self->frameCount = 0;
+	resetFrameCounters(self);
+
+	// what the device captures is fed in from here on
+	if (self->injector != NULL && !self->injector->start(self->injector)) {
+		sprintf(self->error, "%s", self->injector->error);
+		return 0;
+	}
 
 	return 1; // all good
 }
@@ -739,7 +1029,37 @@ static int startStream(Video *self) {
 static int stopStream(Video *self) {
 	enum v4l2_buf_type type;
 	int ret;
-	type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	type = self->bufType;
+
+	if (self->replay != NULL) {
+		self->replay->stop(self->replay);
+		return 1;
+	}
+
+	if (self->pattern != NULL) {
+		PatternSource *pattern = self->pattern;
+		pattern->stop(pattern);
+		writeToLog(self, "Generated %lu frames of %s; drawing took %lld usec on average, %lld at most.",
+				   pattern->generated, self->device,
+				   (pattern->generated > 0) ? pattern->renderUsecSum / (long long) pattern->generated : 0,
+				   pattern->renderUsecMax);
+		return 1;
+	}
+
+	if (self->injector != NULL && self->injector->isStreaming) {
+		FifoInjector *injector = self->injector;
+		injector->stop(injector);
+		writeToLog(self, "Injected %lu frames of %s (%lu passes) into %s: %.1f fps, %.1f MB/s; "
+				   "copy avg %llu usec, max %llu usec; %.0f%% waiting on the device.",
+				   injector->injected, injector->source, injector->loops, injector->device, injector->rate(injector),
+				   (injector->injected > 0) ? injector->rate(injector) * injector->bytes / injector->injected / 1000000.0 : 0,
+				   (injector->injected > 0) ? injector->copyUsecSum / injector->injected : 0, injector->copyUsecMax,
+				   (injector->stoppedUsec > injector->startedUsec) ?
+						   100.0 * injector->waitUsecSum / (injector->stoppedUsec - injector->startedUsec) : 0);
+		if (injector->hasFailed) {
+			writeToLog(self, "%s", injector->error);
+		}
+	}
 
 	switch (self->ioMethod) {
 		case IO_METHOD_READ:
@@ -759,76 +1079,326 @@ static int stopStream(Video *self) {
 	return 1; // all good
 }
 
-static int dequeue(Video *self) {
+static void countDroppedBefore(Video *self, unsigned int _sequence) {
+	// the driver numbers the frames it had no free buffer for, too
+	if (self->hasSequence && _sequence > self->lastSequence + 1) {
+		__atomic_add_fetch(&self->droppedFramesCount, _sequence - self->lastSequence - 1, __ATOMIC_RELAXED);
+	}
+	self->lastSequence = _sequence;
+	self->hasSequence = true;
+}
+
+/**
+ * The recorded frame that is due, where it lies in the mapped file. It is
+ * stamped with when it fell due, so latencies count from there; gaps the
+ * recording has in its sequence count as dropped.
+ */
+static int acquireReplayed(Video *self, VideoFrame *_frame) {
+	const PixelFormatInfo *info = PixelFormat_info(self->pixelFormat);
+	long long due;
+	unsigned int sequence;
+
+	const RecordEntry *entry = self->replay->take(self->replay, &due, &sequence);
+	if (entry == NULL) {
+		sprintf(self->error, "%s: next frame not due yet", self->device);
+		errno = EAGAIN;
+		return 0;
+	}
+
+	_frame->index = (unsigned int) (self->frameCount % self->videoBuffersCount);
+	_frame->data = self->replay->frameAt(self->replay, entry);
+	_frame->bytesused = 0;
+	_frame->sequence = sequence;
+	_frame->flags = (entry->flags & ~V4L2_BUF_FLAG_TIMESTAMP_MASK) | V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC;
+	_frame->timestamp.tv_sec = due / 1000000LL;
+	_frame->timestamp.tv_usec = due % 1000000LL;
+
+	countDroppedBefore(self, sequence);
+
+	unsigned int p;
+	_frame->planesCount = self->planesCount;
+	for (p = 0; p < self->planesCount; p++) {
+		VideoPlane *plane = &_frame->planes[p];
+		describeReplayedPlane(plane, info, p, entry);
+		plane->data = _frame->data + plane->offset;
+		_frame->bytesused += plane->length;
+	}
+
+	self->frame += 1;
+	self->frameCount += 1;
+	__atomic_add_fetch(&self->heldFramesCount, 1, __ATOMIC_RELEASE);
+
+	return 1;
+}
+
+/**
+ * Draws the newest test frame that is due. It is stamped with when it fell
+ * due, so latencies include drawing it; frames passed over while the
+ * application was busy count as dropped.
+ */
+static int acquirePattern(Video *self, VideoFrame *_frame) {
+	long long due;
+	unsigned int sequence, index;
+
+	unsigned char *data = self->pattern->take(self->pattern, &due, &sequence, &index);
+	if (data == NULL) {
+		if (errno == EAGAIN) {
+			sprintf(self->error, "%s: next frame not due yet", self->device);
+		} else {
+			sprintf(self->error, "%s", self->pattern->error);
+		}
+		return 0;
+	}
+
+	_frame->index = index;
+	_frame->data = data;
+	_frame->bytesused = self->pattern->frameSize;
+	_frame->sequence = sequence;
+	_frame->flags = V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC;
+	_frame->timestamp.tv_sec = due / 1000000LL;
+	_frame->timestamp.tv_usec = due % 1000000LL;
+
+	countDroppedBefore(self, sequence);
+
+	unsigned int p;
+	_frame->planesCount = self->planesCount;
+	for (p = 0; p < self->planesCount; p++) {
+		_frame->planes[p] = self->planes[p];
+		_frame->planes[p].data = data + self->planes[p].offset;
+	}
+
+	self->frame += 1;
+	self->frameCount += 1;
+	__atomic_add_fetch(&self->heldFramesCount, 1, __ATOMIC_RELEASE);
+
+	return 1;
+}
+
+static int acquireNext(Video *self, VideoFrame *_frame) {
 	int ret;
 	struct v4l2_buffer buf;
 	CLEAR(buf);
 
-	switch (self->ioMethod) {
-		case IO_METHOD_READ:
-			break;
-		case IO_METHOD_DMABUF:
-			buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-			buf.memory = V4L2_MEMORY_DMABUF;
-			ret = ioctl(self->fd, VIDIOC_DQBUF, &buf);
-			if (ret < 0) {
-				sprintf(self->error, "VIDIOC_DQBUF: %s", ERRSTR);
-				return 0;
-			}
+	if (__atomic_load_n(&self->heldFramesCount, __ATOMIC_ACQUIRE) >= self->maxHeldFrames) {
+		sprintf(self->error, "Cannot acquire: %d of %d frames already held.", self->heldFramesCount, self->maxHeldFrames);
+		return 0;
+	}
 
-			ret = drm_intel_bo_map(self->dmaBuffers[buf.index].bo, 1);
-			self->lastVideoBuffer = (unsigned char *) (self->dmaBuffers[buf.index].bo->virtual);
+	if (self->replay != NULL) {
+		return acquireReplayed(self, _frame);
+	}
 
-			self->frame += 1;
-			self->frameCount += 1;
-			buf.m.fd = self->dmaBuffers[buf.index].prime_fd	;
+	if (self->pattern != NULL) {
+		return acquirePattern(self, _frame);
+	}
 
-			ret = ioctl(self->fd, VIDIOC_QBUF, &buf);
-			if (ret < 0) {
-				sprintf(self->error, "VIDIOC_QBUF: %s", ERRSTR);
-				return 0;
+	struct v4l2_plane planes[VIDEO_FRAME_MAX_PLANES];
+	CLEAR(planes);
+
+	if (!setBufferTypeOf(self, &buf, planes)) {
+		return 0;
+	}
+
+	ret = ioctl(self->fd, VIDIOC_DQBUF, &buf);
+	if (ret < 0) {
+		sprintf(self->error, "VIDIOC_DQBUF: %s", ERRSTR);
+		return 0;
+	}
+
+	if (buf.index >= self->videoBuffersCount) {
+		sprintf(self->error, "Invalid buf.index: %d of %d: %s", buf.index, self->videoBuffersCount, ERRSTR);
+		return 0;
+	}
+
+	_frame->index = buf.index;
+	_frame->bytesused = buf.bytesused;
+	_frame->sequence = buf.sequence;
+	_frame->flags = buf.flags;
+	_frame->timestamp = buf.timestamp;
+
+	countDroppedBefore(self, buf.sequence);
+
+	unsigned int p, dataOffsets[VIDEO_FRAME_MAX_PLANES] = { 0 };
+	if (self->isMultiPlanar) {
+		_frame->bytesused = 0;
+		for (p = 0; p < self->memoryPlanesCount; p++) {
+			_frame->bytesused += buf.m.planes[p].bytesused;
+			dataOffsets[p] = buf.m.planes[p].data_offset;
+		}
+	}
+
+	if (self->ioMethod == IO_METHOD_DMABUF) {
+		for (p = 0; p < self->memoryPlanesCount; p++) {
+			DMABuffer *dmaBuffer = &self->dmaBuffers[(buf.index * self->memoryPlanesCount) + p];
+			if (!self->dmaBufAllocator->beginCpuAccess(self->dmaBufAllocator, dmaBuffer)) {
+				// stale cache lines at worst; the frame is still usable
+				writeToLog(self, "%s", self->dmaBufAllocator->error);
 			}
-			ret = drm_intel_bo_unmap(self->dmaBuffers[buf.index].bo);
-			break;
-		case IO_METHOD_USERPOINTER:
+		}
+	}
+
+	_frame->data = memoryPlaneAt(self, buf.index, 0);
+	_frame->planesCount = self->planesCount;
+	for (p = 0; p < self->planesCount; p++) {
+		VideoPlane *plane = &_frame->planes[p];
+		*plane = self->planes[p];
+		plane->data = memoryPlaneAt(self, buf.index, plane->memoryIndex) + dataOffsets[plane->memoryIndex] + plane->offset;
+	}
+
+	self->frame += 1;
+	self->frameCount += 1;
+	__atomic_add_fetch(&self->heldFramesCount, 1, __ATOMIC_RELEASE);
+
+	return 1;
+}
+
+/**
+ * Drops one held frame; wakes whoever stopped polling at the cap.
+ */
+static void unhold(Video *self) {
+	unsigned int held = __atomic_sub_fetch(&self->heldFramesCount, 1, __ATOMIC_RELEASE);
+	int wakeFd = __atomic_load_n(&self->releaseWakeFd, __ATOMIC_ACQUIRE);
+	uint64_t one = 1;
+
+	if (wakeFd >= 0 && held + 1 >= self->maxHeldFrames) {
+		if (write(wakeFd, &one, sizeof(one)) < 0) {
+			// the counter cannot overflow; a pending wake is as good
+		}
+	}
+}
+
+/**
+ * Hands a frame from acquire() back to the driver. May be called from a
+ * different thread than acquire().
+ */
+static int release(Video *self, VideoFrame *_frame) {
+	int ret;
+	struct v4l2_buffer buf;
+	CLEAR(buf);
+
+	if (self->replay != NULL) {
+		// the mapping outlives every frame; there is nothing to queue
+		_frame->data = NULL;
+		unhold(self);
+		return 1;
+	}
+
+	if (self->pattern != NULL) {
+		self->pattern->giveBack(self->pattern, _frame->index);
+		_frame->data = NULL;
+		unhold(self);
+		return 1;
+	}
+
+	struct v4l2_plane planes[VIDEO_FRAME_MAX_PLANES];
+	CLEAR(planes);
+
+	if (!setBufferTypeOf(self, &buf, planes)) {
+		return 0;
+	}
+	setBufferMemoryOf(self, &buf, _frame->index);
+
+	if (self->ioMethod == IO_METHOD_DMABUF) {
+		unsigned int p;
+		for (p = 0; p < self->memoryPlanesCount; p++) {
+			self->dmaBufAllocator->endCpuAccess(self->dmaBufAllocator,
+												&self->dmaBuffers[(_frame->index * self->memoryPlanesCount) + p]);
+		}
+	}
+
+	// a buffer the driver did not take back stays held, so it is not lost
+	ret = ioctl(self->fd, VIDIOC_QBUF, &buf);
+	if (ret < 0) {
+		sprintf(self->error, "VIDIOC_QBUF: %s", ERRSTR);
+		return 0;
+	}
+
+	_frame->data = NULL;
+	unhold(self);
+
+	return 1;
+}
+
+/**
+ * Dequeues every buffer that is ready and keeps only the newest one. The
+ * older ones go straight back to the driver and are counted as skipped.
+ */
+static int acquireLatest(Video *self, VideoFrame *_frame) {
+	VideoFrame next;
+
+	if (!acquireNext(self, _frame)) {
+		return 0;
+	}
+
+	// looking past the current frame takes one more held buffer
+	while (__atomic_load_n(&self->heldFramesCount, __ATOMIC_ACQUIRE) < self->maxHeldFrames) {
+		if (!acquireNext(self, &next)) {
+			// EAGAIN: nothing newer yet; anything else shows up on the next call
 			break;
-		case IO_METHOD_MMAP:
-		{
-			buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-			buf.memory = V4L2_MEMORY_MMAP;
+		}
 
-			ret = ioctl(self->fd, VIDIOC_DQBUF, &buf);
-			if (ret < 0) {
-				sprintf(self->error, "VIDIOC_DQBUF: %s", ERRSTR);
-				return 0;
-			}
+		if (!release(self, _frame)) {
+			writeToLog(self, "%s", self->error);
+		}
+		*_frame = next;
+		__atomic_add_fetch(&self->skippedFramesCount, 1, __ATOMIC_RELAXED);
+	}
 
-			if (buf.index >= self->videoBuffersCount) {
-				sprintf(self->error, "Invalid buf.index: %d of %d: %s", buf.index, self->videoBuffersCount, ERRSTR);
-				return 0;
-			}
+	return 1;
+}
 
-			self->lastVideoBuffer = (unsigned char *) self->videoBuffers[buf.index].start;
-			self->frame += 1;
-			self->frameCount += 1;
+static int acquire(Video *self, VideoFrame *_frame) {
+	// a recording replayed or a pattern generated flat out always has a newer
+	// frame; draining would never end
+	bool isFlatOut = ((self->replay != NULL || self->pattern != NULL) && self->replayPace == REPLAY_PACE_FAST);
 
-			if (self->isFIFO) {
-				// only QBUF and DQBUF once for FIFO
-				break;
-			}
+	if (self->isLatestFrameOnly && !isFlatOut) {
+		return acquireLatest(self, _frame);
+	}
 
-			ret = ioctl(self->fd, VIDIOC_QBUF, &buf);
-			if (ret < 0) {
-				sprintf(self->error, "VIDIOC_QBUF: %s", ERRSTR);
-				return 0;
-			}
+	return acquireNext(self, _frame);
+}
+
+static int dequeue(Video *self) {
+	VideoFrame frame;
+
+	switch (self->ioMethod) {
+		case IO_METHOD_READ:
+			return 1;
+		default:
 			break;
+	}
+
+	// holding the previous frame and the new one takes two buffers; with a
+	// cap of one (-b 2 or -H 1) the previous frame goes back first, or no
+	// new frame could ever be acquired
+	if (self->hasLastFrame && self->maxHeldFrames < 2) {
+		if (!release(self, &self->lastFrame)) {
+			return 0;
+		}
+		self->hasLastFrame = false;
+	}
+
+	if (!acquire(self, &frame)) {
+		return 0;
+	}
+
+	// keep the previous frame until the new one has arrived, so the driver
+	// never writes into lastVideoBuffer while the app is still reading it.
+	if (self->hasLastFrame) {
+		if (!release(self, &self->lastFrame)) {
+			return 0;
 		}
 	}
+
+	self->lastFrame = frame;
+	self->hasLastFrame = true;
+	self->lastVideoBuffer = frame.data;
+
 	return 1;
 }
 
-static int autoDequeue(Video *self) {
+static int waitForFrame(Video *self) {
 	while(1) {
 		fd_set fds;
 		struct timeval tv;
@@ -860,6 +1430,16 @@ static int autoDequeue(Video *self) {
 			return 0;
 		}
 
+		return 1;
+	}
+}
+
+static int autoDequeue(Video *self) {
+	while(1) {
+		if (!waitForFrame(self)) {
+			return 0;
+		}
+
 		if (dequeue(self)) {
 			break;
 		}
@@ -868,6 +1448,68 @@ static int autoDequeue(Video *self) {
 	return 1;
 }
 
+static int autoAcquire(Video *self, VideoFrame *_frame) {
+	while(1) {
+		// do not spin on a ready fd while the app holds every frame it may
+		if (__atomic_load_n(&self->heldFramesCount, __ATOMIC_ACQUIRE) >= self->maxHeldFrames) {
+			sprintf(self->error, "Cannot acquire: %d of %d frames already held.", self->heldFramesCount, self->maxHeldFrames);
+			return 0;
+		}
+
+		if (!waitForFrame(self)) {
+			return 0;
+		}
+
+		if (acquire(self, _frame)) {
+			break;
+		}
+	}
+
+	return 1;
+}
+
+static void setUserPtrFlagsTo(Video *self, int _userPtrFlags) {
+	self->userPtrFlags = _userPtrFlags;
+}
+
+static void setIsLatestFrameOnly(Video *self, bool _isLatestFrameOnly) {
+	self->isLatestFrameOnly = _isLatestFrameOnly;
+}
+
+static void setReplayPaceTo(Video *self, ReplayPace_t _pace) {
+	self->replayPace = _pace;
+}
+
+/**
+ * Captures what the ISP makes of the raw frames in _rawFile (a file of
+ * frames or a directory of them) fed to _fifoDevice; NULL for FIFO_DEV_PATH.
+ */
+static void setFifoInjectionFrom(Video *self, const char *_rawFile, const char *_fifoDevice) {
+	free(self->rawFile);
+	free(self->fifoDevice);
+	self->rawFile = strdup(_rawFile);
+	self->fifoDevice = (_fifoDevice != NULL) ? strdup(_fifoDevice) : NULL;
+	self->isFIFO = true;
+}
+
+static void setDmaBufBackendTo(Video *self, DmaBufBackend_t _backend) {
+	self->dmaBufBackend = _backend;
+}
+
+static void setMaxHeldFramesTo(Video *self, int _maxHeldFrames) {
+	if (_maxHeldFrames > 0) {
+		self->maxHeldFrames = _maxHeldFrames;
+	}
+}
+
+/**
+ * _fd is written whenever a release takes the held frames below the cap;
+ * -1 stops that. Safe to call while another thread releases frames.
+ */
+static void setReleaseWakeFdTo(Video *self, int _fd) {
+	__atomic_store_n(&self->releaseWakeFd, _fd, __ATOMIC_RELEASE);
+}
+
 static void setIsFromViewFinder(Video *self, bool _isFromViewFinder) {
 	self->isFromViewFinder = true;
 }
@@ -887,7 +1529,7 @@ static void Video_init(Video *self, const char *_device,
 					   PixelFormat_t _pixelFormat,
 					   int _port, bool _isInterlaced) {
 #endif
-	self->device = (char *) calloc(strlen(_device), sizeof(char));
+	self->device = (char *) calloc(strlen(_device) + 1, sizeof(char));
 	strncpy(self->device, _device, strlen(_device));
 
 	self->port = _port;
@@ -902,10 +1544,12 @@ static void Video_init(Video *self, const char *_device,
 	self->isInterlaced = _isInterlaced;
 	self->hasViewFinder = false;
 	self->isFromViewFinder = false;
-	self->fifoFd = -1;
+	self->isMultiPlanar = false;
+	self->bufType = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 	self->hAppLog = NULL;
 	self->rawFile = NULL;
-	self->rawFileInfo = NULL;
+	self->fifoDevice = NULL;
+	self->injector = NULL;
 	self->frameCount = 0;
 	self->frame = -1;
 	self->error = (char *) calloc(256, sizeof(char));
@@ -915,11 +1559,28 @@ static void Video_init(Video *self, const char *_device,
 	self->fd = -1;
 	self->videoBuffersCount = 0;
 	self->requestedBuffersCount = 0;
+	self->memoryPlanesCount = 1;
+	self->planesCount = 0;
 	self->videoBuffers = NULL;
 	self->dmaBuffers = NULL;
 	self->lastVideoBuffer = NULL;
-
-	self->drm = NULL;
+	self->hasLastFrame = false;
+	self->heldFramesCount = 0;
+	self->maxHeldFrames = 0;
+	self->releaseWakeFd = -1;
+	self->isLatestFrameOnly = false;
+	self->skippedFramesCount = 0;
+	self->droppedFramesCount = 0;
+	self->lastSequence = 0;
+	self->hasSequence = false;
+
+	self->dmaBufAllocator = NULL;
+	self->dmaBufBackend = DMABUF_BACKEND_AUTO;
+	self->userPtrPool = NULL;
+	self->userPtrFlags = USERPTR_POOL_LOCK;
+	self->replay = NULL;
+	self->pattern = NULL;
+	self->replayPace = REPLAY_PACE_RECORDED;
 
 	// methods
 	self->setLoggerWith = setLoggerWith;
@@ -927,12 +1588,22 @@ static void Video_init(Video *self, const char *_device,
 	self->setBufferCountTo = setBufferCountTo;
 	self->setIsFromViewFinder = setIsFromViewFinder;
 	self->setHasViewFinder = setHasViewFinder;
+	self->setMaxHeldFramesTo = setMaxHeldFramesTo;
+	self->setReleaseWakeFdTo = setReleaseWakeFdTo;
+	self->setUserPtrFlagsTo = setUserPtrFlagsTo;
+	self->setDmaBufBackendTo = setDmaBufBackendTo;
+	self->setIsLatestFrameOnly = setIsLatestFrameOnly;
+	self->setReplayPaceTo = setReplayPaceTo;
+	self->setFifoInjectionFrom = setFifoInjectionFrom;
 	self->openDevice = openDevice;
 	self->initDevice = initDevice;
 	self->startStream = startStream;
 	self->stopStream = stopStream;
 	self->dequeue = dequeue;
 	self->autoDequeue = autoDequeue;
+	self->acquire = acquire;
+	self->autoAcquire = autoAcquire;
+	self->release = release;
 }
 
 #ifdef COLOR_CONVERSION
@@ -953,6 +1624,25 @@ Video *Video_newWith(const char *_device, int _width, int _height,
 }
 #endif
 
+/**
+ * Microseconds from the driver's capture timestamp to _now (CLOCK_MONOTONIC),
+ * or -1 when the timestamp is on another clock or missing.
+ */
+long long VideoFrame_ageUsecAt(const VideoFrame *_frame, const struct timespec *_now) {
+	// drivers that predate the flag stamp with the monotonic clock as well
+	if ((_frame->flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_COPY) {
+		return -1;
+	}
+
+	if (_frame->timestamp.tv_sec == 0 && _frame->timestamp.tv_usec == 0) {
+		return -1;
+	}
+
+	long long age = ((long long) _now->tv_sec * 1000000LL + _now->tv_nsec / 1000) -
+					((long long) _frame->timestamp.tv_sec * 1000000LL + _frame->timestamp.tv_usec);
+	return (age >= 0) ? age : -1;
+}
+
 void Video_dispose(Video *self) {
 	// 1. free all the buffers from memory
 	writeToLog(self, "Resetting lastVideoBuffer...");
@@ -961,54 +1651,67 @@ void Video_dispose(Video *self) {
 	}
 	writeToLog(self, "Reset lastVideoBuffer.");
 
+	if (self->replay != NULL) {
+		writeToLog(self, "Closing recording...");
+		ReplaySource_dispose(self->replay);
+		self->replay = NULL;
+		self->fd = -1;	/* was its timer */
+		self->videoBuffersCount = 0;
+		writeToLog(self, "Closed recording.");
+	}
+
+	if (self->pattern != NULL) {
+		writeToLog(self, "Disposing test pattern...");
+		PatternSource_dispose(self->pattern);
+		self->pattern = NULL;
+		self->fd = -1;	/* was its timer */
+		self->videoBuffersCount = 0;
+		writeToLog(self, "Disposed test pattern.");
+	}
+
 	switch (self->ioMethod) {
 		case IO_METHOD_MMAP:
 		{
 
-			int i;
-			for (i=0; i < self->videoBuffersCount; i++) {
-				writeToLog(self, "Unmapping %d of %d...", i, self->videoBuffersCount-1);
+			int i, count = self->videoBuffersCount * self->memoryPlanesCount;
+			for (i=0; i < count; i++) {
+				writeToLog(self, "Unmapping %d of %d...", i, count-1);
 				if (-1 == munmap(self->videoBuffers[i].start, self->videoBuffers[i].length)) {
 					sprintf(self->error, "Failed to UNMAP videoBuffers[%d].", i);
 				}
-				writeToLog(self, "Unmapped %d of %d.", i, self->videoBuffersCount-1);
+				writeToLog(self, "Unmapped %d of %d.", i, count-1);
 			}
 			break;
 		}
 		case IO_METHOD_DMABUF:
 		{
-			free(self->drm);
-			/*The unmapping is done in dequeue()*/
+			writeToLog(self, "Freeing DMA buffers...");
+			freeDmaBuffers(self);
+			writeToLog(self, "Freed DMA buffers.");
 			break;
 		}
-		case IO_METHOD_READ:
 		case IO_METHOD_USERPOINTER:
+		{
+			writeToLog(self, "Freeing user pointer pool...");
+			UserPtrPool_dispose(self->userPtrPool);
+			self->userPtrPool = NULL;
+			free(self->videoBuffers);
+			self->videoBuffers = NULL;
+			writeToLog(self, "Freed user pointer pool.");
+			break;
+		}
+		case IO_METHOD_READ:
 		default:
 			// TODO: implement freeing steps here.
 			break;
 	}
 
 	// 2. close the device
-	if (self->drm != NULL) {
-		writeToLog(self, "Closing drm...");
-		if (self->drm->fd >= 0) {
-			drmClose(self->drm->fd);
-		}
-		writeToLog(self, "Closed drm.");
-
-		writeToLog(self, "Freeing dmaBuffers...");
-		if (self->dmaBuffers != NULL) {
-			free(self->dmaBuffers);
-		}
-		writeToLog(self, "Freed dmaBuffers.");
-
-		self->drm = NULL;
-		self->dmaBuffers = NULL;
-	}
-
 	if (self->isFIFO) {
-		free(self->rawFileInfo);
-		self->rawFileInfo = NULL;
+		FifoInjector_dispose(self->injector);
+		self->injector = NULL;
+		free(self->rawFile);
+		free(self->fifoDevice);
 	}
 
 	writeToLog(self, "Closing fd...");
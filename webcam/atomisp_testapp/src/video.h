@@ -15,11 +15,17 @@
 	along with Intel Atom ISP Test App.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <stdio.h>
 #include <stdbool.h>
-
-#include <intel_bufmgr.h>
+#include <time.h>
+#include <sys/time.h>
 
 #include "utilities.h"
+#include "userptr_pool.h"
+#include "dmabuf_allocator.h"
+#include "replay.h"
+#include "pattern.h"
+#include "fifo_injector.h"
 
 #ifndef VIDEO_H_
 #define VIDEO_H_
@@ -35,37 +41,44 @@ typedef struct RESOLUTION_S {
 	int width, height;
 } Resolution;
 
+#define VIDEO_FRAME_MAX_PLANES 3
+
+/**
+ * One memory plane of a capture buffer. Single-planar buffers have exactly
+ * one; multi-planar ones have memoryPlanesCount, stored next to each other.
+ */
 typedef struct VIDEO_BUF_S {
 	void *start;
 	size_t length;
 } VideoBuffer;
 
-typedef struct FIFO_BUF_S {
-	int fd;
-	void *frameBuf1;
-	void *frameBuf2;
-	int	width;
-	int	height;
-	int format;
-	int	size;
-	int	count;	/* Reserved */
-	int	bayerOrder;
-	int	bitDepth;
-} FIFOBuffer;
-
-typedef struct DMA_BUF_S {
-	unsigned int index;
-	drm_intel_bo *bo;
-	int prime_fd;
-} DMABuffer;
-
-typedef struct DRM_S {
-	int fd;
-	unsigned int width;
+/**
+ * Where one color plane (Y, U, V, UV or packed pixels) of a frame lives.
+ */
+typedef struct VIDEO_PLANE_S {
+	unsigned char *data;		/* first pixel; NULL in the layout of a Video */
+	unsigned int width;			/* in pixels of this plane */
 	unsigned int height;
-	unsigned int format;
-	dri_bufmgr *bufmgr;
-} DRMContext;
+	unsigned int memoryIndex;	/* memory plane holding it */
+	unsigned int offset;		/* from the start of that memory plane */
+	unsigned int bytesperline;
+	unsigned int length;
+} VideoPlane;
+
+/**
+ * A captured buffer on loan to the application, from acquire() to release().
+ * While held, the driver cannot write into it.
+ */
+typedef struct VIDEO_FRAME_S {
+	unsigned int index;
+	unsigned char *data;		/* start of memory plane 0 */
+	unsigned int bytesused;		/* summed over memory planes */
+	unsigned int sequence;
+	unsigned int flags;			/* V4L2_BUF_FLAG_*; tells the timestamp's clock */
+	struct timeval timestamp;	/* when the driver captured it */
+	unsigned int planesCount;
+	VideoPlane planes[VIDEO_FRAME_MAX_PLANES];
+} VideoFrame;
 
 typedef struct VIDEO_S {
 	char *device;
@@ -78,35 +91,67 @@ typedef struct VIDEO_S {
 	bool isInterlaced;
 	bool hasViewFinder;
 	bool isFromViewFinder;
+	bool isMultiPlanar;		/* V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE */
+	unsigned int bufType;
 
 	FILE *hAppLog;
 
-	char *rawFile;
-	FIFOBuffer *rawFileInfo;
-	int fifoFd;
+	char *rawFile;				/* injected through fifoDevice when isFIFO */
+	char *fifoDevice;
+	FifoInjector *injector;
 	long frameCount;
 	long frame;
 	int fd;
 	char *error;
 	unsigned int videoBuffersCount;
 	unsigned int requestedBuffersCount;
-	VideoBuffer *videoBuffers;
-	DMABuffer *dmaBuffers;
+	unsigned int memoryPlanesCount;
+	unsigned int memoryPlaneSizes[VIDEO_FRAME_MAX_PLANES];
+	unsigned int planesCount;
+	VideoPlane planes[VIDEO_FRAME_MAX_PLANES];	/* layout every frame is filled in from */
+	VideoBuffer *videoBuffers;	/* videoBuffersCount * memoryPlanesCount */
+	DMABuffer *dmaBuffers;		/* videoBuffersCount * memoryPlanesCount */
 	unsigned char *lastVideoBuffer;
-
-	DRMContext *drm;
+	VideoFrame lastFrame;
+	bool hasLastFrame;
+	unsigned int heldFramesCount;
+	unsigned int maxHeldFrames;
+	int releaseWakeFd;			/* eventfd written when a release frees a slot at the cap; -1 for none */
+	bool isLatestFrameOnly;		/* acquire() drains the queue and keeps the newest */
+	unsigned long skippedFramesCount;	/* dequeued but superseded before the app saw them */
+	unsigned long droppedFramesCount;	/* never dequeued; gaps in the driver's sequence */
+	unsigned int lastSequence;
+	bool hasSequence;
+
+	DmaBufAllocator *dmaBufAllocator;
+	DmaBufBackend_t dmaBufBackend;
+	UserPtrPool *userPtrPool;
+	int userPtrFlags;
+	ReplaySource *replay;		/* set when device is a recording, not a V4L2 node */
+	PatternSource *pattern;		/* set when device names a test pattern */
+	ReplayPace_t replayPace;	/* of recordings and test patterns */
 
 	void (*setLoggerWith) (struct VIDEO_S *, FILE *);
 	void (*setIOMethodTo) (struct VIDEO_S *, IOMethod_t);
 	void (*setBufferCountTo) (struct VIDEO_S *, int);
 	void (*setIsFromViewFinder) (struct VIDEO_S *, bool);
 	void (*setHasViewFinder) (struct VIDEO_S *, bool);
+	void (*setMaxHeldFramesTo) (struct VIDEO_S *, int);
+	void (*setReleaseWakeFdTo) (struct VIDEO_S *, int);
+	void (*setUserPtrFlagsTo) (struct VIDEO_S *, int);
+	void (*setDmaBufBackendTo) (struct VIDEO_S *, DmaBufBackend_t);
+	void (*setIsLatestFrameOnly) (struct VIDEO_S *, bool);
+	void (*setReplayPaceTo) (struct VIDEO_S *, ReplayPace_t);
+	void (*setFifoInjectionFrom) (struct VIDEO_S *, const char *, const char *);
 	int (*openDevice) (struct VIDEO_S *);
 	int (*initDevice) (struct VIDEO_S *);
 	int (*startStream) (struct VIDEO_S *);
 	int (*stopStream) (struct VIDEO_S *);
 	int (*dequeue) (struct VIDEO_S *);
 	int (*autoDequeue) (struct VIDEO_S *);
+	int (*acquire) (struct VIDEO_S *, VideoFrame *);
+	int (*autoAcquire) (struct VIDEO_S *, VideoFrame *);
+	int (*release) (struct VIDEO_S *, VideoFrame *);
 } Video;
 
 #ifdef COLOR_CONVERSION
@@ -115,5 +160,6 @@ Video *Video_newWith(const char *, int, int, PixelFormat_t, PixelFormat_t, int,
 Video *Video_newWith(const char *, int, int, PixelFormat_t, int, bool);
 #endif
 void Video_dispose(Video *);
+long long VideoFrame_ageUsecAt(const VideoFrame *, const struct timespec *);
 
 #endif /* VIDEO_H_ */
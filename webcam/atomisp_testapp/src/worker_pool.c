@@ -0,0 +1,430 @@
+/**
+	This file is part of Intel Atom ISP Test App.
+
+	Intel Atom ISP Test App is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Intel Atom ISP Test App is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Intel Atom ISP Test App.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "worker_pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define DEQUE_INITIAL_CAPACITY 64
+
+static void pushTile(WorkerDeque *_deque, WorkerJob *_job, unsigned int _index) {
+	pthread_mutex_lock(&_deque->lock);
+	if (_deque->bottom == _deque->capacity) {
+		// slide the live tiles down before growing
+		if (_deque->top > 0) {
+			memmove(_deque->tiles, _deque->tiles + _deque->top, (_deque->bottom - _deque->top) * sizeof(WorkerTile));
+			_deque->bottom -= _deque->top;
+			_deque->top = 0;
+		} else {
+			_deque->capacity *= 2;
+			_deque->tiles = (WorkerTile *) realloc(_deque->tiles, _deque->capacity * sizeof(WorkerTile));
+		}
+	}
+	_deque->tiles[_deque->bottom].job = _job;
+	_deque->tiles[_deque->bottom].index = _index;
+	_deque->bottom++;
+	pthread_mutex_unlock(&_deque->lock);
+}
+
+static bool popTile(WorkerDeque *_deque, bool _isOwner, WorkerTile *_tile) {
+	bool isFound = false;
+
+	pthread_mutex_lock(&_deque->lock);
+	if (_deque->bottom > _deque->top) {
+		*_tile = _isOwner ? _deque->tiles[--_deque->bottom] : _deque->tiles[_deque->top++];
+		if (_deque->top == _deque->bottom) {
+			_deque->top = 0;
+			_deque->bottom = 0;
+		}
+		isFound = true;
+	}
+	pthread_mutex_unlock(&_deque->lock);
+
+	return isFound;
+}
+
+/**
+ * The worker's own newest tile, or else the oldest of another worker,
+ * starting with the next one.
+ */
+static bool takeTile(WorkerPool *self, unsigned int _worker, WorkerTile *_tile) {
+	unsigned int i;
+
+	if (__atomic_load_n(&self->queued, __ATOMIC_ACQUIRE) == 0) {
+		return false;
+	}
+
+	if (popTile(&self->workers[_worker].deque, true, _tile)) {
+		__atomic_sub_fetch(&self->queued, 1, __ATOMIC_ACQ_REL);
+		return true;
+	}
+
+	for (i = 1; i < self->threadsCount; i++) {
+		if (popTile(&self->workers[(_worker + i) % self->threadsCount].deque, false, _tile)) {
+			__atomic_sub_fetch(&self->queued, 1, __ATOMIC_ACQ_REL);
+			__atomic_add_fetch(&self->steals, 1, __ATOMIC_RELAXED);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void queueTile(WorkerPool *self, unsigned int _worker, WorkerJob *_job, unsigned int _index) {
+	pushTile(&self->workers[_worker].deque, _job, _index);
+	__atomic_add_fetch(&self->queued, 1, __ATOMIC_ACQ_REL);
+
+	pthread_mutex_lock(&self->lock);
+	pthread_cond_signal(&self->wake);
+	pthread_mutex_unlock(&self->lock);
+}
+
+/**
+ * Tiles [*_first, *_last] of the previous stage that tile _index of _job
+ * reads.
+ */
+static void previousTiles(WorkerJob *_job, unsigned int _index, unsigned int *_first, unsigned int *_last) {
+	WorkerJob *previous = _job->previous;
+	unsigned long long first = (unsigned long long) _index * _job->tileSize;
+	unsigned long long end = first + _job->tileSize;
+
+	if (end > _job->rowsCount) {
+		end = _job->rowsCount;
+	}
+
+	first = (first * previous->rowsCount) / _job->rowsCount;
+	end = ((end * previous->rowsCount) + _job->rowsCount - 1) / _job->rowsCount;
+	first = (first > _job->haloRows) ? first - _job->haloRows : 0;
+	end += _job->haloRows;
+	if (end > previous->rowsCount) {
+		end = previous->rowsCount;
+	}
+	if (end <= first) {
+		end = first + 1;
+	}
+
+	*_first = (unsigned int) (first / previous->tileSize);
+	*_last = (unsigned int) ((end - 1) / previous->tileSize);
+}
+
+static void runTile(WorkerPool *self, unsigned int _worker, WorkerTile *_tile) {
+	WorkerJob *job = _tile->job;
+	WorkerJob *next = job->next;
+	unsigned int first = _tile->index * job->tileSize;
+	unsigned int end = first + job->tileSize;
+
+	job->band(job->arg, first, (end < job->rowsCount) ? end : job->rowsCount);
+
+	// the tiles of the next stage this one held back go on this worker
+	if (next != NULL) {
+		unsigned int i, firstNeeded, lastNeeded;
+		for (i = 0; i < next->tilesCount; i++) {
+			previousTiles(next, i, &firstNeeded, &lastNeeded);
+			if (firstNeeded > _tile->index) {
+				break;
+			}
+			if (lastNeeded >= _tile->index && __atomic_sub_fetch(&next->waiting[i], 1, __ATOMIC_ACQ_REL) == 0) {
+				queueTile(self, _worker, next, i);
+			}
+		}
+	}
+
+	// the last touch of job: once done, its owner may reuse it
+	if (__atomic_sub_fetch(&job->remaining, 1, __ATOMIC_ACQ_REL) == 0) {
+		pthread_mutex_lock(&self->lock);
+		pthread_cond_broadcast(&self->wake);
+		pthread_mutex_unlock(&self->lock);
+	}
+}
+
+/**
+ * Queues every tile of _job, in runs of neighbouring ones per worker;
+ * stealing evens out the rest.
+ */
+static void queueJob(WorkerPool *self, WorkerJob *_job) {
+	unsigned int i;
+
+	for (i = 0; i < _job->tilesCount; i++) {
+		pushTile(&self->workers[(i * self->threadsCount) / _job->tilesCount].deque, _job, i);
+	}
+	__atomic_add_fetch(&self->queued, _job->tilesCount, __ATOMIC_ACQ_REL);
+}
+
+static bool isChainDone(WorkerJob *_job) {
+	for (; _job != NULL; _job = _job->previous) {
+		if (__atomic_load_n(&_job->remaining, __ATOMIC_ACQUIRE) > 0) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static void *workerThread(void *_arg) {
+	Worker *worker = (Worker *) _arg;
+	WorkerPool *self = worker->pool;
+	WorkerTile tile;
+
+	for (;;) {
+		if (takeTile(self, worker->index, &tile)) {
+			runTile(self, worker->index, &tile);
+			continue;
+		}
+
+		pthread_mutex_lock(&self->lock);
+		while (!self->isStopping && __atomic_load_n(&self->queued, __ATOMIC_ACQUIRE) == 0) {
+			pthread_cond_wait(&self->wake, &self->lock);
+		}
+		bool isStopping = self->isStopping;
+		pthread_mutex_unlock(&self->lock);
+
+		if (isStopping) {
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Cuts _job and the stages chained after it in tiles and queues the tiles
+ * of _job; the others follow as their rows are done. The jobs must stay
+ * untouched until wait() on the last of them returns.
+ */
+static void submit(WorkerPool *self, WorkerJob *_job) {
+	WorkerJob *job, *previous = NULL;
+
+	for (job = _job; job != NULL; previous = job, job = job->next) {
+		job->previous = previous;
+		job->tileSize = job->tileRows;
+		if (job->tileSize == 0) {
+			unsigned int tiles = self->threadsCount * WORKER_TILES_PER_THREAD;
+			job->tileSize = (job->rowsCount + tiles - 1) / tiles;
+		}
+		if (job->tileSize == 0) {
+			job->tileSize = 1;
+		}
+		job->tilesCount = (job->rowsCount + job->tileSize - 1) / job->tileSize;
+		__atomic_store_n(&job->remaining, job->tilesCount, __ATOMIC_RELEASE);
+
+		if (previous == NULL) {
+			continue;
+		}
+
+		// nothing to wait for after an empty stage
+		if (previous->tilesCount == 0) {
+			queueJob(self, job);
+			continue;
+		}
+
+		if (job->waitingCapacity < job->tilesCount) {
+			free(job->waiting);
+			job->waiting = (unsigned int *) calloc(job->tilesCount, sizeof(unsigned int));
+			job->waitingCapacity = job->tilesCount;
+		}
+
+		unsigned int i, first, last;
+		for (i = 0; i < job->tilesCount; i++) {
+			previousTiles(job, i, &first, &last);
+			__atomic_store_n(&job->waiting[i], last - first + 1, __ATOMIC_RELEASE);
+		}
+	}
+
+	queueJob(self, _job);
+
+	pthread_mutex_lock(&self->lock);
+	pthread_cond_broadcast(&self->wake);
+	pthread_mutex_unlock(&self->lock);
+}
+
+/**
+ * Runs tiles on the calling thread until _job and the stages before it are
+ * done.
+ */
+static void wait(WorkerPool *self, WorkerJob *_job) {
+	WorkerTile tile;
+
+	while (!isChainDone(_job)) {
+		if (takeTile(self, 0, &tile)) {
+			runTile(self, 0, &tile);
+			continue;
+		}
+
+		pthread_mutex_lock(&self->lock);
+		while (!isChainDone(_job) && __atomic_load_n(&self->queued, __ATOMIC_ACQUIRE) == 0) {
+			pthread_cond_wait(&self->wake, &self->lock);
+		}
+		pthread_mutex_unlock(&self->lock);
+	}
+}
+
+/**
+ * Runs _band over _rowsCount rows in tiles and returns when all are done.
+ */
+static void runBands(WorkerPool *self, WorkerBand_t _band, void *_arg, unsigned int _rowsCount) {
+	if (self->threadsCount == 1) {
+		_band(_arg, 0, _rowsCount);
+		return;
+	}
+
+	WorkerJob job;
+	memset(&job, 0, sizeof(job));
+	job.band = _band;
+	job.arg = _arg;
+	job.rowsCount = _rowsCount;
+
+	submit(self, &job);
+	wait(self, &job);
+}
+
+static void stopWorkers(WorkerPool *self, unsigned int _startedCount) {
+	unsigned int i;
+
+	pthread_mutex_lock(&self->lock);
+	self->isStopping = true;
+	pthread_cond_broadcast(&self->wake);
+	pthread_mutex_unlock(&self->lock);
+
+	for (i = 1; i < _startedCount; i++) {
+		pthread_join(self->workers[i].thread, NULL);
+	}
+}
+
+/**
+ * Chains _next after _first: _next reads _haloRows rows of _first above
+ * and below its own.
+ */
+void WorkerJob_chain(WorkerJob *_first, WorkerJob *_next, unsigned int _haloRows) {
+	_first->next = _next;
+	if (_next != NULL) {
+		_next->haloRows = _haloRows;
+	}
+}
+
+static void WorkerJob_init(WorkerJob *self, WorkerBand_t _band, void *_arg, unsigned int _tileRows) {
+	self->band = _band;
+	self->arg = _arg;
+	self->rowsCount = 0;
+	self->tileRows = _tileRows;
+	self->next = NULL;
+	self->haloRows = 0;
+	self->previous = NULL;
+	self->tileSize = 0;
+	self->tilesCount = 0;
+	self->waiting = NULL;
+	self->waitingCapacity = 0;
+	self->remaining = 0;
+}
+
+/**
+ * A stage running _band with _arg; set rowsCount before each submit().
+ * _tileRows 0 leaves the tile height to the pool.
+ */
+WorkerJob *WorkerJob_newWith(WorkerBand_t _band, void *_arg, unsigned int _tileRows) {
+	WorkerJob *job = (WorkerJob *) calloc(1, sizeof(WorkerJob));
+	WorkerJob_init(job, _band, _arg, _tileRows);
+	return job;
+}
+
+void WorkerJob_dispose(WorkerJob *self) {
+	if (self == NULL) {
+		return;
+	}
+
+	free(self->waiting);
+	free(self);
+}
+
+static void WorkerPool_init(WorkerPool *self, unsigned int _threadsCount) {
+	self->threadsCount = (_threadsCount > 0) ? _threadsCount : WorkerPool_onlineCpus();
+	self->queued = 0;
+	self->steals = 0;
+	self->isStopping = false;
+	self->error = (char *) calloc(256, sizeof(char));
+	pthread_mutex_init(&self->lock, NULL);
+	pthread_cond_init(&self->wake, NULL);
+
+	// methods
+	self->submit = submit;
+	self->wait = wait;
+	self->runBands = runBands;
+
+	self->workers = (Worker *) calloc(self->threadsCount, sizeof(Worker));
+
+	unsigned int i;
+	for (i = 0; i < self->threadsCount; i++) {
+		Worker *worker = &self->workers[i];
+		worker->pool = self;
+		worker->index = i;
+		pthread_mutex_init(&worker->deque.lock, NULL);
+		worker->deque.capacity = DEQUE_INITIAL_CAPACITY;
+		worker->deque.tiles = (WorkerTile *) calloc(DEQUE_INITIAL_CAPACITY, sizeof(WorkerTile));
+	}
+
+	// worker 0 is the calling thread
+	for (i = 1; i < self->threadsCount; i++) {
+		if (0 != pthread_create(&self->workers[i].thread, NULL, workerThread, &self->workers[i])) {
+			sprintf(self->error, "Started %u of %u worker threads.", i - 1, self->threadsCount - 1);
+
+			// carry on with those started; nothing was queued yet
+			unsigned int unused;
+			for (unused = i; unused < self->threadsCount; unused++) {
+				pthread_mutex_destroy(&self->workers[unused].deque.lock);
+				free(self->workers[unused].deque.tiles);
+			}
+			self->threadsCount = i;
+			return;
+		}
+	}
+}
+
+unsigned int WorkerPool_onlineCpus() {
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return (count > 0) ? (unsigned int) count : 1;
+}
+
+/**
+ * _threadsCount counts the calling thread; 0 takes one per online CPU. When
+ * threads cannot be started the pool keeps those it has and sets error.
+ */
+WorkerPool *WorkerPool_newWith(unsigned int _threadsCount) {
+	WorkerPool *pool = (WorkerPool *) calloc(1, sizeof(WorkerPool));
+	WorkerPool_init(pool, _threadsCount);
+	return pool;
+}
+
+void WorkerPool_dispose(WorkerPool *self) {
+	if (self == NULL) {
+		return;
+	}
+
+	stopWorkers(self, self->threadsCount);
+
+	unsigned int i;
+	for (i = 0; i < self->threadsCount; i++) {
+		pthread_mutex_destroy(&self->workers[i].deque.lock);
+		free(self->workers[i].deque.tiles);
+	}
+	pthread_cond_destroy(&self->wake);
+	pthread_mutex_destroy(&self->lock);
+	free(self->workers);
+	free(self->error);
+	free(self);
+}
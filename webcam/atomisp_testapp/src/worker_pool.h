@@ -0,0 +1,115 @@
+/**
+	This file is part of Intel Atom ISP Test App.
+
+	Intel Atom ISP Test App is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Intel Atom ISP Test App is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Intel Atom ISP Test App.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WORKER_POOL_H_
+#define WORKER_POOL_H_
+
+#include <stdbool.h>
+#include <pthread.h>
+
+#define WORKER_TILES_PER_THREAD 4	/* when a job leaves the tile height to the pool */
+
+/**
+ * Processes rows [first, end) of a frame; the void * is the caller's.
+ */
+typedef void (*WorkerBand_t) (void *, unsigned int, unsigned int);
+
+/**
+ * One stage over the rows of one frame, cut in tiles of tileRows rows.
+ *
+ * A job chained after another needs no barrier between the two: each of
+ * its tiles is queued as soon as the tiles of the previous stage holding
+ * the rows it reads are done. Rows map between stages in proportion, so a
+ * stage may have fewer rows than the one before, and haloRows widens what a
+ * tile reads by that many rows of the previous stage above and below.
+ */
+typedef struct WORKER_JOB_S {
+	WorkerBand_t band;
+	void *arg;
+	unsigned int rowsCount;
+	unsigned int tileRows;		/* 0 leaves it to the pool */
+	struct WORKER_JOB_S *next;	/* chained stage; NULL for none */
+	unsigned int haloRows;		/* of the previous stage */
+
+	// set by submit()
+	struct WORKER_JOB_S *previous;
+	unsigned int tileSize;		/* rows per tile in use */
+	unsigned int tilesCount;
+	unsigned int *waiting;		/* per tile: tiles of the previous stage still to do */
+	unsigned int waitingCapacity;
+	unsigned int remaining;		/* tiles still to do */
+} WorkerJob;
+
+typedef struct WORKER_TILE_S {
+	WorkerJob *job;
+	unsigned int index;
+} WorkerTile;
+
+/**
+ * Tiles queued on one worker. The owner pushes and pops at the bottom, so
+ * it runs the tile it queued last while its rows are still in cache;
+ * thieves take the oldest from the top.
+ */
+typedef struct WORKER_DEQUE_S {
+	pthread_mutex_t lock;
+	WorkerTile *tiles;
+	unsigned int capacity;
+	unsigned int top;
+	unsigned int bottom;
+} WorkerDeque;
+
+struct WORKER_POOL_S;
+
+typedef struct WORKER_S {
+	struct WORKER_POOL_S *pool;
+	unsigned int index;
+	pthread_t thread;
+	WorkerDeque deque;
+} Worker;
+
+/**
+ * Work-stealing threads for the CPU stages of a frame. Worker 0 has no
+ * thread: it stands for whoever calls wait(), who runs tiles too until the
+ * job is done. A pool of one thread starts none and runs everything there.
+ *
+ * Jobs of several frames may be in flight at once; wait() returns once the
+ * given job and the stages chained before it are done.
+ */
+typedef struct WORKER_POOL_S {
+	unsigned int threadsCount;	/* worker 0 included */
+	Worker *workers;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;		/* tiles were queued or a job is done */
+	unsigned int queued;		/* tiles in all deques */
+	unsigned long steals;		/* tiles run by another worker than queued on */
+	bool isStopping;
+	char *error;
+
+	void (*submit) (struct WORKER_POOL_S *, WorkerJob *);
+	void (*wait) (struct WORKER_POOL_S *, WorkerJob *);
+	void (*runBands) (struct WORKER_POOL_S *, WorkerBand_t, void *, unsigned int);
+} WorkerPool;
+
+void WorkerJob_chain(WorkerJob *, WorkerJob *, unsigned int);
+WorkerJob *WorkerJob_newWith(WorkerBand_t, void *, unsigned int);
+void WorkerJob_dispose(WorkerJob *);
+
+unsigned int WorkerPool_onlineCpus();
+WorkerPool *WorkerPool_newWith(unsigned int);
+void WorkerPool_dispose(WorkerPool *);
+
+#endif /* WORKER_POOL_H_ */